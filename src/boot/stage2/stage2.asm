@@ -18,9 +18,9 @@
 ; 0x7C00      - Stage1 (512 bytes)
 ; 0x8000      - Stage2 (4096 bytes) - THIS CODE
 ; 0x9000      - Boot info for kernel (256 bytes)
-; 0x10000     - Kernel (148480 bytes = 290 sectors = 145KB)
-; 0x34400     - End of kernel
-; 0x33000     - BSS section (3.9MB uninitialized data)
+; 0x10000     - Kernel (393216 bytes = 768 sectors = 384KB)
+; 0x70000     - End of kernel image area
+; (image end) - BSS section, right after .data (linker.ld), not loaded from disk
 ; 0x3F0000    - End of BSS (~4MB mark)
 ; 0x500000    - Page tables (16KB: PML4, PDPT, PD, PT) - MOVED ABOVE BSS!
 ; 0x510000    - Stack for 32/64-bit modes (grows downward) - MOVED ABOVE BSS!
@@ -28,9 +28,9 @@
 ; === CONSTANTS ===
 KERNEL_LOAD_ADDR      equ 0x10000
 KERNEL_SECTOR_START   equ 10
-KERNEL_SECTOR_COUNT   equ 290
-KERNEL_SIZE_BYTES     equ 148480        ; 290 * 512
-KERNEL_END_ADDR       equ 0x34400       ; 0x10000 + 0x24400 (148480 bytes)
+KERNEL_SECTOR_COUNT   equ 768
+KERNEL_SIZE_BYTES     equ 393216        ; 768 * 512
+KERNEL_END_ADDR       equ 0x70000       ; 0x10000 + 0x60000 (393216 bytes)
 
 PAGE_TABLE_BASE       equ 0x500000      ; MOVED: Above kernel BSS (was 0x70000)
 E820_MAP_ADDR         equ 0x500         ; Low memory (safe after BIOS data area)
@@ -421,97 +421,66 @@ load_kernel_simple:
     jc .use_chs          ; Если не поддерживается, используем CHS
 
     ; Используем INT 13h Extensions (LBA)
-    ; Загружаем 266 секторов (133KB) начиная с LBA 10
+    ; Загружаем KERNEL_SECTOR_COUNT секторов начиная с LBA 10,
+    ; по одному DAP (не более 127 секторов) за вызов
 
-    ; Часть 1: 127 секторов
     mov si, dap1
+.lba_next:
+    push si
     mov ah, 0x42
     mov dl, 0x80
     int 0x13
+    pop si
     jc .disk_error
-
-    ; Часть 2: 127 секторов
-    mov si, dap2
-    mov ah, 0x42
-    mov dl, 0x80
-    int 0x13
-    jc .disk_error
-
-    ; Часть 3: 26 секторов (remaining: 280 - 127 - 127 = 26)
-    mov si, dap3
-    mov ah, 0x42
-    mov dl, 0x80
-    int 0x13
-    jc .disk_error
+    add si, 16
+    cmp si, dap_end
+    jb .lba_next
     jmp .check_kernel
 
 .use_chs:
-    ; Загружаем меньшими порциями, не переходя границу дорожки
-    ; Total: 250 sectors (53+63+63+63+8)
-    ; Часть 1: 53 сектора (сектора 11-63 на головке 0) → 0x10000
-    mov ah, 0x02
-    mov al, 53
-    mov ch, 0
-    mov cl, 11
-    mov dh, 0
-    mov dl, 0x80
-    mov bx, 0x1000
-    mov es, bx
-    mov bx, 0x0000
-    int 0x13
-    jc .disk_error
-
-    ; Часть 2: 63 сектора (вся головка 1) → 0x16A00
-    mov ah, 0x02
-    mov al, 63
-    mov ch, 0
-    mov cl, 1
-    mov dh, 1
+    ; Без расширений: те же KERNEL_SECTOR_COUNT секторов по одному,
+    ; LBA переводится в CHS по геометрии диска (INT 13h AH=08h)
+    mov ah, 0x08
     mov dl, 0x80
-    mov bx, 0x16A0
-    mov es, bx
-    mov bx, 0x0000
-    int 0x13
-    jc .disk_error
-
-    ; Часть 3: 63 сектора (вся головка 2) → 0x1E800
-    mov ah, 0x02
-    mov al, 63
-    mov ch, 0
-    mov cl, 1
-    mov dh, 2
-    mov dl, 0x80
-    mov bx, 0x1E80
-    mov es, bx
-    mov bx, 0x0000
+    xor di, di
+    mov es, di
     int 0x13
     jc .disk_error
-
-    ; Часть 4: 63 сектора (вся головка 3) → 0x26600
-    mov ah, 0x02
-    mov al, 63
-    mov ch, 0
-    mov cl, 1
-    mov dh, 3
+    and cl, 0x3F
+    mov [chs_sectors], cl       ; Секторов на дорожку
+    inc dh
+    mov [chs_heads], dh         ; Число головок
+
+    mov word [chs_lba], KERNEL_SECTOR_START
+    mov word [chs_segment], KERNEL_LOAD_ADDR >> 4
+
+.chs_next:
+    ; sector = lba % spt + 1, head = (lba / spt) % heads, cylinder = lba / spt / heads
+    mov ax, [chs_lba]
+    xor dx, dx
+    movzx bx, byte [chs_sectors]
+    div bx
+    mov cl, dl
+    inc cl
+    xor dx, dx
+    movzx bx, byte [chs_heads]
+    div bx
+    mov dh, dl                  ; Головка
+    mov ch, al                  ; Цилиндр, биты 0-7
+    shl ah, 6
+    or cl, ah                   ; Цилиндр, биты 8-9
     mov dl, 0x80
-    mov bx, 0x2660
+    mov bx, [chs_segment]
     mov es, bx
-    mov bx, 0x0000
+    xor bx, bx
+    mov ax, 0x0201              ; Чтение одного сектора
     int 0x13
     jc .disk_error
 
-    ; Часть 5: 8 секторов (головка 4) → 0x2E400
-    mov ah, 0x02
-    mov al, 8
-    mov ch, 0
-    mov cl, 1
-    mov dh, 4
-    mov dl, 0x80
-    mov bx, 0x2E40
-    mov es, bx
-    mov bx, 0x0000
-    int 0x13
-    jc .disk_error
+    add word [chs_segment], 512 >> 4
+    inc word [chs_lba]
+    cmp word [chs_lba], KERNEL_SECTOR_START + KERNEL_SECTOR_COUNT
+    jb .chs_next
 
 .check_kernel:
     
@@ -762,35 +731,66 @@ gdt_descriptor:
     dd gdt_start                  ; Base address (32-bit в 16-bit режиме)
 
 ; ===== DAP STRUCTURES FOR INT 13h EXTENSIONS (LBA MODE) =====
-; Total: 250 sectors = 125KB
-; Part 1: 127 sectors (max single read) → 0x10000
-; Part 2: 123 sectors (250-127)        → 0x1FE00
+; Total: 768 sectors = 384KB, read back to back by the loop above
+; Each DAP: up to 127 sectors (max single read), 0xFE00 bytes apart
+; The DAPs must stay contiguous (16 bytes each, no padding between them)
 align 4
 dap1:
     db 0x10             ; DAP size (16 bytes)
     db 0                ; Reserved
-    dw 127              ; Sector count: 127 (maximum per INT 13h call)
+    dw 127              ; Sector count
     dw 0x0000           ; Offset
     dw 0x1000           ; Segment (0x1000:0x0000 = 0x10000 physical)
-    dq 10               ; Starting LBA sector: 10
-
-align 4
+    dq 10               ; Starting LBA sector
 dap2:
     db 0x10             ; DAP size (16 bytes)
     db 0                ; Reserved
-    dw 127              ; Sector count: 127
+    dw 127              ; Sector count
     dw 0x0000           ; Offset
     dw 0x1FE0           ; Segment (0x1FE0:0x0000 = 0x1FE00 physical)
-    dq 137              ; Starting LBA sector: 137 (10 + 127)
-
-align 4
+    dq 137              ; Starting LBA sector
 dap3:
     db 0x10             ; DAP size (16 bytes)
     db 0                ; Reserved
-    dw 36               ; Sector count: 36 (290 - 127 - 127 = 36)
+    dw 127              ; Sector count
     dw 0x0000           ; Offset
     dw 0x2FC0           ; Segment (0x2FC0:0x0000 = 0x2FC00 physical)
-    dq 264              ; Starting LBA sector: 264 (10 + 127 + 127)
+    dq 264              ; Starting LBA sector
+dap4:
+    db 0x10             ; DAP size (16 bytes)
+    db 0                ; Reserved
+    dw 127              ; Sector count
+    dw 0x0000           ; Offset
+    dw 0x3FA0           ; Segment (0x3FA0:0x0000 = 0x3FA00 physical)
+    dq 391              ; Starting LBA sector
+dap5:
+    db 0x10             ; DAP size (16 bytes)
+    db 0                ; Reserved
+    dw 127              ; Sector count
+    dw 0x0000           ; Offset
+    dw 0x4F80           ; Segment (0x4F80:0x0000 = 0x4F800 physical)
+    dq 518              ; Starting LBA sector
+dap6:
+    db 0x10             ; DAP size (16 bytes)
+    db 0                ; Reserved
+    dw 127              ; Sector count
+    dw 0x0000           ; Offset
+    dw 0x5F60           ; Segment (0x5F60:0x0000 = 0x5F600 physical)
+    dq 645              ; Starting LBA sector
+dap7:
+    db 0x10             ; DAP size (16 bytes)
+    db 0                ; Reserved
+    dw 6                ; Sector count
+    dw 0x0000           ; Offset
+    dw 0x6F40           ; Segment (0x6F40:0x0000 = 0x6F400 physical)
+    dq 772              ; Starting LBA sector
+dap_end:
+
+; ===== CHS FALLBACK STATE =====
+chs_sectors           db 0
+chs_heads             db 0
+chs_lba               dw 0
+chs_segment           dw 0
 
 ; ===== MESSAGES =====
 msg_stage2_start      db 'BoxKernel Stage2 Started', 13, 10, 0
@@ -800,8 +800,8 @@ msg_e820_success      db '[OK] E820 memory map created', 13, 10, 0
 msg_e820_fail         db '[WARN] E820 failed, using fallback', 13, 10, 0
 msg_memory_fallback   db '[OK] Fallback memory detection', 13, 10, 0
 msg_memory_error      db '[ERROR] Memory detection failed!', 13, 10, 0
-msg_loading_kernel    db 'Loading kernel (290 sectors)...', 13, 10, 0
-msg_kernel_loaded     db '[OK] Kernel loaded (145KB)', 13, 10, 0
+msg_loading_kernel    db 'Loading kernel (768 sectors)...', 13, 10, 0
+msg_kernel_loaded     db '[OK] Kernel loaded (384KB)', 13, 10, 0
 msg_kernel_empty      db '[WARN] Kernel appears empty', 13, 10, 0
 msg_disk_error        db '[ERROR] Disk read failed!', 13, 10, 0
 msg_long_mode_ok      db '[OK] CPU supports 64-bit mode', 13, 10, 0
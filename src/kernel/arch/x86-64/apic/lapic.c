@@ -0,0 +1,143 @@
+#include "lapic.h"
+#include "idt.h"
+#include "cpu.h"
+#include "vmm.h"
+#include "tsc.h"
+#include "ktimer.h"
+#include "klib.h"
+#include "atomics.h"
+
+static volatile uint32_t* lapic_mmio = NULL;   // xAPIC: окно регистров
+static bool lapic_x2 = false;                  // x2APIC: регистры через MSR
+static bool lapic_deadline = false;            // Таймер в режиме TSC-deadline
+static uint64_t lapic_timer_khz = 0;           // One-shot: тиков счётчика в мс (делитель 16)
+static uint64_t lapic_max_delta = 0;           // One-shot: TSC-циклов на полный счётчик
+
+// ========== Доступ к регистрам ==========
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    if (lapic_x2) return (uint32_t)cpu_rdmsr(MSR_X2APIC_BASE + (reg >> 4));
+    return lapic_mmio[reg >> 2];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    if (lapic_x2) {
+        cpu_wrmsr(MSR_X2APIC_BASE + (reg >> 4), value);
+    } else {
+        lapic_mmio[reg >> 2] = value;
+    }
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+// xAPIC: страница регистров в прямом отображении, без кэширования
+static bool lapic_map(uint64_t phys) {
+    uintptr_t virt = (uintptr_t)vmm_phys_to_virt(phys);
+    vmm_context_t* kernel_ctx = vmm_get_kernel_context();
+
+    if (!vmm_is_mapped(kernel_ctx, virt)) {
+        vmm_map_result_t result = vmm_map_page(kernel_ctx, virt, phys,
+            VMM_FLAGS_KERNEL_RW | VMM_FLAG_CACHE_DISABLE | VMM_FLAG_WRITE_THROUGH | VMM_FLAG_NO_EXECUTE);
+        if (!result.success) {
+            kprintf("[LAPIC] ERROR: Cannot map registers at 0x%lx: %s\n", phys, result.error_msg);
+            return false;
+        }
+    }
+
+    lapic_mmio = (volatile uint32_t*)virt;
+    return true;
+}
+
+// ========== Таймер ==========
+
+static void lapic_timer_program(uint64_t deadline_tsc) {
+    if (lapic_deadline) {
+        // 0 снимает таймер
+        cpu_wrmsr(MSR_TSC_DEADLINE, deadline_tsc == KTIMER_NO_EVENT ? 0 : deadline_tsc);
+        return;
+    }
+
+    if (deadline_tsc == KTIMER_NO_EVENT) {
+        lapic_write(LAPIC_REG_TIMER_INIT, 0);
+        return;
+    }
+
+    uint64_t now = rdtsc();
+    uint64_t delta = deadline_tsc > now ? deadline_tsc - now : 0;
+    if (delta > lapic_max_delta) delta = lapic_max_delta;   // Проснёмся раньше и перезапустим
+
+    uint64_t count = delta * lapic_timer_khz / tsc_khz();
+    lapic_write(LAPIC_REG_TIMER_INIT, count ? (uint32_t)count : 1);
+}
+
+// Частота счётчика APIC (у one-shot она своя, не TSC): считаем LAPIC_CALIBRATE_MS по TSC
+static bool lapic_timer_calibrate(void) {
+    lapic_write(LAPIC_REG_TIMER_DIV, LAPIC_TIMER_DIV16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_ONESHOT | IRQ_LAPIC_TIMER);
+    lapic_write(LAPIC_REG_TIMER_INIT, 0xFFFFFFFF);
+
+    uint64_t end = rdtsc() + tsc_ms_to_cycles(LAPIC_CALIBRATE_MS);
+    while (rdtsc() < end) {
+        asm volatile("pause");
+    }
+
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_REG_TIMER_CUR);
+    lapic_write(LAPIC_REG_TIMER_INIT, 0);
+
+    lapic_timer_khz = elapsed / LAPIC_CALIBRATE_MS;
+    if (lapic_timer_khz == 0) return false;
+
+    lapic_max_delta = 0xFFFFFFFFULL * tsc_khz() / lapic_timer_khz;
+    return true;
+}
+
+bool lapic_timer_init(void) {
+    if (!cpu_has(CPU_FEAT_APIC)) {
+        kprintf("[LAPIC] No local APIC, keeping the periodic PIT tick\n");
+        return false;
+    }
+
+    uint64_t base = cpu_rdmsr(MSR_APIC_BASE);
+
+    if (cpu_has(CPU_FEAT_X2APIC)) {
+        cpu_wrmsr(MSR_APIC_BASE, base | MSR_APIC_BASE_ENABLE | MSR_APIC_BASE_X2APIC);
+        lapic_x2 = true;
+    } else {
+        cpu_wrmsr(MSR_APIC_BASE, base | MSR_APIC_BASE_ENABLE);
+        if (!lapic_map(base & VMM_PAGE_MASK & 0x000FFFFFFFFFFFFFULL)) return false;
+    }
+
+    // Программное включение; LINT0 (ExtINT от PIC) остаётся как настроил BIOS
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+    if (cpu_has(CPU_FEAT_TSC_DEADLINE)) {
+        lapic_deadline = true;
+        lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_DEADLINE | IRQ_LAPIC_TIMER);
+        // Запись LVT (MMIO) должна завершиться до первой записи в MSR дедлайна
+        asm volatile("mfence; lfence" : : : "memory");
+    } else {
+        if (!lapic_timer_calibrate()) {
+            kprintf("[LAPIC] WARNING: Timer calibration failed, keeping the PIT tick\n");
+            return false;
+        }
+        lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_ONESHOT | IRQ_LAPIC_TIMER);
+    }
+
+    ktimer_set_event_device(lapic_timer_mode_name(), lapic_timer_program);
+
+    kprintf("[LAPIC] %s, ID %u, timer: %s",
+            lapic_x2 ? "x2APIC" : "xAPIC",
+            lapic_x2 ? lapic_read(LAPIC_REG_ID) : lapic_read(LAPIC_REG_ID) >> 24,
+            lapic_timer_mode_name());
+    if (!lapic_deadline) {
+        kprintf(" (%lu.%03lu MHz)", lapic_timer_khz / 1000, lapic_timer_khz % 1000);
+    }
+    kprintf("\n");
+    return true;
+}
+
+const char* lapic_timer_mode_name(void) {
+    return lapic_deadline ? "LAPIC TSC-deadline" : "LAPIC one-shot";
+}
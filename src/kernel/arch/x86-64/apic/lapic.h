@@ -0,0 +1,38 @@
+#ifndef LAPIC_H
+#define LAPIC_H
+
+#include "ktypes.h"
+
+// Регистры локального APIC (смещения в xAPIC MMIO; в x2APIC - MSR 0x800 + off/16)
+#define LAPIC_REG_ID          0x020
+#define LAPIC_REG_EOI         0x0B0
+#define LAPIC_REG_SVR         0x0F0   // Spurious Interrupt Vector
+#define LAPIC_REG_LVT_TIMER   0x320
+#define LAPIC_REG_TIMER_INIT  0x380   // Initial Count
+#define LAPIC_REG_TIMER_CUR   0x390   // Current Count
+#define LAPIC_REG_TIMER_DIV   0x3E0   // Divide Configuration
+
+#define LAPIC_SVR_ENABLE      (1 << 8)
+#define LAPIC_LVT_MASKED      (1 << 16)
+#define LAPIC_TIMER_ONESHOT   (0 << 17)
+#define LAPIC_TIMER_DEADLINE  (2 << 17)   // TSC-deadline
+#define LAPIC_TIMER_DIV16     0x3
+
+// MSR
+#define MSR_APIC_BASE         0x1B
+#define MSR_APIC_BASE_ENABLE  (1ULL << 11)
+#define MSR_APIC_BASE_X2APIC  (1ULL << 10)
+#define MSR_X2APIC_BASE       0x800
+#define MSR_TSC_DEADLINE      0x6E0
+
+#define LAPIC_CALIBRATE_MS    10
+
+// Включает локальный APIC и переводит ktimer на его одноразовый таймер
+// (TSC-deadline, если есть, иначе one-shot со счётчиком). Вызывать после
+// tsc_init() и ktimer_init(). false - APIC нет, остаётся периодический PIT.
+bool lapic_timer_init(void);
+
+void lapic_eoi(void);
+const char* lapic_timer_mode_name(void);
+
+#endif // LAPIC_H
@@ -4,9 +4,12 @@
 #include "io.h"
 #include "pic.h"  // ИСПРАВЛЕНО: добавлен include
 #include "pit.h"  // PIT timer driver
+#include "ktimer.h" // Timer wheel
+#include "lapic.h" // LAPIC timer EOI
 #include "task.h" // Task scheduler
 #include "keyboard.h" // Keyboard driver
 #include "vmm.h"  // VMM for page fault handling
+#include "fpu.h"  // Lazy FPU restore (#NM)
 
 static idt_entry_t idt[IDT_ENTRIES];
 static idt_descriptor_t idt_desc;
@@ -76,10 +79,14 @@ void idt_init(void) {
         idt_set_entry(i, (uint64_t)isr_table[i], GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT_GATE, 0);
     }
     
-    // Оставшиеся записи (48-255) пока пустые - будут вызывать General Protection Fault
-    for (int i = 48; i < IDT_ENTRIES; i++) {
+    // Таймер локального APIC и его ложное прерывание
+    idt_set_entry(IRQ_LAPIC_TIMER, (uint64_t)isr_table[IRQ_LAPIC_TIMER], GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT_GATE, 0);
+
+    // Оставшиеся записи (49-254) пока пустые - будут вызывать General Protection Fault
+    for (int i = IRQ_LAPIC_TIMER + 1; i < IDT_ENTRIES; i++) {
         idt_set_entry(i, (uint64_t)isr_table[13], GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT_GATE, 0); // GPF handler
     }
+    idt_set_entry(LAPIC_SPURIOUS_VECTOR, (uint64_t)lapic_spurious_isr, GDT_KERNEL_CODE, IDT_TYPE_INTERRUPT_GATE, 0);
     
     kprintf("[IDT] IDT configured with %d entries\n", IDT_ENTRIES);
     kprintf("[IDT] IDT base: 0x%p, limit: %d\n", (void*)idt_desc.base, idt_desc.limit);
@@ -164,6 +171,12 @@ void exception_handler(interrupt_frame_t* frame) {
         return;
     }
 
+    // CR0.TS set by the scheduler: first FPU/SSE use by the new owner
+    if (frame->vector == EXCEPTION_DEVICE_NOT_AVAIL) {
+        fpu_handle_nm();
+        return;
+    }
+
     // For other exceptions, print full details
     kprintf("\n%[E]=== EXCEPTION OCCURRED ===%[D]\n");
     kprintf("%[E]Exception Vector: %llu%[D]\n", frame->vector);
@@ -197,6 +210,14 @@ void exception_handler(interrupt_frame_t* frame) {
 
 // Обработчик аппаратных прерываний (ИСПРАВЛЕНО)
 void irq_handler(interrupt_frame_t* frame) {
+    // One-shot LAPIC timer: not a PIC line, EOI goes to the LAPIC
+    if (frame->vector == IRQ_LAPIC_TIMER) {
+        ktimer_tick();
+        lapic_eoi();
+        task_preempt_irq();
+        return;
+    }
+
     uint8_t irq = frame->vector - 32;
     
     if (irq < 16) {
@@ -209,8 +230,9 @@ void irq_handler(interrupt_frame_t* frame) {
             // Increment PIT tick counter
             pit_tick();
 
-            // Run task scheduler (switch tasks if needed)
-            task_scheduler_tick();
+            // Periodic fallback (no LAPIC timer): fire expired kernel timers
+            // (sleep wakeups, time slices, EVENT_TIMER_CREATE)
+            ktimer_tick();
 
             // Таймер - уменьшили частоту логирования
             if (irq_count[0] % 1000 == 0) {  // Каждые ~55 секунд вместо 5.5
@@ -237,4 +259,10 @@ void irq_handler(interrupt_frame_t* frame) {
     
     // Отправляем EOI через PIC (ИСПРАВЛЕНО)
     pic_send_eoi(irq);
+
+    // Preemption last: after EOI, since the next task may run for a while
+    // before this handler returns
+    if (frame->vector == IRQ_TIMER) {
+        task_preempt_irq();
+    }
 }
\ No newline at end of file
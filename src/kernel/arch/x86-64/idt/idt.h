@@ -50,6 +50,10 @@
 #define IRQ_ATA_PRIMARY 46  // IRQ 14
 #define IRQ_ATA_SECONDARY 47 // IRQ 15
 
+// Локальный APIC (мимо PIC, EOI пишется в сам APIC)
+#define IRQ_LAPIC_TIMER       48    // Таймер APIC
+#define LAPIC_SPURIOUS_VECTOR 0xFF  // Ложное прерывание APIC: без EOI
+
 // Структура IDT записи (64-bit)
 typedef struct {
     uint16_t offset_low;    // Offset биты 0-15
@@ -91,5 +95,6 @@ void irq_handler(interrupt_frame_t* frame);
 
 // Внешние ASM обработчики (объявляем как массив)
 extern void* isr_table[IDT_ENTRIES];
+extern void lapic_spurious_isr(void);
 
 #endif // IDT_H
\ No newline at end of file
@@ -6,6 +6,7 @@ extern exception_handler
 extern irq_handler
 
 global isr_table
+global lapic_spurious_isr
 
 ; Макрос для исключений БЕЗ error code
 %macro ISR_NOERROR 1
@@ -86,6 +87,11 @@ IRQ 12, 44      ; Mouse
 IRQ 13, 45      ; FPU
 IRQ 14, 46      ; ATA Primary
 IRQ 15, 47      ; ATA Secondary
+IRQ 16, 48      ; LAPIC timer (не через PIC)
+
+; Ложное прерывание APIC: регистры не трогаем, EOI не нужен
+lapic_spurious_isr:
+    iretq
 
 ; Общий обработчик прерываний
 isr_common:
@@ -105,6 +111,9 @@ isr_common:
     push r13
     push r14
     push r15
+
+    ; System V ABI: DF = 0 при входе в C (прерванный код мог быть внутри std)
+    cld
     
     ; Теперь стек выглядит так (сверху вниз):
     ; r15, r14, r13, r12, r11, r10, r9, r8
@@ -171,4 +180,5 @@ isr_table:
     dq isr16, isr17, isr18, isr19, isr20, isr21, isr22, isr23
     dq isr24, isr25, isr26, isr27, isr28, isr29, isr30, isr31
     dq irq0, irq1, irq2, irq3, irq4, irq5, irq6, irq7
-    dq irq8, irq9, irq10, irq11, irq12, irq13, irq14, irq15
\ No newline at end of file
+    dq irq8, irq9, irq10, irq11, irq12, irq13, irq14, irq15
+    dq irq16
\ No newline at end of file
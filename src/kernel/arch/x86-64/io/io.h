@@ -73,10 +73,10 @@ static inline void pause(void) {
 
 // ========== Flags / Barriers ==========
 
-static inline uint32_t cpu_get_flags(void) {
-    uint32_t flags;
+static inline uint64_t cpu_get_flags(void) {
+    uint64_t flags;
     __asm__ volatile (
-        "pushf\n\t"
+        "pushfq\n\t"
         "pop %0"
         : "=r"(flags)
         :
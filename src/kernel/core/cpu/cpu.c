@@ -4,6 +4,77 @@
 // Глобальная структура с информацией о CPU
 static cpu_info_t cpu_info = {0};
 
+// ===== РЕЕСТР ВОЗМОЖНОСТЕЙ CPU =====
+
+uint32_t cpu_feature_bits = 0;
+
+// Где искать бит каждой возможности
+typedef struct {
+    uint32_t leaf;
+    uint32_t subleaf;
+    uint8_t reg;        // 0 = EAX, 1 = EBX, 2 = ECX, 3 = EDX
+    uint8_t bit;
+    const char* name;
+} cpu_feature_desc_t;
+
+static const cpu_feature_desc_t cpu_feature_table[CPU_FEAT_COUNT] = {
+    [CPU_FEAT_SSE42]      = { 0x00000001, 0, 2, 20, "SSE4.2" },
+    [CPU_FEAT_POPCNT]     = { 0x00000001, 0, 2, 23, "POPCNT" },
+    [CPU_FEAT_PCID]       = { 0x00000001, 0, 2, 17, "PCID" },
+    [CPU_FEAT_XSAVE]      = { 0x00000001, 0, 2, 26, "XSAVE" },
+    [CPU_FEAT_AVX]        = { 0x00000001, 0, 2, 28, "AVX" },
+    [CPU_FEAT_RDRAND]     = { 0x00000001, 0, 2, 30, "RDRAND" },
+    [CPU_FEAT_MWAIT]      = { 0x00000001, 0, 2, 3,  "MWAIT" },
+    [CPU_FEAT_BMI1]       = { 0x00000007, 0, 1, 3,  "BMI1" },
+    [CPU_FEAT_AVX2]       = { 0x00000007, 0, 1, 5,  "AVX2" },
+    [CPU_FEAT_BMI2]       = { 0x00000007, 0, 1, 8,  "BMI2" },
+    [CPU_FEAT_ERMS]       = { 0x00000007, 0, 1, 9,  "ERMS" },
+    [CPU_FEAT_INVPCID]    = { 0x00000007, 0, 1, 10, "INVPCID" },
+    [CPU_FEAT_CLFLUSHOPT] = { 0x00000007, 0, 1, 23, "CLFLUSHOPT" },
+    [CPU_FEAT_FSRM]       = { 0x00000007, 0, 3, 4,  "FSRM" },
+    [CPU_FEAT_PDPE1GB]    = { 0x80000001, 0, 3, 26, "PDPE1GB" },
+    [CPU_FEAT_FXSR]       = { 0x00000001, 0, 3, 24, "FXSR" },
+    [CPU_FEAT_XSAVEOPT]   = { 0x0000000D, 1, 0, 0,  "XSAVEOPT" },
+    [CPU_FEAT_XSAVEC]     = { 0x0000000D, 1, 0, 1,  "XSAVEC" },
+    [CPU_FEAT_APIC]       = { 0x00000001, 0, 3, 9,  "APIC" },
+    [CPU_FEAT_X2APIC]     = { 0x00000001, 0, 2, 21, "x2APIC" },
+    [CPU_FEAT_TSC_DEADLINE] = { 0x00000001, 0, 2, 24, "TSC-deadline" },
+};
+
+void cpu_features_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t max_basic, max_ext;
+    uint32_t bits = 0;
+
+    cpu_cpuid(0x00000000, 0, &max_basic, &ebx, &ecx, &edx);
+    cpu_cpuid(0x80000000, 0, &max_ext, &ebx, &ecx, &edx);
+
+    for (int i = 0; i < CPU_FEAT_COUNT; i++) {
+        const cpu_feature_desc_t* f = &cpu_feature_table[i];
+        uint32_t max = (f->leaf & 0x80000000) ? max_ext : max_basic;
+        if (f->leaf > max) continue;
+
+        // Листов всего несколько - повторный CPUID дешевле, чем кэш по листам
+        cpu_cpuid(f->leaf, f->subleaf, &eax, &ebx, &ecx, &edx);
+        uint32_t reg = (f->reg == 0) ? eax : (f->reg == 1) ? ebx : (f->reg == 2) ? ecx : edx;
+        if (reg & (1U << f->bit)) bits |= 1U << i;
+    }
+
+    cpu_feature_bits = bits;
+}
+
+const char* cpu_feature_name(cpu_feature_t feature) {
+    if ((int)feature < 0 || feature >= CPU_FEAT_COUNT) return "?";
+    return cpu_feature_table[feature].name;
+}
+
+void cpu_print_features(void) {
+    for (int i = 0; i < CPU_FEAT_COUNT; i++) {
+        if (cpu_has((cpu_feature_t)i)) kprintf("%s ", cpu_feature_table[i].name);
+    }
+    kprintf("\n");
+}
+
 // Функция для получения информации о CPU (базовая)
 void detect_cpu_info(char* cpu_vendor, char* cpu_brand) {
     uint32_t eax, ebx, ecx, edx;
@@ -207,4 +278,7 @@ void cpu_print_detailed_info(void) {
     if (cpu_info.extended_features_ecx & (1 << 6)) kprintf("SSE4A ");
     if (cpu_info.extended_features_ecx & (1 << 29)) kprintf("LM ");  // Long mode
     kprintf("\n");
+
+    kprintf("Kernel dispatch: ");
+    cpu_print_features();
 }
\ No newline at end of file
@@ -29,6 +29,44 @@ typedef struct {
     uint32_t extended_features_ecx;
 } cpu_info_t;
 
+// ===== РЕЕСТР ВОЗМОЖНОСТЕЙ CPU =====
+// Заполняется один раз в cpu_features_init() (до kmem и VMM); дальше
+// горячие пути не вызывают CPUID, а выбирают реализацию при загрузке
+typedef enum {
+    CPU_FEAT_SSE42 = 0,     // CPUID.1:ECX[20]   - crc32, pcmpistri
+    CPU_FEAT_POPCNT,        // CPUID.1:ECX[23]
+    CPU_FEAT_PCID,          // CPUID.1:ECX[17]
+    CPU_FEAT_XSAVE,         // CPUID.1:ECX[26]
+    CPU_FEAT_AVX,           // CPUID.1:ECX[28]
+    CPU_FEAT_RDRAND,        // CPUID.1:ECX[30]
+    CPU_FEAT_MWAIT,         // CPUID.1:ECX[3]    - MONITOR/MWAIT
+    CPU_FEAT_BMI1,          // CPUID.7.0:EBX[3]  - tzcnt, andn
+    CPU_FEAT_AVX2,          // CPUID.7.0:EBX[5]
+    CPU_FEAT_BMI2,          // CPUID.7.0:EBX[8]  - pdep, pext
+    CPU_FEAT_ERMS,          // CPUID.7.0:EBX[9]  - быстрые rep movsb/stosb
+    CPU_FEAT_INVPCID,       // CPUID.7.0:EBX[10]
+    CPU_FEAT_CLFLUSHOPT,    // CPUID.7.0:EBX[23]
+    CPU_FEAT_FSRM,          // CPUID.7.0:EDX[4]  - быстрые короткие rep movsb
+    CPU_FEAT_PDPE1GB,       // CPUID.80000001:EDX[26] - страницы 1GB
+    CPU_FEAT_FXSR,          // CPUID.1:EDX[24]   - fxsave/fxrstor
+    CPU_FEAT_XSAVEOPT,      // CPUID.D.1:EAX[0]
+    CPU_FEAT_XSAVEC,        // CPUID.D.1:EAX[1]  - сжатый формат XSAVE
+    CPU_FEAT_APIC,          // CPUID.1:EDX[9]    - локальный APIC
+    CPU_FEAT_X2APIC,        // CPUID.1:ECX[21]   - регистры APIC через MSR
+    CPU_FEAT_TSC_DEADLINE,  // CPUID.1:ECX[24]   - таймер APIC по значению TSC
+    CPU_FEAT_COUNT
+} cpu_feature_t;
+
+extern uint32_t cpu_feature_bits;
+
+void cpu_features_init(void);
+const char* cpu_feature_name(cpu_feature_t feature);
+void cpu_print_features(void);
+
+static inline bool cpu_has(cpu_feature_t feature) {
+    return (cpu_feature_bits & (1U << feature)) != 0;
+}
+
 // Функции
 void detect_cpu_info(char* cpu_vendor, char* cpu_brand);
 void cpu_detect_topology(cpu_info_t* info);
@@ -42,6 +80,16 @@ static inline uint64_t __read_cr2(void) {
     return value;
 }
 
+static inline uint64_t cpu_rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void cpu_wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
 static inline void cpu_cpuid(uint32_t eax, uint32_t ecx, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d) {
     __asm__ volatile ("cpuid"
         : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
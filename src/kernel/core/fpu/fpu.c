@@ -1,21 +1,256 @@
 #include "ktypes.h"
+#include "klib.h"
+#include "cpu.h"
 #include "fpu.h"
 
+#define CR0_MP          (1ULL << 1)
+#define CR0_EM          (1ULL << 2)
+#define CR0_TS          (1ULL << 3)
+#define CR4_OSFXSR      (1ULL << 9)
+#define CR4_OSXMMEXCPT  (1ULL << 10)
+#define CR4_OSXSAVE     (1ULL << 18)
+
+// Компоненты XCR0
+#define XFEATURE_X87    (1ULL << 0)
+#define XFEATURE_SSE    (1ULL << 1)
+#define XFEATURE_AVX    (1ULL << 2)
+
+#define FPU_AREA_ALIGN  64      // Требование XSAVE
+#define FPU_LEGACY_SIZE 512     // Формат fxsave
+#define FPU_HEADER_SIZE 64      // Заголовок XSAVE (XSTATE_BV, XCOMP_BV)
+
+// ===== Выбор способа сохранения =====
+
+static const char* fpu_mode_name = "fxsave";
+static size_t fpu_size = FPU_LEGACY_SIZE;
+static uint64_t fpu_xcr0 = 0;
+
+static void fpu_fxsave(void* area) {
+    asm volatile("fxsave64 (%0)" : : "r"(area) : "memory");
+}
+
+static void fpu_fxrstor(void* area) {
+    asm volatile("fxrstor64 (%0)" : : "r"(area) : "memory");
+}
+
+static void fpu_xsave(void* area) {
+    asm volatile("xsave64 (%0)"
+                 : : "r"(area), "a"((uint32_t)fpu_xcr0), "d"((uint32_t)(fpu_xcr0 >> 32)) : "memory");
+}
+
+static void fpu_xsaveopt(void* area) {
+    asm volatile("xsaveopt64 (%0)"
+                 : : "r"(area), "a"((uint32_t)fpu_xcr0), "d"((uint32_t)(fpu_xcr0 >> 32)) : "memory");
+}
+
+static void fpu_xsavec(void* area) {
+    asm volatile("xsavec64 (%0)"
+                 : : "r"(area), "a"((uint32_t)fpu_xcr0), "d"((uint32_t)(fpu_xcr0 >> 32)) : "memory");
+}
+
+// Читает и стандартный, и сжатый (xsavec) формат
+static void fpu_xrstor(void* area) {
+    asm volatile("xrstor64 (%0)"
+                 : : "r"(area), "a"((uint32_t)fpu_xcr0), "d"((uint32_t)(fpu_xcr0 >> 32)) : "memory");
+}
+
+// Выбираются один раз в enable_fpu()
+static void (*fpu_save)(void* area) = fpu_fxsave;
+static void (*fpu_restore)(void* area) = fpu_fxrstor;
+
+// Чистое состояние: FCW = 0x37F, MXCSR = 0x1F80, XSTATE_BV = 0 (остальные
+// компоненты - в начальном состоянии). Годится и для fxrstor, и для xrstor.
+static uint8_t fpu_init_state[FPU_LEGACY_SIZE + FPU_HEADER_SIZE] __attribute__((aligned(FPU_AREA_ALIGN)));
+
+// ===== Владельцы регистров =====
+
+static void* fpu_kernel_state = NULL;           // Код вне задач (загрузка, shell)
+static void** fpu_current = &fpu_kernel_state;  // Чьё состояние должно быть в регистрах
+static void** fpu_owner = &fpu_kernel_state;    // Чьё состояние в них на самом деле (NULL - ничьё)
+static bool fpu_ts = false;                     // Кэш CR0.TS - не пишем CR0 без нужды
+
+static uint32_t kernel_fpu_depth = 0;
+static uint64_t kernel_fpu_flags = 0;
+
+static inline void fpu_clts(void) {
+    if (fpu_ts) {
+        asm volatile("clts");
+        fpu_ts = false;
+    }
+}
+
+static inline void fpu_stts(void) {
+    if (!fpu_ts) {
+        uint64_t cr0;
+        asm volatile("mov %%cr0, %0" : "=r"(cr0));
+        asm volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_TS));
+        fpu_ts = true;
+    }
+}
+
+// XSAVE-область выравнивается на 64 байта; исходный указатель kmalloc
+// лежит прямо перед ней
+static void* fpu_area_alloc(void) {
+    uint8_t* raw = kmalloc(fpu_size + FPU_AREA_ALIGN + sizeof(void*));
+    if (!raw) return NULL;
+
+    uint8_t* area = (uint8_t*)ALIGN_UP((uintptr_t)raw + sizeof(void*), FPU_AREA_ALIGN);
+    ((void**)area)[-1] = raw;
+
+    // Заголовок XSAVE должен быть нулевым, иначе xrstor даст #GP
+    memset(area, 0, fpu_size);
+    return area;
+}
+
+static void fpu_area_free(void* area) {
+    if (area) kfree(((void**)area)[-1]);
+}
+
+// Сохранить значения владельца в его область; регистры после этого свободны
+static void fpu_evict(void) {
+    if (!fpu_owner) return;
+
+    if (!*fpu_owner) {
+        *fpu_owner = fpu_area_alloc();
+        if (!*fpu_owner) panic("[FPU] Out of memory for FPU state");
+    }
+
+    fpu_save(*fpu_owner);
+    fpu_owner = NULL;
+}
+
+// ===== Инициализация =====
+
 void enable_fpu(void) {
     uint64_t cr0, cr4;
 
     // CR0: разрешаем FPU
     asm volatile("mov %%cr0, %0" : "=r"(cr0));
-    cr0 &= ~(1 << 2); // EM = 0 (разрешить FPU)
-    cr0 |=  (1 << 1); // MP = 1
+    cr0 &= ~CR0_EM;   // EM = 0 (разрешить FPU)
+    cr0 &= ~CR0_TS;   // TS = 0 (ставится при переключении задач)
+    cr0 |=  CR0_MP;   // MP = 1 (wait/fwait тоже ловится по TS)
     asm volatile("mov %0, %%cr0" :: "r"(cr0));
+    fpu_ts = false;
 
     // CR4: разрешить SSE и FXSR
     asm volatile("mov %%cr4, %0" : "=r"(cr4));
-    cr4 |= (1 << 9);  // OSFXSR — включить поддержку fxsave/fxrstor
-    cr4 |= (1 << 10); // OSXMMEXCPT — разрешить SSE-исключения
+    cr4 |= CR4_OSFXSR;      // OSFXSR — включить поддержку fxsave/fxrstor
+    cr4 |= CR4_OSXMMEXCPT;  // OSXMMEXCPT — разрешить SSE-исключения
+    if (cpu_has(CPU_FEAT_XSAVE)) {
+        cr4 |= CR4_OSXSAVE; // OSXSAVE — xsave/xrstor и XCR0
+    }
     asm volatile("mov %0, %%cr4" :: "r"(cr4));
 
+    if (cpu_has(CPU_FEAT_XSAVE)) {
+        uint32_t eax, ebx, ecx, edx;
+
+        // x87 + SSE всегда, AVX - если его поддерживает и CPU, и XSAVE
+        cpu_cpuid(0x0000000D, 0, &eax, &ebx, &ecx, &edx);
+        fpu_xcr0 = XFEATURE_X87 | XFEATURE_SSE;
+        if (cpu_has(CPU_FEAT_AVX) && (eax & XFEATURE_AVX)) {
+            fpu_xcr0 |= XFEATURE_AVX;
+        }
+        asm volatile("xsetbv" : : "c"(0), "a"((uint32_t)fpu_xcr0), "d"((uint32_t)(fpu_xcr0 >> 32)));
+
+        // После записи XCR0: EBX листа D.0 - размер стандартного формата,
+        // EBX листа D.1 - сжатого
+        fpu_restore = fpu_xrstor;
+        if (cpu_has(CPU_FEAT_XSAVEOPT)) {
+            // Не пишет компоненты, не изменённые с последнего xrstor
+            cpu_cpuid(0x0000000D, 0, &eax, &ebx, &ecx, &edx);
+            fpu_save = fpu_xsaveopt;
+            fpu_mode_name = "xsaveopt";
+        } else if (cpu_has(CPU_FEAT_XSAVEC)) {
+            cpu_cpuid(0x0000000D, 1, &eax, &ebx, &ecx, &edx);
+            fpu_save = fpu_xsavec;
+            fpu_mode_name = "xsavec";
+        } else {
+            cpu_cpuid(0x0000000D, 0, &eax, &ebx, &ecx, &edx);
+            fpu_save = fpu_xsave;
+            fpu_mode_name = "xsave";
+        }
+        fpu_size = MAX((size_t)ebx, (size_t)(FPU_LEGACY_SIZE + FPU_HEADER_SIZE));
+    }
+
+    memset(fpu_init_state, 0, sizeof(fpu_init_state));
+    *(uint16_t*)(fpu_init_state + 0) = 0x037F;     // FCW: все исключения x87 замаскированы
+    *(uint32_t*)(fpu_init_state + 24) = 0x1F80;    // MXCSR: все исключения SSE замаскированы
+
     // Сбросить FPU
     asm volatile("fninit");
+    fpu_restore(fpu_init_state);
+}
+
+const char* fpu_save_mode_name(void) {
+    return fpu_mode_name;
+}
+
+size_t fpu_state_size(void) {
+    return fpu_size;
+}
+
+// ===== Переключение задач =====
+
+void fpu_switch_to(void** state) {
+    fpu_current = state;
+
+    // Возвращаемся к владельцу регистров - ловушка не нужна
+    if (fpu_owner == state) {
+        fpu_clts();
+    } else {
+        fpu_stts();
+    }
+}
+
+void fpu_release(void** state) {
+    if (fpu_owner == state) fpu_owner = NULL;   // Значения мёртвой задачи не сохраняем
+    if (fpu_current == state) fpu_current = &fpu_kernel_state;
+
+    fpu_area_free(*state);
+    *state = NULL;
+}
+
+void fpu_handle_nm(void) {
+    fpu_clts();
+
+    // Регистры уже принадлежат текущему контексту (например, после kernel_fpu_end)
+    if (fpu_owner == fpu_current) return;
+
+    fpu_evict();
+
+    if (!*fpu_current) {
+        // Первая FPU-инструкция контекста: выделяем область, стартуем с чистого состояния
+        *fpu_current = fpu_area_alloc();
+        if (!*fpu_current) panic("[FPU] Out of memory for FPU state");
+        fpu_restore(fpu_init_state);
+    } else {
+        fpu_restore(*fpu_current);
+    }
+
+    fpu_owner = fpu_current;
+}
+
+// ===== SIMD в ядре =====
+
+void kernel_fpu_begin(void) {
+    uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+
+    if (kernel_fpu_depth++ == 0) {
+        kernel_fpu_flags = flags;
+        fpu_clts();
+        fpu_evict();
+    }
+}
+
+void kernel_fpu_end(void) {
+    if (kernel_fpu_depth == 0) return;
+    if (--kernel_fpu_depth > 0) return;
+
+    // Регистры ничьи: первая FPU-инструкция контекста восстановит его через #NM
+    fpu_stts();
+
+    if (kernel_fpu_flags & (1ULL << 9)) {   // IF
+        asm volatile("sti" : : : "memory");
+    }
 }
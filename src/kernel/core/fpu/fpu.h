@@ -1,6 +1,38 @@
 #ifndef FPU_H
 #define FPU_H
 
+#include "ktypes.h"
+
+// Включает x87/SSE (и XSAVE, если есть) и выбирает способ сохранения.
+// Вызывать после cpu_features_init().
 void enable_fpu(void);
 
-#endif // FPU_H
\ No newline at end of file
+// ===== ЛЕНИВОЕ СОХРАНЕНИЕ FPU/SSE =====
+//
+// Состояние задачи хранится в XSAVE-области (TaskContext.fpu_state), которая
+// выделяется при первой FPU/SSE-инструкции задачи. При переключении задач
+// регистры не трогаются: ставится CR0.TS, и только если новая задача
+// действительно использует FPU, #NM сохраняет прежнего владельца и загружает
+// её состояние. Задачи без FPU не платят ни памятью, ни XSAVE.
+//
+// Обработчики прерываний, которым нужны SIMD-регистры, обязаны обрамлять
+// код kernel_fpu_begin()/kernel_fpu_end().
+//
+// Поэтому ядро собрано с -mgeneral-regs-only: иначе компилятор сам кладёт
+// xmm в memset/копирование структур, и такой код в обработчике #PF ловит
+// вложенный #NM (CR0.TS) или портит регистры задачи-владельца. SIMD-код
+// допустим только в FPU_SOURCES (Makefile, см. kfloat.h).
+
+const char* fpu_save_mode_name(void);   // "xsaveopt", "xsavec", "xsave", "fxsave"
+size_t fpu_state_size(void);            // Размер XSAVE-области задачи
+
+void fpu_switch_to(void** state);       // Планировщик: дальше работает владелец state
+void fpu_release(void** state);         // Освободить область (задача завершена)
+void fpu_handle_nm(void);               // #NM (вектор 7)
+
+// SIMD в ядре: регистры текущего владельца сохраняются, прерывания
+// запрещены до kernel_fpu_end(). Допускается вложенность.
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+#endif // FPU_H
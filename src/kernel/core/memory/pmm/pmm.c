@@ -6,6 +6,7 @@ typedef struct {
     uintptr_t base;
     size_t pages;
     uint8_t* bitmap;
+    pmm_page_t* pages_desc;   // Дескрипторы кадров (счётчики ссылок)
     spinlock_t lock;
     size_t last_free;
 } pmm_zone_t;
@@ -18,6 +19,7 @@ static void pmm_reserve_region(uintptr_t base, uintptr_t end, const char* name);
 static void pmm_set_bit(size_t bit, pmm_frame_state_t state);
 static pmm_frame_state_t pmm_get_bit(size_t bit);
 static size_t pmm_find_free_sequence(size_t count);
+static size_t pmm_page_index(void* addr);
 
 
 void pmm_init(void) {
@@ -82,10 +84,15 @@ void pmm_init(void) {
     pmm_zone.bitmap = (uint8_t*)ALIGN_UP((uintptr_t)&_kernel_end, 4096);
     kprintf("[PMM] Bitmap placed at %p (after kernel)\n", pmm_zone.bitmap);
 
-    // CRITICAL: Ensure bitmap is in identity-mapped region (first 16MB)
+    // Page descriptors go right after the bitmap
+    size_t desc_size = pmm_zone.pages * sizeof(pmm_page_t);
+    pmm_zone.pages_desc = (pmm_page_t*)ALIGN_UP((uintptr_t)pmm_zone.bitmap + bitmap_size, 4096);
+    kprintf("[PMM] Page descriptors at %p (%d KB)\n", pmm_zone.pages_desc, (int)(desc_size / 1024));
+
+    // CRITICAL: Ensure bitmap (and descriptors) are in identity-mapped region (first 16MB)
     // PMM is initialized BEFORE VMM, so we only have identity mapping!
     // The bitmap must be accessible during early boot.
-    uintptr_t bitmap_end = (uintptr_t)pmm_zone.bitmap + bitmap_size;
+    uintptr_t bitmap_end = (uintptr_t)pmm_zone.pages_desc + desc_size;
 
     if (bitmap_end > 0x1000000) {  // 16MB limit
         panic("[PMM] CRITICAL: Bitmap extends beyond identity-mapped region!\n"
@@ -101,6 +108,7 @@ void pmm_init(void) {
 
     // Mark all pages as used (safe default)
     memset(pmm_zone.bitmap, 0xFF, bitmap_size);
+    memset(pmm_zone.pages_desc, 0, desc_size);
 
     // Free all usable regions from e820 (except below 1MB)
     for (size_t i = 0; i < entry_count; i++) {
@@ -128,6 +136,8 @@ void pmm_init(void) {
     extern uintptr_t _kernel_end;
     pmm_reserve_region((uintptr_t)&_kernel_start, (uintptr_t)&_kernel_end, "Kernel");
     pmm_reserve_region((uintptr_t)pmm_zone.bitmap, (uintptr_t)pmm_zone.bitmap + bitmap_size, "Bitmap");
+    pmm_reserve_region((uintptr_t)pmm_zone.pages_desc, (uintptr_t)pmm_zone.pages_desc + desc_size,
+                       "Page descriptors");
 
     spinlock_init(&pmm_zone.lock);
     pmm_initialized = true;
@@ -209,6 +219,7 @@ void* pmm_alloc(size_t pages) {
     
     for (size_t i = 0; i < pages; i++) {
         pmm_set_bit(start + i, PMM_FRAME_USED);
+        pmm_zone.pages_desc[start + i].refcount = 1;
     }
     
     void* addr = (void*)(pmm_zone.base + start * PMM_PAGE_SIZE);
@@ -247,12 +258,7 @@ void* pmm_alloc_zero(size_t pages) {
 void pmm_free(void* addr, size_t pages) {
     if (!addr || !pages || !pmm_initialized) return;
     
-    uintptr_t base = (uintptr_t)addr;
-    if (base < pmm_zone.base || base >= pmm_zone.base + pmm_zone.pages * PMM_PAGE_SIZE) {
-        panic("PMM: Invalid free address %p", addr);
-    }
-    
-    size_t first = (base - pmm_zone.base) / PMM_PAGE_SIZE;
+    size_t first = pmm_page_index(addr);
     
     spin_lock(&pmm_zone.lock);
     
@@ -263,8 +269,13 @@ void pmm_free(void* addr, size_t pages) {
         }
     }
     
-    // Освобождение
+    // Освобождение: разделяемые кадры только теряют одну ссылку
     for (size_t i = first; i < first + pages; i++) {
+        if (pmm_zone.pages_desc[i].refcount > 1) {
+            pmm_zone.pages_desc[i].refcount--;
+            continue;
+        }
+        pmm_zone.pages_desc[i].refcount = 0;
         pmm_set_bit(i, PMM_FRAME_FREE);
     }
     
@@ -276,7 +287,40 @@ void pmm_free(void* addr, size_t pages) {
     spin_unlock(&pmm_zone.lock);
 }
 
+void pmm_ref(void* addr, size_t pages) {
+    if (!addr || !pages || !pmm_initialized) return;
+
+    size_t first = pmm_page_index(addr);
+
+    spin_lock(&pmm_zone.lock);
+    for (size_t i = first; i < first + pages; i++) {
+        if (pmm_get_bit(i) == PMM_FRAME_FREE) {
+            panic("PMM: Reference to free page %d", i);
+        }
+        if (pmm_zone.pages_desc[i].refcount == PMM_REFCOUNT_MAX) {
+            panic("PMM: Reference count overflow at page %d", i);
+        }
+        pmm_zone.pages_desc[i].refcount++;
+    }
+    spin_unlock(&pmm_zone.lock);
+}
+
+uint16_t pmm_refcount(void* addr) {
+    if (!addr || !pmm_initialized) return 0;
+
+    size_t index = pmm_page_index(addr);
+    return __atomic_load_n(&pmm_zone.pages_desc[index].refcount, __ATOMIC_ACQUIRE);
+}
+
 // Внутренние функции
+static size_t pmm_page_index(void* addr) {
+    uintptr_t base = (uintptr_t)addr;
+    if (base < pmm_zone.base || base >= pmm_zone.base + pmm_zone.pages * PMM_PAGE_SIZE) {
+        panic("PMM: Invalid page address %p", addr);
+    }
+    return (base - pmm_zone.base) / PMM_PAGE_SIZE;
+}
+
 static void pmm_reserve_region(uintptr_t base, uintptr_t end, const char* name) {
     base = ALIGN_DOWN(base, PMM_PAGE_SIZE);
     end = ALIGN_UP(end, PMM_PAGE_SIZE);
@@ -319,38 +363,23 @@ static pmm_frame_state_t pmm_get_bit(size_t bit) {
     return (pmm_zone.bitmap[byte] & (1 << offset)) ? PMM_FRAME_USED : PMM_FRAME_FREE;
 }
 
+// Поиск по 64 бита за раз (kbits): занятые слова пропускаются целиком
 static size_t pmm_find_free_sequence(size_t count) {
-    size_t consecutive = 0;
-    size_t start_search_from = pmm_zone.last_free; // Изменил имя переменной для ясности
+    size_t start_search_from = pmm_zone.last_free;
 
     // Ищем от last_free до конца
-    for (size_t i = start_search_from; i < pmm_zone.pages; i++) {
-        if (pmm_get_bit(i) == PMM_FRAME_FREE) {
-            consecutive++;
-            if (consecutive == count) {
-                pmm_zone.last_free = i - count + 1; // Обновляем last_free на место найденного блока
-                return i - count + 1;
-            }
-        } else {
-            consecutive = 0;
-        }
-    }
+    size_t start = bitmap_find_zero_run(pmm_zone.bitmap, start_search_from, pmm_zone.pages, count);
 
-    // Если не нашли, сбрасываем consecutive и ищем с начала до last_free
-    consecutive = 0; // Сброс для нового прохода
-    for (size_t i = 0; i < start_search_from; i++) { // Ищем только до last_free
-        if (pmm_get_bit(i) == PMM_FRAME_FREE) {
-            consecutive++;
-            if (consecutive == count) {
-                pmm_zone.last_free = i - count + 1; // Обновляем last_free на место найденного блока
-                return i - count + 1;
-            }
-        } else {
-            consecutive = 0;
-        }
+    // Если не нашли - с начала; серия может заканчиваться не дальше last_free + count - 1
+    if (start == KBITS_NONE) {
+        size_t limit = MIN(start_search_from + count - 1, pmm_zone.pages);
+        start = bitmap_find_zero_run(pmm_zone.bitmap, 0, limit, count);
     }
 
-    return (size_t)-1;
+    if (start != KBITS_NONE) {
+        pmm_zone.last_free = start; // Обновляем last_free на место найденного блока
+    }
+    return start;
 }
 
 // Утилиты
@@ -359,11 +388,8 @@ size_t pmm_total_pages(void) {
 }
 
 size_t pmm_free_pages(void) {
-    size_t count = 0;
     spin_lock(&pmm_zone.lock);
-    for (size_t i = 0; i < pmm_zone.pages; i++) {
-        if (pmm_get_bit(i) == PMM_FRAME_FREE) count++;
-    }
+    size_t count = pmm_zone.pages - bitmap_weight(pmm_zone.bitmap, pmm_zone.pages);
     spin_unlock(&pmm_zone.lock);
     return count;
 }
@@ -15,6 +15,13 @@ typedef enum {
     PMM_FRAME_BAD
 } pmm_frame_state_t;
 
+// Дескриптор физической страницы (один на кадр, массив рядом с битмапом)
+typedef struct {
+    uint16_t refcount;    // Сколько отображений ссылается на кадр (0 = свободен)
+} pmm_page_t;
+
+#define PMM_REFCOUNT_MAX    0xFFFF
+
 // Инициализация PMM
 void pmm_init(void);
 
@@ -23,6 +30,12 @@ void* pmm_alloc(size_t pages);
 void* pmm_alloc_zero(size_t pages);
 void pmm_free(void* addr, size_t pages);
 
+// Счётчики ссылок (copy-on-write): pmm_alloc выдаёт кадры с refcount = 1,
+// pmm_ref добавляет владельца, pmm_free освобождает кадр только когда
+// уходит последняя ссылка
+void pmm_ref(void* addr, size_t pages);
+uint16_t pmm_refcount(void* addr);
+
 // Утилиты
 size_t pmm_total_pages(void);
 size_t pmm_free_pages(void);
@@ -0,0 +1,334 @@
+#include "vma.h"
+#include "vmm.h"
+
+// ========== GAP INDEX ==========
+
+static inline vma_t* vma_entry(rb_node_t* node) {
+    return node ? container_of(node, vma_t, node) : NULL;
+}
+
+// End of the previous area (or the space base) - where this area's gap starts
+static inline uintptr_t vma_prev_end(const vma_t* vma) {
+    return vma->start - vma->gap;
+}
+
+static void vma_augment(rb_node_t* node) {
+    vma_t* vma = vma_entry(node);
+    uintptr_t max_gap = vma->gap;
+
+    if (node->left && vma_entry(node->left)->max_gap > max_gap) {
+        max_gap = vma_entry(node->left)->max_gap;
+    }
+    if (node->right && vma_entry(node->right)->max_gap > max_gap) {
+        max_gap = vma_entry(node->right)->max_gap;
+    }
+
+    vma->max_gap = max_gap;
+}
+
+// ========== TREE HELPERS (caller holds space->lock) ==========
+
+// First area ending above addr
+static vma_t* vma_lower_bound(vma_space_t* space, uintptr_t addr) {
+    rb_node_t* node = space->tree.root;
+    vma_t* best = NULL;
+
+    while (node) {
+        vma_t* vma = vma_entry(node);
+        if (vma->end > addr) {
+            best = vma;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+
+    return best;
+}
+
+static bool vma_link(vma_space_t* space, vma_t* vma) {
+    rb_node_t** link = &space->tree.root;
+    rb_node_t* parent = NULL;
+    vma_t* prev = NULL;
+    vma_t* next = NULL;
+
+    while (*link) {
+        vma_t* cur = vma_entry(*link);
+        parent = *link;
+
+        if (vma->end <= cur->start) {
+            next = cur;
+            link = &parent->left;
+        } else if (vma->start >= cur->end) {
+            prev = cur;
+            link = &parent->right;
+        } else {
+            return false;   // Overlap
+        }
+    }
+
+    vma->gap = vma->start - (prev ? prev->end : space->base);
+    vma->max_gap = vma->gap;
+    rb_insert(&space->tree, &vma->node, parent, link);
+
+    // The area now sits in front of `next` and shrinks its gap
+    if (next) {
+        next->gap = next->start - vma->end;
+        rb_propagate(&space->tree, &next->node);
+    }
+
+    space->count++;
+    return true;
+}
+
+static void vma_unlink(vma_space_t* space, vma_t* vma) {
+    vma_t* next = vma_next(vma);
+    uintptr_t prev_end = vma_prev_end(vma);
+
+    rb_erase(&space->tree, &vma->node);
+
+    if (next) {
+        next->gap = next->start - prev_end;
+        rb_propagate(&space->tree, &next->node);
+    }
+
+    space->count--;
+}
+
+// Cut vma at addr (start < addr < end). Returns the upper half.
+static vma_t* vma_split(vma_space_t* space, vma_t* vma, uintptr_t addr) {
+    vma_t* upper = kmalloc(sizeof(vma_t));
+    if (!upper) return NULL;
+
+    upper->start = addr;
+    upper->end = vma->end;
+    upper->flags = vma->flags;
+    upper->kind = vma->kind;
+
+    // Shrinking the lower half leaves its gap (and so the index) unchanged
+    vma->end = addr;
+    vma_link(space, upper);
+
+    return upper;
+}
+
+// Lowest aligned start for `size` bytes in [prev_end, next_start) ∩ [lo, hi)
+static uintptr_t vma_fit(uintptr_t prev_end, uintptr_t next_start, size_t size,
+                         uintptr_t lo, uintptr_t hi, size_t align, uintptr_t offset) {
+    uintptr_t floor = MAX(prev_end, lo);
+    uintptr_t top = MIN(next_start, hi);
+
+    uintptr_t addr = ALIGN_DOWN(floor, align) + offset;
+    if (addr < floor) addr += align;
+
+    if (addr < floor || addr >= top || size > top - addr) return 0;
+    return addr;
+}
+
+// Leftmost gap in the subtree that fits. `need` includes alignment slack,
+// so any subtree whose max_gap passes the check is worth descending into.
+static uintptr_t vma_gap_search(rb_node_t* node, size_t size, size_t need,
+                                uintptr_t lo, uintptr_t hi, size_t align, uintptr_t offset) {
+    while (node) {
+        vma_t* vma = vma_entry(node);
+        if (vma->max_gap < need) return 0;
+
+        // Everything in the left subtree lies below this area's gap
+        if (node->left && vma_prev_end(vma) > lo) {
+            uintptr_t addr = vma_gap_search(node->left, size, need, lo, hi, align, offset);
+            if (addr) return addr;
+        }
+
+        if (vma->gap >= size && vma->start > lo && vma_prev_end(vma) < hi) {
+            uintptr_t addr = vma_fit(vma_prev_end(vma), vma->start, size, lo, hi, align, offset);
+            if (addr) return addr;
+        }
+
+        if (vma->end >= hi) return 0;
+        node = node->right;
+    }
+
+    return 0;
+}
+
+static uintptr_t vma_find_gap_locked(vma_space_t* space, size_t size, uintptr_t lo, uintptr_t hi,
+                                     size_t align, uintptr_t offset) {
+    lo = MAX(lo, space->base);
+    hi = MIN(hi, space->limit);
+    if (size == 0 || lo >= hi || size > hi - lo) return 0;
+
+    if (align < VMM_PAGE_SIZE) align = VMM_PAGE_SIZE;
+    offset &= align - 1;
+
+    size_t need = size + (align - VMM_PAGE_SIZE);
+    uintptr_t addr = vma_gap_search(space->tree.root, size, need, lo, hi, align, offset);
+    if (addr) return addr;
+
+    // Space after the last area is not anyone's gap
+    vma_t* last = vma_entry(rb_last(&space->tree));
+    return vma_fit(last ? last->end : space->base, space->limit, size, lo, hi, align, offset);
+}
+
+// ========== PUBLIC API ==========
+
+void vma_space_init(vma_space_t* space, uintptr_t base, uintptr_t limit) {
+    rb_tree_init(&space->tree, vma_augment);
+    space->base = base;
+    space->limit = limit;
+    space->count = 0;
+    spinlock_init(&space->lock);
+}
+
+static void vma_free_subtree(rb_node_t* node) {
+    while (node) {
+        rb_node_t* right = node->right;
+        vma_free_subtree(node->left);
+        kfree(vma_entry(node));
+        node = right;
+    }
+}
+
+void vma_space_destroy(vma_space_t* space) {
+    spin_lock(&space->lock);
+    vma_free_subtree(space->tree.root);
+    space->tree.root = NULL;
+    space->count = 0;
+    spin_unlock(&space->lock);
+}
+
+bool vma_find(vma_space_t* space, uintptr_t addr, vma_t* out) {
+    spin_lock(&space->lock);
+    vma_t* vma = vma_lower_bound(space, addr);
+    bool found = vma && vma->start <= addr;
+    if (found && out) *out = *vma;
+    spin_unlock(&space->lock);
+    return found;
+}
+
+uintptr_t vma_find_gap(vma_space_t* space, size_t size, uintptr_t lo, uintptr_t hi,
+                       size_t align, uintptr_t offset) {
+    spin_lock(&space->lock);
+    uintptr_t addr = vma_find_gap_locked(space, size, lo, hi, align, offset);
+    spin_unlock(&space->lock);
+    return addr;
+}
+
+bool vma_insert(vma_space_t* space, uintptr_t start, size_t size,
+                uint64_t flags, uint32_t kind) {
+    if (size == 0 || start < space->base || start + size > space->limit || start + size < start) {
+        return false;
+    }
+
+    vma_t* vma = kmalloc(sizeof(vma_t));
+    if (!vma) return false;
+
+    vma->start = start;
+    vma->end = start + size;
+    vma->flags = flags;
+    vma->kind = kind;
+
+    spin_lock(&space->lock);
+    bool ok = vma_link(space, vma);
+    spin_unlock(&space->lock);
+
+    if (!ok) kfree(vma);
+    return ok;
+}
+
+uintptr_t vma_alloc(vma_space_t* space, size_t size, uintptr_t lo, uintptr_t hi,
+                    size_t align, uintptr_t offset, uint64_t flags, uint32_t kind) {
+    vma_t* vma = kmalloc(sizeof(vma_t));
+    if (!vma) return 0;
+
+    spin_lock(&space->lock);
+
+    uintptr_t addr = vma_find_gap_locked(space, size, lo, hi, align, offset);
+    if (addr) {
+        vma->start = addr;
+        vma->end = addr + size;
+        vma->flags = flags;
+        vma->kind = kind;
+        vma_link(space, vma);
+    }
+
+    spin_unlock(&space->lock);
+
+    if (!addr) kfree(vma);
+    return addr;
+}
+
+bool vma_unreserve(vma_space_t* space, uintptr_t start, size_t size) {
+    uintptr_t end = start + size;
+    bool ok = true;
+
+    spin_lock(&space->lock);
+
+    vma_t* vma = vma_lower_bound(space, start);
+    if (vma && vma->start < start && vma->end > start) {
+        vma = vma_split(space, vma, start);
+        if (!vma) ok = false;
+    }
+
+    while (ok && vma && vma->start < end) {
+        if (vma->end > end && !vma_split(space, vma, end)) {
+            ok = false;
+            break;
+        }
+
+        vma_t* next = vma_next(vma);
+        vma_unlink(space, vma);
+        kfree(vma);
+        vma = next;
+    }
+
+    spin_unlock(&space->lock);
+    return ok;
+}
+
+// Split areas at the edges of [start, start + size) and retag everything in
+// between. Fails if any part of the range is not covered by an area.
+static bool vma_update(vma_space_t* space, uintptr_t start, size_t size,
+                       bool set_flags, uint64_t flags, bool set_kind, uint32_t kind) {
+    uintptr_t end = start + size;
+
+    spin_lock(&space->lock);
+
+    // The whole range must be covered, without holes
+    vma_t* first = vma_lower_bound(space, start);
+    uintptr_t covered = start;
+    for (vma_t* vma = first; covered < end; vma = vma_next(vma)) {
+        if (!vma || vma->start > covered) {
+            spin_unlock(&space->lock);
+            return false;
+        }
+        covered = vma->end;
+    }
+
+    bool ok = true;
+    vma_t* vma = first;
+    if (vma->start < start) {
+        vma = vma_split(space, vma, start);
+        if (!vma) ok = false;
+    }
+
+    while (ok && vma && vma->start < end) {
+        if (vma->end > end && !vma_split(space, vma, end)) {
+            ok = false;
+            break;
+        }
+        if (set_flags) vma->flags = flags;
+        if (set_kind) vma->kind = kind;
+        vma = vma_next(vma);
+    }
+
+    spin_unlock(&space->lock);
+    return ok;
+}
+
+bool vma_set_flags(vma_space_t* space, uintptr_t start, size_t size, uint64_t flags) {
+    return vma_update(space, start, size, true, flags, false, 0);
+}
+
+bool vma_set_kind(vma_space_t* space, uintptr_t start, size_t size, uint32_t kind) {
+    return vma_update(space, start, size, false, 0, true, kind);
+}
@@ -0,0 +1,88 @@
+#ifndef VMA_H
+#define VMA_H
+
+#include "klib.h"
+#include "rbtree.h"
+
+// ============================================================================
+// VIRTUAL MEMORY AREAS
+// ============================================================================
+//
+// A vma_space_t tracks which parts of a virtual range are in use. Areas are
+// kept in a red-black tree ordered by address; every node also stores the
+// size of the hole in front of it (gap) and the largest such hole in its
+// subtree (max_gap), so lookups, inserts and free-space searches are all
+// O(log n) instead of walking page tables.
+
+// What created the area
+#define VMA_KIND_ANON       0   // vmm_alloc_pages()
+#define VMA_KIND_VMALLOC    1   // vmalloc() - freed through vfree()
+#define VMA_KIND_RESERVED   2   // vmm_reserve_region()
+#define VMA_KIND_GUARD      4   // Never mapped; a fault here is an overflow
+#define VMA_KIND_SHARED     5   // vmm_map_shared() - frames owned by an IPC segment
+#define VMA_KIND_STACK      6   // vmalloc_stack() - fully mapped, guard pages around
+
+typedef struct vma {
+    rb_node_t node;
+    uintptr_t start;              // First byte (page aligned)
+    uintptr_t end;                // One past the last byte (page aligned)
+    uint64_t flags;               // VMM_FLAG_* the area is mapped with
+    uint32_t kind;                // VMA_KIND_*
+
+    // Gap index (maintained by the tree)
+    uintptr_t gap;                // start - end of previous area (or space base)
+    uintptr_t max_gap;            // Largest gap in this subtree
+} vma_t;
+
+typedef struct {
+    rb_tree_t tree;
+    uintptr_t base;               // Lowest address managed
+    uintptr_t limit;              // One past the highest address managed
+    size_t count;                 // Number of areas
+    spinlock_t lock;
+} vma_space_t;
+
+// Space management
+void vma_space_init(vma_space_t* space, uintptr_t base, uintptr_t limit);
+void vma_space_destroy(vma_space_t* space);
+
+// Copy of the area containing addr into *out (out may be NULL); false if
+// there is none. A copy, because another CPU may free the area itself as
+// soon as space->lock is dropped.
+bool vma_find(vma_space_t* space, uintptr_t addr, vma_t* out);
+
+// Lowest free range of `size` bytes inside [lo, hi) whose start is congruent
+// to `offset` modulo `align` (align is a power of two >= page size).
+// Returns 0 if nothing fits. Does not reserve the range.
+uintptr_t vma_find_gap(vma_space_t* space, size_t size, uintptr_t lo, uintptr_t hi,
+                       size_t align, uintptr_t offset);
+
+// Record [start, start + size). Fails if it overlaps an existing area.
+bool vma_insert(vma_space_t* space, uintptr_t start, size_t size,
+                uint64_t flags, uint32_t kind);
+
+// vma_find_gap() + vma_insert() under one lock. Returns 0 on failure.
+uintptr_t vma_alloc(vma_space_t* space, size_t size, uintptr_t lo, uintptr_t hi,
+                    size_t align, uintptr_t offset, uint64_t flags, uint32_t kind);
+
+// Forget [start, start + size): areas inside are dropped, areas crossing the
+// edges are trimmed or split. Returns false only if a split ran out of memory.
+bool vma_unreserve(vma_space_t* space, uintptr_t start, size_t size);
+
+// Change flags (or kind) on [start, start + size), splitting areas at the edges.
+// Fails if any part of the range is not covered by an area.
+bool vma_set_flags(vma_space_t* space, uintptr_t start, size_t size, uint64_t flags);
+bool vma_set_kind(vma_space_t* space, uintptr_t start, size_t size, uint32_t kind);
+
+// In-order iteration (caller holds space->lock)
+static inline vma_t* vma_first(vma_space_t* space) {
+    rb_node_t* node = rb_first(&space->tree);
+    return node ? container_of(node, vma_t, node) : NULL;
+}
+
+static inline vma_t* vma_next(vma_t* vma) {
+    rb_node_t* node = rb_next(&vma->node);
+    return node ? container_of(node, vma_t, node) : NULL;
+}
+
+#endif // VMA_H
@@ -2,6 +2,7 @@
 #include "pmm.h"
 #include "klib.h"
 #include "io.h"
+#include "cpu.h"
 
 
 // ========== GLOBAL VARIABLES ==========
@@ -12,19 +13,9 @@ static char last_error[256] = {0};
 static vmm_stats_t global_stats = {0};
 static spinlock_t vmm_global_lock = {0};
 
-// Kernel heap tracking
-static uintptr_t kernel_heap_current = VMM_KERNEL_HEAP_BASE;
-static spinlock_t kernel_heap_lock = {0};
-
-// vmalloc tracking (simple linked list)
-typedef struct vmalloc_entry {
-    void* virt_base;
-    size_t pages;
-    struct vmalloc_entry* next;
-} vmalloc_entry_t;
-
-static vmalloc_entry_t* vmalloc_list = NULL;
-static spinlock_t vmalloc_lock = {0};
+// Kernel heap areas (shared by all contexts, like the kernel half itself).
+// Freed ranges go back into the gap index and are handed out again.
+static vma_space_t kernel_heap_vmas;
 
 // ========== ERROR HANDLING ==========
 void vmm_set_error(const char* error) {
@@ -40,8 +31,50 @@ const char* vmm_get_last_error(void) {
     return last_error;
 }
 
+// Area tracker responsible for an address
+static inline vma_space_t* vmm_vmas_for(vmm_context_t* ctx, uintptr_t virt_addr) {
+    return vmm_is_kernel_addr(virt_addr) ? &kernel_heap_vmas : &ctx->vmas;
+}
+
+// Page table physical address -> pointer usable by the kernel
+static inline page_table_t* vmm_table_virt(uintptr_t table_phys) {
+    // Before vmm_init() finishes only the identity mapping is available
+    return vmm_initialized ? (page_table_t*)vmm_phys_to_virt(table_phys)
+                           : (page_table_t*)table_phys;
+}
+
 // ========== PHYSICAL MEMORY INTEGRATION ==========
+
+// Page-table page cache. pt_cache holds zeroed pages; pt_reclaim holds
+// freed tables that still have to be zeroed; zombie_pml4 holds the PML4s of
+// destroyed contexts whose user half has not been torn down yet. All three
+// are drained and refilled by vmm_idle_work() (the scheduler's idle path);
+// vmm_create_context() also tears down one zombie, so they cannot pile up
+// on a CPU that never idles.
+static uintptr_t pt_cache[VMM_PT_CACHE_SIZE];
+static size_t pt_cache_count = 0;
+static uintptr_t pt_reclaim[VMM_PT_RECLAIM_SIZE];
+static size_t pt_reclaim_count = 0;
+static uintptr_t zombie_pml4[VMM_ZOMBIE_CONTEXTS];
+static size_t zombie_count = 0;
+static spinlock_t pt_cache_lock = {0};
+
+static void vmm_free_user_space_tables(page_table_t* pml4);
+
 uintptr_t vmm_alloc_page_table(void) {
+    // Fast path: a page zeroed ahead of time by the idle loop
+    uintptr_t cached = 0;
+    spin_lock(&pt_cache_lock);
+    if (pt_cache_count) cached = pt_cache[--pt_cache_count];
+    spin_unlock(&pt_cache_lock);
+
+    if (cached) {
+        spin_lock(&vmm_global_lock);
+        global_stats.page_tables_allocated++;
+        spin_unlock(&vmm_global_lock);
+        return cached;
+    }
+
     // PMM returns PHYSICAL address
     void* phys_page = pmm_alloc(1);  // Returns physical address
     if (!phys_page) {
@@ -76,13 +109,145 @@ uintptr_t vmm_alloc_page_table(void) {
 
 void vmm_free_page_table(uintptr_t phys_addr) {
     if (!phys_addr) return;
-    pmm_free((void*)phys_addr, 1);
+
     spin_lock(&vmm_global_lock);
     if (global_stats.page_tables_allocated > 0) global_stats.page_tables_allocated--;
     spin_unlock(&vmm_global_lock);
+
+    // Keep it for reuse; the idle loop zeroes it
+    spin_lock(&pt_cache_lock);
+    bool queued = pt_reclaim_count < VMM_PT_RECLAIM_SIZE;
+    if (queued) pt_reclaim[pt_reclaim_count++] = phys_addr;
+    spin_unlock(&pt_cache_lock);
+
+    if (!queued) pmm_free((void*)phys_addr, 1);
+}
+
+// Tear down the user half of one destroyed context. Returns false if none.
+static bool vmm_reap_zombie(void) {
+    uintptr_t pml4_phys = 0;
+    spin_lock(&pt_cache_lock);
+    if (zombie_count) pml4_phys = zombie_pml4[--zombie_count];
+    spin_unlock(&pt_cache_lock);
+
+    if (!pml4_phys) return false;
+
+    vmm_free_user_space_tables(vmm_table_virt(pml4_phys));
+    vmm_free_page_table(pml4_phys);
+    return true;
+}
+
+bool vmm_idle_work(void) {
+    if (!vmm_initialized) return false;
+
+    // A destroyed context first: its tables feed the cache below
+    if (vmm_reap_zombie()) return true;
+
+    bool worked = false;
+
+    for (size_t i = 0; i < VMM_IDLE_BATCH; i++) {
+        uintptr_t page = 0;
+
+        spin_lock(&pt_cache_lock);
+        bool full = pt_cache_count >= VMM_PT_CACHE_SIZE;
+        if (pt_reclaim_count) page = pt_reclaim[--pt_reclaim_count];
+        spin_unlock(&pt_cache_lock);
+
+        if (!page) {
+            if (full) break;
+            page = (uintptr_t)pmm_alloc(1);
+            if (!page) break;
+        } else if (full) {
+            // Cache is full: the reclaimed table goes back to the PMM
+            pmm_free((void*)page, 1);
+            worked = true;
+            continue;
+        }
+
+        memset(vmm_phys_to_virt(page), 0, VMM_PAGE_SIZE);
+
+        spin_lock(&pt_cache_lock);
+        if (pt_cache_count < VMM_PT_CACHE_SIZE) {
+            pt_cache[pt_cache_count++] = page;
+            page = 0;
+        }
+        spin_unlock(&pt_cache_lock);
+
+        if (page) pmm_free((void*)page, 1);
+        worked = true;
+    }
+
+    return worked;
+}
+
+// Account `pages` 4KB pages as mapped (or unmapped) in ctx and global stats
+static void vmm_stats_mapped(vmm_context_t* ctx, uint64_t flags, size_t pages, bool mapped) {
+    bool user = (flags & VMM_FLAG_USER) != 0;
+
+    if (mapped) {
+        ctx->mapped_pages += pages;
+        if (user) ctx->user_pages += pages;
+        else ctx->kernel_pages += pages;
+    } else {
+        ctx->mapped_pages -= MIN(ctx->mapped_pages, pages);
+        if (user) ctx->user_pages -= MIN(ctx->user_pages, pages);
+        else ctx->kernel_pages -= MIN(ctx->kernel_pages, pages);
+    }
+
+    spin_lock(&vmm_global_lock);
+    if (mapped) {
+        if (user) global_stats.user_mapped_pages += pages;
+        else global_stats.kernel_mapped_pages += pages;
+        global_stats.total_mapped_pages += pages;
+    } else {
+        if (user) global_stats.user_mapped_pages -= MIN(global_stats.user_mapped_pages, pages);
+        else global_stats.kernel_mapped_pages -= MIN(global_stats.kernel_mapped_pages, pages);
+        global_stats.total_mapped_pages -= MIN(global_stats.total_mapped_pages, pages);
+    }
+    spin_unlock(&vmm_global_lock);
 }
 
 // ========== TLB MANAGEMENT ==========
+
+// PCID state. Contexts get a PCID from 1..VMM_PCID_POOL_SIZE-1 the first time
+// they are loaded in a generation; when the pool runs out the generation
+// is bumped, every tag is flushed and contexts pick up new PCIDs lazily.
+static bool pcid_on = false;
+static bool invpcid_supported = false;
+static uint64_t pcid_generation = 1;
+static uint16_t pcid_next = 1;
+
+#define CR0_WP     (1ULL << 16)
+#define CR4_PGE    (1ULL << 7)
+#define CR4_PCIDE  (1ULL << 17)
+
+static inline uint64_t vmm_read_cr4(void) {
+    uint64_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static inline void vmm_write_cr4(uint64_t cr4) {
+    asm volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+// Drop every TLB entry for every PCID, global ones included
+static void vmm_flush_tlb_all(void) {
+    if (invpcid_supported) {
+        struct { uint64_t pcid; uint64_t addr; } desc = {0, 0};
+        asm volatile("invpcid %0, %1" : : "m"(desc), "r"(2ULL) : "memory");
+    } else {
+        // Toggling CR4.PGE flushes all PCIDs
+        uint64_t cr4 = vmm_read_cr4();
+        vmm_write_cr4(cr4 ^ CR4_PGE);
+        vmm_write_cr4(cr4);
+    }
+
+    spin_lock(&vmm_global_lock);
+    global_stats.tlb_flushes++;
+    spin_unlock(&vmm_global_lock);
+}
+
 void vmm_flush_tlb(void) {
     uintptr_t cr3;
     asm volatile("mov %%cr3, %0" : "=r"(cr3));
@@ -103,6 +268,215 @@ void vmm_invalidate_page(uintptr_t virt_addr) {
     vmm_flush_tlb_page(virt_addr);
 }
 
+bool vmm_pcid_enabled(void) {
+    return pcid_on;
+}
+
+// Kernel-half leaves are global (CR4.PGE): they survive CR3 loads in every
+// PCID, and invlpg drops a global entry from all of them, so changing the
+// kernel half never has to flush other address spaces' tags
+static inline uint64_t vmm_leaf_global(uintptr_t virt_addr, uint64_t flags) {
+    return vmm_is_kernel_addr(virt_addr) ? (flags | VMM_FLAG_GLOBAL)
+                                         : (flags & ~VMM_FLAG_GLOBAL);
+}
+
+// Give ctx a PCID valid in the current generation.
+// Returns true if the tag is new (its TLB entries must not be trusted).
+static bool vmm_pcid_assign(vmm_context_t* ctx) {
+    if (ctx == kernel_context) return false;   // PCID 0, never recycled
+    if (ctx->pcid_gen == pcid_generation) return false;
+
+    if (pcid_next >= VMM_PCID_POOL_SIZE) {
+        // Rollover: every tag from the old generation is now stale
+        pcid_generation++;
+        pcid_next = 1;
+        vmm_flush_tlb_all();
+        klog_debug(KLOG_VMM, "[VMM] PCID generation rollover -> %llu\n",
+                   (unsigned long long)pcid_generation);
+    }
+
+    ctx->pcid = pcid_next++;
+    ctx->pcid_gen = pcid_generation;
+    return true;
+}
+
+static void vmm_pcid_init(void) {
+    if (!cpu_has(CPU_FEAT_PCID)) {
+        klog_info(KLOG_VMM, "[VMM] PCID not supported, CR3 loads flush the TLB\n");
+        return;
+    }
+
+    invpcid_supported = cpu_has(CPU_FEAT_INVPCID);
+
+    // CR4.PCIDE may only be set while CR3[11:0] == 0: the kernel context
+    // (PCID 0) must be loaded
+    kernel_context->pcid = 0;
+    vmm_write_cr4(vmm_read_cr4() | CR4_PCIDE);
+    pcid_on = true;
+
+    klog_info(KLOG_VMM, "[VMM] PCID enabled (%d tags per generation, INVPCID %s)\n",
+              VMM_PCID_POOL_SIZE - 1, invpcid_supported ? "yes" : "no");
+}
+
+// ========== TLB GATHER / SHOOTDOWN ==========
+
+// CPUs that are up. Only the boot CPU today; SMP bring-up adds bits here.
+static uint64_t vmm_cpus_online = 1;
+
+static inline uint32_t vmm_this_cpu(void) {
+    return 0;
+}
+
+// Descriptor published to remote CPUs: one IPI per batch, not per page
+static struct {
+    const vmm_tlb_batch_t* batch;
+    volatile uint64_t pending;    // CPUs that still have to flush
+} tlb_shootdown;
+static spinlock_t tlb_shootdown_lock = {0};
+
+// Invalidate a batch on this CPU
+static void vmm_tlb_batch_apply(const vmm_tlb_batch_t* batch) {
+    if (batch->flush_all) {
+        // A CR3 reload keeps global entries: kernel ranges need the full flush
+        if (batch->kernel) vmm_flush_tlb_all();
+        else vmm_flush_tlb();
+        return;
+    }
+
+    for (size_t i = 0; i < batch->addr_count; i++) {
+        asm volatile("invlpg (%0)" : : "r"(batch->addrs[i]) : "memory");
+    }
+
+    spin_lock(&vmm_global_lock);
+    global_stats.tlb_flushes++;
+    spin_unlock(&vmm_global_lock);
+}
+
+void vmm_tlb_shootdown_handle(void) {
+    uint64_t self = 1ULL << vmm_this_cpu();
+    if (!(tlb_shootdown.pending & self)) return;
+
+    vmm_tlb_batch_apply(tlb_shootdown.batch);
+    __atomic_and_fetch(&tlb_shootdown.pending, ~self, __ATOMIC_RELEASE);
+}
+
+// No IPI delivery yet, and none is needed: only the boot CPU is online, so
+// there is never a remote CPU to reach and this does nothing. The check
+// guards that assumption; SMP bring-up has to replace it with a real IPI.
+static void vmm_tlb_send_ipi(uint64_t mask) {
+    (void)mask;
+    if (vmm_cpus_online != 1) {
+        panic("vmm_tlb_send_ipi: several CPUs online but no shootdown IPI");
+    }
+}
+
+static void vmm_tlb_shootdown(const vmm_tlb_batch_t* batch, uint64_t mask) {
+    // A CPU that is not up cannot acknowledge: never wait for one
+    mask &= vmm_cpus_online;
+    if (!mask) return;
+
+    spin_lock(&tlb_shootdown_lock);
+    tlb_shootdown.batch = batch;
+    __atomic_store_n(&tlb_shootdown.pending, mask, __ATOMIC_RELEASE);
+
+    vmm_tlb_send_ipi(mask);
+    while (__atomic_load_n(&tlb_shootdown.pending, __ATOMIC_ACQUIRE)) {
+        pause();
+    }
+
+    tlb_shootdown.batch = NULL;
+    spin_unlock(&tlb_shootdown_lock);
+}
+
+void vmm_tlb_batch_begin(vmm_tlb_batch_t* batch, vmm_context_t* ctx) {
+    batch->ctx = ctx;
+    batch->addr_count = 0;
+    batch->flush_all = false;
+    batch->kernel = false;
+    batch->frame_runs = 0;
+}
+
+void vmm_tlb_batch_add(vmm_tlb_batch_t* batch, uintptr_t virt_addr, size_t page_count) {
+    if (page_count == 0) return;
+
+    if (vmm_is_kernel_addr(virt_addr)) batch->kernel = true;
+    if (batch->flush_all) return;
+
+    if (batch->addr_count + page_count > VMM_TLB_BATCH_PAGES) {
+        batch->flush_all = true;
+        return;
+    }
+
+    for (size_t i = 0; i < page_count; i++) {
+        batch->addrs[batch->addr_count++] = virt_addr + i * VMM_PAGE_SIZE;
+    }
+}
+
+// Queue frames to release once the flush is done. The virtual range that
+// mapped them must already have been added: a full run list flushes early.
+void vmm_tlb_batch_free_frames(vmm_tlb_batch_t* batch, uintptr_t phys_addr, size_t page_count) {
+    if (page_count == 0) return;
+
+    if (batch->frame_runs) {
+        vmm_frame_run_t* last = &batch->frames[batch->frame_runs - 1];
+        if (last->phys + vmm_pages_to_size(last->pages) == phys_addr) {
+            last->pages += page_count;
+            return;
+        }
+    }
+
+    if (batch->frame_runs == VMM_TLB_BATCH_RUNS) {
+        vmm_tlb_batch_flush(batch);
+    }
+
+    batch->frames[batch->frame_runs].phys = phys_addr;
+    batch->frames[batch->frame_runs].pages = page_count;
+    batch->frame_runs++;
+}
+
+void vmm_tlb_batch_flush(vmm_tlb_batch_t* batch) {
+    vmm_context_t* ctx = batch->ctx;
+
+    if (batch->flush_all || batch->addr_count) {
+        uint64_t self = 1ULL << vmm_this_cpu();
+        uint64_t targets;
+
+        if (batch->kernel) {
+            // Kernel half is shared and global: every CPU, all PCIDs at once
+            targets = vmm_cpus_online;
+        } else {
+            targets = ctx ? ctx->cpu_mask : self;
+            // Entries tagged with ctx's PCID survive until it is loaded again
+            if (pcid_on && ctx && !(targets & self)) ctx->tlb_stale = true;
+        }
+
+        if (targets & self) vmm_tlb_batch_apply(batch);
+        vmm_tlb_shootdown(batch, targets & ~self);
+    }
+
+    for (size_t i = 0; i < batch->frame_runs; i++) {
+        pmm_free((void*)batch->frames[i].phys, batch->frames[i].pages);
+    }
+    batch->frame_runs = 0;
+}
+
+void vmm_tlb_batch_finish(vmm_tlb_batch_t* batch) {
+    vmm_tlb_batch_flush(batch);
+    batch->addr_count = 0;
+    batch->flush_all = false;
+    batch->kernel = false;
+}
+
+// Flush a range changed in ctx with a single batch
+static void vmm_flush_range(vmm_context_t* ctx, uintptr_t virt_addr, size_t page_count) {
+    if (page_count == 0) return;
+
+    vmm_tlb_batch_t batch;
+    vmm_tlb_batch_begin(&batch, ctx);
+    vmm_tlb_batch_add(&batch, virt_addr, page_count);
+    vmm_tlb_batch_finish(&batch);
+}
+
 // ========== PAGE TABLE MANIPULATION (helpers) ==========
 
 // Internal: walk and create intermediate tables up to `level` (1..3). Return pointer to that table (virtual).
@@ -132,6 +506,10 @@ page_table_t* vmm_get_or_create_table(vmm_context_t* ctx, uintptr_t virt_addr, i
 
             // Map it with kernel flags (present + writable)
             *entry = vmm_make_pte(new_table_phys, VMM_FLAGS_KERNEL_RW);
+        } else if (*entry & VMM_FLAG_LARGE_PAGE) {
+            // A large page leaf is not a table - never descend into it
+            vmm_set_error("Address is covered by a large page");
+            return NULL;
         }
 
         // Move to next level (phys -> virtual pointer)
@@ -150,8 +528,10 @@ page_table_t* vmm_get_or_create_table(vmm_context_t* ctx, uintptr_t virt_addr, i
     return current_table;
 }
 
-// Internal: get existing (no allocation) PTE. Returns NULL if PT or parent tables not present.
-static pte_t* vmm_get_pte_noalloc(vmm_context_t* ctx, uintptr_t virt_addr) {
+// Internal: get existing (no allocation) leaf entry. Returns NULL if not mapped.
+// The leaf may be a 1GB PDPT entry, a 2MB PD entry or a 4KB PT entry;
+// its size is reported through page_size (if non-NULL).
+static pte_t* vmm_get_pte_noalloc(vmm_context_t* ctx, uintptr_t virt_addr, size_t* page_size) {
     if (!ctx || !ctx->pml4) return NULL;
 
     uint32_t pml4_idx = VMM_PML4_INDEX(virt_addr);
@@ -169,34 +549,37 @@ static pte_t* vmm_get_pte_noalloc(vmm_context_t* ctx, uintptr_t virt_addr) {
         (page_table_t*)vmm_phys_to_virt(pdpt_phys) :
         (page_table_t*)pdpt_phys;
 
-    pte_t pdpt_entry = pdpt->entries[pdpt_idx];
-    if (!(pdpt_entry & VMM_FLAG_PRESENT)) return NULL;
+    pte_t* pdpt_entry = &pdpt->entries[pdpt_idx];
+    if (!(*pdpt_entry & VMM_FLAG_PRESENT)) return NULL;
 
-    // If PDPT entry is large page (1GB), then there's no lower PT
-    if (pdpt_entry & VMM_FLAG_LARGE_PAGE) {
-        return NULL;
+    // PDPT entry is a 1GB leaf
+    if (*pdpt_entry & VMM_FLAG_LARGE_PAGE) {
+        if (page_size) *page_size = VMM_HUGE_PAGE_SIZE;
+        return pdpt_entry;
     }
 
     // Get PD (convert phys to virt based on VMM state)
-    uintptr_t pd_phys = vmm_pte_to_phys(pdpt_entry);
+    uintptr_t pd_phys = vmm_pte_to_phys(*pdpt_entry);
     page_table_t* pd = vmm_initialized ?
         (page_table_t*)vmm_phys_to_virt(pd_phys) :
         (page_table_t*)pd_phys;
 
-    pte_t pd_entry = pd->entries[pd_idx];
-    if (!(pd_entry & VMM_FLAG_PRESENT)) return NULL;
+    pte_t* pd_entry = &pd->entries[pd_idx];
+    if (!(*pd_entry & VMM_FLAG_PRESENT)) return NULL;
 
-    // If PD entry is large page (2MB), there's no PT
-    if (pd_entry & VMM_FLAG_LARGE_PAGE) {
-        return NULL;
+    // PD entry is a 2MB leaf
+    if (*pd_entry & VMM_FLAG_LARGE_PAGE) {
+        if (page_size) *page_size = VMM_LARGE_PAGE_SIZE;
+        return pd_entry;
     }
 
     // Get PT (convert phys to virt based on VMM state)
-    uintptr_t pt_phys = vmm_pte_to_phys(pd_entry);
+    uintptr_t pt_phys = vmm_pte_to_phys(*pd_entry);
     page_table_t* pt = vmm_initialized ?
         (page_table_t*)vmm_phys_to_virt(pt_phys) :
         (page_table_t*)pt_phys;
 
+    if (page_size) *page_size = VMM_PAGE_SIZE;
     return &pt->entries[pt_idx];
 }
 
@@ -209,14 +592,23 @@ pte_t* vmm_get_or_create_pte(vmm_context_t* ctx, uintptr_t virt_addr) {
 
 // Public wrappers (as declared in header).
 // vmm_get_pte -> does NOT create tables (safe for translations)
+// Note: for addresses covered by a large page this returns the 2MB/1GB leaf.
 pte_t* vmm_get_pte(vmm_context_t* ctx, uintptr_t virt_addr) {
-    return vmm_get_pte_noalloc(ctx, virt_addr);
+    return vmm_get_pte_noalloc(ctx, virt_addr, NULL);
+}
+
+pte_t* vmm_get_leaf(vmm_context_t* ctx, uintptr_t virt_addr, size_t* page_size) {
+    return vmm_get_pte_noalloc(ctx, virt_addr, page_size);
 }
 
 
 
 // ========== CONTEXT MANAGEMENT ==========
 vmm_context_t* vmm_create_context(void) {
+    // One destroyed context goes first, whether or not anyone idles:
+    // its tables are what the new one will be built from
+    if (vmm_initialized) vmm_reap_zombie();
+
     vmm_context_t* ctx = kmalloc(sizeof(vmm_context_t));
     if (!ctx) {
         vmm_set_error("Failed to allocate VMM context");
@@ -248,6 +640,7 @@ vmm_context_t* vmm_create_context(void) {
     ctx->stack_top = VMM_USER_STACK_TOP;
 
     spinlock_init(&ctx->lock);
+    vma_space_init(&ctx->vmas, VMM_USER_BASE, VMM_USER_STACK_TOP);
 
     // Copy kernel mappings from kernel_context if we have one
     if (kernel_context && kernel_context->pml4) {
@@ -264,13 +657,107 @@ vmm_context_t* vmm_create_context(void) {
     return ctx;
 }
 
-// Helper: free user-space page tables & mapped pages for a context
-static void vmm_free_user_space_tables(vmm_context_t* ctx) {
-    if (!ctx || !ctx->pml4) return;
+// ----- Copy-on-write cloning -----
+
+// Share a leaf with a clone: a writable leaf loses the W bit and becomes
+// COW, and every frame behind it gains a reference. Returns the entry the
+// child should use.
+static pte_t vmm_cow_share_leaf(pte_t* entry, size_t page_size) {
+    if ((*entry & VMM_FLAG_WRITABLE) && !(*entry & VMM_FLAG_SHARED)) {
+        *entry = (*entry & ~VMM_FLAG_WRITABLE) | VMM_FLAG_COW;
+    }
+    pmm_ref((void*)vmm_leaf_to_phys(*entry, page_size), page_size / VMM_PAGE_SIZE);
+    return *entry;
+}
+
+// Duplicate one user table (level 1 = PDPT, 2 = PD, 3 = PT) and everything
+// below it. On allocation failure *ok is cleared and the partial copy is
+// still returned, so the caller can link it and tear it down normally.
+static uintptr_t vmm_cow_copy_table(page_table_t* src, int level, bool* ok) {
+    uintptr_t copy_phys = vmm_alloc_page_table();
+    if (!copy_phys) {
+        *ok = false;
+        return 0;
+    }
+
+    page_table_t* copy = vmm_table_virt(copy_phys);
+
+    for (int i = 0; i < 512 && *ok; i++) {
+        pte_t entry = src->entries[i];
+        if (!(entry & VMM_FLAG_PRESENT)) continue;
+
+        if (level == 3 || (entry & VMM_FLAG_LARGE_PAGE)) {
+            size_t page_size = level == 3 ? VMM_PAGE_SIZE :
+                               level == 2 ? VMM_LARGE_PAGE_SIZE : VMM_HUGE_PAGE_SIZE;
+            copy->entries[i] = vmm_cow_share_leaf(&src->entries[i], page_size);
+            continue;
+        }
+
+        uintptr_t child = vmm_cow_copy_table(vmm_table_virt(vmm_pte_to_phys(entry)), level + 1, ok);
+        if (child) {
+            copy->entries[i] = vmm_make_pte(child, vmm_pte_to_flags(entry));
+        }
+    }
+
+    return copy_phys;
+}
+
+vmm_context_t* vmm_clone_context(vmm_context_t* parent) {
+    if (!parent || parent == kernel_context) {
+        vmm_set_error("Cannot clone the kernel context");
+        return NULL;
+    }
+
+    vmm_context_t* child = vmm_create_context();
+    if (!child) return NULL;
+
+    bool ok = true;
+
+    spin_lock(&parent->lock);
+
+    for (int p4 = 0; p4 < 256 && ok; p4++) {
+        pte_t entry = parent->pml4->entries[p4];
+        if (!(entry & VMM_FLAG_PRESENT)) continue;
+
+        uintptr_t pdpt = vmm_cow_copy_table(vmm_table_virt(vmm_pte_to_phys(entry)), 1, &ok);
+        if (pdpt) {
+            child->pml4->entries[p4] = vmm_make_pte(pdpt, vmm_pte_to_flags(entry));
+        }
+    }
+
+    child->heap_start = parent->heap_start;
+    child->heap_end = parent->heap_end;
+    child->stack_top = parent->stack_top;
+
+    spin_unlock(&parent->lock);
+
+    // The parent's writable pages just became read-only
+    vmm_flush_range(parent, VMM_USER_BASE, vmm_size_to_pages(VMM_USER_STACK_TOP - VMM_USER_BASE));
+
+    // Same areas in the child, so faults and frees behave the same
+    spin_lock(&parent->vmas.lock);
+    for (vma_t* vma = vma_first(&parent->vmas); vma && ok; vma = vma_next(vma)) {
+        ok = vma_insert(&child->vmas, vma->start, vma->end - vma->start, vma->flags, vma->kind);
+    }
+    spin_unlock(&parent->vmas.lock);
+
+    if (!ok) {
+        vmm_set_error("Out of memory while cloning context");
+        vmm_destroy_context(child);
+        return NULL;
+    }
+
+    vmm_stats_mapped(child, VMM_FLAG_USER, parent->user_pages, true);
+    return child;
+}
+
+// Free user-space page tables & mapped pages under a PML4
+static void vmm_free_user_space_tables(page_table_t* pml4) {
+    if (!pml4) return;
 
     // Only iterate low half (user space): PML4 indices 0..255
     for (int p4 = 0; p4 < 256; p4++) {
-        pte_t pml4_entry = ctx->pml4->entries[p4];
+        pte_t pml4_entry = pml4->entries[p4];
         if (!(pml4_entry & VMM_FLAG_PRESENT)) continue;
 
         page_table_t* pdpt = (page_table_t*)vmm_phys_to_virt(vmm_pte_to_phys(pml4_entry));
@@ -282,7 +769,7 @@ static void vmm_free_user_space_tables(vmm_context_t* ctx) {
 
             // If PDPT entry is 1GB large page
             if (pdpt_entry & VMM_FLAG_LARGE_PAGE) {
-                uintptr_t phys = vmm_pte_to_phys(pdpt_entry);
+                uintptr_t phys = vmm_leaf_to_phys(pdpt_entry, VMM_HUGE_PAGE_SIZE);
                 // 1GB = 512 * 512 * 4KB = 262144 pages
                 pmm_free((void*)phys, 512 * 512);
                 continue;
@@ -297,7 +784,7 @@ static void vmm_free_user_space_tables(vmm_context_t* ctx) {
 
                 // If PD entry is 2MB large page
                 if (pd_entry & VMM_FLAG_LARGE_PAGE) {
-                    uintptr_t phys = vmm_pte_to_phys(pd_entry);
+                    uintptr_t phys = vmm_leaf_to_phys(pd_entry, VMM_LARGE_PAGE_SIZE);
                     // 2MB = 512 * 4KB = 512 pages
                     pmm_free((void*)phys, 512);
                     continue;
@@ -311,7 +798,7 @@ static void vmm_free_user_space_tables(vmm_context_t* ctx) {
                     if (!(pt_entry & VMM_FLAG_PRESENT)) continue;
 
                     uintptr_t phys = vmm_pte_to_phys(pt_entry);
-                    // Free single physical page
+                    // Free single physical page (drops one reference if shared)
                     pmm_free((void*)phys, 1);
 
                     // Clear PT entry to be clean (not strictly required since we'll free PT)
@@ -319,36 +806,39 @@ static void vmm_free_user_space_tables(vmm_context_t* ctx) {
                 }
 
                 // Free PT table itself
-                vmm_free_page_table((uintptr_t)pt);
+                vmm_free_page_table(vmm_pte_to_phys(pd_entry));
                 pd->entries[p2] = 0;
             }
 
             // Free PD table
-            vmm_free_page_table((uintptr_t)pd);
+            vmm_free_page_table(vmm_pte_to_phys(pdpt_entry));
             pdpt->entries[p3] = 0;
         }
 
         // Free PDPT table
-        vmm_free_page_table((uintptr_t)pdpt);
-        ctx->pml4->entries[p4] = 0;
+        vmm_free_page_table(vmm_pte_to_phys(pml4_entry));
+        pml4->entries[p4] = 0;
     }
 }
 
 void vmm_destroy_context(vmm_context_t* ctx) {
     if (!ctx || ctx == kernel_context) return;
 
-    spin_lock(&ctx->lock);
-
-    // Free all user-space mappings and associated page tables
-    vmm_free_user_space_tables(ctx);
+    // Tear the user half down later from the idle loop; only the PML4 has
+    // to be remembered. If too many are queued already, do it now.
+    spin_lock(&pt_cache_lock);
+    bool deferred = zombie_count < VMM_ZOMBIE_CONTEXTS;
+    if (deferred) zombie_pml4[zombie_count++] = ctx->pml4_phys;
+    spin_unlock(&pt_cache_lock);
 
-    // Finally free the PML4 itself
-    if (ctx->pml4_phys) {
+    if (!deferred) {
+        spin_lock(&ctx->lock);
+        vmm_free_user_space_tables(ctx->pml4);
         vmm_free_page_table(ctx->pml4_phys);
+        spin_unlock(&ctx->lock);
     }
 
-    spin_unlock(&ctx->lock);
-
+    vma_space_destroy(&ctx->vmas);
     kfree(ctx);
 
     spin_lock(&vmm_global_lock);
@@ -367,9 +857,28 @@ vmm_context_t* vmm_get_current_context(void) {
 void vmm_switch_context(vmm_context_t* ctx) {
     if (!ctx || !ctx->pml4_phys) return;
 
+    uint64_t rflags = cpu_get_flags();
+    cli();
+
+    // Without PCID the CR3 load itself flushes non-global entries
+    uint64_t cr3 = ctx->pml4_phys;
+    if (pcid_on) {
+        bool flush = vmm_pcid_assign(ctx);
+        if (ctx->tlb_stale) flush = true;
+        ctx->tlb_stale = false;
+
+        cr3 |= ctx->pcid & VMM_CR3_PCID_MASK;
+        if (!flush) cr3 |= VMM_CR3_NOFLUSH;
+    }
+
+    uint64_t self = 1ULL << vmm_this_cpu();
+    if (current_context && current_context != ctx) current_context->cpu_mask &= ~self;
+    ctx->cpu_mask |= self;
+
     current_context = ctx;
-    asm volatile("mov %0, %%cr3" : : "r"(ctx->pml4_phys) : "memory");
-    vmm_flush_tlb();
+    asm volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+
+    if (rflags & (1ULL << 9)) sti();
 }
 
 // ========== MEMORY MAPPING ==========
@@ -387,6 +896,8 @@ vmm_map_result_t vmm_map_page(vmm_context_t* ctx, uintptr_t virt_addr,
         return result;
     }
 
+    flags = vmm_leaf_global(virt_addr, flags);
+
     spin_lock(&ctx->lock);
 
     // We need to create page table for mapping
@@ -417,7 +928,7 @@ vmm_map_result_t vmm_map_page(vmm_context_t* ctx, uintptr_t virt_addr,
                   "Page already mapped (virt=0x%p: existing_phys=0x%p, new_phys=0x%p, existing_flags=0x%llx, new_flags=0x%llx)",
                   (void*)virt_addr, (void*)existing_phys, (void*)phys_addr,
                   (unsigned long long)existing_flags, (unsigned long long)flags);
-        kprintf("[VMM] %s\n", error_buf);
+        klog_warn(KLOG_VMM, "[VMM] %s\n", error_buf);
         result.error_msg = "Page already mapped with different address/flags";
         return result;
     }
@@ -426,25 +937,11 @@ vmm_map_result_t vmm_map_page(vmm_context_t* ctx, uintptr_t virt_addr,
     *pte = vmm_make_pte(phys_addr, flags);
 
     // Update statistics
-    ctx->mapped_pages++;
-    if (flags & VMM_FLAG_USER) {
-        ctx->user_pages++;
-        spin_lock(&vmm_global_lock);
-        global_stats.user_mapped_pages++;
-        global_stats.total_mapped_pages++;
-        spin_unlock(&vmm_global_lock);
-    } else {
-        ctx->kernel_pages++;
-        spin_lock(&vmm_global_lock);
-        global_stats.kernel_mapped_pages++;
-        global_stats.total_mapped_pages++;
-        spin_unlock(&vmm_global_lock);
-    }
+    vmm_stats_mapped(ctx, flags, 1, true);
 
     spin_unlock(&ctx->lock);
 
-    // Invalidate TLB for this page
-    vmm_flush_tlb_page(virt_addr);
+    // The entry was not present, so no TLB can hold it: nothing to flush
 
     result.success = true;
     result.virt_addr = virt_addr;
@@ -456,171 +953,357 @@ vmm_map_result_t vmm_map_page(vmm_context_t* ctx, uintptr_t virt_addr,
 
 vmm_map_result_t vmm_map_pages(vmm_context_t* ctx, uintptr_t virt_addr,
                                uintptr_t phys_addr, size_t page_count, uint64_t flags) {
-    vmm_map_result_t result = {0};
-    result.virt_addr = virt_addr;
-    result.phys_addr = phys_addr;
+    return vmm_map_range(ctx, virt_addr, phys_addr, page_count, flags);
+}
 
-    for (size_t i = 0; i < page_count; i++) {
-        vmm_map_result_t single_result = vmm_map_page(ctx,
-            virt_addr + i * VMM_PAGE_SIZE,
-            phys_addr + i * VMM_PAGE_SIZE,
-            flags);
-
-        if (!single_result.success) {
-            // Rollback previous mappings
-            for (size_t j = 0; j < i; j++) {
-                vmm_unmap_page(ctx, virt_addr + j * VMM_PAGE_SIZE);
+bool vmm_unmap_page(vmm_context_t* ctx, uintptr_t virt_addr) {
+    if (!ctx || !vmm_is_page_aligned(virt_addr)) return false;
+    return vmm_unmap_range(ctx, virt_addr, 1) == 1;
+}
+
+bool vmm_unmap_pages(vmm_context_t* ctx, uintptr_t virt_addr, size_t page_count) {
+    if (!ctx || !vmm_is_page_aligned(virt_addr)) return false;
+    return vmm_unmap_range(ctx, virt_addr, page_count) == page_count;
+}
+
+// ========== RANGE MAPPING ==========
+
+// Number of 4KB pages from addr to the next `span` boundary
+static inline size_t vmm_pages_to_boundary(uintptr_t addr, size_t span) {
+    return (span - (addr & (span - 1))) / VMM_PAGE_SIZE;
+}
+
+// Replace a 2MB leaf with a page table of 512 equivalent 4KB entries.
+// Caller holds ctx->lock and flushes the TLB for the affected range.
+static bool vmm_split_large_page(pte_t* pd_entry) {
+    uintptr_t pt_phys = vmm_alloc_page_table();
+    if (!pt_phys) return false;
+
+    page_table_t* pt = vmm_table_virt(pt_phys);
+    uintptr_t phys = vmm_leaf_to_phys(*pd_entry, VMM_LARGE_PAGE_SIZE);
+    uint64_t flags = vmm_pte_to_flags(*pd_entry) & ~VMM_FLAG_LARGE_PAGE;
+
+    for (size_t i = 0; i < VMM_PAGES_PER_LARGE; i++) {
+        pt->entries[i] = vmm_make_pte(phys + i * VMM_PAGE_SIZE, flags);
+    }
+
+    *pd_entry = vmm_make_pte(pt_phys, flags & (VMM_FLAG_PRESENT | VMM_FLAG_WRITABLE | VMM_FLAG_USER));
+    return true;
+}
+
+// Unmap a range; caller holds ctx->lock and flushes the TLB.
+// Walks each table once, drops whole large leaves covered by the range and
+// splits 2MB leaves covered partially. With a batch, the frames behind the
+// cleared entries are queued for release after the flush.
+// Returns the number of 4KB pages that were mapped and are now unmapped.
+static size_t vmm_unmap_range_locked(vmm_context_t* ctx, uintptr_t virt_addr, size_t page_count,
+                                     vmm_tlb_batch_t* free_batch) {
+    size_t done = 0;
+    size_t kernel_unmapped = 0;
+    size_t user_unmapped = 0;
+
+    while (done < page_count) {
+        uintptr_t v = virt_addr + done * VMM_PAGE_SIZE;
+        size_t remaining = page_count - done;
+
+        pte_t pml4_entry = ctx->pml4->entries[VMM_PML4_INDEX(v)];
+        if (!(pml4_entry & VMM_FLAG_PRESENT)) {
+            done += MIN(remaining, vmm_pages_to_boundary(v, 512 * VMM_HUGE_PAGE_SIZE));
+            continue;
+        }
+
+        page_table_t* pdpt = vmm_table_virt(vmm_pte_to_phys(pml4_entry));
+        pte_t* pdpt_entry = &pdpt->entries[VMM_PDPT_INDEX(v)];
+        if (!(*pdpt_entry & VMM_FLAG_PRESENT)) {
+            done += MIN(remaining, vmm_pages_to_boundary(v, VMM_HUGE_PAGE_SIZE));
+            continue;
+        }
+
+        if (*pdpt_entry & VMM_FLAG_LARGE_PAGE) {
+            size_t span = vmm_pages_to_boundary(v, VMM_HUGE_PAGE_SIZE);
+            if (IS_ALIGNED(v, VMM_HUGE_PAGE_SIZE) && remaining >= span) {
+                if (*pdpt_entry & VMM_FLAG_USER) user_unmapped += span;
+                else kernel_unmapped += span;
+                if (free_batch) {
+                    vmm_tlb_batch_free_frames(free_batch, vmm_leaf_to_phys(*pdpt_entry, VMM_HUGE_PAGE_SIZE), span);
+                }
+                *pdpt_entry = 0;
+            } else {
+                vmm_set_error("Cannot partially unmap a 1GB page");
+            }
+            done += MIN(remaining, span);
+            continue;
+        }
+
+        page_table_t* pd = vmm_table_virt(vmm_pte_to_phys(*pdpt_entry));
+        pte_t* pd_entry = &pd->entries[VMM_PD_INDEX(v)];
+        if (!(*pd_entry & VMM_FLAG_PRESENT)) {
+            done += MIN(remaining, vmm_pages_to_boundary(v, VMM_LARGE_PAGE_SIZE));
+            continue;
+        }
+
+        if (*pd_entry & VMM_FLAG_LARGE_PAGE) {
+            if (IS_ALIGNED(v, VMM_LARGE_PAGE_SIZE) && remaining >= VMM_PAGES_PER_LARGE) {
+                if (*pd_entry & VMM_FLAG_USER) user_unmapped += VMM_PAGES_PER_LARGE;
+                else kernel_unmapped += VMM_PAGES_PER_LARGE;
+                if (free_batch) {
+                    vmm_tlb_batch_free_frames(free_batch, vmm_leaf_to_phys(*pd_entry, VMM_LARGE_PAGE_SIZE),
+                                              VMM_PAGES_PER_LARGE);
+                }
+                *pd_entry = 0;
+                done += VMM_PAGES_PER_LARGE;
+                continue;
+            }
+
+            if (!vmm_split_large_page(pd_entry)) {
+                vmm_set_error("Failed to split large page");
+                done += MIN(remaining, vmm_pages_to_boundary(v, VMM_LARGE_PAGE_SIZE));
+                continue;
             }
-            result.error_msg = single_result.error_msg;
-            return result;
         }
 
-        result.pages_mapped++;
+        page_table_t* pt = vmm_table_virt(vmm_pte_to_phys(*pd_entry));
+        size_t index = VMM_PT_INDEX(v);
+        size_t count = MIN(VMM_PAGES_PER_LARGE - index, remaining);
+
+        for (size_t i = 0; i < count; i++) {
+            pte_t* pte = &pt->entries[index + i];
+            if (!(*pte & VMM_FLAG_PRESENT)) continue;
+
+            if (*pte & VMM_FLAG_USER) user_unmapped++;
+            else kernel_unmapped++;
+            if (free_batch) vmm_tlb_batch_free_frames(free_batch, vmm_pte_to_phys(*pte), 1);
+            *pte = 0;
+        }
+
+        done += count;
     }
 
-    result.success = true;
-    return result;
+    if (user_unmapped) vmm_stats_mapped(ctx, VMM_FLAG_USER, user_unmapped, false);
+    if (kernel_unmapped) vmm_stats_mapped(ctx, 0, kernel_unmapped, false);
+
+    return user_unmapped + kernel_unmapped;
 }
 
-bool vmm_unmap_page(vmm_context_t* ctx, uintptr_t virt_addr) {
-    if (!ctx || !vmm_is_page_aligned(virt_addr)) return false;
+size_t vmm_unmap_range(vmm_context_t* ctx, uintptr_t virt_addr, size_t page_count) {
+    if (!ctx || !ctx->pml4 || page_count == 0) return 0;
 
     spin_lock(&ctx->lock);
+    size_t unmapped = vmm_unmap_range_locked(ctx, virt_addr, page_count, NULL);
+    spin_unlock(&ctx->lock);
 
-    pte_t* pte = vmm_get_pte(ctx, virt_addr); // noalloc
-    if (!pte || !(*pte & VMM_FLAG_PRESENT)) {
-        spin_unlock(&ctx->lock);
-        return false;
+    vmm_flush_range(ctx, virt_addr, page_count);
+    return unmapped;
+}
+
+// One pass of vmm_map_range() over the range (ctx->lock held). With install
+// false it only creates the tables and looks for conflicting entries; with
+// install true it fills in every entry that is not present yet and counts
+// them. Returns NULL or the reason the range does not fit.
+static const char* vmm_map_range_pass(vmm_context_t* ctx, uintptr_t virt_addr, uintptr_t phys_addr,
+                                      size_t page_count, uint64_t pte_flags, bool install,
+                                      size_t* newly_mapped) {
+    size_t done = 0;
+
+    while (done < page_count) {
+        uintptr_t v = virt_addr + done * VMM_PAGE_SIZE;
+        uintptr_t p = phys_addr + done * VMM_PAGE_SIZE;
+        size_t remaining = page_count - done;
+
+        // Whole 2MB chunk with matching alignment: a single PD entry
+        if (remaining >= VMM_PAGES_PER_LARGE && IS_ALIGNED(v | p, VMM_LARGE_PAGE_SIZE)) {
+            page_table_t* pd = vmm_get_or_create_table(ctx, v, 2);
+            if (!pd) {
+                return "Failed to get/create page directory";
+            }
+
+            pte_t* pd_entry = &pd->entries[VMM_PD_INDEX(v)];
+            if (!(*pd_entry & VMM_FLAG_PRESENT)) {
+                if (install) {
+                    *pd_entry = (p & VMM_LARGE_ADDR_MASK) | pte_flags | VMM_FLAG_LARGE_PAGE;
+                    *newly_mapped += VMM_PAGES_PER_LARGE;
+                }
+                done += VMM_PAGES_PER_LARGE;
+                continue;
+            }
+            // A page table already exists here - fill it below
+        }
+
+        page_table_t* pt = vmm_get_or_create_table(ctx, v, 3);
+        if (!pt) {
+            return "Failed to get/create page table entry";
+        }
+
+        // The rest of this page table in one go
+        size_t index = VMM_PT_INDEX(v);
+        size_t count = MIN(VMM_PAGES_PER_LARGE - index, remaining);
+        pte_t* pte = &pt->entries[index];
+
+        for (size_t i = 0; i < count; i++) {
+            pte_t new_pte = vmm_make_pte(p + i * VMM_PAGE_SIZE, pte_flags);
+
+            if (pte[i] & VMM_FLAG_PRESENT) {
+                // Same mapping is fine, anything else is a conflict
+                if ((pte[i] & ~(VMM_FLAG_ACCESSED | VMM_FLAG_DIRTY)) != new_pte) {
+                    return "Page already mapped with different address/flags";
+                }
+                continue;
+            }
+
+            if (install) {
+                pte[i] = new_pte;
+                (*newly_mapped)++;
+            }
+        }
+
+        done += count;
     }
 
-    // Update statistics (only counts, do not free physical pages here)
-    uint64_t flags = vmm_pte_to_flags(*pte);
-    if (flags & VMM_FLAG_USER) {
-        if (ctx->user_pages > 0) ctx->user_pages--;
-        spin_lock(&vmm_global_lock);
-        if (global_stats.user_mapped_pages > 0) global_stats.user_mapped_pages--;
-        if (global_stats.total_mapped_pages > 0) global_stats.total_mapped_pages--;
-        spin_unlock(&vmm_global_lock);
-    } else {
-        if (ctx->kernel_pages > 0) ctx->kernel_pages--;
-        spin_lock(&vmm_global_lock);
-        if (global_stats.kernel_mapped_pages > 0) global_stats.kernel_mapped_pages--;
-        if (global_stats.total_mapped_pages > 0) global_stats.total_mapped_pages--;
-        spin_unlock(&vmm_global_lock);
+    return NULL;
+}
+
+vmm_map_result_t vmm_map_range(vmm_context_t* ctx, uintptr_t virt_addr,
+                               uintptr_t phys_addr, size_t page_count, uint64_t flags) {
+    vmm_map_result_t result = {0};
+    result.virt_addr = virt_addr;
+    result.phys_addr = phys_addr;
+
+    if (!ctx) {
+        result.error_msg = "Invalid context";
+        return result;
+    }
+
+    if (!vmm_is_page_aligned(virt_addr) || !vmm_is_page_aligned(phys_addr)) {
+        result.error_msg = "Address not page-aligned";
+        return result;
     }
 
-    if (ctx->mapped_pages > 0) ctx->mapped_pages--;
-
-    // Clear the PTE
-    *pte = 0;
+    uint64_t pte_flags = vmm_leaf_global(virt_addr, flags & VMM_PTE_FLAGS_MASK & ~VMM_FLAG_LARGE_PAGE);
+    size_t newly_mapped = 0;
 
-    spin_unlock(&ctx->lock);
+    spin_lock(&ctx->lock);
 
-    // Invalidate TLB
-    vmm_flush_tlb_page(virt_addr);
+    // Check the whole range before writing anything: a failure leaves the
+    // existing mappings as they were, so there is nothing to roll back.
+    // Tables created by the check stay in place (empty), as after an unmap.
+    const char* error = vmm_map_range_pass(ctx, virt_addr, phys_addr, page_count,
+                                           pte_flags, false, NULL);
+    if (error) {
+        spin_unlock(&ctx->lock);
+        result.error_msg = error;
+        vmm_set_error(error);
+        return result;
+    }
 
-    return true;
-}
+    // Every table is there now: this pass cannot fail
+    vmm_map_range_pass(ctx, virt_addr, phys_addr, page_count, pte_flags, true, &newly_mapped);
+    vmm_stats_mapped(ctx, flags, newly_mapped, true);
 
-bool vmm_unmap_pages(vmm_context_t* ctx, uintptr_t virt_addr, size_t page_count) {
-    bool success = true;
+    spin_unlock(&ctx->lock);
 
-    for (size_t i = 0; i < page_count; i++) {
-        if (!vmm_unmap_page(ctx, virt_addr + i * VMM_PAGE_SIZE)) {
-            success = false;
-        }
-    }
+    // Only not-present entries were filled in (x86 never caches those),
+    // so a successful map needs no TLB flush at all
 
-    return success;
+    result.success = true;
+    result.pages_mapped = page_count;
+    return result;
 }
 
 // ========== HIGH-LEVEL ALLOCATION ==========
-void* vmm_alloc_pages(vmm_context_t* ctx, size_t page_count, uint64_t flags) {
+static void* vmm_alloc_pages_kind(vmm_context_t* ctx, size_t page_count, uint64_t flags, uint32_t kind) {
     if (!ctx || page_count == 0) {
-        kprintf("[VMM] vmm_alloc_pages: invalid parameters (ctx=%p, count=%zu)\n", ctx, page_count);
+        klog_warn(KLOG_VMM, "[VMM] vmm_alloc_pages: invalid parameters (ctx=%p, count=%zu)\n", ctx, page_count);
         return NULL;
     }
 
-    kprintf("[VMM] vmm_alloc_pages: requesting %zu pages with flags 0x%llx\n", page_count, (unsigned long long)flags);
+    klog_debug(KLOG_VMM, "[VMM] vmm_alloc_pages: requesting %zu pages with flags 0x%llx\n", page_count, (unsigned long long)flags);
 
     // Allocate physical pages first (returns pointer to physical memory)
     void* phys_pages = pmm_alloc(page_count);
     if (!phys_pages) {
         vmm_set_error("Failed to allocate physical pages");
-        kprintf("[VMM] PMM allocation failed for %zu pages\n", page_count);
+        klog_error(KLOG_VMM, "[VMM] PMM allocation failed for %zu pages\n", page_count);
         return NULL;
     }
 
-    kprintf("[VMM] PMM allocated %zu pages at physical 0x%p\n", page_count, phys_pages);
+    klog_debug(KLOG_VMM, "[VMM] PMM allocated %zu pages at physical 0x%p\n", page_count, phys_pages);
 
     uintptr_t phys_base = (uintptr_t)phys_pages;
-    uintptr_t virt_base;
+    size_t size = vmm_pages_to_size(page_count);
+
+    // Large allocations: give virt the same 2MB offset as phys so the
+    // middle of the range can be mapped with 2MB entries
+    size_t align = VMM_PAGE_SIZE;
+    if (page_count >= VMM_PAGES_PER_LARGE) {
+        align = VMM_LARGE_PAGE_SIZE;
+    }
 
     // Find virtual address space
-    if (flags & VMM_FLAG_USER) {
-        virt_base = vmm_find_free_region(ctx, vmm_pages_to_size(page_count),
-                                         VMM_USER_BASE, VMM_USER_STACK_TOP);
-        if (!virt_base) {
-            pmm_free(phys_pages, page_count);
+    vma_space_t* vmas = (flags & VMM_FLAG_USER) ? &ctx->vmas : &kernel_heap_vmas;
+    uintptr_t virt_base = vma_alloc(vmas, size, vmas->base, vmas->limit,
+                                    align, phys_base, flags, kind);
+    if (!virt_base) {
+        pmm_free(phys_pages, page_count);
+        if (flags & VMM_FLAG_USER) {
             vmm_set_error("Failed to find user virtual address space");
-            kprintf("[VMM] Failed to find user virtual space for %zu pages\n", page_count);
-            return NULL;
-        }
-        kprintf("[VMM] Found user virtual space at 0x%p\n", (void*)virt_base);
-    } else {
-        // Kernel allocation - use simple sequential allocation
-        spin_lock(&kernel_heap_lock);
-        virt_base = kernel_heap_current;
-
-        kprintf("[VMM] Current kernel heap pointer: 0x%p\n", (void*)kernel_heap_current);
-        kprintf("[VMM] Kernel heap base: 0x%p\n", (void*)VMM_KERNEL_HEAP_BASE);
-        kprintf("[VMM] Kernel heap size: 0x%llx\n", (unsigned long long)VMM_KERNEL_HEAP_SIZE);
-
-        // Check if we have enough space (basic check)
-        if (virt_base + vmm_pages_to_size(page_count) > VMM_KERNEL_HEAP_BASE + VMM_KERNEL_HEAP_SIZE) {
-            spin_unlock(&kernel_heap_lock);
-            pmm_free(phys_pages, page_count);
+            klog_error(KLOG_VMM, "[VMM] Failed to find user virtual space for %zu pages\n", page_count);
+        } else {
             vmm_set_error("Kernel heap exhausted");
-            kprintf("[VMM] ERROR: Kernel heap exhausted! Current: 0x%p, need: 0x%llx, limit: 0x%p\n",
-                   (void*)virt_base, (unsigned long long)vmm_pages_to_size(page_count),
-                   (void*)(VMM_KERNEL_HEAP_BASE + VMM_KERNEL_HEAP_SIZE));
-            return NULL;
+            klog_error(KLOG_VMM, "[VMM] ERROR: Kernel heap exhausted! need: 0x%llx, areas: %zu\n",
+                   (unsigned long long)size, vmas->count);
         }
+        return NULL;
+    }
 
-        kernel_heap_current += vmm_pages_to_size(page_count);
-        spin_unlock(&kernel_heap_lock);
+    klog_debug(KLOG_VMM, "[VMM] Allocation: virt=0x%p, phys=0x%p, pages=%zu\n",
+           (void*)virt_base, (void*)phys_base, page_count);
 
-        kprintf("[VMM] Kernel allocation: virt=0x%p, phys=0x%p, pages=%zu\n",
-               (void*)virt_base, (void*)phys_base, page_count);
+    // Map the whole range at once (2MB entries where alignment allows)
+    vmm_map_result_t result = vmm_map_range(ctx, virt_base, phys_base, page_count, flags);
+    if (!result.success) {
+        klog_error(KLOG_VMM, "[VMM] ERROR: Failed to map %zu pages at virt=0x%p (phys=0x%p): %s\n",
+               page_count, (void*)virt_base, (void*)phys_base,
+               result.error_msg ? result.error_msg : "unknown error");
+        vma_unreserve(vmas, virt_base, size);
+        pmm_free(phys_pages, page_count);
+        vmm_set_error(result.error_msg);
+        return NULL;
     }
 
-    // Map the pages individually for better error handling
-    for (size_t i = 0; i < page_count; i++) {
-        uintptr_t virt_addr = virt_base + i * VMM_PAGE_SIZE;
-        uintptr_t phys_addr = phys_base + i * VMM_PAGE_SIZE;
+    klog_debug(KLOG_VMM, "[VMM] SUCCESS: Allocated %zu pages at virtual 0x%p\n", page_count, (void*)virt_base);
+    return (void*)virt_base;
+}
 
-        kprintf("[VMM] Mapping page %zu/%zu: virt=0x%p -> phys=0x%p\n",
-               i + 1, page_count, (void*)virt_addr, (void*)phys_addr);
+void* vmm_alloc_pages(vmm_context_t* ctx, size_t page_count, uint64_t flags) {
+    return vmm_alloc_pages_kind(ctx, page_count, flags, VMA_KIND_ANON);
+}
 
-        vmm_map_result_t result = vmm_map_page(ctx, virt_addr, phys_addr, flags);
+void* vmm_map_shared(vmm_context_t* ctx, uintptr_t phys_addr, size_t page_count, uint64_t flags) {
+    if (!ctx || page_count == 0 || !vmm_is_page_aligned(phys_addr) || !(flags & VMM_FLAG_USER)) {
+        vmm_set_error("vmm_map_shared: invalid parameters");
+        return NULL;
+    }
 
-        if (!result.success) {
-            kprintf("[VMM] ERROR: Failed to map page %zu/%zu (virt=0x%p, phys=0x%p): %s\n",
-                   i + 1, page_count, (void*)virt_addr, (void*)phys_addr,
-                   result.error_msg ? result.error_msg : "unknown error");
+    flags |= VMM_FLAG_SHARED;
+    size_t size = vmm_pages_to_size(page_count);
+    uintptr_t virt_base = vma_alloc(&ctx->vmas, size, ctx->vmas.base, ctx->vmas.limit,
+                                    VMM_PAGE_SIZE, 0, flags, VMA_KIND_SHARED);
+    if (!virt_base) {
+        vmm_set_error("Failed to find user virtual address space");
+        return NULL;
+    }
 
-            // Rollback previous mappings
-            for (size_t j = 0; j < i; j++) {
-                vmm_unmap_page(ctx, virt_base + j * VMM_PAGE_SIZE);
-            }
+    // The unmap path drops one reference per mapped frame
+    pmm_ref((void*)phys_addr, page_count);
 
-            pmm_free(phys_pages, page_count);
-            vmm_set_error(result.error_msg);
-            return NULL;
-        }
+    vmm_map_result_t result = vmm_map_range(ctx, virt_base, phys_addr, page_count, flags);
+    if (!result.success) {
+        pmm_free((void*)phys_addr, page_count);
+        vma_unreserve(&ctx->vmas, virt_base, size);
+        vmm_set_error(result.error_msg);
+        return NULL;
     }
 
-    kprintf("[VMM] SUCCESS: Allocated %zu pages at virtual 0x%p\n", page_count, (void*)virt_base);
     return (void*)virt_base;
 }
 
@@ -629,74 +1312,51 @@ void vmm_free_pages(vmm_context_t* ctx, void* virt_addr, size_t page_count) {
 
     uintptr_t virt_base = (uintptr_t)virt_addr;
 
-    // Collect physical addresses
-    uintptr_t* phys_addrs = kmalloc(page_count * sizeof(uintptr_t));
-    if (phys_addrs) {
-        for (size_t i = 0; i < page_count; i++) {
-            phys_addrs[i] = vmm_virt_to_phys(ctx, virt_base + i * VMM_PAGE_SIZE);
-        }
-    }
+    // One walk clears the entries and queues their frames; one flush; then
+    // the frames go back to the PMM (never before the TLB forgot them)
+    vmm_tlb_batch_t batch;
+    vmm_tlb_batch_begin(&batch, ctx);
+    vmm_tlb_batch_add(&batch, virt_base, page_count);
 
-    // Unmap virtual pages (does not free physical)
-    vmm_unmap_pages(ctx, virt_base, page_count);
+    spin_lock(&ctx->lock);
+    vmm_unmap_range_locked(ctx, virt_base, page_count, &batch);
+    spin_unlock(&ctx->lock);
 
-    // Free physical pages
-    if (phys_addrs) {
-        for (size_t i = 0; i < page_count; i++) {
-            if (phys_addrs[i]) {
-                pmm_free((void*)phys_addrs[i], 1);
-            }
-        }
-        kfree(phys_addrs);
-    }
+    vmm_tlb_batch_finish(&batch);
+
+    // Virtual range is free for reuse only once nothing maps it
+    vma_unreserve(vmm_vmas_for(ctx, virt_base), virt_base, vmm_pages_to_size(page_count));
 }
 
 // ========== KERNEL HEAP (vmalloc) ==========
 void* vmalloc(size_t size) {
     if (size == 0) {
-        kprintf("[VMM] vmalloc: size is 0\n");
+        klog_warn(KLOG_VMM, "[VMM] vmalloc: size is 0\n");
         return NULL;
     }
 
     if (!vmm_initialized) {
-        kprintf("[VMM] vmalloc: VMM not initialized\n");
+        klog_warn(KLOG_VMM, "[VMM] vmalloc: VMM not initialized\n");
         return NULL;
     }
 
     size_t page_count = vmm_size_to_pages(size);
-    kprintf("[VMM] vmalloc: requested %zu bytes (%zu pages)\n", size, page_count);
+    klog_debug(KLOG_VMM, "[VMM] vmalloc: requested %zu bytes (%zu pages)\n", size, page_count);
 
     vmm_context_t* ctx = vmm_get_current_context();
     if (!ctx) {
-        kprintf("[VMM] vmalloc: no current context\n");
+        klog_warn(KLOG_VMM, "[VMM] vmalloc: no current context\n");
         return NULL;
     }
 
-    void* virt = vmm_alloc_pages(ctx, page_count, VMM_FLAGS_KERNEL_RW);
+    // The area recorded in kernel_heap_vmas is what vfree() looks up later
+    void* virt = vmm_alloc_pages_kind(ctx, page_count, VMM_FLAGS_KERNEL_RW, VMA_KIND_VMALLOC);
     if (!virt) {
-        kprintf("[VMM] vmalloc FAILED: %s\n", vmm_get_last_error());
+        klog_error(KLOG_VMM, "[VMM] vmalloc FAILED: %s\n", vmm_get_last_error());
         return NULL;
     }
 
-    uintptr_t phys_first = vmm_virt_to_phys(ctx, (uintptr_t)virt);
-    kprintf("[VMM] vmalloc: allocated virt=%p phys=%p pages=%zu\n",
-            virt, (void*)phys_first, page_count);
-
-    // Register allocation for vfree
-    vmalloc_entry_t* ent = kmalloc(sizeof(vmalloc_entry_t));
-    if (ent) {
-        ent->virt_base = virt;
-        ent->pages = page_count;
-        spin_lock(&vmalloc_lock);
-        ent->next = vmalloc_list;
-        vmalloc_list = ent;
-        spin_unlock(&vmalloc_lock);
-        kprintf("[VMM] vmalloc: recorded allocation (%p, %zu pages)\n", virt, page_count);
-    } else {
-        kprintf("[VMM] vmalloc: WARNING: could not record allocation for vfree()\n");
-    }
-
-    kprintf("[VMM] vmalloc SUCCESS: %p (%zu pages)\n", virt, page_count);
+    klog_debug(KLOG_VMM, "[VMM] vmalloc SUCCESS: %p (%zu pages)\n", virt, page_count);
     return virt;
 }
 
@@ -709,48 +1369,90 @@ void* vzalloc(size_t size) {
     return addr;
 }
 
-void vfree(void* addr) {
-    if (!addr) {
-        kprintf("[VMM] vfree: null pointer, nothing to free\n");
-        return;
+// Claim guard + body + guard in the kernel heap and open up the body as an
+// area of `kind`. Returns the body, or 0.
+static uintptr_t vmm_reserve_guarded(size_t bytes, uint32_t kind) {
+    size_t guard = vmm_pages_to_size(VMM_STACK_GUARD_PAGES);
+
+    uintptr_t base = vma_alloc(&kernel_heap_vmas, bytes + 2 * guard,
+                               kernel_heap_vmas.base, kernel_heap_vmas.limit,
+                               VMM_PAGE_SIZE, 0, VMM_FLAGS_KERNEL_RW, VMA_KIND_GUARD);
+    if (!base) {
+        vmm_set_error("Kernel heap exhausted");
+        return 0;
+    }
+
+    if (!vma_set_kind(&kernel_heap_vmas, base + guard, bytes, kind)) {
+        vma_unreserve(&kernel_heap_vmas, base, bytes + 2 * guard);
+        vmm_set_error("Failed to record guarded area");
+        return 0;
     }
 
-    spin_lock(&vmalloc_lock);
-    vmalloc_entry_t* prev = NULL;
-    vmalloc_entry_t* cur = vmalloc_list;
+    return base + guard;
+}
 
-    while (cur) {
-        if (cur->virt_base == addr) {
-            // Found allocation
-            if (prev) prev->next = cur->next;
-            else vmalloc_list = cur->next;
-            spin_unlock(&vmalloc_lock);
+static void vmm_unreserve_guarded(uintptr_t body, size_t bytes) {
+    size_t guard = vmm_pages_to_size(VMM_STACK_GUARD_PAGES);
+    vma_unreserve(&kernel_heap_vmas, body - guard, bytes + 2 * guard);
+}
 
-            kprintf("[VMM] vfree: freeing allocation at %p (%zu pages)\n",
-                    addr, cur->pages);
+void* vmalloc_stack(size_t size) {
+    if (size == 0 || !vmm_initialized) {
+        klog_warn(KLOG_VMM, "[VMM] vmalloc_stack: invalid request (size=%zu)\n", size);
+        return NULL;
+    }
 
-            vmm_free_pages(vmm_get_current_context(), addr, cur->pages);
-            kfree(cur);
+    size_t page_count = vmm_size_to_pages(size);
+    size_t bytes = vmm_pages_to_size(page_count);
 
-            kprintf("[VMM] vfree: successfully freed %p\n", addr);
-            return;
-        }
-        prev = cur;
-        cur = cur->next;
+    void* phys_pages = pmm_alloc(page_count);
+    if (!phys_pages) {
+        vmm_set_error("Failed to allocate physical pages");
+        klog_error(KLOG_VMM, "[VMM] vmalloc_stack FAILED: no frames for %zu pages\n", page_count);
+        return NULL;
+    }
+
+    uintptr_t body = vmm_reserve_guarded(bytes, VMA_KIND_STACK);
+    if (!body) {
+        pmm_free(phys_pages, page_count);
+        klog_error(KLOG_VMM, "[VMM] vmalloc_stack FAILED: %s (%zu bytes)\n", vmm_get_last_error(), bytes);
+        return NULL;
     }
 
-    spin_unlock(&vmalloc_lock);
+    vmm_map_result_t result = vmm_map_range(kernel_context, body, (uintptr_t)phys_pages,
+                                            page_count, VMM_FLAGS_KERNEL_RW);
+    if (!result.success) {
+        vmm_unreserve_guarded(body, bytes);
+        pmm_free(phys_pages, page_count);
+        klog_error(KLOG_VMM, "[VMM] vmalloc_stack FAILED: %s\n", result.error_msg);
+        return NULL;
+    }
 
-    // Not found — fallback mode
-    kprintf("[VMM] vfree: allocation not found in list, fallback free at %p\n", addr);
+    return (void*)body;
+}
 
-    uintptr_t phys = vmm_virt_to_phys(vmm_get_current_context(), (uintptr_t)addr);
-    if (phys) {
-        kprintf("[VMM] vfree: unmapped single page virt=%p phys=%p\n", addr, (void*)phys);
-        vmm_unmap_page(vmm_get_current_context(), (uintptr_t)addr);
-        pmm_free((void*)phys, 1);
-    } else {
-        kprintf("[VMM] vfree: WARNING: could not resolve physical address for %p\n", addr);
+void vfree(void* addr) {
+    if (!addr) {
+        klog_debug(KLOG_VMM, "[VMM] vfree: null pointer, nothing to free\n");
+        return;
+    }
+
+    vma_t vma;
+    if (!vma_find(&kernel_heap_vmas, (uintptr_t)addr, &vma) || vma.start != (uintptr_t)addr ||
+        (vma.kind != VMA_KIND_VMALLOC && vma.kind != VMA_KIND_STACK)) {
+        klog_warn(KLOG_VMM, "[VMM] vfree: WARNING: %p is not a vmalloc allocation\n", addr);
+        return;
+    }
+
+    bool guarded = vma.kind == VMA_KIND_STACK;
+    size_t pages = vmm_size_to_pages(vma.end - vma.start);
+    klog_debug(KLOG_VMM, "[VMM] vfree: freeing allocation at %p (%zu pages)\n", addr, pages);
+
+    // Only frames that were actually touched are mapped (and freed)
+    vmm_free_pages(vmm_get_current_context(), addr, pages);
+
+    if (guarded) {
+        vmm_unreserve_guarded((uintptr_t)addr, vmm_pages_to_size(pages));
     }
 }
 
@@ -761,14 +1463,15 @@ uintptr_t vmm_virt_to_phys(vmm_context_t* ctx, uintptr_t virt_addr) {
 
     spin_lock(&ctx->lock);
 
-    pte_t* pte = vmm_get_pte(ctx, virt_addr); // noalloc
+    size_t page_size = 0;
+    pte_t* pte = vmm_get_leaf(ctx, virt_addr, &page_size); // noalloc
     if (!pte || !(*pte & VMM_FLAG_PRESENT)) {
         spin_unlock(&ctx->lock);
         return 0;
     }
 
-    uintptr_t phys_base = vmm_pte_to_phys(*pte);
-    uintptr_t offset = virt_addr & VMM_PAGE_OFFSET_MASK;
+    uintptr_t phys_base = vmm_leaf_to_phys(*pte, page_size);
+    uintptr_t offset = virt_addr & (page_size - 1);
 
     spin_unlock(&ctx->lock);
 
@@ -800,35 +1503,9 @@ uint64_t vmm_get_page_flags(vmm_context_t* ctx, uintptr_t virt_addr) {
 uintptr_t vmm_find_free_region(vmm_context_t* ctx, size_t size, uintptr_t start, uintptr_t end) {
     if (!ctx || size == 0 || start >= end) return 0;
 
-    size_t pages_needed = vmm_size_to_pages(size);
-    uintptr_t current = vmm_page_align_up(start);
-
-    while (current + vmm_pages_to_size(pages_needed) <= end) {
-        bool region_free = true;
-
-        // Check pages
-        for (size_t i = 0; i < pages_needed; i++) {
-            if (vmm_is_mapped(ctx, current + i * VMM_PAGE_SIZE)) {
-                region_free = false;
-                // skip past this mapped page
-                uintptr_t next = current + (i + 1) * VMM_PAGE_SIZE;
-
-                // Check for overflow and ensure we're making progress
-                if (next <= current || next >= end) {
-                    return 0;  // No free region found (overflow or out of bounds)
-                }
-
-                current = vmm_page_align_up(next);
-                break;
-            }
-        }
-
-        if (region_free) {
-            return current;
-        }
-    }
-
-    return 0;
+    // Gap index lookup instead of probing page tables page by page
+    return vma_find_gap(vmm_vmas_for(ctx, start), vmm_page_align_up(size),
+                        vmm_page_align_up(start), end, VMM_PAGE_SIZE, 0);
 }
 
 bool vmm_is_kernel_addr(uintptr_t addr) {
@@ -849,28 +1526,63 @@ bool vmm_protect(vmm_context_t* ctx, uintptr_t virt_addr, size_t size, uint64_t
     size_t page_count = vmm_size_to_pages(size);
     uintptr_t current_addr = vmm_page_align_down(virt_addr);
 
+    // Tracked ranges must be fully covered by areas; this rejects holes up
+    // front and keeps the recorded flags in sync. Untracked ranges (direct
+    // map, identity map) are handled by the table walk alone.
+    vma_space_t* vmas = vmm_vmas_for(ctx, current_addr);
+    if (vma_find(vmas, current_addr, NULL) &&
+        !vma_set_flags(vmas, current_addr, vmm_pages_to_size(page_count), new_flags)) {
+        vmm_set_error("vmm_protect: range crosses unallocated space");
+        return false;
+    }
+
+    // Ensure present bit remains set unless new_flags explicitly clears it
+    uint64_t flags_to_set = vmm_leaf_global(virt_addr, (new_flags & VMM_PTE_FLAGS_MASK) & ~VMM_FLAG_LARGE_PAGE);
+    if (!(flags_to_set & VMM_FLAG_PRESENT)) flags_to_set |= VMM_FLAG_PRESENT;
+
+    bool ok = true;
+    size_t done = 0;
+
     spin_lock(&ctx->lock);
 
-    for (size_t i = 0; i < page_count; i++) {
-        pte_t* pte = vmm_get_pte(ctx, current_addr); // noalloc
-        if (!pte || !(*pte & VMM_FLAG_PRESENT)) {
-            spin_unlock(&ctx->lock);
-            return false;
+    while (done < page_count) {
+        uintptr_t addr = current_addr + done * VMM_PAGE_SIZE;
+        size_t page_size = 0;
+        pte_t* pte = vmm_get_leaf(ctx, addr, &page_size); // noalloc
+        if (!pte || !(*pte & VMM_FLAG_PRESENT) || page_size == VMM_HUGE_PAGE_SIZE) {
+            ok = false;
+            break;
         }
 
-        // Update flags while preserving physical address
-        uintptr_t phys_addr = vmm_pte_to_phys(*pte);
-        // Ensure present bit remains set unless new_flags explicitly clears it
-        uint64_t flags_to_set = (new_flags & VMM_PTE_FLAGS_MASK);
-        if (!(flags_to_set & VMM_FLAG_PRESENT)) flags_to_set |= VMM_FLAG_PRESENT;
-        *pte = vmm_make_pte(phys_addr, flags_to_set);
+        // Shared pages stay read-only; the write fault makes them writable
+        uint64_t leaf_flags = flags_to_set;
+        if (*pte & VMM_FLAG_COW) {
+            leaf_flags = (leaf_flags & ~VMM_FLAG_WRITABLE) | VMM_FLAG_COW;
+        }
+
+        if (page_size == VMM_LARGE_PAGE_SIZE) {
+            // Whole 2MB leaf covered: update it in place, otherwise split it
+            if (IS_ALIGNED(addr, VMM_LARGE_PAGE_SIZE) && page_count - done >= VMM_PAGES_PER_LARGE) {
+                *pte = vmm_leaf_to_phys(*pte, VMM_LARGE_PAGE_SIZE) | leaf_flags | VMM_FLAG_LARGE_PAGE;
+                done += VMM_PAGES_PER_LARGE;
+                continue;
+            }
+            if (!vmm_split_large_page(pte)) {
+                ok = false;
+                break;
+            }
+            continue;
+        }
 
-        vmm_flush_tlb_page(current_addr);
-        current_addr += VMM_PAGE_SIZE;
+        // Update flags while preserving physical address
+        *pte = vmm_make_pte(vmm_pte_to_phys(*pte), leaf_flags);
+        done++;
     }
 
     spin_unlock(&ctx->lock);
-    return true;
+
+    vmm_flush_range(ctx, current_addr, done);
+    return ok;
 }
 
 bool vmm_reserve_region(vmm_context_t* ctx, uintptr_t start, size_t size, uint64_t flags) {
@@ -879,9 +1591,21 @@ bool vmm_reserve_region(vmm_context_t* ctx, uintptr_t start, size_t size, uint64
     size_t page_count = vmm_size_to_pages(size);
     uintptr_t virt_base = vmm_page_align_down(start);
 
+    // Claim the range first so concurrent allocations cannot land on it
+    vma_space_t* vmas = vmm_vmas_for(ctx, virt_base);
+    bool tracked = virt_base >= vmas->base && virt_base < vmas->limit;
+    if (tracked && !vma_insert(vmas, virt_base, vmm_pages_to_size(page_count),
+                               flags, VMA_KIND_RESERVED)) {
+        vmm_set_error("vmm_reserve_region: range overlaps an existing area");
+        return false;
+    }
+
     // Allocate physical pages
     void* phys_pages = pmm_alloc(page_count);
-    if (!phys_pages) return false;
+    if (!phys_pages) {
+        if (tracked) vma_unreserve(vmas, virt_base, vmm_pages_to_size(page_count));
+        return false;
+    }
 
     // Map the region
     vmm_map_result_t result = vmm_map_pages(ctx, virt_base, (uintptr_t)phys_pages,
@@ -889,24 +1613,86 @@ bool vmm_reserve_region(vmm_context_t* ctx, uintptr_t start, size_t size, uint64
 
     if (!result.success) {
         pmm_free(phys_pages, page_count);
+        if (tracked) vma_unreserve(vmas, virt_base, vmm_pages_to_size(page_count));
         return false;
     }
 
     return true;
 }
 
+// ========== LARGE PAGE MAPPINGS ==========
+
+// 1GB pages supported (pdpe1gb)
+static bool vmm_cpu_has_huge_pages(void) {
+    return cpu_has(CPU_FEAT_PDPE1GB);
+}
+
+// Map [virt, virt + size) -> [phys, phys + size) with large leaf entries:
+// 1GB PDPT entries where allowed and both sides are 1GB aligned, 2MB PD
+// entries otherwise. virt, phys and size must be 2MB aligned.
+// Stops at the first failure or already present entry.
+// Returns the number of bytes mapped.
+static size_t vmm_map_large_range(vmm_context_t* ctx, uintptr_t virt, uintptr_t phys,
+                                  size_t size, uint64_t flags, bool allow_huge) {
+    if (!ctx || !IS_ALIGNED(virt | phys | size, VMM_LARGE_PAGE_SIZE)) {
+        vmm_set_error("Large mapping not 2MB aligned");
+        return 0;
+    }
+
+    uint64_t leaf_flags = vmm_leaf_global(virt, flags & VMM_PTE_FLAGS_MASK) | VMM_FLAG_LARGE_PAGE;
+    size_t mapped = 0;
+
+    spin_lock(&ctx->lock);
+
+    while (mapped < size) {
+        uintptr_t v = virt + mapped;
+        uintptr_t p = phys + mapped;
+        size_t remaining = size - mapped;
+
+        if (allow_huge && remaining >= VMM_HUGE_PAGE_SIZE &&
+            IS_ALIGNED(v | p, VMM_HUGE_PAGE_SIZE)) {
+            page_table_t* pdpt = vmm_get_or_create_table(ctx, v, 1);
+            if (!pdpt) break;
+
+            pte_t* entry = &pdpt->entries[VMM_PDPT_INDEX(v)];
+            if (*entry & VMM_FLAG_PRESENT) break;
+
+            *entry = (p & VMM_HUGE_ADDR_MASK) | leaf_flags;
+            mapped += VMM_HUGE_PAGE_SIZE;
+            continue;
+        }
+
+        page_table_t* pd = vmm_get_or_create_table(ctx, v, 2);
+        if (!pd) break;
+
+        pte_t* entry = &pd->entries[VMM_PD_INDEX(v)];
+        if (*entry & VMM_FLAG_PRESENT) break;
+
+        *entry = (p & VMM_LARGE_ADDR_MASK) | leaf_flags;
+        mapped += VMM_LARGE_PAGE_SIZE;
+    }
+
+    vmm_stats_mapped(ctx, flags, mapped / VMM_PAGE_SIZE, true);
+
+    spin_unlock(&ctx->lock);
+
+    return mapped;
+}
+
 // ========== INITIALIZATION ==========
 void vmm_init(void) {
     if (vmm_initialized) {
-        kprintf("[VMM] Already initialized!\n");
+        klog_warn(KLOG_VMM, "[VMM] Already initialized!\n");
         return;
     }
 
-    kprintf("[VMM] Initializing Virtual Memory Manager...\n");
+    klog_info(KLOG_VMM, "[VMM] Initializing Virtual Memory Manager...\n");
 
     spinlock_init(&vmm_global_lock);
-    spinlock_init(&kernel_heap_lock);
-    spinlock_init(&vmalloc_lock);
+    spinlock_init(&tlb_shootdown_lock);
+    spinlock_init(&pt_cache_lock);
+    vma_space_init(&kernel_heap_vmas, VMM_KERNEL_HEAP_BASE,
+                   VMM_KERNEL_HEAP_BASE + VMM_KERNEL_HEAP_SIZE);
 
     // Create kernel context
     kernel_context = vmm_create_context();
@@ -914,8 +1700,8 @@ void vmm_init(void) {
         panic("Failed to create kernel VMM context");
     }
 
-    kprintf("[VMM] Kernel context created at %p\n", kernel_context);
-    kprintf("[VMM] PML4 physical address: 0x%p\n", (void*)kernel_context->pml4_phys);
+    klog_debug(KLOG_VMM, "[VMM] Kernel context created at %p\n", kernel_context);
+    klog_debug(KLOG_VMM, "[VMM] PML4 physical address: 0x%p\n", (void*)kernel_context->pml4_phys);
 
     // ========== CRITICAL: Set up higher-half direct mapping ==========
     // Map ALL physical memory to higher-half (0xFFFF888000000000+)
@@ -928,7 +1714,7 @@ void vmm_init(void) {
     //
     // This replaces the fragile identity mapping approach.
 
-    kprintf("[VMM] Setting up higher-half direct mapping (0x%p)...\n",
+    klog_debug(KLOG_VMM, "[VMM] Setting up higher-half direct mapping (0x%p)...\n",
             (void*)VMM_PHYS_MAP_BASE);
 
     // Determine how much physical memory to map
@@ -939,52 +1725,38 @@ void vmm_init(void) {
         phys_to_map = VMM_PHYS_MAP_SIZE;
     }
 
-    kprintf("[VMM] Physical memory detected: %zu MB\n", total_phys_mem / (1024 * 1024));
-    kprintf("[VMM] Mapping %zu MB to higher-half...\n", phys_to_map / (1024 * 1024));
+    klog_info(KLOG_VMM, "[VMM] Physical memory detected: %zu MB\n", total_phys_mem / (1024 * 1024));
+    klog_debug(KLOG_VMM, "[VMM] Mapping %zu MB to higher-half...\n", phys_to_map / (1024 * 1024));
 
-    size_t direct_map_pages = 0;
-    size_t failed_pages = 0;
+    // Map the direct map with large pages: 1GB leaves where the CPU supports
+    // them (pdpe1gb), 2MB leaves otherwise. Round up to a whole 2MB page.
+    bool huge_pages = vmm_cpu_has_huge_pages();
+    phys_to_map = ALIGN_UP(phys_to_map, VMM_LARGE_PAGE_SIZE);
 
-    // Map physical memory to higher-half
-    for (uintptr_t phys = 0; phys < phys_to_map; phys += VMM_PAGE_SIZE) {
-        uintptr_t virt = VMM_PHYS_MAP_BASE + phys;
-        vmm_map_result_t result = vmm_map_page(kernel_context, virt, phys, VMM_FLAGS_KERNEL_RW);
+    size_t direct_mapped = vmm_map_large_range(kernel_context, VMM_PHYS_MAP_BASE, 0,
+                                               phys_to_map, VMM_FLAGS_KERNEL_RW, huge_pages);
 
-        if (result.success) {
-            direct_map_pages++;
-        } else {
-            failed_pages++;
-            // Only warn for first 16MB (critical region)
-            if (phys < 0x1000000) {
-                kprintf("[VMM] WARNING: Failed to map phys 0x%p → virt 0x%p: %s\n",
-                       (void*)phys, (void*)virt, result.error_msg);
-            }
+    klog_info(KLOG_VMM, "[VMM] Higher-half direct mapping complete!\n");
+    klog_info(KLOG_VMM, "[VMM]   Mapped: %zu MB using %s pages\n",
+           direct_mapped / (1024 * 1024), huge_pages ? "1GB" : "2MB");
+    if (direct_mapped < phys_to_map) {
+        klog_error(KLOG_VMM, "[VMM]   Failed: %zu MB\n", (phys_to_map - direct_mapped) / (1024 * 1024));
+        if (direct_mapped < 0x1000000) {
+            panic("Failed to map the critical region of the direct map");
         }
     }
 
-    kprintf("[VMM] Higher-half direct mapping complete!\n");
-    kprintf("[VMM]   Mapped: %zu pages (%zu MB)\n",
-           direct_map_pages, (direct_map_pages * VMM_PAGE_SIZE) / (1024 * 1024));
-    if (failed_pages > 0) {
-        kprintf("[VMM]   Failed: %zu pages\n", failed_pages);
-    }
-
     // Also keep identity mapping for first 16MB for bootstrap compatibility
-    kprintf("[VMM] Setting up identity mapping for first 16MB (bootstrap)...\n");
-    size_t identity_pages = 0;
-    for (uintptr_t addr = 0; addr < 0x1000000; addr += VMM_PAGE_SIZE) { // 16MB
-        vmm_map_result_t result = vmm_map_page(kernel_context, addr, addr, VMM_FLAGS_KERNEL_RW);
-        if (result.success) {
-            identity_pages++;
-        }
-    }
-    kprintf("[VMM] Identity mapped %zu pages for bootstrap\n", identity_pages);
+    klog_debug(KLOG_VMM, "[VMM] Setting up identity mapping for first 16MB (bootstrap)...\n");
+    size_t identity_mapped = vmm_map_large_range(kernel_context, 0, 0, 0x1000000,
+                                                 VMM_FLAGS_KERNEL_RW, false);
+    klog_info(KLOG_VMM, "[VMM] Identity mapped %zu MB for bootstrap\n", identity_mapped / (1024 * 1024));
 
-    kprintf("[VMM] Kernel heap will be mapped on demand starting at 0x%p\n",
+    klog_debug(KLOG_VMM, "[VMM] Kernel heap will be mapped on demand starting at 0x%p\n",
            (void*)VMM_KERNEL_HEAP_BASE);
 
     // Test identity mapping by writing & reading known physical address (1MB mark)
-    kprintf("[VMM] Testing identity mapping...\n");
+    klog_debug(KLOG_VMM, "[VMM] Testing identity mapping...\n");
     volatile uint32_t* test_ptr = (volatile uint32_t*)0x100000; // 1MB
     uint32_t old_value = *test_ptr;
     *test_ptr = 0xDEADBEEF;
@@ -992,11 +1764,19 @@ void vmm_init(void) {
         panic("Identity mapping test failed");
     }
     *test_ptr = old_value; // Restore
-    kprintf("[VMM] Identity mapping test: PASSED\n");
+    klog_debug(KLOG_VMM, "[VMM] Identity mapping test: PASSED\n");
 
     // Switch to our new page tables
     current_context = kernel_context;
     vmm_switch_context(kernel_context);
+    vmm_write_cr4(vmm_read_cr4() | CR4_PGE);   // Kernel-half leaves are global
+    vmm_pcid_init();
+
+    // Supervisor writes must honour read-only entries too, otherwise a
+    // kernel copy into a COW page would write straight through the share
+    uint64_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    asm volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_WP) : "memory");
 
     // Test that we can still access memory after switch
     *test_ptr = 0xCAFEBABE;
@@ -1007,16 +1787,16 @@ void vmm_init(void) {
 
     vmm_initialized = true;
 
-    kprintf("[VMM] Virtual memory layout:\n");
-    kprintf("[VMM]   Kernel base:      0x%p\n", (void*)VMM_KERNEL_BASE);
-    kprintf("[VMM]   Kernel heap:      0x%p - 0x%p (on-demand)\n",
+    klog_info(KLOG_VMM, "[VMM] Virtual memory layout:\n");
+    klog_info(KLOG_VMM, "[VMM]   Kernel base:      0x%p\n", (void*)VMM_KERNEL_BASE);
+    klog_info(KLOG_VMM, "[VMM]   Kernel heap:      0x%p - 0x%p (on-demand)\n",
            (void*)VMM_KERNEL_HEAP_BASE,
            (void*)(VMM_KERNEL_HEAP_BASE + VMM_KERNEL_HEAP_SIZE));
-    kprintf("[VMM]   User base:        0x%p\n", (void*)VMM_USER_BASE);
-    kprintf("[VMM]   User heap:        0x%p\n", (void*)VMM_USER_HEAP_BASE);
-    kprintf("[VMM]   User stack top:   0x%p\n", (void*)VMM_USER_STACK_TOP);
+    klog_info(KLOG_VMM, "[VMM]   User base:        0x%p\n", (void*)VMM_USER_BASE);
+    klog_info(KLOG_VMM, "[VMM]   User heap:        0x%p\n", (void*)VMM_USER_HEAP_BASE);
+    klog_info(KLOG_VMM, "[VMM]   User stack top:   0x%p\n", (void*)VMM_USER_STACK_TOP);
 
-    kprintf("[VMM] %[S]Virtual Memory Manager initialized successfully!%[D]\n");
+    klog_info(KLOG_VMM, "[VMM] %[S]Virtual Memory Manager initialized successfully!%[D]\n");
 }
 
 // ========== DEBUGGING & STATISTICS ==========
@@ -1057,6 +1837,14 @@ void vmm_dump_page_tables(vmm_context_t* ctx, uintptr_t virt_addr) {
         return;
     }
 
+    // If PDPT entry is a huge page, no PD
+    if (pdpt_entry & VMM_FLAG_LARGE_PAGE) {
+        kprintf("[VMM]   PDPT entry is a huge page (1GB). Physical: 0x%p\n",
+               (void*)vmm_leaf_to_phys(pdpt_entry, VMM_HUGE_PAGE_SIZE));
+        spin_unlock(&ctx->lock);
+        return;
+    }
+
     page_table_t* pd = (page_table_t*)vmm_phys_to_virt(vmm_pte_to_phys(pdpt_entry));
     pte_t pd_entry = pd->entries[VMM_PD_INDEX(virt_addr)];
     kprintf("[VMM]   PD entry:   0x%016llx (present: %s)\n",
@@ -1069,7 +1857,8 @@ void vmm_dump_page_tables(vmm_context_t* ctx, uintptr_t virt_addr) {
 
     // If PD entry is large page, no PT
     if (pd_entry & VMM_FLAG_LARGE_PAGE) {
-        kprintf("[VMM]   PD entry is a large page (2MB). Physical: 0x%p\n", (void*)vmm_pte_to_phys(pd_entry));
+        kprintf("[VMM]   PD entry is a large page (2MB). Physical: 0x%p\n",
+               (void*)vmm_leaf_to_phys(pd_entry, VMM_LARGE_PAGE_SIZE));
         spin_unlock(&ctx->lock);
         return;
     }
@@ -1135,8 +1924,13 @@ void vmm_print_stats(void) {
     kprintf("[VMM]   Page tables allocated: %zu (%zu KB)\n",
            stats.page_tables_allocated,
            (stats.page_tables_allocated * VMM_PAGE_SIZE) / 1024);
+    kprintf("[VMM]   Page-table cache:      %zu ready, %zu to reclaim, %zu dead contexts\n",
+            pt_cache_count, pt_reclaim_count, zombie_count);
     kprintf("[VMM]   Page faults handled:   %zu\n", stats.page_faults_handled);
+    kprintf("[VMM]   COW copies:            %zu\n", stats.cow_copies);
     kprintf("[VMM]   TLB flushes:           %zu\n", stats.tlb_flushes);
+    kprintf("[VMM]   PCID:                  %s (generation %llu)\n",
+            pcid_on ? "on" : "off", (unsigned long long)pcid_generation);
 }
 
 // ========== BASIC TESTING ==========
@@ -1246,6 +2040,75 @@ void vmm_test_basic(void) {
 #define PF_RESERVED  (1 << 3)  // 1 = reserved bit set in page table
 #define PF_INSTR     (1 << 4)  // 1 = instruction fetch
 
+// Write to a COW page: copy the frame unless this is the last reference,
+// in which case the page simply becomes writable again
+static bool vmm_cow_fault(vmm_context_t* ctx, uintptr_t page_addr) {
+    spin_lock(&ctx->lock);
+
+    size_t page_size = 0;
+    pte_t* pte = vmm_get_pte_noalloc(ctx, page_addr, &page_size);
+    if (!pte || !(*pte & VMM_FLAG_COW)) {
+        // Resolved by someone else in the meantime: just retry the access
+        spin_unlock(&ctx->lock);
+        return true;
+    }
+
+    if (page_size == VMM_HUGE_PAGE_SIZE) {
+        spin_unlock(&ctx->lock);
+        klog_error(KLOG_VMM, "[VMM] ERROR: Copy-on-write of a 1GB page is not supported\n");
+        return false;
+    }
+
+    uintptr_t flush_addr = page_addr;
+    size_t flush_pages = 1;
+
+    // A shared 2MB leaf is split first: each 4KB frame in it holds its own
+    // reference, so only the page being written gets copied
+    if (page_size == VMM_LARGE_PAGE_SIZE) {
+        if (!vmm_split_large_page(pte)) {
+            spin_unlock(&ctx->lock);
+            klog_error(KLOG_VMM, "[VMM] ERROR: Failed to split shared 2MB page\n");
+            return false;
+        }
+        *pte |= VMM_FLAG_WRITABLE;   // Leaves below decide
+
+        flush_addr = ALIGN_DOWN(page_addr, VMM_LARGE_PAGE_SIZE);
+        flush_pages = VMM_PAGES_PER_LARGE;
+        pte = vmm_get_pte_noalloc(ctx, page_addr, &page_size);
+    }
+
+    uintptr_t old_phys = vmm_pte_to_phys(*pte);
+    uint64_t flags = (vmm_pte_to_flags(*pte) & ~VMM_FLAG_COW) | VMM_FLAG_WRITABLE;
+    bool copied = false;
+
+    if (pmm_refcount((void*)old_phys) > 1) {
+        void* copy = pmm_alloc(1);
+        if (!copy) {
+            spin_unlock(&ctx->lock);
+            klog_error(KLOG_VMM, "[VMM] ERROR: Failed to allocate page for copy-on-write\n");
+            return false;
+        }
+
+        memcpy(vmm_phys_to_virt((uintptr_t)copy), vmm_phys_to_virt(old_phys), VMM_PAGE_SIZE);
+        *pte = vmm_make_pte((uintptr_t)copy, flags);
+        pmm_free((void*)old_phys, 1);   // Drop this context's reference
+        copied = true;
+    } else {
+        *pte = vmm_make_pte(old_phys, flags);
+    }
+
+    spin_unlock(&ctx->lock);
+
+    // The read-only entry may be cached
+    vmm_flush_range(ctx, flush_addr, flush_pages);
+
+    spin_lock(&vmm_global_lock);
+    global_stats.page_faults_handled++;
+    if (copied) global_stats.cow_copies++;
+    spin_unlock(&vmm_global_lock);
+    return true;
+}
+
 int vmm_handle_page_fault(uintptr_t fault_addr, uint64_t error_code) {
     // Analyze fault
     bool present = error_code & PF_PRESENT;
@@ -1254,87 +2117,157 @@ int vmm_handle_page_fault(uintptr_t fault_addr, uint64_t error_code) {
     bool reserved = error_code & PF_RESERVED;
     bool instr_fetch = error_code & PF_INSTR;
 
-    kprintf("[VMM] Page fault at 0x%llx (error=0x%llx)\n", fault_addr, error_code);
-    kprintf("[VMM]   present=%d write=%d user=%d reserved=%d instr=%d\n",
+    klog_debug(KLOG_VMM, "[VMM] Page fault at 0x%llx (error=0x%llx)\n", fault_addr, error_code);
+    klog_debug(KLOG_VMM, "[VMM]   present=%d write=%d user=%d reserved=%d instr=%d\n",
             present, write, user, reserved, instr_fetch);
 
     // Reserved bit violations are always fatal
     if (reserved) {
-        kprintf("[VMM] ERROR: Reserved bit violation - cannot handle\n");
+        klog_error(KLOG_VMM, "[VMM] ERROR: Reserved bit violation - cannot handle\n");
         return -1;
     }
 
+    vmm_context_t* ctx = vmm_get_current_context();
+
+    // Align fault address to page boundary
+    uintptr_t page_addr = fault_addr & ~(VMM_PAGE_SIZE - 1);
+
+    // Write to a page shared by a clone
+    if (present && write) {
+        pte_t* leaf = vmm_get_leaf(ctx, page_addr, NULL);
+        if (leaf && (*leaf & VMM_FLAG_COW)) {
+            if (!vmm_cow_fault(ctx, page_addr)) return -1;
+            klog_trace(KLOG_VMM, "[VMM] Copy-on-write at 0x%llx\n", page_addr);
+            return 0;
+        }
+    }
+
     // If page is present, it's a protection fault
     if (present) {
-        kprintf("[VMM] ERROR: Protection fault - access denied\n");
+        klog_error(KLOG_VMM, "[VMM] ERROR: Protection fault - access denied\n");
         return -1;
     }
 
     // Page not present - demand paging
-    kprintf("[VMM] Page not present - attempting demand paging\n");
+    klog_debug(KLOG_VMM, "[VMM] Page not present - attempting demand paging\n");
 
-    // Get kernel context
-    vmm_context_t* ctx = kernel_context;
+    // Guard pages and anything else in the kernel heap that is not backed
+    // by an area are real bugs: heap memory is always mapped up front
+    vma_t vma;
+    bool in_area = vma_find(vmm_vmas_for(ctx, page_addr), page_addr, &vma);
 
-    // Align fault address to page boundary
-    uintptr_t page_addr = fault_addr & ~(VMM_PAGE_SIZE - 1);
+    if (in_area && vma.kind == VMA_KIND_GUARD) {
+        klog_error(KLOG_VMM, "[VMM] ERROR: Guard page hit at 0x%llx (overflow?)\n", fault_addr);
+        return -1;
+    }
 
-    // Check if this is in kernel heap range (higher half)
     if (page_addr >= VMM_KERNEL_HEAP_BASE &&
         page_addr < VMM_KERNEL_HEAP_BASE + VMM_KERNEL_HEAP_SIZE) {
+        klog_error(KLOG_VMM, "[VMM] ERROR: Kernel heap fault outside any area (0x%llx)\n", fault_addr);
+        return -1;
+    }
 
-        kprintf("[VMM] Demand paging: mapping kernel heap page at 0x%llx\n", page_addr);
+    // Check if this is in low memory (0-256MB) for kernel data/heap fallback
+    if (page_addr < (256ULL * 1024 * 1024)) {
+        klog_debug(KLOG_VMM, "[VMM] Demand paging: mapping low memory page at 0x%llx\n", page_addr);
 
         // Allocate physical page
         void* phys_page = pmm_alloc(1);
         if (!phys_page) {
-            kprintf("[VMM] ERROR: Failed to allocate physical page\n");
+            klog_error(KLOG_VMM, "[VMM] ERROR: Failed to allocate physical page\n");
             return -1;
         }
 
-        // Map the page
+        // Map the page (kernel mode, writable)
         uint64_t flags = VMM_FLAG_PRESENT | VMM_FLAG_WRITABLE;
-        if (user) {
-            flags |= VMM_FLAG_USER;
-        }
 
-        vmm_map_result_t result = vmm_map_page(ctx, page_addr, (uintptr_t)phys_page, flags);
+        vmm_map_result_t result = vmm_map_page(kernel_context, page_addr, (uintptr_t)phys_page, flags);
         if (!result.success) {
-            kprintf("[VMM] ERROR: Failed to map page\n");
+            klog_error(KLOG_VMM, "[VMM] ERROR: Failed to map page\n");
             pmm_free(phys_page, 1);
             return -1;
         }
 
-        kprintf("[VMM] SUCCESS: Demand paging successful\n");
+        klog_debug(KLOG_VMM, "[VMM] SUCCESS: Low memory page mapped\n");
         return 0;  // Handled successfully
     }
 
-    // Check if this is in low memory (0-256MB) for kernel data/heap fallback
-    if (page_addr < (256ULL * 1024 * 1024)) {
-        kprintf("[VMM] Demand paging: mapping low memory page at 0x%llx\n", page_addr);
+    // Not in a valid range
+    klog_error(KLOG_VMM, "[VMM] ERROR: Fault address not in valid range (0x%llx)\n", fault_addr);
+    return -1;  // Cannot handle
+}
 
-        // Allocate physical page
-        void* phys_page = pmm_alloc(1);
-        if (!phys_page) {
-            kprintf("[VMM] ERROR: Failed to allocate physical page\n");
-            return -1;
+// ========== COPY THROUGH ANOTHER CONTEXT ==========
+
+// Direct-map pointer to virt in ctx, or NULL when the access would fault
+// for the owner of ctx. Outside the kernel context only user pages count.
+// COW pages are resolved the way a write fault would.
+static uint8_t* vmm_context_page(vmm_context_t* ctx, uintptr_t virt, bool write) {
+    uintptr_t page_addr = virt & ~(VMM_PAGE_SIZE - 1);
+
+    // One pass to look, one more after resolving COW
+    for (int attempt = 0; attempt < 2; attempt++) {
+        spin_lock(&ctx->lock);
+
+        size_t page_size = 0;
+        pte_t* pte = vmm_get_leaf(ctx, virt, &page_size);
+        pte_t entry = pte ? *pte : 0;
+
+        if (entry & VMM_FLAG_PRESENT) {
+            bool user_ok = ctx == kernel_context || (entry & VMM_FLAG_USER);
+            bool write_ok = !write || (entry & VMM_FLAG_WRITABLE);
+            if (user_ok && write_ok) {
+                uintptr_t phys = vmm_leaf_to_phys(entry, page_size) + (virt & (page_size - 1));
+                spin_unlock(&ctx->lock);
+                return (uint8_t*)vmm_phys_to_virt(phys);
+            }
+            spin_unlock(&ctx->lock);
+
+            if (!user_ok || !write || !(entry & VMM_FLAG_COW)) return NULL;
+            if (!vmm_cow_fault(ctx, page_addr)) return NULL;
+            continue;
         }
 
-        // Map the page (kernel mode, writable)
-        uint64_t flags = VMM_FLAG_PRESENT | VMM_FLAG_WRITABLE;
+        spin_unlock(&ctx->lock);
+        return NULL;
+    }
 
-        vmm_map_result_t result = vmm_map_page(ctx, page_addr, (uintptr_t)phys_page, flags);
-        if (!result.success) {
-            kprintf("[VMM] ERROR: Failed to map page\n");
-            pmm_free(phys_page, 1);
-            return -1;
-        }
+    return NULL;
+}
 
-        kprintf("[VMM] SUCCESS: Low memory page mapped\n");
-        return 0;  // Handled successfully
+// Every page is checked before the first byte moves, so a bad range
+// leaves both sides untouched
+static bool vmm_context_copy(vmm_context_t* ctx, uintptr_t addr, uint8_t* kbuf,
+                             size_t len, bool to_ctx) {
+    if (!ctx) return false;
+    if (len == 0) return true;
+    if (addr + len < addr) return false;
+
+    uintptr_t first_page = addr & ~(VMM_PAGE_SIZE - 1);
+    for (uintptr_t page = first_page; page < addr + len; page += VMM_PAGE_SIZE) {
+        if (!vmm_context_page(ctx, page, to_ctx)) return false;
+        if (page + VMM_PAGE_SIZE < page) break;
     }
 
-    // Not in a valid range
-    kprintf("[VMM] ERROR: Fault address not in valid range (0x%llx)\n", fault_addr);
-    return -1;  // Cannot handle
+    while (len > 0) {
+        size_t chunk = MIN(len, VMM_PAGE_SIZE - (addr & (VMM_PAGE_SIZE - 1)));
+        uint8_t* mapped = vmm_context_page(ctx, addr, to_ctx);
+        if (!mapped) return false;
+
+        if (to_ctx) memcpy(mapped, kbuf, chunk);
+        else memcpy(kbuf, mapped, chunk);
+
+        addr += chunk;
+        kbuf += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+bool vmm_copy_from_context(vmm_context_t* ctx, void* dst, uintptr_t src, size_t len) {
+    return vmm_context_copy(ctx, src, (uint8_t*)dst, len, false);
+}
+
+bool vmm_copy_to_context(vmm_context_t* ctx, uintptr_t dst, const void* src, size_t len) {
+    return vmm_context_copy(ctx, dst, (uint8_t*)src, len, true);
 }
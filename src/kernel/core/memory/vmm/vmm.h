@@ -2,12 +2,18 @@
 #define VMM_H
 
 #include "klib.h"
+#include "vma.h"
 
 // ========== VMM CONSTANTS ==========
 #define VMM_PAGE_SIZE           4096
 #define VMM_PAGE_MASK           0xFFFFFFFFFFFFF000ULL
 #define VMM_PAGE_OFFSET_MASK    0x0000000000000FFFULL
 
+// Large page sizes (PD-level and PDPT-level leaf entries)
+#define VMM_LARGE_PAGE_SIZE     (1ULL << 21)           // 2MB
+#define VMM_HUGE_PAGE_SIZE      (1ULL << 30)           // 1GB
+#define VMM_PAGES_PER_LARGE     (VMM_LARGE_PAGE_SIZE / VMM_PAGE_SIZE)  // 512
+
 // Virtual address space layout
 #define VMM_KERNEL_BASE         0xFFFF800000000000ULL  // -128TB
 #define VMM_KERNEL_HEAP_BASE    0xFFFF800000000000ULL  // Kernel heap start
@@ -32,6 +38,8 @@
 #define VMM_FLAG_DIRTY          (1ULL << 6)   // Page was written to
 #define VMM_FLAG_LARGE_PAGE     (1ULL << 7)   // 2MB/1GB page
 #define VMM_FLAG_GLOBAL         (1ULL << 8)   // Global page
+#define VMM_FLAG_COW            (1ULL << 9)   // Software: shared frame, copy on write
+#define VMM_FLAG_SHARED         (1ULL << 10)  // Software: shared on purpose, stays writable in clones
 #define VMM_FLAG_NO_EXECUTE     (1ULL << 63)  // No execute (NX bit)
 
 // Convenience flag combinations
@@ -45,6 +53,22 @@
 // Page table entry masks
 #define VMM_PTE_ADDR_MASK       0x000FFFFFFFFFF000ULL
 #define VMM_PTE_FLAGS_MASK      0x8000000000000FFFULL
+#define VMM_LARGE_ADDR_MASK     0x000FFFFFFFE00000ULL  // 2MB leaf (bit 12 is PAT)
+#define VMM_HUGE_ADDR_MASK      0x000FFFFFC0000000ULL  // 1GB leaf
+
+// PCID (process-context identifiers): TLB entries are tagged per address
+// space so loading CR3 does not have to throw them away
+#define VMM_PCID_POOL_SIZE      64                     // PCIDs 1..63 per generation; 0 = kernel
+#define VMM_CR3_PCID_MASK       0xFFFULL
+#define VMM_CR3_NOFLUSH         (1ULL << 63)           // Keep entries tagged with the new PCID
+
+// Page-table page cache: zeroed table pages kept ready for the hot path.
+// Freed tables and the tables of destroyed contexts are reclaimed later,
+// from the idle loop (vmm_idle_work), which also refills the cache.
+#define VMM_PT_CACHE_SIZE       64                     // Zeroed pages ready to hand out
+#define VMM_PT_RECLAIM_SIZE     256                    // Freed tables waiting to be zeroed
+#define VMM_ZOMBIE_CONTEXTS     32                     // Destroyed contexts awaiting teardown
+#define VMM_IDLE_BATCH          16                     // Pages handled per vmm_idle_work() call
 
 // Virtual address indices
 #define VMM_PML4_INDEX(addr)    (((addr) >> 39) & 0x1FF)
@@ -73,12 +97,44 @@ typedef struct {
     size_t kernel_pages;          // Kernel pages in this context
     size_t user_pages;            // User pages in this context
     
+    // User-half areas [VMM_USER_BASE, VMM_USER_STACK_TOP); the kernel heap
+    // is shared by every context and tracked separately inside vmm.c
+    vma_space_t vmas;
+
+    // TLB tagging (only used when PCID is enabled)
+    uint16_t pcid;                // Current PCID, valid while pcid_gen matches
+    uint64_t pcid_gen;            // PCID generation the tag was handed out in
+    bool tlb_stale;               // User half changed while not loaded
+    uint64_t cpu_mask;            // CPUs that currently have this context loaded
+
     // Memory regions tracking (simple version)
     uintptr_t heap_start;         // Current heap start
     uintptr_t heap_end;           // Current heap end
     uintptr_t stack_top;          // Stack top for user processes
 } vmm_context_t;
 
+// TLB gather: unmap paths queue addresses (and frames to release) and
+// flush once. Up to VMM_TLB_BATCH_PAGES pages are invalidated one by one,
+// anything bigger becomes a full flush. Frames are returned to the PMM only
+// after every CPU that might cache them has flushed.
+#define VMM_TLB_BATCH_PAGES     32
+#define VMM_TLB_BATCH_RUNS      32
+
+typedef struct {
+    uintptr_t phys;
+    size_t pages;
+} vmm_frame_run_t;
+
+typedef struct {
+    vmm_context_t* ctx;
+    uintptr_t addrs[VMM_TLB_BATCH_PAGES];  // Pages to invlpg
+    size_t addr_count;
+    bool flush_all;                        // Too many pages: full flush instead
+    bool kernel;                           // Touches the shared kernel half
+    vmm_frame_run_t frames[VMM_TLB_BATCH_RUNS];  // Released after the flush
+    size_t frame_runs;
+} vmm_tlb_batch_t;
+
 // Memory mapping result
 typedef struct {
     bool success;
@@ -101,6 +157,11 @@ vmm_context_t* vmm_get_kernel_context(void);
 vmm_context_t* vmm_get_current_context(void);
 void vmm_switch_context(vmm_context_t* ctx);
 
+// Copy-on-write clone: the child gets its own page tables for the user half
+// but shares every frame with the parent. Writable pages turn read-only in
+// both (VMM_FLAG_COW) and are copied on the first write fault.
+vmm_context_t* vmm_clone_context(vmm_context_t* parent);
+
 // Memory mapping
 vmm_map_result_t vmm_map_page(vmm_context_t* ctx, uintptr_t virt_addr, 
                               uintptr_t phys_addr, uint64_t flags);
@@ -109,20 +170,44 @@ vmm_map_result_t vmm_map_pages(vmm_context_t* ctx, uintptr_t virt_addr,
 bool vmm_unmap_page(vmm_context_t* ctx, uintptr_t virt_addr);
 bool vmm_unmap_pages(vmm_context_t* ctx, uintptr_t virt_addr, size_t page_count);
 
+// Range mapping: one table walk per page table, 2MB entries where aligned,
+// a single TLB flush at the end. Unmap returns the number of pages unmapped.
+vmm_map_result_t vmm_map_range(vmm_context_t* ctx, uintptr_t virt_addr,
+                               uintptr_t phys_addr, size_t page_count, uint64_t flags);
+size_t vmm_unmap_range(vmm_context_t* ctx, uintptr_t virt_addr, size_t page_count);
+
 // Memory allocation (high-level)
 void* vmm_alloc_pages(vmm_context_t* ctx, size_t page_count, uint64_t flags);
 void vmm_free_pages(vmm_context_t* ctx, void* virt_addr, size_t page_count);
 
+// Map frames owned by someone else (IPC segments) into the user half of ctx.
+// The mapping takes its own reference on the frames; vmm_free_pages() or
+// context teardown drops it. Returns the virtual address or NULL.
+void* vmm_map_shared(vmm_context_t* ctx, uintptr_t phys_addr, size_t page_count, uint64_t flags);
+
 // Address translation
 uintptr_t vmm_virt_to_phys(vmm_context_t* ctx, uintptr_t virt_addr);
 bool vmm_is_mapped(vmm_context_t* ctx, uintptr_t virt_addr);
 uint64_t vmm_get_page_flags(vmm_context_t* ctx, uintptr_t virt_addr);
 
+// Copy to/from an address in ctx (not necessarily the loaded one) through
+// the direct map. Fails without copying anything unless the owner of ctx
+// could access the whole range itself: user pages only outside the kernel
+// context, writable ones for copy_to. COW pages are resolved first.
+bool vmm_copy_from_context(vmm_context_t* ctx, void* dst, uintptr_t src, size_t len);
+bool vmm_copy_to_context(vmm_context_t* ctx, uintptr_t dst, const void* src, size_t len);
+
 // Kernel heap (vmalloc equivalent)
 void* vmalloc(size_t size);
 void* vzalloc(size_t size);  // Zero-initialized
 void vfree(void* addr);
 
+// Kernel stack: every page is mapped up front, so the stack never faults
+// while its owner holds a lock, and VMM_STACK_GUARD_PAGES unmapped pages sit
+// on either side to catch overflows. Freed with vfree().
+#define VMM_STACK_GUARD_PAGES   1
+void* vmalloc_stack(size_t size);
+
 // Memory regions
 uintptr_t vmm_find_free_region(vmm_context_t* ctx, size_t size, uintptr_t start, uintptr_t end);
 bool vmm_reserve_region(vmm_context_t* ctx, uintptr_t start, size_t size, uint64_t flags);
@@ -132,6 +217,22 @@ void vmm_dump_page_tables(vmm_context_t* ctx, uintptr_t virt_addr);
 void vmm_dump_context_stats(vmm_context_t* ctx);
 void vmm_flush_tlb(void);
 void vmm_flush_tlb_page(uintptr_t virt_addr);
+bool vmm_pcid_enabled(void);
+
+// Background upkeep for the idle loop: tears down one destroyed context or
+// zeroes/refills up to VMM_IDLE_BATCH cached table pages.
+// Returns false when there was nothing to do.
+bool vmm_idle_work(void);
+
+// TLB gather
+void vmm_tlb_batch_begin(vmm_tlb_batch_t* batch, vmm_context_t* ctx);
+void vmm_tlb_batch_add(vmm_tlb_batch_t* batch, uintptr_t virt_addr, size_t page_count);
+void vmm_tlb_batch_free_frames(vmm_tlb_batch_t* batch, uintptr_t phys_addr, size_t page_count);
+void vmm_tlb_batch_flush(vmm_tlb_batch_t* batch);   // Flush + release frames, keep addresses
+void vmm_tlb_batch_finish(vmm_tlb_batch_t* batch);  // Flush + release frames, reset
+
+// Remote side of a shootdown (called from the IPI handler on each target CPU)
+void vmm_tlb_shootdown_handle(void);
 
 // Protection and flags
 bool vmm_protect(vmm_context_t* ctx, uintptr_t virt_addr, size_t size, uint64_t new_flags);
@@ -143,6 +244,7 @@ bool vmm_is_kernel_addr(uintptr_t addr);
 // Page table manipulation
 page_table_t* vmm_get_or_create_table(vmm_context_t* ctx, uintptr_t virt_addr, int level);
 pte_t* vmm_get_pte(vmm_context_t* ctx, uintptr_t virt_addr);
+pte_t* vmm_get_leaf(vmm_context_t* ctx, uintptr_t virt_addr, size_t* page_size);
 pte_t* vmm_get_or_create_pte(vmm_context_t* ctx, uintptr_t virt_addr);
 void vmm_invalidate_page(uintptr_t virt_addr);
 
@@ -162,6 +264,7 @@ typedef struct {
     size_t user_mapped_pages;
     size_t page_tables_allocated;
     size_t page_faults_handled;
+    size_t cow_copies;            // Frames copied on a write to a shared page
     size_t tlb_flushes;
 } vmm_stats_t;
 
@@ -200,6 +303,13 @@ static inline uintptr_t vmm_pte_to_phys(pte_t pte) {
     return pte & VMM_PTE_ADDR_MASK;
 }
 
+// Extract physical base from a leaf entry of the given page size
+static inline uintptr_t vmm_leaf_to_phys(pte_t pte, size_t page_size) {
+    if (page_size == VMM_HUGE_PAGE_SIZE) return pte & VMM_HUGE_ADDR_MASK;
+    if (page_size == VMM_LARGE_PAGE_SIZE) return pte & VMM_LARGE_ADDR_MASK;
+    return pte & VMM_PTE_ADDR_MASK;
+}
+
 // Extract flags from PTE
 static inline uint64_t vmm_pte_to_flags(pte_t pte) {
     return pte & VMM_PTE_FLAGS_MASK;
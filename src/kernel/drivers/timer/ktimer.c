@@ -0,0 +1,275 @@
+#include "ktimer.h"
+#include "tsc.h"
+#include "klib.h"
+#include "atomics.h"
+
+#define KTIMER_MASK      (KTIMER_SLOTS - 1)
+#define KTIMER_MAX_DELTA ((1ULL << (KTIMER_SLOT_BITS * KTIMER_LEVELS)) - 1)
+
+static ktimer_t* wheel[KTIMER_LEVELS][KTIMER_SLOTS];
+static uint64_t wheel_next = 1;     // Next tick to process; wheel_next - 1 is done
+static uint64_t wheel_count = 0;    // Pending timers
+static spinlock_t wheel_lock;       // Taken with interrupts off (shared with the IRQ)
+
+// TSC cycles per wheel tick (default rate until ktimer_init())
+static uint64_t ktimer_cycles_per_tick = TSC_DEFAULT_KHZ * KTIMER_RESOLUTION_US / 1000;
+
+// One-shot event device and the tick it is currently set for
+static void (*event_program)(uint64_t deadline_tsc) = NULL;
+static const char* event_name = "periodic";
+static uint64_t event_programmed = KTIMER_NO_EVENT;
+
+// ========== SLOT LISTS (caller holds wheel_lock) ==========
+
+static void ktimer_unlink(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->pending = false;
+    wheel_count--;
+}
+
+static void ktimer_push(ktimer_t** head, ktimer_t* timer) {
+    timer->next = *head;
+    timer->pprev = head;
+    if (*head) (*head)->pprev = &timer->next;
+    *head = timer;
+}
+
+// Lowest level whose range covers the delay. Relative to wheel_next, so a
+// timer always lands in a slot that is cascaded or run before it is due.
+static void ktimer_link(ktimer_t* timer) {
+    if (timer->expires < wheel_next) timer->expires = wheel_next;
+
+    uint64_t delta = timer->expires - wheel_next;
+    if (delta > KTIMER_MAX_DELTA) {
+        delta = KTIMER_MAX_DELTA;
+        timer->expires = wheel_next + delta;
+    }
+
+    int level = 0;
+    while (delta >= (1ULL << (KTIMER_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+
+    uint32_t slot = (uint32_t)(timer->expires >> (KTIMER_SLOT_BITS * level)) & KTIMER_MASK;
+    ktimer_push(&wheel[level][slot], timer);
+    timer->pending = true;
+    wheel_count++;
+}
+
+// Move every timer of a higher-level slot down to where it now belongs
+static void ktimer_cascade(int level, uint32_t slot) {
+    ktimer_t* list = wheel[level][slot];
+    wheel[level][slot] = NULL;
+
+    while (list) {
+        ktimer_t* timer = list;
+        list = timer->next;
+        wheel_count--;
+        ktimer_link(timer);
+    }
+}
+
+// Earliest tick at which the wheel has work: a level-0 slot to run or a
+// non-empty higher slot to cascade. Never later than the real first expiry
+// (a cascade only moves timers), at most KTIMER_LEVELS * KTIMER_SLOTS checks.
+static uint64_t ktimer_next_event_locked(void) {
+    if (wheel_count == 0) return KTIMER_NO_EVENT;
+
+    uint64_t best = KTIMER_NO_EVENT;
+
+    // Level 0 holds exactly the ticks wheel_next .. wheel_next + 63
+    for (uint64_t i = 0; i < KTIMER_SLOTS; i++) {
+        if (wheel[0][(wheel_next + i) & KTIMER_MASK]) {
+            best = wheel_next + i;
+            break;
+        }
+    }
+
+    // Level k slot s is cascaded at the next tick whose level-k index is s
+    // and whose lower bits are all zero
+    for (int level = 1; level < KTIMER_LEVELS; level++) {
+        uint32_t shift = KTIMER_SLOT_BITS * level;
+        uint64_t base = wheel_next >> shift;
+        uint64_t first = (wheel_next & ((1ULL << shift) - 1)) ? 1 : 0;
+
+        for (uint64_t i = first; i <= KTIMER_SLOTS; i++) {
+            if (wheel[level][(base + i) & KTIMER_MASK]) {
+                uint64_t when = (base + i) << shift;
+                if (when < best) best = when;
+                break;
+            }
+        }
+    }
+
+    return best;
+}
+
+// Move the clock up to now + 1 over ticks where nothing happens
+static void ktimer_forward_locked(uint64_t now) {
+    if (wheel_next > now) return;
+
+    uint64_t next = ktimer_next_event_locked();
+    if (next > wheel_next) {
+        wheel_next = (next > now + 1) ? now + 1 : next;
+    }
+}
+
+static void ktimer_run_tick(uint64_t tick, uint64_t* flags) {
+    wheel_next = tick;
+
+    // Level 0 wrapped: pull the next slot of level 1 down (and so on upwards)
+    if ((tick & KTIMER_MASK) == 0) {
+        for (int level = 1; level < KTIMER_LEVELS; level++) {
+            uint32_t slot = (uint32_t)(tick >> (KTIMER_SLOT_BITS * level)) & KTIMER_MASK;
+            ktimer_cascade(level, slot);
+            if (slot != 0) break;
+        }
+    }
+
+    wheel_next = tick + 1;
+
+    // Detach the slot first: a periodic timer re-armed a full turn ahead
+    // lands in this same slot
+    ktimer_t* expired = wheel[0][tick & KTIMER_MASK];
+    wheel[0][tick & KTIMER_MASK] = NULL;
+    if (expired) expired->pprev = &expired;
+
+    while (expired) {
+        ktimer_t* timer = expired;
+        ktimer_unlink(timer);
+
+        if (timer->period) {
+            timer->expires += timer->period;
+            ktimer_link(timer);
+        }
+
+        // The callback may re-arm or cancel timers (including this one)
+        spin_unlock_irqrestore(&wheel_lock, *flags);
+        timer->fn(timer);
+        *flags = spin_lock_irqsave(&wheel_lock);
+    }
+}
+
+static void ktimer_program_locked(uint64_t tick) {
+    event_programmed = tick;
+    event_program(tick == KTIMER_NO_EVENT ? KTIMER_NO_EVENT : tick * ktimer_cycles_per_tick);
+}
+
+// ========== PUBLIC API ==========
+
+void ktimer_init(void) {
+    uint64_t flags = spin_lock_irqsave(&wheel_lock);
+
+    ktimer_cycles_per_tick = tsc_khz() * KTIMER_RESOLUTION_US / 1000;
+    if (ktimer_cycles_per_tick == 0) ktimer_cycles_per_tick = 1;
+
+    // Timers armed on the default rate keep their place relative to the clock
+    if (wheel_count == 0) {
+        wheel_next = ktimer_now() + 1;
+    }
+
+    spin_unlock_irqrestore(&wheel_lock, flags);
+
+    kprintf("[KTIMER] Timing wheel: %u levels x %u slots, %u us per tick\n",
+            KTIMER_LEVELS, KTIMER_SLOTS, KTIMER_RESOLUTION_US);
+}
+
+void ktimer_set_event_device(const char* name, void (*program)(uint64_t deadline_tsc)) {
+    uint64_t flags = spin_lock_irqsave(&wheel_lock);
+
+    event_program = program;
+    event_name = program ? name : "periodic";
+    if (event_program) {
+        ktimer_program_locked(ktimer_next_event_locked());
+    }
+
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
+
+const char* ktimer_event_device(void) {
+    return event_name;
+}
+
+uint64_t ktimer_now(void) {
+    return rdtsc() / ktimer_cycles_per_tick;
+}
+
+uint64_t ktimer_us_to_ticks(uint64_t us) {
+    uint64_t ticks = (us + KTIMER_RESOLUTION_US - 1) / KTIMER_RESOLUTION_US;
+    return ticks ? ticks : 1;
+}
+
+uint64_t ktimer_ms_to_ticks(uint64_t ms) {
+    return ktimer_us_to_ticks(ms * 1000);
+}
+
+void ktimer_setup(ktimer_t* timer, void (*fn)(ktimer_t* timer)) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->period = 0;
+    timer->fn = fn;
+    timer->pending = false;
+}
+
+void ktimer_arm_us(ktimer_t* timer, uint64_t delay_us, uint64_t period_us) {
+    uint64_t flags = spin_lock_irqsave(&wheel_lock);
+
+    if (timer->pending) ktimer_unlink(timer);
+
+    // The clock may have stood still while idle: catch up before linking
+    uint64_t now = ktimer_now();
+    ktimer_forward_locked(now);
+
+    timer->expires = now + ktimer_us_to_ticks(delay_us);
+    timer->period = period_us ? ktimer_us_to_ticks(period_us) : 0;
+    ktimer_link(timer);
+
+    // New earliest timer: bring the interrupt forward
+    if (event_program && timer->expires < event_programmed) {
+        ktimer_program_locked(timer->expires);
+    }
+
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
+
+void ktimer_arm(ktimer_t* timer, uint64_t delay_ms, uint64_t period_ms) {
+    ktimer_arm_us(timer, delay_ms * 1000, period_ms * 1000);
+}
+
+bool ktimer_cancel(ktimer_t* timer) {
+    uint64_t flags = spin_lock_irqsave(&wheel_lock);
+
+    bool was_pending = timer->pending;
+    if (was_pending) ktimer_unlink(timer);
+    timer->period = 0;
+
+    // The device stays programmed: one early interrupt finds nothing to do
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    return was_pending;
+}
+
+void ktimer_tick(void) {
+    uint64_t flags = spin_lock_irqsave(&wheel_lock);
+
+    // Callbacks may take long enough for more ticks to come due
+    uint64_t now = ktimer_now();
+    for (;;) {
+        ktimer_forward_locked(now);
+        if (wheel_next > now) {
+            now = ktimer_now();
+            if (wheel_next > now) break;
+            continue;
+        }
+        ktimer_run_tick(wheel_next, &flags);
+    }
+
+    if (event_program) {
+        ktimer_program_locked(ktimer_next_event_locked());
+    }
+
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
@@ -0,0 +1,70 @@
+#ifndef KTIMER_H
+#define KTIMER_H
+
+#include "ktypes.h"
+
+// ============================================================================
+// KERNEL TIMERS - hierarchical timing wheel
+// ============================================================================
+//
+// Timers are kept in KTIMER_LEVELS wheels of KTIMER_SLOTS slots. Level 0
+// has one slot per wheel tick (KTIMER_RESOLUTION_US of TSC time), each
+// higher level covers KTIMER_SLOTS times the range of the one below.
+// Arming and cancelling are O(1) list operations; processing a tick runs
+// one level-0 slot and, every KTIMER_SLOTS ticks, re-sorts one slot of the
+// level above into the lower level (cascade). Nothing ever scans all timers.
+//
+// The wheel clock is the TSC, not an interrupt counter: whatever timer
+// interrupt arrives (periodic PIT, one-shot LAPIC) calls ktimer_tick(),
+// which catches up to "now" and skips stretches where nothing is due.
+// With a one-shot event device the interrupt is programmed for the
+// earliest pending timer only, so an idle system takes no ticks at all.
+//
+// Callbacks run from the timer interrupt with interrupts disabled. They
+// must not sleep or take locks that other code holds with interrupts on;
+// locks shared with them must use spin_lock_irqsave().
+
+#define KTIMER_SLOT_BITS      6
+#define KTIMER_SLOTS          (1 << KTIMER_SLOT_BITS)
+#define KTIMER_LEVELS         5     // 2^30 ticks: ~74 hours; longer delays are clamped
+#define KTIMER_RESOLUTION_US  250   // One wheel tick
+#define KTIMER_NO_EVENT       (~0ULL)
+
+typedef struct ktimer {
+    struct ktimer* next;        // Slot list
+    struct ktimer** pprev;      // Link pointing at us (O(1) unlink)
+    uint64_t expires;           // Wheel tick at which the timer fires
+    uint64_t period;            // Ticks between firings, 0 = one-shot
+    void (*fn)(struct ktimer* timer);
+    bool pending;               // Linked into the wheel
+} ktimer_t;
+
+// Start the wheel clock (after tsc_init())
+void ktimer_init(void);
+
+// One-shot event device: program(deadline) must raise a timer interrupt
+// once the TSC reaches deadline, or stop for KTIMER_NO_EVENT. Without one
+// the wheel relies on a periodic interrupt.
+void ktimer_set_event_device(const char* name, void (*program)(uint64_t deadline_tsc));
+const char* ktimer_event_device(void);
+
+// Prepare a timer; fn gets the timer back (use container_of for its owner)
+void ktimer_setup(ktimer_t* timer, void (*fn)(ktimer_t* timer));
+
+// (Re)arm: first firing after delay_ms, then every period_ms (0 = once).
+// Re-arming a pending timer moves it.
+void ktimer_arm(ktimer_t* timer, uint64_t delay_ms, uint64_t period_ms);
+void ktimer_arm_us(ktimer_t* timer, uint64_t delay_us, uint64_t period_us);
+
+// Returns true if the timer was pending
+bool ktimer_cancel(ktimer_t* timer);
+
+// Timer interrupt: run everything that expired by now, reprogram the device
+void ktimer_tick(void);
+
+// Current wheel tick, and conversions (rounded up, at least 1 tick)
+uint64_t ktimer_now(void);
+uint64_t ktimer_us_to_ticks(uint64_t us);
+uint64_t ktimer_ms_to_ticks(uint64_t ms);
+
+#endif // KTIMER_H
@@ -1,6 +1,7 @@
 #include "pit.h"
 #include "io.h"
 #include "klib.h"
+#include "atomics.h"
 
 // Global tick counter (updated by IRQ 0 handler)
 static volatile uint64_t pit_ticks = 0;
@@ -71,3 +72,35 @@ void pit_sleep_ms(uint32_t milliseconds) {
 uint32_t pit_get_frequency(void) {
     return pit_frequency;
 }
+
+// Measure the TSC against channel 2 (the PC speaker channel) in mode 0:
+// its output (port 0x61 bit 5) goes high when the count reaches zero.
+uint64_t pit_measure_tsc(uint32_t milliseconds) {
+    uint32_t count = (uint32_t)(((uint64_t)PIT_FREQUENCY * milliseconds) / 1000);
+    if (count == 0 || count > 0xFFFF) {
+        return 0;
+    }
+
+    // Gate on, speaker off
+    uint8_t gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, (gate & ~0x02) | 0x01);
+
+    outb(PIT_COMMAND, PIT_CMD_CHANNEL2 | PIT_CMD_RW_BOTH | PIT_CMD_MODE0 | PIT_CMD_BINARY);
+    outb(PIT_CHANNEL2, (uint8_t)(count & 0xFF));
+    outb(PIT_CHANNEL2, (uint8_t)((count >> 8) & 0xFF));
+
+    uint64_t start = rdtsc();
+    uint64_t spins = 0;
+
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        // ~1us per port read: far more than 50ms worth means no PIT
+        if (++spins > 10000000) {
+            outb(PIT_GATE_PORT, gate);
+            return 0;
+        }
+    }
+    uint64_t end = rdtsc();
+
+    outb(PIT_GATE_PORT, gate);
+    return end - start;
+}
@@ -11,6 +11,7 @@
 #define PIT_CHANNEL1     0x41     // Channel 1 data port (unused)
 #define PIT_CHANNEL2     0x42     // Channel 2 data port (PC speaker)
 #define PIT_COMMAND      0x43     // Command register
+#define PIT_GATE_PORT    0x61     // Channel 2 gate (bit 0), speaker (bit 1), output (bit 5)
 
 // Command byte format:
 // Bits 7-6: Channel select (00=Ch0, 01=Ch1, 10=Ch2, 11=Read-back)
@@ -23,6 +24,8 @@
 #define PIT_CMD_MODE3    0x06     // Mode 3: Square Wave Generator
 #define PIT_CMD_RW_BOTH  0x30     // Read/Write LSB then MSB
 #define PIT_CMD_CHANNEL0 0x00     // Select Channel 0
+#define PIT_CMD_CHANNEL2 0x80     // Select Channel 2
+#define PIT_CMD_MODE0    0x00     // Mode 0: Interrupt on Terminal Count
 
 // Initialize PIT to generate interrupts at specified frequency
 void pit_init(uint32_t frequency_hz);
@@ -30,10 +33,18 @@ void pit_init(uint32_t frequency_hz);
 // Increment tick counter (called from IRQ 0 handler)
 void pit_tick(void);
 
-// Get current tick count (updated by IRQ 0 handler)
+// Get current tick count (updated by IRQ 0 handler; IRQ 0 is masked
+// once the LAPIC timer drives ktimer)
 uint64_t pit_get_ticks(void);
 
 // Sleep for specified number of milliseconds (busy wait)
 void pit_sleep_ms(uint32_t milliseconds);
 
+// Channel 0 frequency set by pit_init() (0 before that)
+uint32_t pit_get_frequency(void);
+
+// TSC cycles elapsed while channel 2 counts down `milliseconds` (1..50).
+// Does not need interrupts; returns 0 if the PIT never reached terminal count.
+uint64_t pit_measure_tsc(uint32_t milliseconds);
+
 #endif // PIT_H
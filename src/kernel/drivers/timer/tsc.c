@@ -0,0 +1,30 @@
+#include "tsc.h"
+#include "pit.h"
+#include "klib.h"
+
+static uint64_t tsc_rate_khz = TSC_DEFAULT_KHZ;
+
+void tsc_init(void) {
+    uint64_t best = 0;
+
+    for (int i = 0; i < TSC_CALIBRATE_RUNS; i++) {
+        uint64_t cycles = pit_measure_tsc(TSC_CALIBRATE_MS);
+        if (cycles && (best == 0 || cycles < best)) {
+            best = cycles;
+        }
+    }
+
+    if (best == 0) {
+        kprintf("[TSC] WARNING: PIT calibration failed, assuming %lu MHz\n",
+                tsc_rate_khz / 1000);
+        return;
+    }
+
+    tsc_rate_khz = best / TSC_CALIBRATE_MS;
+    kprintf("[TSC] Calibrated against PIT: %lu.%03lu MHz\n",
+            tsc_rate_khz / 1000, tsc_rate_khz % 1000);
+}
+
+uint64_t tsc_khz(void) {
+    return tsc_rate_khz;
+}
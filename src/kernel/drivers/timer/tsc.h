@@ -0,0 +1,28 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include "ktypes.h"
+
+// TSC (Time Stamp Counter) - cycle counter used for timestamps and runtime
+// accounting. Its rate is calibrated once against PIT channel 2; until then
+// the old 2.4 GHz assumption is used.
+
+#define TSC_DEFAULT_KHZ     2400000   // Fallback before/without calibration
+#define TSC_CALIBRATE_MS    10        // Length of one PIT measurement
+#define TSC_CALIBRATE_RUNS  3         // Shortest run wins (SMIs only add time)
+
+// Calibrate against the PIT (interrupts not required)
+void tsc_init(void);
+
+// Cycles per millisecond
+uint64_t tsc_khz(void);
+
+static inline uint64_t tsc_ms_to_cycles(uint64_t ms) {
+    return ms * tsc_khz();
+}
+
+static inline uint64_t tsc_cycles_to_us(uint64_t cycles) {
+    return cycles * 1000 / tsc_khz();
+}
+
+#endif // TSC_H
@@ -17,7 +17,7 @@ void center_init(void) {
     center_stats.routing_errors = 0;
     center_stats.security_denied = 0;
 
-    kprintf("[CENTER] Initialized (with Security checks)\n");
+    klog_info(KLOG_PIPELINE, "[CENTER] Initialized (with Security checks)\n");
 }
 
 // ============================================================================
@@ -25,7 +25,7 @@ void center_init(void) {
 // ============================================================================
 
 void center_run(EventRingBuffer* from_receiver_ring, RoutingTable* routing_table, ResponseRingBuffer* kernel_to_user_ring) {
-    kprintf("[CENTER] Starting main loop...\n");
+    klog_debug(KLOG_PIPELINE, "[CENTER] Starting main loop...\n");
 
     Event event;
     uint64_t iterations = 0;
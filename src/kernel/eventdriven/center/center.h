@@ -49,7 +49,7 @@ static inline int security_check_event(Event* event) {
             uint64_t size = *(uint64_t*)event->data;
             // Не разрешаем аллокации > 1GB
             if (size > (1ULL << 30)) {
-                kprintf("[CENTER:SECURITY] Denied: memory allocation too large (%lu bytes) for user %lu\n",
+                klog_warn(KLOG_PIPELINE, "[CENTER:SECURITY] Denied: memory allocation too large (%lu bytes) for user %lu\n",
                         size, event->user_id);
                 return 0;
             }
@@ -63,7 +63,7 @@ static inline int security_check_event(Event* event) {
             const char* path = (const char*)event->data;
             // Запрещаем доступ к /etc/shadow
             if (strcmp(path, "/etc/shadow") == 0) {
-                kprintf("[CENTER:SECURITY] Denied: access to %s for user %lu\n",
+                klog_warn(KLOG_PIPELINE, "[CENTER:SECURITY] Denied: access to %s for user %lu\n",
                         path, event->user_id);
                 return 0;
             }
@@ -172,7 +172,7 @@ static inline void center_determine_route(EventType type, uint8_t prefixes[MAX_R
 
         default:
             // Неизвестный тип - отправим в OPERATIONS
-            kprintf("[CENTER] Unknown event type %d, routing to OPERATIONS\n", type);
+            klog_debug(KLOG_PIPELINE, "[CENTER] Unknown event type %d, routing to OPERATIONS\n", type);
             prefixes[0] = DECK_PREFIX_OPERATIONS;
             break;
     }
@@ -189,7 +189,7 @@ static inline int center_process_event(Event* event, RoutingTable* routing_table
     // 1. SECURITY CHECK - ПЕРЕД маршрутизацией!
     if (!security_check_event(event)) {
         atomic_increment_u64((volatile uint64_t*)&center_stats.security_denied);
-        kprintf("[CENTER] Event %lu DENIED by security\n", event->id);
+        klog_warn(KLOG_PIPELINE, "[CENTER] Event %lu DENIED by security\n", event->id);
 
         // FIXED: Отправляем error response обратно в user space
         Response error_response;
@@ -203,7 +203,7 @@ static inline int center_process_event(Event* event, RoutingTable* routing_table
         while (!response_ring_push(kernel_to_user_ring, &error_response)) {
             cpu_pause();
             if (--timeout == 0) {
-                kprintf("[CENTER] ERROR: Response ring buffer timeout for event %lu\n", event->id);
+                klog_error(KLOG_PIPELINE, "[CENTER] ERROR: Response ring buffer timeout for event %lu\n", event->id);
                 return 0;  // Не смогли отправить ответ
             }
         }
@@ -50,7 +50,7 @@ typedef enum {
     EVENT_DEV_WRITE = 43,
 
     // Timer operations
-    EVENT_TIMER_CREATE = 50,
+    EVENT_TIMER_CREATE = 50,      // Result: timer id (not a pointer)
     EVENT_TIMER_CANCEL = 51,
     EVENT_TIMER_SLEEP = 52,
     EVENT_TIMER_GETTICKS = 53,
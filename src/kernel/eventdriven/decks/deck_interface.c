@@ -17,7 +17,7 @@ void deck_init(DeckContext* ctx, const char* name, uint8_t prefix, DeckProcessFu
     // Получаем input queue от Guide
     ctx->input_queue = guide_get_deck_queue(prefix);
 
-    kprintf("[DECK:%s] Initialized (prefix=%d)\n", name, prefix);
+    klog_info(KLOG_PIPELINE, "[DECK:%s] Initialized (prefix=%d)\n", name, prefix);
 }
 
 // ============================================================================
@@ -44,7 +44,7 @@ int deck_run_once(DeckContext* ctx) {
 }
 
 void deck_run(DeckContext* ctx) {
-    kprintf("[DECK:%s] Starting main loop...\n", ctx->stats.name);
+    klog_debug(KLOG_PIPELINE, "[DECK:%s] Starting main loop...\n", ctx->stats.name);
 
     uint64_t iterations = 0;
 
@@ -57,7 +57,7 @@ void deck_run(DeckContext* ctx) {
         // Периодическая статистика
         iterations++;
         if (iterations % 10000000 == 0) {
-            kprintf("[DECK:%s] processed=%lu errors=%lu\n",
+            klog_debug(KLOG_PIPELINE, "[DECK:%s] processed=%lu errors=%lu\n",
                     ctx->stats.name,
                     ctx->stats.events_processed,
                     ctx->stats.errors);
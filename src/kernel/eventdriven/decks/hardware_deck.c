@@ -1,62 +1,126 @@
 #include "deck_interface.h"
 #include "klib.h"
 #include "../task/task.h"  // NEW: Task system integration
+#include "ktimer.h"
 
 // ============================================================================
 // HARDWARE DECK - Timer & Device Operations
 // ============================================================================
 
-// Timer descriptor
-typedef struct {
+// Timer descriptor (kmalloc'd, no fixed limit)
+typedef struct Timer {
     uint64_t id;
     uint64_t owner_task_id;      // Changed from owner_pid to owner_task_id
-    uint64_t expiration;         // TSC timestamp
-    uint64_t interval;           // 0 = one-shot, >0 = periodic
+    uint64_t interval_ms;        // 0 = one-shot, >0 = periodic
     uint64_t event_id;           // Для отправки уведомления
+    uint64_t fired;              // Срабатывания, ещё не обработанные деком
+    ktimer_t wheel;              // Узел колеса таймеров
+    struct Timer* hash_next;     // Цепочка в timer_hash
+    struct Timer* expired_next;  // Очередь expired_timers
     int active;
+    int queued;                  // Лежит в expired_timers
 } Timer;
 
-#define MAX_TIMERS 64
-static Timer timers[MAX_TIMERS];
+// Поиск по id для EVENT_TIMER_CANCEL
+#define TIMER_HASH_SIZE 64
+static Timer* timer_hash[TIMER_HASH_SIZE];
+static spinlock_t timer_hash_lock;
 static volatile uint64_t next_timer_id = 1;
 
+// Сработавшие таймеры: кладёт прерывание таймера, разбирает
+// hardware_deck_run_once(), поэтому замок берётся с запретом прерываний
+static Timer* expired_head = NULL;
+static Timer* expired_tail = NULL;
+static spinlock_t expired_lock;
+
 // ============================================================================
 // TIMER OPERATIONS (Integrated with Task system)
 // ============================================================================
 
+static inline uint32_t timer_hash_index(uint64_t id) {
+    return (uint32_t)(id & (TIMER_HASH_SIZE - 1));
+}
+
+static void timer_hash_unlink(Timer* timer) {
+    spin_lock(&timer_hash_lock);
+    Timer** link = &timer_hash[timer_hash_index(timer->id)];
+    while (*link && *link != timer) link = &(*link)->hash_next;
+    if (*link) *link = timer->hash_next;
+    spin_unlock(&timer_hash_lock);
+}
+
+// Прерывание таймера: только ставим в очередь, работа - в контексте дека
+static void timer_fired(ktimer_t* wheel) {
+    Timer* timer = container_of(wheel, Timer, wheel);
+
+    uint64_t flags = spin_lock_irqsave(&expired_lock);
+    timer->fired++;
+    if (!timer->queued) {
+        timer->queued = 1;
+        timer->expired_next = NULL;
+        if (expired_tail) expired_tail->expired_next = timer;
+        else expired_head = timer;
+        expired_tail = timer;
+    }
+    spin_unlock_irqrestore(&expired_lock, flags);
+}
+
 static Timer* timer_create(uint64_t delay_ms, uint64_t interval_ms) {
-    // Находим свободный slot
-    for (int i = 0; i < MAX_TIMERS; i++) {
-        if (!timers[i].active) {
-            timers[i].id = atomic_increment_u64(&next_timer_id);
+    Timer* timer = kmalloc(sizeof(Timer));
+    if (!timer) {
+        klog_error(KLOG_HARDWARE, "[HARDWARE] ERROR: Out of memory for timer!\n");
+        return 0;
+    }
+    memset(timer, 0, sizeof(Timer));
 
-            // Get current task ID
-            timers[i].owner_task_id = task_get_current_id();
+    timer->id = atomic_increment_u64(&next_timer_id);
 
-            timers[i].expiration = rdtsc() + (delay_ms * 2400000);  // Примерная конверсия ms->TSC
-            timers[i].interval = interval_ms * 2400000;
-            timers[i].active = 1;
+    // Get current task ID
+    timer->owner_task_id = task_get_current_id();
+    timer->interval_ms = interval_ms;
+    timer->active = 1;
 
-            kprintf("[HARDWARE] Created timer %lu for task %lu: delay=%lu ms, interval=%lu ms\n",
-                    timers[i].id, timers[i].owner_task_id, delay_ms, interval_ms);
+    spin_lock(&timer_hash_lock);
+    uint32_t index = timer_hash_index(timer->id);
+    timer->hash_next = timer_hash[index];
+    timer_hash[index] = timer;
+    spin_unlock(&timer_hash_lock);
 
-            return &timers[i];
-        }
-    }
+    ktimer_setup(&timer->wheel, timer_fired);
+    ktimer_arm(&timer->wheel, delay_ms, interval_ms);
 
-    kprintf("[HARDWARE] ERROR: No free timer slots!\n");
-    return 0;
+    klog_debug(KLOG_HARDWARE, "[HARDWARE] Created timer %lu for task %lu: delay=%lu ms, interval=%lu ms\n",
+            timer->id, timer->owner_task_id, delay_ms, interval_ms);
+
+    return timer;
+}
+
+static void timer_destroy(Timer* timer) {
+    ktimer_cancel(&timer->wheel);
+    timer_hash_unlink(timer);
+    timer->active = 0;
+
+    // Уже в очереди сработавших - освободит timer_check_expired()
+    uint64_t flags = spin_lock_irqsave(&expired_lock);
+    int queued = timer->queued;
+    spin_unlock_irqrestore(&expired_lock, flags);
+
+    if (!queued) kfree(timer);
 }
 
 static int timer_cancel(uint64_t timer_id) {
-    for (int i = 0; i < MAX_TIMERS; i++) {
-        if (timers[i].active && timers[i].id == timer_id) {
-            timers[i].active = 0;
-            kprintf("[HARDWARE] Cancelled timer %lu\n", timer_id);
-            return 1;
-        }
+    spin_lock(&timer_hash_lock);
+    Timer* timer = timer_hash[timer_hash_index(timer_id)];
+    while (timer && timer->id != timer_id) timer = timer->hash_next;
+    spin_unlock(&timer_hash_lock);
+
+    if (!timer) {
+        return 0;  // Not found
     }
-    return 0;  // Not found
+
+    timer_destroy(timer);
+    klog_debug(KLOG_HARDWARE, "[HARDWARE] Cancelled timer %lu\n", timer_id);
+    return 1;
 }
 
 static void timer_sleep(uint64_t ms) {
@@ -65,9 +129,9 @@ static void timer_sleep(uint64_t ms) {
 
     if (task_id > 0) {
         task_sleep(task_id, ms);
-        kprintf("[HARDWARE] Task %lu sleeping for %lu ms\n", task_id, ms);
+        klog_debug(KLOG_HARDWARE, "[HARDWARE] Task %lu sleeping for %lu ms\n", task_id, ms);
     } else {
-        kprintf("[HARDWARE] WARNING: No current task to sleep\n");
+        klog_warn(KLOG_HARDWARE, "[HARDWARE] WARNING: No current task to sleep\n");
     }
 }
 
@@ -76,26 +140,42 @@ static uint64_t timer_get_ticks(void) {
     return rdtsc();
 }
 
-// Проверка истёкших таймеров (вызывается периодически)
+// Обработка сработавших таймеров (вызывается периодически).
+// Колесо само перезапускает периодические таймеры; здесь только
+// уведомления, без просмотра всех таймеров.
 static void timer_check_expired(void) {
-    uint64_t now = rdtsc();
+    uint64_t flags = spin_lock_irqsave(&expired_lock);
+    Timer* list = expired_head;
+    expired_head = NULL;
+    expired_tail = NULL;
+    spin_unlock_irqrestore(&expired_lock, flags);
+
+    while (list) {
+        Timer* timer = list;
+        list = timer->expired_next;
+
+        flags = spin_lock_irqsave(&expired_lock);
+        uint64_t fired = timer->fired;
+        timer->fired = 0;
+        timer->queued = 0;
+        spin_unlock_irqrestore(&expired_lock, flags);
+
+        if (!timer->active) {
+            kfree(timer);   // Отменён, пока ждал в очереди
+            continue;
+        }
 
-    for (int i = 0; i < MAX_TIMERS; i++) {
-        if (timers[i].active && now >= timers[i].expiration) {
-            kprintf("[HARDWARE] Timer %lu expired!\n", timers[i].id);
+        klog_debug(KLOG_HARDWARE, "[HARDWARE] Timer %lu expired! (%lu times since last check)\n", timer->id, fired);
 
-            // Wake up the owner task!
-            if (timers[i].owner_task_id > 0) {
-                task_wake(timers[i].owner_task_id);
-                kprintf("[HARDWARE] Woke up task %lu\n", timers[i].owner_task_id);
-            }
+        // Wake up the owner task!
+        if (timer->owner_task_id > 0) {
+            task_wake(timer->owner_task_id);
+            klog_debug(KLOG_HARDWARE, "[HARDWARE] Woke up task %lu\n", timer->owner_task_id);
+        }
 
-            // Если periodic - перезапускаем
-            if (timers[i].interval > 0) {
-                timers[i].expiration = now + timers[i].interval;
-            } else {
-                timers[i].active = 0;  // One-shot
-            }
+        // One-shot таймер больше не нужен
+        if (timer->interval_ms == 0) {
+            timer_destroy(timer);
         }
     }
 }
@@ -134,16 +214,19 @@ int hardware_deck_process(RoutingEntry* entry) {
     switch (event->type) {
         // === TIMER OPERATIONS ===
         case EVENT_TIMER_CREATE: {
-            // Payload: [delay_ms:8][interval_ms:8]
+            // Payload: [delay_ms:8][interval_ms:8] -> timer id (the value itself,
+            // not a Timer*: a one-shot timer is freed once it fires). The id is
+            // what EVENT_TIMER_CANCEL takes.
             uint64_t delay_ms = *(uint64_t*)event->data;
             uint64_t interval_ms = *(uint64_t*)(event->data + 8);
 
             Timer* timer = timer_create(delay_ms, interval_ms);
 
             if (timer) {
-                deck_complete(entry, DECK_PREFIX_HARDWARE, timer);
-                kprintf("[HARDWARE] Event %lu: created timer %lu\n",
-                        event->id, timer->id);
+                uint64_t timer_id = timer->id;   // A one-shot may fire and go away right after
+                deck_complete(entry, DECK_PREFIX_HARDWARE, (void*)timer_id);
+                klog_debug(KLOG_HARDWARE, "[HARDWARE] Event %lu: created timer %lu\n",
+                        event->id, timer_id);
                 return 1;
             }
             deck_error(entry, DECK_PREFIX_HARDWARE, 1);
@@ -158,7 +241,7 @@ int hardware_deck_process(RoutingEntry* entry) {
             } else {
                 deck_error(entry, DECK_PREFIX_HARDWARE, 2);
             }
-            kprintf("[HARDWARE] Event %lu: cancelled timer %lu (status=%d)\n",
+            klog_debug(KLOG_HARDWARE, "[HARDWARE] Event %lu: cancelled timer %lu (status=%d)\n",
                     event->id, timer_id, success);
             return success;
         }
@@ -167,14 +250,14 @@ int hardware_deck_process(RoutingEntry* entry) {
             uint64_t ms = *(uint64_t*)event->data;
             timer_sleep(ms);
             deck_complete(entry, DECK_PREFIX_HARDWARE, 0);
-            kprintf("[HARDWARE] Event %lu: sleep %lu ms\n", event->id, ms);
+            klog_debug(KLOG_HARDWARE, "[HARDWARE] Event %lu: sleep %lu ms\n", event->id, ms);
             return 1;
         }
 
         case EVENT_TIMER_GETTICKS: {
             uint64_t ticks = timer_get_ticks();
             deck_complete(entry, DECK_PREFIX_HARDWARE, (void*)ticks);
-            kprintf("[HARDWARE] Event %lu: getticks = %lu\n", event->id, ticks);
+            klog_debug(KLOG_HARDWARE, "[HARDWARE] Event %lu: getticks = %lu\n", event->id, ticks);
             return 1;
         }
 
@@ -233,10 +316,8 @@ int hardware_deck_process(RoutingEntry* entry) {
 DeckContext hardware_deck_context;
 
 void hardware_deck_init(void) {
-    // Очищаем все таймеры
-    for (int i = 0; i < MAX_TIMERS; i++) {
-        timers[i].active = 0;
-    }
+    spinlock_init(&timer_hash_lock);
+    spinlock_init(&expired_lock);
 
     deck_init(&hardware_deck_context, "Hardware", DECK_PREFIX_HARDWARE, hardware_deck_process);
 }
@@ -1,6 +1,7 @@
 #include "deck_interface.h"
 #include "klib.h"
 #include "../task/task.h"  // NEW: Task system integration
+#include "../ipc/ipc.h"
 
 // ============================================================================
 // OPERATIONS DECK - Task & IPC Operations
@@ -36,6 +37,10 @@ int operations_deck_process(RoutingEntry* entry) {
 
                 // Return task ID as result
                 uint64_t* result = (uint64_t*)kmalloc(sizeof(uint64_t));
+                if (!result) {
+                    deck_error(entry, DECK_PREFIX_OPERATIONS, 10);
+                    return 0;
+                }
                 *result = task->task_id;
                 deck_complete(entry, DECK_PREFIX_OPERATIONS, result);
                 return 1;
@@ -103,6 +108,10 @@ int operations_deck_process(RoutingEntry* entry) {
             uint64_t task_id = task_get_current_id();
 
             uint64_t* result = (uint64_t*)kmalloc(sizeof(uint64_t));
+            if (!result) {
+                deck_error(entry, DECK_PREFIX_OPERATIONS, 10);
+                return 0;
+            }
             *result = task_id;
 
             deck_complete(entry, DECK_PREFIX_OPERATIONS, result);
@@ -153,15 +162,121 @@ int operations_deck_process(RoutingEntry* entry) {
             }
         }
 
-        // === IPC OPERATIONS (TODO - будет в следующей версии) ===
-        case EVENT_IPC_SEND:
-        case EVENT_IPC_RECV:
-        case EVENT_IPC_SHM_CREATE:
-        case EVENT_IPC_SHM_ATTACH:
+        // === IPC OPERATIONS ===
+        // Bulk data lives in shared segments and pipe rings (ipc.h); events
+        // only carry handles and addresses
+        case EVENT_IPC_SHM_CREATE: {
+            // Payload: [size:8] -> handle
+            uint64_t size = *(uint64_t*)event->data;
+
+            uint64_t handle = ipc_shm_create(size);
+            if (handle == IPC_INVALID_HANDLE) {
+                kprintf("[OPERATIONS] ERROR: Event %lu: cannot create %lu byte segment\n",
+                        event->id, size);
+                deck_error(entry, DECK_PREFIX_OPERATIONS, 6);
+                return 0;
+            }
+
+            uint64_t* result = (uint64_t*)kmalloc(sizeof(uint64_t));
+            if (!result) {
+                ipc_close(handle);
+                deck_error(entry, DECK_PREFIX_OPERATIONS, 10);
+                return 0;
+            }
+            *result = handle;
+            deck_complete(entry, DECK_PREFIX_OPERATIONS, result);
+            return 1;
+        }
+
+        case EVENT_IPC_SHM_ATTACH: {
+            // Payload: [handle:8][task_id:8] -> address
+            // Pipe handles attach too: the ring is then used in place.
+            // Only into the submitter (task_id 0 or its own id): there is no
+            // permission model yet for mapping into someone else
+            uint64_t handle = *(uint64_t*)event->data;
+            uint64_t task_id = *(uint64_t*)(event->data + 8);
+            if (task_id != 0 && task_id != event->user_id) {
+                kprintf("[OPERATIONS] ERROR: Event %lu: task %lu cannot attach into task %lu\n",
+                        event->id, event->user_id, task_id);
+                deck_error(entry, DECK_PREFIX_OPERATIONS, 11);
+                return 0;
+            }
+
+            // Allocated first: an attach cannot be taken back
+            uint64_t* result = (uint64_t*)kmalloc(sizeof(uint64_t));
+            if (!result) {
+                deck_error(entry, DECK_PREFIX_OPERATIONS, 10);
+                return 0;
+            }
+
+            uintptr_t addr = ipc_shm_attach(handle, event->user_id);
+            if (!addr) {
+                kfree(result);
+                kprintf("[OPERATIONS] ERROR: Event %lu: cannot attach handle %lu\n",
+                        event->id, handle);
+                deck_error(entry, DECK_PREFIX_OPERATIONS, 7);
+                return 0;
+            }
+
+            *result = addr;
+            deck_complete(entry, DECK_PREFIX_OPERATIONS, result);
+            return 1;
+        }
+
         case EVENT_IPC_PIPE_CREATE: {
-            kprintf("[OPERATIONS] Event %lu: IPC operation (type=%d) - TODO\n",
-                    event->id, event->type);
-            deck_complete(entry, DECK_PREFIX_OPERATIONS, 0);
+            // Payload: [capacity:8] -> [read_handle:8][write_handle:8]
+            uint64_t capacity = *(uint64_t*)event->data;
+
+            uint64_t* result = (uint64_t*)kmalloc(2 * sizeof(uint64_t));
+            if (!result || ipc_pipe_create(capacity, &result[0], &result[1]) != 0) {
+                if (result) kfree(result);
+                kprintf("[OPERATIONS] ERROR: Event %lu: cannot create pipe (%lu bytes)\n",
+                        event->id, capacity);
+                deck_error(entry, DECK_PREFIX_OPERATIONS, 8);
+                return 0;
+            }
+
+            deck_complete(entry, DECK_PREFIX_OPERATIONS, result);
+            return 1;
+        }
+
+        case EVENT_IPC_SEND:
+        case EVENT_IPC_RECV: {
+            // Copying path for tasks that did not attach the ring
+            // Payload: [handle:8][buffer:8][length:8] -> bytes moved (never blocks)
+            uint64_t handle = *(uint64_t*)event->data;
+            uintptr_t buffer = *(uint64_t*)(event->data + 8);
+            uint64_t length = *(uint64_t*)(event->data + 16);
+
+            // The buffer is an address in the submitter's space, not ours:
+            // copy through its context so a bad range fails the event
+            Task* submitter = task_get(event->user_id);
+            vmm_context_t* ctx = (submitter && submitter->vmm_ctx) ? submitter->vmm_ctx
+                                                                   : vmm_get_kernel_context();
+
+            // Allocated first: bytes moved through the ring cannot be put back
+            uint64_t* result = (uint64_t*)kmalloc(sizeof(uint64_t));
+            if (!result) {
+                deck_error(entry, DECK_PREFIX_OPERATIONS, 10);
+                return 0;
+            }
+
+            int64_t moved = -1;
+            if (buffer) {
+                moved = (event->type == EVENT_IPC_SEND) ? ipc_pipe_write_from(handle, ctx, buffer, length)
+                                                        : ipc_pipe_read_into(handle, ctx, buffer, length);
+            }
+
+            if (moved < 0) {
+                kprintf("[OPERATIONS] ERROR: Event %lu: IPC %s on handle %lu failed\n",
+                        event->id, event->type == EVENT_IPC_SEND ? "send" : "recv", handle);
+                kfree(result);
+                deck_error(entry, DECK_PREFIX_OPERATIONS, 9);
+                return 0;
+            }
+
+            *result = (uint64_t)moved;
+            deck_complete(entry, DECK_PREFIX_OPERATIONS, result);
             return 1;
         }
 
@@ -179,6 +294,7 @@ int operations_deck_process(RoutingEntry* entry) {
 DeckContext operations_deck_context;
 
 void operations_deck_init(void) {
+    ipc_init();
     deck_init(&operations_deck_context, "Operations", DECK_PREFIX_OPERATIONS, operations_deck_process);
 }
 
@@ -3,6 +3,7 @@
 #include "vmm.h"  // Virtual memory manager
 #include "klib.h"
 #include "../storage/tagfs.h"  // TagFS - Tag-based filesystem
+#include "../task/task.h"
 
 // ============================================================================
 // STORAGE DECK - Memory & Filesystem Operations
@@ -33,6 +34,20 @@ static spinlock_t fd_table_lock;
 // Глобальный счетчик FD
 static volatile uint64_t next_fd = 100;
 
+// Выделения EVENT_MEMORY_ALLOC / MAP: FREE освобождает и возвращает группе
+// ровно то, что было выделено и списано, а не размер из запроса
+#define MAX_MEMORY_RECORDS 256
+typedef struct {
+    void* address;
+    uint64_t owner;            // task_id, которому списано
+    uint64_t size;             // Списанные байты (целые страницы)
+    bool vmapped;              // MEMORY_MAP (vmalloc) или MEMORY_ALLOC (страницы VMM)
+    bool in_use;
+} MemoryRecord;
+
+static MemoryRecord memory_records[MAX_MEMORY_RECORDS];
+static spinlock_t memory_records_lock;
+
 // File stat structure (returned by fs_stat)
 typedef struct {
     uint64_t inode_id;           // Inode ID
@@ -56,19 +71,62 @@ static void* memory_alloc(uint64_t size) {
                                  VMM_FLAGS_KERNEL_RW);
 
     if (addr) {
-        kprintf("[STORAGE] Allocated %lu bytes (%lu pages) at %p\n",
+        klog_debug(KLOG_STORAGE, "[STORAGE] Allocated %lu bytes (%lu pages) at %p\n",
                 size, page_count, addr);
     } else {
-        kprintf("[STORAGE] Failed to allocate %lu bytes\n", size);
+        klog_error(KLOG_STORAGE, "[STORAGE] Failed to allocate %lu bytes\n", size);
     }
 
     return addr;
 }
 
+// Сколько байт списывается с группы задачи: целые страницы
+static uint64_t memory_charge_size(uint64_t size) {
+    return ((size + 4095) / 4096) * 4096;
+}
+
 static void memory_free(void* addr, uint64_t size) {
     size_t page_count = (size + 4095) / 4096;
     vmm_free_pages(vmm_get_kernel_context(), addr, page_count);
-    kprintf("[STORAGE] Freed memory at %p (%lu pages)\n", addr, page_count);
+    klog_debug(KLOG_STORAGE, "[STORAGE] Freed memory at %p (%lu pages)\n", addr, page_count);
+}
+
+// Запомнить выделение; false, если таблица заполнена
+static bool memory_record_add(void* addr, uint64_t owner, uint64_t size, bool vmapped) {
+    spin_lock(&memory_records_lock);
+
+    for (int i = 0; i < MAX_MEMORY_RECORDS; i++) {
+        if (!memory_records[i].in_use) {
+            memory_records[i].address = addr;
+            memory_records[i].owner = owner;
+            memory_records[i].size = size;
+            memory_records[i].vmapped = vmapped;
+            memory_records[i].in_use = true;
+            spin_unlock(&memory_records_lock);
+            return true;
+        }
+    }
+
+    spin_unlock(&memory_records_lock);
+    return false;
+}
+
+// Забрать запись о выделении addr задачей owner (чужое освободить нельзя)
+static bool memory_record_take(void* addr, uint64_t owner, MemoryRecord* out) {
+    spin_lock(&memory_records_lock);
+
+    for (int i = 0; i < MAX_MEMORY_RECORDS; i++) {
+        if (memory_records[i].in_use && memory_records[i].address == addr &&
+            memory_records[i].owner == owner) {
+            *out = memory_records[i];
+            memory_records[i].in_use = false;
+            spin_unlock(&memory_records_lock);
+            return true;
+        }
+    }
+
+    spin_unlock(&memory_records_lock);
+    return false;
 }
 
 // ============================================================================
@@ -158,11 +216,11 @@ static int fs_open(const char* path) {
         int fd = allocate_fd(inode_id, path, 0);  // flags=0 for now
 
         if (fd >= 0) {
-            kprintf("[STORAGE] Opened file '%s' (inode=%lu, fd=%d)\n",
+            klog_debug(KLOG_STORAGE, "[STORAGE] Opened file '%s' (inode=%lu, fd=%d)\n",
                     path, inode_id, fd);
             return fd;
         } else {
-            kprintf("[STORAGE] ERROR: Failed to allocate FD for '%s'\n", path);
+            klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Failed to allocate FD for '%s'\n", path);
             return -1;
         }
     } else {
@@ -177,11 +235,11 @@ static int fs_open(const char* path) {
 
         if (inode_id != TAGFS_INVALID_INODE) {
             int fd = allocate_fd(inode_id, path, 0);
-            kprintf("[STORAGE] Created & opened file '%s' (inode=%lu, fd=%d)\n",
+            klog_debug(KLOG_STORAGE, "[STORAGE] Created & opened file '%s' (inode=%lu, fd=%d)\n",
                     path, inode_id, fd);
             return fd;
         } else {
-            kprintf("[STORAGE] ERROR: Failed to create file '%s'\n", path);
+            klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Failed to create file '%s'\n", path);
             return -1;
         }
     }
@@ -192,12 +250,12 @@ static int fs_close(int fd) {
     FileDescriptor* fd_info = find_fd(fd);
 
     if (fd_info) {
-        kprintf("[STORAGE] Closed fd=%d (inode=%lu, '%s')\n",
+        klog_debug(KLOG_STORAGE, "[STORAGE] Closed fd=%d (inode=%lu, '%s')\n",
                 fd, fd_info->inode_id, fd_info->path);
         free_fd(fd);
         return 0;
     } else {
-        kprintf("[STORAGE] ERROR: Invalid fd=%d\n", fd);
+        klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Invalid fd=%d\n", fd);
         return -1;
     }
 }
@@ -207,7 +265,7 @@ static int fs_read(int fd, void* buffer, uint64_t size) {
     FileDescriptor* fd_info = find_fd(fd);
 
     if (!fd_info) {
-        kprintf("[STORAGE] ERROR: Read: invalid fd=%d\n", fd);
+        klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Read: invalid fd=%d\n", fd);
         return -1;
     }
 
@@ -217,11 +275,11 @@ static int fs_read(int fd, void* buffer, uint64_t size) {
 
     if (bytes_read >= 0) {
         fd_info->position += bytes_read;
-        kprintf("[STORAGE] Read %d bytes from fd=%d (inode=%lu, pos=%lu)\n",
+        klog_debug(KLOG_STORAGE, "[STORAGE] Read %d bytes from fd=%d (inode=%lu, pos=%lu)\n",
                 bytes_read, fd, fd_info->inode_id, fd_info->position);
         return bytes_read;
     } else {
-        kprintf("[STORAGE] ERROR: Read failed from fd=%d\n", fd);
+        klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Read failed from fd=%d\n", fd);
         return -1;
     }
 }
@@ -231,7 +289,7 @@ static int fs_write(int fd, const void* buffer, uint64_t size) {
     FileDescriptor* fd_info = find_fd(fd);
 
     if (!fd_info) {
-        kprintf("[STORAGE] ERROR: Write: invalid fd=%d\n", fd);
+        klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Write: invalid fd=%d\n", fd);
         return -1;
     }
 
@@ -248,11 +306,11 @@ static int fs_write(int fd, const void* buffer, uint64_t size) {
             fd_info->size = inode->size;
         }
 
-        kprintf("[STORAGE] Wrote %d bytes to fd=%d (inode=%lu, pos=%lu, size=%lu)\n",
+        klog_debug(KLOG_STORAGE, "[STORAGE] Wrote %d bytes to fd=%d (inode=%lu, pos=%lu, size=%lu)\n",
                 bytes_written, fd, fd_info->inode_id, fd_info->position, fd_info->size);
         return bytes_written;
     } else {
-        kprintf("[STORAGE] ERROR: Write failed to fd=%d\n", fd);
+        klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Write failed to fd=%d\n", fd);
         return -1;
     }
 }
@@ -287,15 +345,15 @@ static int fs_stat(const char* path, FileStat* stat_buf) {
             stat_buf->tag_count = inode->tag_count;
             stat_buf->flags = inode->flags;
 
-            kprintf("[STORAGE] Stat '%s': inode=%lu, size=%lu bytes, tags=%u\n",
+            klog_debug(KLOG_STORAGE, "[STORAGE] Stat '%s': inode=%lu, size=%lu bytes, tags=%u\n",
                     path, inode_id, inode->size, inode->tag_count);
             return 0;  // Success
         } else {
-            kprintf("[STORAGE] ERROR: Stat '%s': inode not found in memory\n", path);
+            klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Stat '%s': inode not found in memory\n", path);
             return -1;
         }
     } else {
-        kprintf("[STORAGE] ERROR: Stat '%s': file not found\n", path);
+        klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Stat '%s': file not found\n", path);
         return -1;  // File not found
     }
 }
@@ -307,30 +365,65 @@ static int fs_stat(const char* path, FileStat* stat_buf) {
 int storage_deck_process(RoutingEntry* entry) {
     Event* event = &entry->event_copy;
 
+    // File operations count as I/O of the task that sent them
+    if (event->type >= EVENT_FILE_OPEN && event->type <= EVENT_FILE_TAG_GET) {
+        task_count_io(event->user_id);
+    }
+
     switch (event->type) {
         // === MEMORY OPERATIONS ===
         case EVENT_MEMORY_ALLOC: {
             uint64_t size = *(uint64_t*)event->data;
+            uint64_t charge = memory_charge_size(size);
+
+            if (task_group_charge_memory(event->user_id, charge) != 0) {
+                deck_error(entry, DECK_PREFIX_STORAGE, 15);
+                klog_warn(KLOG_STORAGE, "[STORAGE] Event %lu: %lu bytes over the group memory limit of task %lu\n",
+                        event->id, charge, event->user_id);
+                return 0;
+            }
+
             void* addr = memory_alloc(size);
+            if (addr && !memory_record_add(addr, event->user_id, charge, false)) {
+                klog_error(KLOG_STORAGE, "[STORAGE] Event %lu: allocation table full\n", event->id);
+                memory_free(addr, size);
+                addr = NULL;
+            }
 
             if (addr) {
                 deck_complete(entry, DECK_PREFIX_STORAGE, addr);
-                kprintf("[STORAGE] Event %lu: allocated %lu bytes\n",
+                klog_debug(KLOG_STORAGE, "[STORAGE] Event %lu: allocated %lu bytes\n",
                         event->id, size);
                 return 1;
             } else {
+                task_group_uncharge_memory(event->user_id, charge);
                 deck_error(entry, DECK_PREFIX_STORAGE, 1);
-                kprintf("[STORAGE] Event %lu: allocation failed\n", event->id);
+                klog_error(KLOG_STORAGE, "[STORAGE] Event %lu: allocation failed\n", event->id);
                 return 0;
             }
         }
 
         case EVENT_MEMORY_FREE: {
+            // Payload: [addr:8][size:8]; the size is taken from the record,
+            // the one in the payload is not trusted
             void* addr = *(void**)event->data;
-            uint64_t size = *(uint64_t*)(event->data + 8);
-            memory_free(addr, size);
+
+            MemoryRecord record;
+            if (!memory_record_take(addr, event->user_id, &record)) {
+                deck_error(entry, DECK_PREFIX_STORAGE, 16);
+                klog_warn(KLOG_STORAGE, "[STORAGE] Event %lu: %p is not an allocation of task %lu\n",
+                        event->id, addr, event->user_id);
+                return 0;
+            }
+
+            if (record.vmapped) {
+                vfree(addr);
+            } else {
+                memory_free(addr, record.size);
+            }
+            task_group_uncharge_memory(event->user_id, record.size);
             deck_complete(entry, DECK_PREFIX_STORAGE, 0);
-            kprintf("[STORAGE] Event %lu: freed memory at %p\n", event->id, addr);
+            klog_debug(KLOG_STORAGE, "[STORAGE] Event %lu: freed memory at %p\n", event->id, addr);
             return 1;
         }
 
@@ -345,8 +438,21 @@ int storage_deck_process(RoutingEntry* entry) {
             // File-backed mapping can be added later
 
             if (fd == -1) {
+                uint64_t charge = memory_charge_size(size);
+                if (task_group_charge_memory(event->user_id, charge) != 0) {
+                    deck_error(entry, DECK_PREFIX_STORAGE, 15);
+                    klog_warn(KLOG_STORAGE, "[STORAGE] Event %lu: mapping of %lu bytes over the group memory limit of task %lu\n",
+                            event->id, charge, event->user_id);
+                    return 0;
+                }
+
                 // Anonymous mapping - allocate virtual memory
                 void* mapped_addr = vmalloc(size);
+                if (mapped_addr && !memory_record_add(mapped_addr, event->user_id, charge, true)) {
+                    klog_error(KLOG_STORAGE, "[STORAGE] Event %lu: allocation table full\n", event->id);
+                    vfree(mapped_addr);
+                    mapped_addr = NULL;
+                }
 
                 if (mapped_addr) {
                     // Zero-initialize if requested
@@ -354,18 +460,19 @@ int storage_deck_process(RoutingEntry* entry) {
                         memset(mapped_addr, 0, size);
                     }
 
-                    kprintf("[STORAGE] Memory mapped %lu bytes at %p (anonymous)\n",
+                    klog_debug(KLOG_STORAGE, "[STORAGE] Memory mapped %lu bytes at %p (anonymous)\n",
                             size, mapped_addr);
                     deck_complete(entry, DECK_PREFIX_STORAGE, mapped_addr);
                     return 1;
                 } else {
-                    kprintf("[STORAGE] ERROR: Memory mapping failed for %lu bytes\n", size);
+                    task_group_uncharge_memory(event->user_id, charge);
+                    klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Memory mapping failed for %lu bytes\n", size);
                     deck_error(entry, DECK_PREFIX_STORAGE, 9);
                     return 0;
                 }
             } else {
                 // File-backed mapping - TODO: implement later
-                kprintf("[STORAGE] ERROR: File-backed memory mapping not yet supported (fd=%d)\n", fd);
+                klog_error(KLOG_STORAGE, "[STORAGE] ERROR: File-backed memory mapping not yet supported (fd=%d)\n", fd);
                 deck_error(entry, DECK_PREFIX_STORAGE, 10);
                 return 0;
             }
@@ -449,7 +556,7 @@ int storage_deck_process(RoutingEntry* entry) {
             // Allocate stat buffer to return to caller
             FileStat* stat_buf = (FileStat*)kmalloc(sizeof(FileStat));
             if (!stat_buf) {
-                kprintf("[STORAGE] ERROR: Failed to allocate stat buffer\n");
+                klog_error(KLOG_STORAGE, "[STORAGE] ERROR: Failed to allocate stat buffer\n");
                 deck_error(entry, DECK_PREFIX_STORAGE, 7);
                 return 0;
             }
@@ -477,12 +584,12 @@ int storage_deck_process(RoutingEntry* entry) {
             uint64_t inode_id = tagfs_create_file(tags, tag_count);
             if (inode_id != TAGFS_INVALID_INODE) {
                 deck_complete(entry, DECK_PREFIX_STORAGE, (void*)inode_id);
-                kprintf("[STORAGE] Event %lu: created file inode=%lu with %u tags\n",
+                klog_debug(KLOG_STORAGE, "[STORAGE] Event %lu: created file inode=%lu with %u tags\n",
                         event->id, inode_id, tag_count);
                 return 1;
             } else {
                 deck_error(entry, DECK_PREFIX_STORAGE, 10);
-                kprintf("[STORAGE] Event %lu: failed to create tagged file\n", event->id);
+                klog_error(KLOG_STORAGE, "[STORAGE] Event %lu: failed to create tagged file\n", event->id);
                 return 0;
             }
         }
@@ -507,13 +614,13 @@ int storage_deck_process(RoutingEntry* entry) {
             if (success) {
                 // Pass results back (will be in Response)
                 deck_complete(entry, DECK_PREFIX_STORAGE, result_inodes);
-                kprintf("[STORAGE] Event %lu: query found %u files\n",
+                klog_debug(KLOG_STORAGE, "[STORAGE] Event %lu: query found %u files\n",
                         event->id, query.result_count);
                 return 1;
             } else {
                 kfree(result_inodes);
                 deck_error(entry, DECK_PREFIX_STORAGE, 11);
-                kprintf("[STORAGE] Event %lu: query failed\n", event->id);
+                klog_error(KLOG_STORAGE, "[STORAGE] Event %lu: query failed\n", event->id);
                 return 0;
             }
         }
@@ -526,12 +633,12 @@ int storage_deck_process(RoutingEntry* entry) {
             int success = tagfs_add_tag(inode_id, tag);
             if (success) {
                 deck_complete(entry, DECK_PREFIX_STORAGE, 0);
-                kprintf("[STORAGE] Event %lu: added tag %s:%s to inode=%lu\n",
+                klog_debug(KLOG_STORAGE, "[STORAGE] Event %lu: added tag %s:%s to inode=%lu\n",
                         event->id, tag->key, tag->value, inode_id);
                 return 1;
             } else {
                 deck_error(entry, DECK_PREFIX_STORAGE, 12);
-                kprintf("[STORAGE] Event %lu: failed to add tag to inode=%lu\n",
+                klog_error(KLOG_STORAGE, "[STORAGE] Event %lu: failed to add tag to inode=%lu\n",
                         event->id, inode_id);
                 return 0;
             }
@@ -545,12 +652,12 @@ int storage_deck_process(RoutingEntry* entry) {
             int success = tagfs_remove_tag(inode_id, key);
             if (success) {
                 deck_complete(entry, DECK_PREFIX_STORAGE, 0);
-                kprintf("[STORAGE] Event %lu: removed tag '%s' from inode=%lu\n",
+                klog_debug(KLOG_STORAGE, "[STORAGE] Event %lu: removed tag '%s' from inode=%lu\n",
                         event->id, key, inode_id);
                 return 1;
             } else {
                 deck_error(entry, DECK_PREFIX_STORAGE, 13);
-                kprintf("[STORAGE] Event %lu: failed to remove tag from inode=%lu\n",
+                klog_error(KLOG_STORAGE, "[STORAGE] Event %lu: failed to remove tag from inode=%lu\n",
                         event->id, inode_id);
                 return 0;
             }
@@ -566,20 +673,20 @@ int storage_deck_process(RoutingEntry* entry) {
             int success = tagfs_get_tags(inode_id, tags, &count);
             if (success) {
                 deck_complete(entry, DECK_PREFIX_STORAGE, tags);
-                kprintf("[STORAGE] Event %lu: retrieved %u tags from inode=%lu\n",
+                klog_debug(KLOG_STORAGE, "[STORAGE] Event %lu: retrieved %u tags from inode=%lu\n",
                         event->id, count, inode_id);
                 return 1;
             } else {
                 kfree(tags);
                 deck_error(entry, DECK_PREFIX_STORAGE, 14);
-                kprintf("[STORAGE] Event %lu: failed to get tags from inode=%lu\n",
+                klog_error(KLOG_STORAGE, "[STORAGE] Event %lu: failed to get tags from inode=%lu\n",
                         event->id, inode_id);
                 return 0;
             }
         }
 
         default:
-            kprintf("[STORAGE] Unknown event type %d\n", event->type);
+            klog_debug(KLOG_STORAGE, "[STORAGE] Unknown event type %d\n", event->type);
             deck_error(entry, DECK_PREFIX_STORAGE, 3);
             return 0;
     }
@@ -597,11 +704,14 @@ void storage_deck_init(void) {
     // Initialize FD table
     memset(fd_table, 0, sizeof(fd_table));
     spinlock_init(&fd_table_lock);
-    kprintf("[STORAGE] FD table initialized (%d slots)\n", MAX_OPEN_FILES);
+    klog_info(KLOG_STORAGE, "[STORAGE] FD table initialized (%d slots)\n", MAX_OPEN_FILES);
+
+    memset(memory_records, 0, sizeof(memory_records));
+    spinlock_init(&memory_records_lock);
 
     // Initialize TagFS
     tagfs_init();
-    kprintf("[STORAGE] TagFS initialized\n");
+    klog_info(KLOG_STORAGE, "[STORAGE] TagFS initialized\n");
 }
 
 int storage_deck_run_once(void) {
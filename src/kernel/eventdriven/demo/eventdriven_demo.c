@@ -293,6 +293,10 @@ void eventdriven_demo_run(void) {
         // Set memory limit for group
         kprintf("[DEMO] Setting group memory limit to 1MB...\n");
         task_group_set_memory_limit(group_id, 1024 * 1024);
+
+        // Cap the group's CPU share so it cannot starve the other tests
+        kprintf("[DEMO] Capping group CPU share at 50%%...\n");
+        task_group_set_energy_limit(group_id, 50);
     }
 
     kprintf("\n--- TEST 9: Task Health & Statistics ---\n");
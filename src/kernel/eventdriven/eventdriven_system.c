@@ -39,14 +39,14 @@ static ResponseRingBuffer kernel_to_user_buffer;
 // ============================================================================
 
 void eventdriven_system_init(void) {
-    kprintf("\n");
-    kprintf("============================================================\n");
-    kprintf("  EVENT-DRIVEN SYSTEM INITIALIZATION (v1)\n");
-    kprintf("============================================================\n");
-    kprintf("\n");
+    klog_info(KLOG_PIPELINE, "\n");
+    klog_info(KLOG_PIPELINE, "============================================================\n");
+    klog_info(KLOG_PIPELINE, "  EVENT-DRIVEN SYSTEM INITIALIZATION (v1)\n");
+    klog_info(KLOG_PIPELINE, "============================================================\n");
+    klog_info(KLOG_PIPELINE, "\n");
 
     // 1. Инициализируем ring buffers
-    kprintf("[SYSTEM] Initializing ring buffers...\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] Initializing ring buffers...\n");
     event_ring_init(&user_to_kernel_buffer);
     event_ring_init(&receiver_to_center_buffer);
     response_ring_init(&kernel_to_user_buffer);
@@ -55,22 +55,22 @@ void eventdriven_system_init(void) {
     global_event_system.receiver_to_center_ring = &receiver_to_center_buffer;
     global_event_system.kernel_to_user_ring = &kernel_to_user_buffer;
 
-    kprintf("[SYSTEM] Ring buffers initialized\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] Ring buffers initialized\n");
 
     // 2. Инициализируем routing table
-    kprintf("[SYSTEM] Initializing routing table...\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] Initializing routing table...\n");
     routing_table_init(&global_routing_table);
     global_event_system.routing_table = &global_routing_table;
 
     // 3. Инициализируем компоненты pipeline
-    kprintf("[SYSTEM] Initializing pipeline components...\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] Initializing pipeline components...\n");
 
     receiver_init();
     center_init();  // Center теперь включает Security проверки!
     guide_init(&global_routing_table);
 
     // 4. Инициализируем 4 processing decks (НОВАЯ АРХИТЕКТУРА)
-    kprintf("[SYSTEM] Initializing processing decks...\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] Initializing processing decks...\n");
 
     operations_deck_init();  // Process + IPC
     storage_deck_init();     // Memory + Filesystem
@@ -78,19 +78,19 @@ void eventdriven_system_init(void) {
     network_deck_init();     // Network (stub в v1)
 
     // 5. Инициализируем execution deck
-    kprintf("[SYSTEM] Initializing execution deck...\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] Initializing execution deck...\n");
     execution_deck_init(&kernel_to_user_buffer, &global_routing_table);
 
     global_event_system.initialized = 1;
     global_event_system.running = 0;
 
-    kprintf("\n");
-    kprintf("============================================================\n");
-    kprintf("  EVENT-DRIVEN SYSTEM INITIALIZED SUCCESSFULLY\n");
-    kprintf("  Architecture: 4 decks (OPERATIONS, STORAGE, HARDWARE, NETWORK)\n");
-    kprintf("  Security: Integrated in Center (pre-routing check)\n");
-    kprintf("============================================================\n");
-    kprintf("\n");
+    klog_info(KLOG_PIPELINE, "\n");
+    klog_info(KLOG_PIPELINE, "============================================================\n");
+    klog_info(KLOG_PIPELINE, "  EVENT-DRIVEN SYSTEM INITIALIZED SUCCESSFULLY\n");
+    klog_info(KLOG_PIPELINE, "  Architecture: 4 decks (OPERATIONS, STORAGE, HARDWARE, NETWORK)\n");
+    klog_info(KLOG_PIPELINE, "  Security: Integrated in Center (pre-routing check)\n");
+    klog_info(KLOG_PIPELINE, "============================================================\n");
+    klog_info(KLOG_PIPELINE, "\n");
 }
 
 // ============================================================================
@@ -102,11 +102,11 @@ void eventdriven_system_init(void) {
 
 void eventdriven_system_start(void) {
     if (!global_event_system.initialized) {
-        kprintf("[SYSTEM] ERROR: System not initialized!\n");
+        klog_error(KLOG_PIPELINE, "[SYSTEM] ERROR: System not initialized!\n");
         return;
     }
 
-    kprintf("[SYSTEM] Starting event-driven system...\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] Starting event-driven system...\n");
     global_event_system.running = 1;
 
     // TODO: В реальной системе здесь должны быть:
@@ -114,8 +114,8 @@ void eventdriven_system_start(void) {
     // 2. Создание kernel threads для каждого компонента
     // 3. Запуск всех компонентов параллельно
 
-    kprintf("[SYSTEM] System is ready to process events!\n");
-    kprintf("[SYSTEM] NOTE: Using synchronous processing for demo\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] System is ready to process events!\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] NOTE: Using synchronous processing for demo\n");
 }
 
 // ============================================================================
@@ -161,9 +161,9 @@ void eventdriven_process_events(int iterations) {
 // ============================================================================
 
 void eventdriven_system_stop(void) {
-    kprintf("[SYSTEM] Stopping event-driven system...\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] Stopping event-driven system...\n");
     global_event_system.running = 0;
-    kprintf("[SYSTEM] System stopped\n");
+    klog_info(KLOG_PIPELINE, "[SYSTEM] System stopped\n");
 }
 
 // ============================================================================
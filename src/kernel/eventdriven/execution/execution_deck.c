@@ -1,5 +1,6 @@
 #include "execution_deck.h"
 #include "klib.h"
+#include "../task/task.h"
 
 // ============================================================================
 // GLOBAL STATE
@@ -23,7 +24,7 @@ void execution_deck_init(ResponseRingBuffer* resp_ring, RoutingTable* rtable) {
     execution_stats.responses_sent = 0;
     execution_stats.errors = 0;
 
-    kprintf("[EXECUTION] Initialized\n");
+    klog_info(KLOG_PIPELINE, "[EXECUTION] Initialized\n");
 }
 
 // ============================================================================
@@ -55,12 +56,12 @@ static void collect_results(RoutingEntry* entry, Response* response) {
         *(void**)response->result = deck_result;
         response->result_size = sizeof(void*);
 
-        kprintf("[EXECUTION] Collected result from deck at index %d for event %lu\n",
+        klog_debug(KLOG_PIPELINE, "[EXECUTION] Collected result from deck at index %d for event %lu\n",
                 result_index, entry->event_id);
     } else {
         // Нет результатов (событие прошло, но ничего не вернуло)
         response->result_size = 0;
-        kprintf("[EXECUTION] No results for event %lu\n", entry->event_id);
+        klog_debug(KLOG_PIPELINE, "[EXECUTION] No results for event %lu\n", entry->event_id);
     }
 }
 
@@ -80,7 +81,10 @@ static void process_completed_event(RoutingEntry* entry) {
 
     atomic_increment_u64((volatile uint64_t*)&execution_stats.responses_sent);
 
-    kprintf("[EXECUTION] Sent response for event %lu to user space\n", entry->event_id);
+    // Прогресс (или ошибка) задачи, отправившей событие
+    task_count_completion(entry->event_copy.user_id, entry->abort_flag != 0);
+
+    klog_debug(KLOG_PIPELINE, "[EXECUTION] Sent response for event %lu to user space\n", entry->event_id);
 
     // 3. Удаляем routing entry из таблицы (освобождаем ресурсы)
     routing_table_remove(routing_table, entry->event_id);
@@ -106,7 +110,7 @@ int execution_deck_run_once(void) {
 }
 
 void execution_deck_run(void) {
-    kprintf("[EXECUTION] Starting main loop...\n");
+    klog_debug(KLOG_PIPELINE, "[EXECUTION] Starting main loop...\n");
 
     uint64_t iterations = 0;
 
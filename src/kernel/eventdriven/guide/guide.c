@@ -13,7 +13,7 @@ GuideContext guide_context;
 // ============================================================================
 
 void guide_init(RoutingTable* routing_table) {
-    kprintf("[GUIDE] Initializing...\n");
+    klog_info(KLOG_PIPELINE, "[GUIDE] Initializing...\n");
 
     guide_context.routing_table = routing_table;
     guide_context.scan_position = 0;
@@ -29,7 +29,7 @@ void guide_init(RoutingTable* routing_table) {
     guide_stats.events_completed = 0;
     guide_stats.routing_iterations = 0;
 
-    kprintf("[GUIDE] Initialized (4 decks: OPERATIONS, STORAGE, HARDWARE, NETWORK)\n");
+    klog_info(KLOG_PIPELINE, "[GUIDE] Initialized (4 decks: OPERATIONS, STORAGE, HARDWARE, NETWORK)\n");
 }
 
 // ============================================================================
@@ -43,7 +43,7 @@ void guide_scan_and_dispatch(RoutingTable* routing_table) {
 }
 
 void guide_run(void) {
-    kprintf("[GUIDE] Starting main loop...\n");
+    klog_debug(KLOG_PIPELINE, "[GUIDE] Starting main loop...\n");
 
     uint64_t iterations = 0;
 
@@ -0,0 +1,435 @@
+#include "ipc.h"
+#include "klib.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "../task/task.h"
+
+// ============================================================================
+// GLOBAL STATE
+// ============================================================================
+
+typedef struct {
+    uint64_t refcount;          // Handles that name the segment
+    uintptr_t phys;             // First frame; segments are physically contiguous
+    size_t pages;
+    uint8_t* kernel_addr;       // Direct-map view
+    ipc_pipe_t* pipe;           // Pipe header, NULL for plain shared memory
+} IpcSegment;
+
+typedef struct {
+    IpcSegment* segment;
+    IpcHandleType type;
+} IpcHandle;
+
+static IpcHandle ipc_handles[IPC_MAX_HANDLES];
+static uint32_t ipc_generation[IPC_MAX_HANDLES];
+static spinlock_t ipc_lock;
+
+// ============================================================================
+// SEGMENTS
+// ============================================================================
+
+static IpcSegment* ipc_segment_create(size_t size) {
+    if (size == 0 || size > IPC_SHM_MAX_SIZE) return NULL;
+
+    IpcSegment* segment = (IpcSegment*)kmalloc(sizeof(IpcSegment));
+    if (!segment) return NULL;
+
+    segment->pages = (size + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    void* frames = pmm_alloc_zero(segment->pages);
+    if (!frames) {
+        kfree(segment);
+        return NULL;
+    }
+
+    segment->refcount = 0;
+    segment->phys = (uintptr_t)frames;
+    segment->kernel_addr = (uint8_t*)vmm_phys_to_virt(segment->phys);
+    segment->pipe = NULL;
+    return segment;
+}
+
+// Frames mapped into tasks carry their own references (vmm_map_shared),
+// so this only drops the segment's
+static void ipc_segment_put(IpcSegment* segment) {
+    if (atomic_decrement_u64(&segment->refcount) != 0) return;
+
+    pmm_free((void*)segment->phys, segment->pages);
+    kfree(segment);
+}
+
+// ============================================================================
+// HANDLE TABLE
+// ============================================================================
+
+void ipc_init(void) {
+    spinlock_init(&ipc_lock);
+    for (uint32_t i = 0; i < IPC_MAX_HANDLES; i++) {
+        ipc_handles[i].segment = NULL;
+        ipc_handles[i].type = IPC_HANDLE_FREE;
+        ipc_generation[i] = 1;
+    }
+
+    klog_info(KLOG_IPC, "[IPC] Handle table: %u slots, segments up to %llu KB\n",
+              IPC_MAX_HANDLES, (unsigned long long)(IPC_SHM_MAX_SIZE >> 10));
+}
+
+// Slot 0 is never handed out, so a valid handle is never 0
+static uint64_t ipc_handle_alloc(IpcSegment* segment, IpcHandleType type) {
+    spin_lock(&ipc_lock);
+
+    for (uint32_t slot = 1; slot < IPC_MAX_HANDLES; slot++) {
+        if (ipc_handles[slot].type != IPC_HANDLE_FREE) continue;
+
+        ipc_handles[slot].segment = segment;
+        ipc_handles[slot].type = type;
+        atomic_increment_u64(&segment->refcount);
+
+        uint64_t handle = IPC_MAKE_HANDLE(ipc_generation[slot], slot);
+        spin_unlock(&ipc_lock);
+        return handle;
+    }
+
+    spin_unlock(&ipc_lock);
+    klog_warn(KLOG_IPC, "[IPC] Handle table full\n");
+    return IPC_INVALID_HANDLE;
+}
+
+// Returns the segment with a reference held (drop with ipc_segment_put)
+static IpcSegment* ipc_handle_get(uint64_t handle, IpcHandleType* type) {
+    uint32_t slot = IPC_HANDLE_SLOT(handle);
+    if (slot == 0) return NULL;
+
+    spin_lock(&ipc_lock);
+
+    IpcHandle* entry = &ipc_handles[slot];
+    if (entry->type == IPC_HANDLE_FREE || ipc_generation[slot] != IPC_HANDLE_GENERATION(handle)) {
+        spin_unlock(&ipc_lock);
+        return NULL;
+    }
+
+    IpcSegment* segment = entry->segment;
+    atomic_increment_u64(&segment->refcount);
+    if (type) *type = entry->type;
+
+    spin_unlock(&ipc_lock);
+    return segment;
+}
+
+// Pipe end of the requested type, or NULL
+static ipc_pipe_t* ipc_pipe_get(uint64_t handle, IpcHandleType want, IpcSegment** segment) {
+    IpcHandleType type;
+    *segment = ipc_handle_get(handle, &type);
+    if (!*segment) return NULL;
+
+    if (type != want || !(*segment)->pipe) {
+        ipc_segment_put(*segment);
+        *segment = NULL;
+        return NULL;
+    }
+
+    return (*segment)->pipe;
+}
+
+int ipc_close(uint64_t handle) {
+    uint32_t slot = IPC_HANDLE_SLOT(handle);
+    if (slot == 0) return -1;
+
+    spin_lock(&ipc_lock);
+
+    IpcHandle* entry = &ipc_handles[slot];
+    if (entry->type == IPC_HANDLE_FREE || ipc_generation[slot] != IPC_HANDLE_GENERATION(handle)) {
+        spin_unlock(&ipc_lock);
+        return -1;
+    }
+
+    IpcSegment* segment = entry->segment;
+    IpcHandleType type = entry->type;
+
+    entry->segment = NULL;
+    entry->type = IPC_HANDLE_FREE;
+
+    // Retire the handle; generation 0 is never used
+    uint32_t gen = ipc_generation[slot] + 1;
+    ipc_generation[slot] = gen ? gen : 1;
+
+    spin_unlock(&ipc_lock);
+
+    if (type == IPC_HANDLE_PIPE_WRITE) {
+        __atomic_fetch_or(&segment->pipe->closed, IPC_PIPE_WRITER_CLOSED, __ATOMIC_RELEASE);
+    } else if (type == IPC_HANDLE_PIPE_READ) {
+        __atomic_fetch_or(&segment->pipe->closed, IPC_PIPE_READER_CLOSED, __ATOMIC_RELEASE);
+    }
+
+    ipc_segment_put(segment);
+    return 0;
+}
+
+IpcHandleType ipc_handle_type(uint64_t handle) {
+    IpcHandleType type;
+    IpcSegment* segment = ipc_handle_get(handle, &type);
+    if (!segment) return IPC_HANDLE_FREE;
+
+    ipc_segment_put(segment);
+    return type;
+}
+
+// ============================================================================
+// SHARED MEMORY
+// ============================================================================
+
+uint64_t ipc_shm_create(size_t size) {
+    IpcSegment* segment = ipc_segment_create(size);
+    if (!segment) {
+        klog_warn(KLOG_IPC, "[IPC] Cannot create a %llu byte segment\n", (unsigned long long)size);
+        return IPC_INVALID_HANDLE;
+    }
+
+    uint64_t handle = ipc_handle_alloc(segment, IPC_HANDLE_SHM);
+    if (handle == IPC_INVALID_HANDLE) {
+        pmm_free((void*)segment->phys, segment->pages);
+        kfree(segment);
+        return IPC_INVALID_HANDLE;
+    }
+
+    klog_debug(KLOG_IPC, "[IPC] Segment %llu: %llu pages at phys 0x%llx\n",
+               (unsigned long long)handle, (unsigned long long)segment->pages,
+               (unsigned long long)segment->phys);
+    return handle;
+}
+
+uintptr_t ipc_shm_attach(uint64_t handle, uint64_t task_id) {
+    IpcSegment* segment = ipc_handle_get(handle, NULL);
+    if (!segment) return 0;
+
+    Task* task = task_id ? task_get(task_id) : task_get_current();
+    if (!task) {
+        ipc_segment_put(segment);
+        return 0;
+    }
+
+    vmm_context_t* ctx = task->vmm_ctx;
+    uintptr_t addr = 0;
+
+    if (!ctx || ctx == vmm_get_kernel_context()) {
+        // Kernel-context tasks already see every frame through the direct map
+        addr = (uintptr_t)segment->kernel_addr;
+    } else {
+        addr = (uintptr_t)vmm_map_shared(ctx, segment->phys, segment->pages,
+                                         VMM_FLAGS_USER_RW | VMM_FLAG_NO_EXECUTE);
+        if (!addr) {
+            klog_warn(KLOG_IPC, "[IPC] Attach of %llu failed: %s\n",
+                      (unsigned long long)handle, vmm_get_last_error());
+        }
+    }
+
+    ipc_segment_put(segment);
+    return addr;
+}
+
+size_t ipc_shm_size(uint64_t handle) {
+    IpcSegment* segment = ipc_handle_get(handle, NULL);
+    if (!segment) return 0;
+
+    size_t size = segment->pages * VMM_PAGE_SIZE;
+    ipc_segment_put(segment);
+    return size;
+}
+
+// ============================================================================
+// PIPES
+// ============================================================================
+
+int ipc_pipe_create(size_t capacity, uint64_t* read_handle, uint64_t* write_handle) {
+    if (!read_handle || !write_handle || capacity > IPC_PIPE_MAX_CAPACITY) return -1;
+
+    size_t ring = IPC_PIPE_MIN_CAPACITY;
+    while (ring < capacity) ring <<= 1;
+
+    IpcSegment* segment = ipc_segment_create(IPC_PIPE_DATA_OFFSET + ring);
+    if (!segment) return -1;
+
+    segment->pipe = (ipc_pipe_t*)segment->kernel_addr;
+    segment->pipe->capacity = ring;
+    segment->pipe->data_offset = IPC_PIPE_DATA_OFFSET;
+
+    *read_handle = ipc_handle_alloc(segment, IPC_HANDLE_PIPE_READ);
+    if (*read_handle == IPC_INVALID_HANDLE) {
+        pmm_free((void*)segment->phys, segment->pages);
+        kfree(segment);
+        return -1;
+    }
+
+    *write_handle = ipc_handle_alloc(segment, IPC_HANDLE_PIPE_WRITE);
+    if (*write_handle == IPC_INVALID_HANDLE) {
+        ipc_close(*read_handle);    // Last reference: frees the segment
+        *read_handle = IPC_INVALID_HANDLE;
+        return -1;
+    }
+
+    klog_debug(KLOG_IPC, "[IPC] Pipe %llu -> %llu: %llu byte ring\n",
+               (unsigned long long)*write_handle, (unsigned long long)*read_handle,
+               (unsigned long long)ring);
+    return 0;
+}
+
+static inline uint8_t* ipc_pipe_data(ipc_pipe_t* pipe) {
+    return (uint8_t*)pipe + IPC_PIPE_DATA_OFFSET;
+}
+
+void* ipc_pipe_write_begin(uint64_t handle, size_t* len) {
+    IpcSegment* segment;
+    ipc_pipe_t* pipe = ipc_pipe_get(handle, IPC_HANDLE_PIPE_WRITE, &segment);
+    if (!pipe) return NULL;
+
+    // Our own head needs no barrier; the consumer's tail does
+    uint64_t head = pipe->head;
+    uint64_t tail = __atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE);
+    uint64_t offset = head & (pipe->capacity - 1);
+
+    size_t span = MIN(pipe->capacity - (head - tail), pipe->capacity - offset);
+    void* data = span ? ipc_pipe_data(pipe) + offset : NULL;
+    *len = span;
+
+    // The handle holds the segment, and only this end moves head
+    ipc_segment_put(segment);
+    return data;
+}
+
+int ipc_pipe_write_commit(uint64_t handle, size_t len) {
+    IpcSegment* segment;
+    ipc_pipe_t* pipe = ipc_pipe_get(handle, IPC_HANDLE_PIPE_WRITE, &segment);
+    if (!pipe) return -1;
+
+    uint64_t head = pipe->head;
+    int ret = -1;
+    if (head + len - __atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE) <= pipe->capacity) {
+        // Data stores become visible before the new head
+        __atomic_store_n(&pipe->head, head + len, __ATOMIC_RELEASE);
+        ret = 0;
+    }
+
+    ipc_segment_put(segment);
+    return ret;
+}
+
+const void* ipc_pipe_read_begin(uint64_t handle, size_t* len) {
+    IpcSegment* segment;
+    ipc_pipe_t* pipe = ipc_pipe_get(handle, IPC_HANDLE_PIPE_READ, &segment);
+    if (!pipe) return NULL;
+
+    uint64_t tail = pipe->tail;
+    uint64_t head = __atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE);
+    uint64_t offset = tail & (pipe->capacity - 1);
+
+    size_t span = MIN(head - tail, pipe->capacity - offset);
+    const void* data = span ? ipc_pipe_data(pipe) + offset : NULL;
+    *len = span;
+
+    ipc_segment_put(segment);
+    return data;
+}
+
+int ipc_pipe_read_done(uint64_t handle, size_t len) {
+    IpcSegment* segment;
+    ipc_pipe_t* pipe = ipc_pipe_get(handle, IPC_HANDLE_PIPE_READ, &segment);
+    if (!pipe) return -1;
+
+    uint64_t tail = pipe->tail;
+    int ret = -1;
+    if (len <= __atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE) - tail) {
+        // Reads of the data finish before the producer may reuse the space
+        __atomic_store_n(&pipe->tail, tail + len, __ATOMIC_RELEASE);
+        ret = 0;
+    }
+
+    ipc_segment_put(segment);
+    return ret;
+}
+
+// Caller buffer <-> ring: a plain copy for kernel buffers (ctx NULL),
+// otherwise through ctx so a bad range fails instead of faulting here
+static bool ipc_copy_in(vmm_context_t* ctx, void* dst, uintptr_t src, size_t len) {
+    if (!ctx) {
+        memcpy(dst, (const void*)src, len);
+        return true;
+    }
+    return vmm_copy_from_context(ctx, dst, src, len);
+}
+
+static bool ipc_copy_out(vmm_context_t* ctx, uintptr_t dst, const void* src, size_t len) {
+    if (!ctx) {
+        memcpy((void*)dst, src, len);
+        return true;
+    }
+    return vmm_copy_to_context(ctx, dst, src, len);
+}
+
+// At most two spans per call (the ring may wrap once). Nothing is published
+// unless both spans were copied.
+int64_t ipc_pipe_write_from(uint64_t handle, vmm_context_t* ctx, uintptr_t buf, size_t len) {
+    IpcSegment* segment;
+    ipc_pipe_t* pipe = ipc_pipe_get(handle, IPC_HANDLE_PIPE_WRITE, &segment);
+    if (!pipe) return -1;
+
+    if (__atomic_load_n(&pipe->closed, __ATOMIC_ACQUIRE) & IPC_PIPE_READER_CLOSED) {
+        ipc_segment_put(segment);
+        return -1;
+    }
+
+    uint64_t head = pipe->head;
+    uint64_t tail = __atomic_load_n(&pipe->tail, __ATOMIC_ACQUIRE);
+    size_t count = MIN(len, pipe->capacity - (head - tail));
+
+    uint64_t offset = head & (pipe->capacity - 1);
+    size_t first = MIN(count, pipe->capacity - offset);
+    if (!ipc_copy_in(ctx, ipc_pipe_data(pipe) + offset, buf, first) ||
+        !ipc_copy_in(ctx, ipc_pipe_data(pipe), buf + first, count - first)) {
+        ipc_segment_put(segment);
+        return -1;
+    }
+
+    __atomic_store_n(&pipe->head, head + count, __ATOMIC_RELEASE);
+
+    ipc_segment_put(segment);
+    return (int64_t)count;
+}
+
+int64_t ipc_pipe_read_into(uint64_t handle, vmm_context_t* ctx, uintptr_t buf, size_t len) {
+    IpcSegment* segment;
+    ipc_pipe_t* pipe = ipc_pipe_get(handle, IPC_HANDLE_PIPE_READ, &segment);
+    if (!pipe) return -1;
+
+    // Closed flag first: a writer that closed after its last commit has
+    // that data visible by the time we see the flag
+    uint32_t closed = __atomic_load_n(&pipe->closed, __ATOMIC_ACQUIRE);
+    uint64_t tail = pipe->tail;
+    uint64_t head = __atomic_load_n(&pipe->head, __ATOMIC_ACQUIRE);
+    size_t count = MIN(len, head - tail);
+
+    if (count == 0 && (closed & IPC_PIPE_WRITER_CLOSED)) {
+        ipc_segment_put(segment);
+        return -1;
+    }
+
+    uint64_t offset = tail & (pipe->capacity - 1);
+    size_t first = MIN(count, pipe->capacity - offset);
+    if (!ipc_copy_out(ctx, buf, ipc_pipe_data(pipe) + offset, first) ||
+        !ipc_copy_out(ctx, buf + first, ipc_pipe_data(pipe), count - first)) {
+        ipc_segment_put(segment);
+        return -1;
+    }
+
+    __atomic_store_n(&pipe->tail, tail + count, __ATOMIC_RELEASE);
+
+    ipc_segment_put(segment);
+    return (int64_t)count;
+}
+
+int64_t ipc_pipe_write(uint64_t handle, const void* buf, size_t len) {
+    return ipc_pipe_write_from(handle, NULL, (uintptr_t)buf, len);
+}
+
+int64_t ipc_pipe_read(uint64_t handle, void* buf, size_t len) {
+    return ipc_pipe_read_into(handle, NULL, (uintptr_t)buf, len);
+}
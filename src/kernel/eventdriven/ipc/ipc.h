@@ -0,0 +1,120 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include "ktypes.h"
+#include "vmm.h"
+
+// ============================================================================
+// IPC - Shared-memory segments and zero-copy pipes
+// ============================================================================
+//
+// Bulk data does not travel through Event.data (224 bytes). A task creates
+// a shared-memory segment, every task that attaches it gets the same
+// physical frames mapped into its own address space, and from then on the
+// data is written once and read in place.
+//
+// A pipe is a segment that starts with an ipc_pipe_t header followed by a
+// power-of-two data ring. It has exactly one producer and one consumer
+// (SPSC): the producer only moves head, the consumer only moves tail, so
+// neither side takes a lock. Both ends can run the protocol directly on
+// their own mapping; EVENT_IPC_SEND / EVENT_IPC_RECV are the copying
+// fallback for tasks that did not attach the ring.
+//
+// Segments and pipe ends are named by handles: (generation << IPC_SLOT_BITS)
+// | slot, like task IDs. A closed handle's slot gets a new generation, so a
+// stale handle never reaches the next object in that slot.
+//
+// ============================================================================
+
+#define IPC_SLOT_BITS           8
+#define IPC_MAX_HANDLES         (1U << IPC_SLOT_BITS)
+#define IPC_INVALID_HANDLE      0
+
+#define IPC_HANDLE_SLOT(h)          ((uint32_t)((h) & (IPC_MAX_HANDLES - 1)))
+#define IPC_HANDLE_GENERATION(h)    ((uint32_t)((h) >> IPC_SLOT_BITS))
+#define IPC_MAKE_HANDLE(gen, slot)  (((uint64_t)(gen) << IPC_SLOT_BITS) | (slot))
+
+#define IPC_SHM_MAX_SIZE        (16ULL << 20)   // Physically contiguous, keep it modest
+#define IPC_PIPE_MIN_CAPACITY   4096
+#define IPC_PIPE_MAX_CAPACITY   (8ULL << 20)
+
+typedef enum {
+    IPC_HANDLE_FREE = 0,
+    IPC_HANDLE_SHM,             // Shared-memory segment
+    IPC_HANDLE_PIPE_READ,       // Consumer end of a pipe
+    IPC_HANDLE_PIPE_WRITE       // Producer end of a pipe
+} IpcHandleType;
+
+// ============================================================================
+// PIPE LAYOUT (lives at the start of the pipe's segment)
+// ============================================================================
+
+// ipc_pipe_t.closed
+#define IPC_PIPE_WRITER_CLOSED  (1U << 0)
+#define IPC_PIPE_READER_CLOSED  (1U << 1)
+
+// Offset of the data ring from the start of the segment
+#define IPC_PIPE_DATA_OFFSET    256
+
+// head and tail are free-running byte counters: used = head - tail, the
+// ring position is counter & (capacity - 1). Each sits on its own cache
+// line so the two sides do not bounce one line between CPUs.
+typedef struct {
+    volatile uint64_t head;         // Bytes ever written (producer only)
+    uint8_t pad0[56];
+    volatile uint64_t tail;         // Bytes ever read (consumer only)
+    uint8_t pad1[56];
+    uint64_t capacity;              // Ring size in bytes, power of two
+    volatile uint32_t closed;       // IPC_PIPE_*_CLOSED
+    uint32_t data_offset;           // IPC_PIPE_DATA_OFFSET
+} ipc_pipe_t;
+
+_Static_assert(sizeof(ipc_pipe_t) <= IPC_PIPE_DATA_OFFSET, "Pipe header must fit before the ring");
+
+// ============================================================================
+// API
+// ============================================================================
+
+void ipc_init(void);
+
+// Shared memory: size is rounded up to whole pages, the segment is zeroed.
+// Attach maps it into the task's address space (task_id 0 = current task)
+// and returns the address there; kernel-context tasks get the direct-map
+// view. Returns IPC_INVALID_HANDLE / 0 on failure.
+uint64_t ipc_shm_create(size_t size);
+uintptr_t ipc_shm_attach(uint64_t handle, uint64_t task_id);
+size_t ipc_shm_size(uint64_t handle);
+
+// Pipes: capacity is rounded up to a power of two. Returns 0 and both
+// ends, or -1. Either end can be attached like a segment to reach the
+// ring directly.
+int ipc_pipe_create(size_t capacity, uint64_t* read_handle, uint64_t* write_handle);
+
+// Copying transfer: moves as much as fits without blocking. Returns the
+// number of bytes moved (0 = ring full / empty), or -1 for a bad handle or
+// when the other end is closed and nothing is left to move.
+int64_t ipc_pipe_write(uint64_t handle, const void* buf, size_t len);
+int64_t ipc_pipe_read(uint64_t handle, void* buf, size_t len);
+
+// The same for a buffer in another address space (the submitter of an
+// event): copied through ctx, -1 without moving anything if the range is
+// not accessible there. ctx NULL means a kernel buffer.
+int64_t ipc_pipe_write_from(uint64_t handle, vmm_context_t* ctx, uintptr_t buf, size_t len);
+int64_t ipc_pipe_read_into(uint64_t handle, vmm_context_t* ctx, uintptr_t buf, size_t len);
+
+// Zero-copy transfer: begin returns the largest contiguous span that can be
+// written (or read) in place and its length, commit/done publishes how much
+// of it was used. Returns NULL when there is nothing to do.
+void* ipc_pipe_write_begin(uint64_t handle, size_t* len);
+int ipc_pipe_write_commit(uint64_t handle, size_t len);
+const void* ipc_pipe_read_begin(uint64_t handle, size_t* len);
+int ipc_pipe_read_done(uint64_t handle, size_t len);
+
+// Drop a handle. The segment goes away with its last handle; frames still
+// mapped into a task stay valid until that mapping is gone too. Closing a
+// pipe end marks it closed for the other side.
+int ipc_close(uint64_t handle);
+
+IpcHandleType ipc_handle_type(uint64_t handle);
+
+#endif // IPC_H
@@ -20,7 +20,7 @@ void receiver_init(void) {
     receiver_stats.events_rejected = 0;
     receiver_stats.events_forwarded = 0;
 
-    kprintf("[RECEIVER] Initialized (ID counter = %lu)\n", global_event_id_counter);
+    klog_info(KLOG_PIPELINE, "[RECEIVER] Initialized (ID counter = %lu)\n", global_event_id_counter);
 }
 
 // ============================================================================
@@ -28,7 +28,7 @@ void receiver_init(void) {
 // ============================================================================
 
 void receiver_run(EventRingBuffer* from_user_ring, EventRingBuffer* to_center_ring) {
-    kprintf("[RECEIVER] Starting main loop...\n");
+    klog_debug(KLOG_PIPELINE, "[RECEIVER] Starting main loop...\n");
 
     Event event;
     uint64_t iterations = 0;
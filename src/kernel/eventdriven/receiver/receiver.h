@@ -4,6 +4,7 @@
 #include "../core/events.h"
 #include "../core/ringbuffer.h"
 #include "../core/atomics.h"
+#include "../task/task.h"
 #include "klib.h"
 
 // ============================================================================
@@ -123,6 +124,9 @@ static inline void receiver_process_event(Event* event, EventRingBuffer* to_cent
 
     atomic_increment_u64((volatile uint64_t*)&receiver_stats.events_validated);
 
+    // Нагрузка на pipeline засчитывается задаче-отправителю
+    task_count_event(event->user_id);
+
     // 3. Генерируем уникальный ID (ПЕРЕПИСЫВАЕМ поле id!)
     event->id = receiver_generate_event_id();
 
@@ -136,7 +140,7 @@ static inline void receiver_process_event(Event* event, EventRingBuffer* to_cent
         cpu_pause();
         if (--timeout == 0) {
             // Timeout - буфер переполнен слишком долго!
-            kprintf("[RECEIVER] ERROR: Center ring buffer timeout for event %lu\n", event->id);
+            klog_error(KLOG_PIPELINE, "[RECEIVER] ERROR: Center ring buffer timeout for event %lu\n", event->id);
             atomic_increment_u64((volatile uint64_t*)&receiver_stats.events_rejected);
             return;  // Отбрасываем событие
         }
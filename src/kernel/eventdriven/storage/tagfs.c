@@ -33,12 +33,7 @@ static inline int bitmap_test_bit(uint8_t* bitmap, uint64_t bit) {
 
 // Найти первый свободный бит
 static uint64_t bitmap_find_free(uint8_t* bitmap, uint64_t max_bits) {
-    for (uint64_t i = 0; i < max_bits; i++) {
-        if (!bitmap_test_bit(bitmap, i)) {
-            return i;
-        }
-    }
-    return (uint64_t)-1;  // Не найдено
+    return bitmap_find_zero(bitmap, 0, max_bits);  // KBITS_NONE == (uint64_t)-1, если не найдено
 }
 
 // ============================================================================
@@ -48,7 +43,7 @@ static uint64_t bitmap_find_free(uint8_t* bitmap, uint64_t max_bits) {
 // Читать блок из диска или памяти
 static int tagfs_read_block_raw(uint64_t block_num, uint8_t* buffer) {
     if (block_num >= TAGFS_MEM_BLOCKS) {
-        kprintf("[TAGFS] ERROR: Block %lu out of bounds\n", block_num);
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Block %lu out of bounds\n", block_num);
         return -1;
     }
 
@@ -65,7 +60,7 @@ static int tagfs_read_block_raw(uint64_t block_num, uint8_t* buffer) {
 // Записать блок на диск или в память
 static int tagfs_write_block_raw(uint64_t block_num, const uint8_t* buffer) {
     if (block_num >= TAGFS_MEM_BLOCKS) {
-        kprintf("[TAGFS] ERROR: Block %lu out of bounds\n", block_num);
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Block %lu out of bounds\n", block_num);
         return -1;
     }
 
@@ -89,7 +84,7 @@ int tagfs_sync_superblock(void) {
         return 0;  // В режиме памяти ничего не делаем
     }
 
-    kprintf("[TAGFS] Syncing superblock to disk...\n");
+    klog_debug(KLOG_TAGFS, "[TAGFS] Syncing superblock to disk...\n");
 
     // Superblock всегда в блоке 0
     return tagfs_write_block_raw(0, (const uint8_t*)global_tagfs.superblock);
@@ -101,7 +96,7 @@ int tagfs_load_superblock(void) {
         return 0;  // В режиме памяти ничего не делаем
     }
 
-    kprintf("[TAGFS] Loading superblock from disk...\n");
+    klog_debug(KLOG_TAGFS, "[TAGFS] Loading superblock from disk...\n");
 
     // Читаем блок 0
     return tagfs_read_block_raw(0, (uint8_t*)tagfs_storage[0]);
@@ -113,7 +108,7 @@ int tagfs_sync_inode_table(void) {
         return 0;
     }
 
-    kprintf("[TAGFS] Syncing inode table to disk...\n");
+    klog_debug(KLOG_TAGFS, "[TAGFS] Syncing inode table to disk...\n");
 
     // Inode table начинается с блока inode_table_block
     uint64_t start_block = global_tagfs.superblock->inode_table_block;
@@ -122,7 +117,7 @@ int tagfs_sync_inode_table(void) {
     // Пишем все блоки inode table
     for (uint64_t block = start_block; block < end_block; block++) {
         if (tagfs_write_block_raw(block, tagfs_storage[block]) != 0) {
-            kprintf("[TAGFS] ERROR: Failed to sync inode table block %lu\n", block);
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to sync inode table block %lu\n", block);
             return -1;
         }
     }
@@ -136,14 +131,14 @@ int tagfs_load_inode_table(void) {
         return 0;
     }
 
-    kprintf("[TAGFS] Loading inode table from disk...\n");
+    klog_debug(KLOG_TAGFS, "[TAGFS] Loading inode table from disk...\n");
 
     uint64_t start_block = global_tagfs.superblock->inode_table_block;
     uint64_t end_block = global_tagfs.superblock->tag_index_block;
 
     for (uint64_t block = start_block; block < end_block; block++) {
         if (tagfs_read_block_raw(block, tagfs_storage[block]) != 0) {
-            kprintf("[TAGFS] ERROR: Failed to load inode table block %lu\n", block);
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to load inode table block %lu\n", block);
             return -1;
         }
     }
@@ -154,21 +149,21 @@ int tagfs_load_inode_table(void) {
 // Полная синхронизация файловой системы с диском
 int tagfs_sync(void) {
     if (!use_disk) {
-        kprintf("[TAGFS] Sync skipped (memory mode)\n");
+        klog_debug(KLOG_TAGFS, "[TAGFS] Sync skipped (memory mode)\n");
         return 0;
     }
 
-    kprintf("[TAGFS] Full sync to disk...\n");
+    klog_debug(KLOG_TAGFS, "[TAGFS] Full sync to disk...\n");
 
     // 1. Sync superblock
     if (tagfs_sync_superblock() != 0) {
-        kprintf("[TAGFS] ERROR: Failed to sync superblock\n");
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to sync superblock\n");
         return -1;
     }
 
     // 2. Sync inode table
     if (tagfs_sync_inode_table() != 0) {
-        kprintf("[TAGFS] ERROR: Failed to sync inode table\n");
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to sync inode table\n");
         return -1;
     }
 
@@ -176,19 +171,19 @@ int tagfs_sync(void) {
     uint64_t data_start = global_tagfs.superblock->data_blocks_start;
     uint64_t total_blocks = global_tagfs.superblock->total_blocks;
 
-    kprintf("[TAGFS] Syncing data blocks (%lu-%lu)...\n", data_start, total_blocks - 1);
+    klog_debug(KLOG_TAGFS, "[TAGFS] Syncing data blocks (%lu-%lu)...\n", data_start, total_blocks - 1);
 
     for (uint64_t block = data_start; block < total_blocks; block++) {
         // Проверяем bitmap - пишем только занятые блоки
         if (bitmap_test_bit(global_tagfs.block_bitmap, block)) {
             if (tagfs_write_block_raw(block, tagfs_storage[block]) != 0) {
-                kprintf("[TAGFS] ERROR: Failed to sync data block %lu\n", block);
+                klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to sync data block %lu\n", block);
                 return -1;
             }
         }
     }
 
-    kprintf("[TAGFS] Sync complete!\n");
+    klog_debug(KLOG_TAGFS, "[TAGFS] Sync complete!\n");
     return 0;
 }
 
@@ -200,9 +195,9 @@ int tagfs_sync(void) {
 void tagfs_set_disk_mode(int enable) {
     use_disk = enable;
     if (enable) {
-        kprintf("[TAGFS] Disk mode ENABLED - using ATA driver\n");
+        klog_info(KLOG_TAGFS, "[TAGFS] Disk mode ENABLED - using ATA driver\n");
     } else {
-        kprintf("[TAGFS] Disk mode DISABLED - using memory storage\n");
+        klog_info(KLOG_TAGFS, "[TAGFS] Disk mode DISABLED - using memory storage\n");
     }
 }
 
@@ -215,7 +210,7 @@ static uint64_t tagfs_alloc_block(void) {
     if (block != (uint64_t)-1) {
         // Bounds check to prevent out-of-bounds access
         if (block >= TAGFS_MEM_BLOCKS) {
-            kprintf("[TAGFS] ERROR: Block allocation out of bounds (%lu >= %u)\n",
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Block allocation out of bounds (%lu >= %u)\n",
                     block, TAGFS_MEM_BLOCKS);
             return (uint64_t)-1;
         }
@@ -234,7 +229,7 @@ static void tagfs_free_block(uint64_t block) {
         bitmap_clear_bit(global_tagfs.block_bitmap, block);
         global_tagfs.superblock->free_blocks++;
     } else if (block >= TAGFS_MEM_BLOCKS) {
-        kprintf("[TAGFS] ERROR: Attempt to free invalid block %lu (>= %u)\n",
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Attempt to free invalid block %lu (>= %u)\n",
                 block, TAGFS_MEM_BLOCKS);
     }
 }
@@ -264,7 +259,7 @@ static uint64_t tagfs_get_block_by_index(FileInode* inode, uint64_t block_idx) {
 
         // Проверка bounds
         if (inode->indirect_block >= TAGFS_MEM_BLOCKS) {
-            kprintf("[TAGFS] ERROR: Invalid indirect_block %lu\n", inode->indirect_block);
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid indirect_block %lu\n", inode->indirect_block);
             return 0;
         }
 
@@ -283,7 +278,7 @@ static uint64_t tagfs_get_block_by_index(FileInode* inode, uint64_t block_idx) {
 
         // Проверка bounds
         if (inode->double_indirect_block >= TAGFS_MEM_BLOCKS) {
-            kprintf("[TAGFS] ERROR: Invalid double_indirect_block %lu\n", inode->double_indirect_block);
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid double_indirect_block %lu\n", inode->double_indirect_block);
             return 0;
         }
 
@@ -299,7 +294,7 @@ static uint64_t tagfs_get_block_by_index(FileInode* inode, uint64_t block_idx) {
         }
 
         if (level2_block >= TAGFS_MEM_BLOCKS) {
-            kprintf("[TAGFS] ERROR: Invalid level2_block %lu\n", level2_block);
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid level2_block %lu\n", level2_block);
             return 0;
         }
 
@@ -308,7 +303,7 @@ static uint64_t tagfs_get_block_by_index(FileInode* inode, uint64_t block_idx) {
         return level2_table[level2_idx];
     }
 
-    kprintf("[TAGFS] ERROR: Block index %lu too large (file too big)\n", block_idx + 12 + PTRS_PER_BLOCK);
+    klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Block index %lu too large (file too big)\n", block_idx + 12 + PTRS_PER_BLOCK);
     return 0;
 }
 
@@ -336,7 +331,7 @@ static uint64_t tagfs_alloc_block_by_index(FileInode* inode, uint64_t block_idx)
         }
 
         if (inode->indirect_block >= TAGFS_MEM_BLOCKS) {
-            kprintf("[TAGFS] ERROR: Invalid indirect_block %lu\n", inode->indirect_block);
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid indirect_block %lu\n", inode->indirect_block);
             return (uint64_t)-1;
         }
 
@@ -363,7 +358,7 @@ static uint64_t tagfs_alloc_block_by_index(FileInode* inode, uint64_t block_idx)
         }
 
         if (inode->double_indirect_block >= TAGFS_MEM_BLOCKS) {
-            kprintf("[TAGFS] ERROR: Invalid double_indirect_block %lu\n", inode->double_indirect_block);
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid double_indirect_block %lu\n", inode->double_indirect_block);
             return (uint64_t)-1;
         }
 
@@ -383,7 +378,7 @@ static uint64_t tagfs_alloc_block_by_index(FileInode* inode, uint64_t block_idx)
         uint64_t level2_block = level1_table[level1_idx];
 
         if (level2_block >= TAGFS_MEM_BLOCKS) {
-            kprintf("[TAGFS] ERROR: Invalid level2_block %lu\n", level2_block);
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid level2_block %lu\n", level2_block);
             return (uint64_t)-1;
         }
 
@@ -397,7 +392,7 @@ static uint64_t tagfs_alloc_block_by_index(FileInode* inode, uint64_t block_idx)
         return level2_table[level2_idx];
     }
 
-    kprintf("[TAGFS] ERROR: Block index %lu too large (max file size exceeded)\n", block_idx + 12 + PTRS_PER_BLOCK);
+    klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Block index %lu too large (max file size exceeded)\n", block_idx + 12 + PTRS_PER_BLOCK);
     return (uint64_t)-1;
 }
 
@@ -536,12 +531,18 @@ int tagfs_tag_equal(const Tag* a, const Tag* b) {
     return (strcmp(a->key, b->key) == 0) && (strcmp(a->value, b->value) == 0);
 }
 
+uint32_t tagfs_tag_hash(const Tag* tag) {
+    uint32_t crc = crc32c(0, tag->key, strnlen(tag->key, TAGFS_TAG_KEY_SIZE));
+    crc = crc32c(crc, ":", 1);
+    return crc32c(crc, tag->value, strnlen(tag->value, TAGFS_TAG_VALUE_SIZE));
+}
+
 // ============================================================================
 // INITIALIZATION
 // ============================================================================
 
 void tagfs_init(void) {
-    kprintf("[TAGFS] Initializing tag-based filesystem...\n");
+    klog_info(KLOG_TAGFS, "[TAGFS] Initializing tag-based filesystem...\n");
 
     memset(&global_tagfs, 0, sizeof(TagFSContext));
 
@@ -551,7 +552,7 @@ void tagfs_init(void) {
     // Проверяем наличие ATA диска
     int disk_available = 0;
     if (ata_primary_master.exists) {
-        kprintf("[TAGFS] ATA disk detected: %s (%lu MB)\n",
+        klog_info(KLOG_TAGFS, "[TAGFS] ATA disk detected: %s (%lu MB)\n",
                 ata_primary_master.model, ata_primary_master.size_mb);
         disk_available = 1;
     }
@@ -561,59 +562,59 @@ void tagfs_init(void) {
     if (disk_available) {
         tagfs_set_disk_mode(1);  // Включаем режим диска
 
-        kprintf("[TAGFS] Attempting to load filesystem from disk...\n");
+        klog_info(KLOG_TAGFS, "[TAGFS] Attempting to load filesystem from disk...\n");
         if (tagfs_load_superblock() == 0) {
             if (global_tagfs.superblock->magic == TAGFS_MAGIC) {
-                kprintf("[TAGFS] Valid superblock found on disk (version %u)\n",
+                klog_info(KLOG_TAGFS, "[TAGFS] Valid superblock found on disk (version %u)\n",
                         global_tagfs.superblock->version);
 
                 // Загружаем таблицу inodes
                 if (tagfs_load_inode_table() == 0) {
-                    kprintf("[TAGFS] Successfully loaded filesystem from disk!\n");
+                    klog_info(KLOG_TAGFS, "[TAGFS] Successfully loaded filesystem from disk!\n");
                     loaded_from_disk = 1;
                 } else {
-                    kprintf("[TAGFS] Failed to load inode table from disk\n");
+                    klog_error(KLOG_TAGFS, "[TAGFS] Failed to load inode table from disk\n");
                 }
             } else {
-                kprintf("[TAGFS] No valid filesystem on disk (magic=0x%lx)\n",
+                klog_info(KLOG_TAGFS, "[TAGFS] No valid filesystem on disk (magic=0x%lx)\n",
                         global_tagfs.superblock->magic);
             }
         } else {
-            kprintf("[TAGFS] Failed to read superblock from disk\n");
+            klog_error(KLOG_TAGFS, "[TAGFS] Failed to read superblock from disk\n");
         }
     }
 
     // Если не загрузили с диска, форматируем
     if (!loaded_from_disk) {
-        kprintf("[TAGFS] Creating new filesystem...\n");
+        klog_info(KLOG_TAGFS, "[TAGFS] Creating new filesystem...\n");
         tagfs_format(TAGFS_MEM_BLOCKS);
 
         // Если диск доступен, записываем новую ФС на диск
         if (disk_available) {
-            kprintf("[TAGFS] Writing new filesystem to disk...\n");
+            klog_info(KLOG_TAGFS, "[TAGFS] Writing new filesystem to disk...\n");
             if (tagfs_sync() == 0) {
-                kprintf("[TAGFS] Filesystem synced to disk successfully!\n");
+                klog_info(KLOG_TAGFS, "[TAGFS] Filesystem synced to disk successfully!\n");
             } else {
-                kprintf("[TAGFS] WARNING: Failed to sync filesystem to disk\n");
+                klog_warn(KLOG_TAGFS, "[TAGFS] WARNING: Failed to sync filesystem to disk\n");
             }
         }
     }
 
     // Validate superblock values to prevent out-of-bounds access
     if (global_tagfs.superblock->inode_table_block >= TAGFS_MEM_BLOCKS) {
-        kprintf("[TAGFS] ERROR: Invalid inode_table_block (%lu >= %u), reformatting...\n",
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid inode_table_block (%lu >= %u), reformatting...\n",
                 global_tagfs.superblock->inode_table_block, TAGFS_MEM_BLOCKS);
         tagfs_format(TAGFS_MEM_BLOCKS);
     }
 
     if (global_tagfs.superblock->data_blocks_start > TAGFS_MEM_BLOCKS) {
-        kprintf("[TAGFS] ERROR: Invalid data_blocks_start (%lu > %u), reformatting...\n",
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid data_blocks_start (%lu > %u), reformatting...\n",
                 global_tagfs.superblock->data_blocks_start, TAGFS_MEM_BLOCKS);
         tagfs_format(TAGFS_MEM_BLOCKS);
     }
 
     if (global_tagfs.superblock->total_blocks > TAGFS_MEM_BLOCKS) {
-        kprintf("[TAGFS] ERROR: Invalid total_blocks (%lu > %u), reformatting...\n",
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid total_blocks (%lu > %u), reformatting...\n",
                 global_tagfs.superblock->total_blocks, TAGFS_MEM_BLOCKS);
         tagfs_format(TAGFS_MEM_BLOCKS);
     }
@@ -626,7 +627,7 @@ void tagfs_init(void) {
     uint64_t max_possible_inodes = (available_inode_blocks * TAGFS_BLOCK_SIZE) / TAGFS_INODE_SIZE;
 
     if (global_tagfs.superblock->total_inodes > max_possible_inodes) {
-        kprintf("[TAGFS] ERROR: Invalid total_inodes (%lu > max %lu), reformatting...\n",
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid total_inodes (%lu > max %lu), reformatting...\n",
                 global_tagfs.superblock->total_inodes, max_possible_inodes);
         tagfs_format(TAGFS_MEM_BLOCKS);
     }
@@ -638,7 +639,7 @@ void tagfs_init(void) {
     uint64_t block_bitmap_size = (global_tagfs.superblock->total_blocks + 7) / 8;
     uint64_t inode_bitmap_size = (global_tagfs.superblock->total_inodes + 7) / 8;
 
-    kprintf("[TAGFS] Allocating bitmaps: block_bitmap=%lu bytes, inode_bitmap=%lu bytes\n",
+    klog_debug(KLOG_TAGFS, "[TAGFS] Allocating bitmaps: block_bitmap=%lu bytes, inode_bitmap=%lu bytes\n",
             block_bitmap_size, inode_bitmap_size);
 
     global_tagfs.block_bitmap = (uint8_t*)kmalloc(block_bitmap_size);
@@ -672,7 +673,7 @@ void tagfs_init(void) {
     // Initialize spinlock for thread-safe access
     spinlock_init(&global_tagfs.lock);
 
-    kprintf("[TAGFS] Initialized: %lu blocks (%lu free), %lu inodes (%lu free)\n",
+    klog_info(KLOG_TAGFS, "[TAGFS] Initialized: %lu blocks (%lu free), %lu inodes (%lu free)\n",
             global_tagfs.superblock->total_blocks,
             global_tagfs.superblock->free_blocks,
             global_tagfs.superblock->total_inodes,
@@ -680,7 +681,7 @@ void tagfs_init(void) {
 }
 
 void tagfs_format(uint64_t total_blocks) {
-    kprintf("[TAGFS] Formatting filesystem with %lu blocks...\n", total_blocks);
+    klog_info(KLOG_TAGFS, "[TAGFS] Formatting filesystem with %lu blocks...\n", total_blocks);
 
     // Clear storage
     memset(tagfs_storage, 0, sizeof(tagfs_storage));
@@ -704,7 +705,7 @@ void tagfs_format(uint64_t total_blocks) {
     if (total_blocks > (1 + tag_index_blocks + 10)) {
         available_for_inodes = total_blocks - 1 - tag_index_blocks - 10;
     } else {
-        kprintf("[TAGFS] ERROR: Not enough blocks for filesystem!\n");
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Not enough blocks for filesystem!\n");
         available_for_inodes = 1;  // Minimum
     }
 
@@ -727,7 +728,7 @@ void tagfs_format(uint64_t total_blocks) {
 
     // Ensure data_blocks_start doesn't exceed total_blocks
     if (sb->data_blocks_start > total_blocks) {
-        kprintf("[TAGFS] ERROR: Filesystem layout exceeds available blocks!\n");
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Filesystem layout exceeds available blocks!\n");
         sb->data_blocks_start = total_blocks;
         sb->free_blocks = 0;
     } else {
@@ -736,7 +737,7 @@ void tagfs_format(uint64_t total_blocks) {
 
     sb->free_inodes = max_inodes;
 
-    kprintf("[TAGFS] Format complete: inodes=%lu (in %lu blocks), tag_index=%lu, data_start=%lu\n",
+    klog_info(KLOG_TAGFS, "[TAGFS] Format complete: inodes=%lu (in %lu blocks), tag_index=%lu, data_start=%lu\n",
             max_inodes, inode_blocks, sb->tag_index_block, sb->data_blocks_start);
 }
 
@@ -746,7 +747,7 @@ void tagfs_format(uint64_t total_blocks) {
 
 uint64_t tagfs_create_file(Tag* tags, uint32_t tag_count) {
     if (tag_count > TAGFS_MAX_TAGS_PER_FILE) {
-        kprintf("[TAGFS] Error: too many tags (%u > %u)\n", tag_count, TAGFS_MAX_TAGS_PER_FILE);
+        klog_error(KLOG_TAGFS, "[TAGFS] Error: too many tags (%u > %u)\n", tag_count, TAGFS_MAX_TAGS_PER_FILE);
         return TAGFS_INVALID_INODE;
     }
 
@@ -756,7 +757,7 @@ uint64_t tagfs_create_file(Tag* tags, uint32_t tag_count) {
     uint64_t inode_id = tagfs_alloc_inode();
     if (inode_id == TAGFS_INVALID_INODE) {
         spin_unlock(&global_tagfs.lock);
-        kprintf("[TAGFS] Error: no free inodes\n");
+        klog_error(KLOG_TAGFS, "[TAGFS] Error: no free inodes\n");
         return TAGFS_INVALID_INODE;
     }
 
@@ -777,7 +778,7 @@ uint64_t tagfs_create_file(Tag* tags, uint32_t tag_count) {
 
     if (!inode) {
         spin_unlock(&global_tagfs.lock);
-        kprintf("[TAGFS] Error: inode table full\n");
+        klog_error(KLOG_TAGFS, "[TAGFS] Error: inode table full\n");
         return TAGFS_INVALID_INODE;
     }
 
@@ -801,7 +802,7 @@ uint64_t tagfs_create_file(Tag* tags, uint32_t tag_count) {
 
     spin_unlock(&global_tagfs.lock);
 
-    kprintf("[TAGFS] Created file inode=%lu with %u tags\n", inode_id, tag_count);
+    klog_debug(KLOG_TAGFS, "[TAGFS] Created file inode=%lu with %u tags\n", inode_id, tag_count);
     return inode_id;
 }
 
@@ -818,7 +819,7 @@ int tagfs_delete_file(uint64_t inode_id) {
 
     if (result) {
         atomic_increment_u64(&global_tagfs.files_deleted);
-        kprintf("[TAGFS] File inode=%lu marked as trashed\n", inode_id);
+        klog_debug(KLOG_TAGFS, "[TAGFS] File inode=%lu marked as trashed\n", inode_id);
     }
 
     return result;
@@ -882,7 +883,7 @@ int tagfs_read_file(uint64_t inode_id, uint64_t offset, uint8_t* buffer, uint64_
 
         // Bounds check
         if (block_num >= TAGFS_MEM_BLOCKS) {
-            kprintf("[TAGFS] ERROR: Invalid block number %lu in read (>= %u)\n",
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid block number %lu in read (>= %u)\n",
                     block_num, TAGFS_MEM_BLOCKS);
             break;
         }
@@ -922,13 +923,13 @@ int tagfs_write_file(uint64_t inode_id, uint64_t offset, const uint8_t* buffer,
         uint64_t block_num = tagfs_alloc_block_by_index(inode, block_idx);
 
         if (block_num == (uint64_t)-1) {
-            kprintf("[TAGFS] Error: failed to allocate block at index %lu\n", block_idx);
+            klog_error(KLOG_TAGFS, "[TAGFS] Error: failed to allocate block at index %lu\n", block_idx);
             break;
         }
 
         // Bounds check
         if (block_num >= TAGFS_MEM_BLOCKS) {
-            kprintf("[TAGFS] ERROR: Invalid block number %lu in write (>= %u)\n",
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Invalid block number %lu in write (>= %u)\n",
                     block_num, TAGFS_MEM_BLOCKS);
             break;
         }
@@ -964,14 +965,14 @@ int tagfs_add_tag(uint64_t inode_id, const Tag* tag) {
     }
 
     if (inode->tag_count >= TAGFS_MAX_TAGS_PER_FILE) {
-        kprintf("[TAGFS] Error: max tags reached for inode=%lu\n", inode_id);
+        klog_error(KLOG_TAGFS, "[TAGFS] Error: max tags reached for inode=%lu\n", inode_id);
         return 0;
     }
 
     // Check if tag already exists
     for (uint32_t i = 0; i < inode->tag_count; i++) {
         if (tagfs_tag_equal(&inode->tags[i], tag)) {
-            kprintf("[TAGFS] Tag already exists on inode=%lu\n", inode_id);
+            klog_debug(KLOG_TAGFS, "[TAGFS] Tag already exists on inode=%lu\n", inode_id);
             return 1;  // Already exists - success
         }
     }
@@ -1049,12 +1050,14 @@ int tagfs_file_has_tag(uint64_t inode_id, const Tag* tag) {
 void tagfs_index_add_file(uint64_t inode_id, const Tag* tags, uint32_t tag_count) {
     for (uint32_t i = 0; i < tag_count; i++) {
         const Tag* tag = &tags[i];
+        uint32_t hash = tagfs_tag_hash(tag);
 
         // Find or create index entry for this tag
         TagIndexEntry* entry = NULL;
         for (uint32_t j = 0; j < global_tagfs.tag_index.entry_count; j++) {
-            if (tagfs_tag_equal(&global_tagfs.tag_index.entries[j].tag, tag)) {
-                entry = &global_tagfs.tag_index.entries[j];
+            TagIndexEntry* candidate = &global_tagfs.tag_index.entries[j];
+            if (candidate->hash == hash && tagfs_tag_equal(&candidate->tag, tag)) {
+                entry = candidate;
                 break;
             }
         }
@@ -1062,7 +1065,7 @@ void tagfs_index_add_file(uint64_t inode_id, const Tag* tags, uint32_t tag_count
         if (!entry) {
             // Create new entry
             if (global_tagfs.tag_index.entry_count >= TAGFS_MAX_TAG_INDEX) {
-                kprintf("[TAGFS] Warning: tag index full\n");
+                klog_warn(KLOG_TAGFS, "[TAGFS] Warning: tag index full\n");
                 continue;
             }
 
@@ -1070,12 +1073,13 @@ void tagfs_index_add_file(uint64_t inode_id, const Tag* tags, uint32_t tag_count
             global_tagfs.tag_index.entry_count++;
 
             entry->tag = *tag;
+            entry->hash = hash;
             entry->file_count = 0;
             entry->capacity = 16;  // Start small
             entry->inode_ids = (uint64_t*)kmalloc(entry->capacity * sizeof(uint64_t));
 
             if (!entry->inode_ids) {
-                kprintf("[TAGFS] ERROR: Failed to allocate inode_ids array for tag %s:%s\n",
+                klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to allocate inode_ids array for tag %s:%s\n",
                         tag->key, tag->value);
                 global_tagfs.tag_index.entry_count--;  // Rollback
                 continue;
@@ -1098,7 +1102,7 @@ void tagfs_index_add_file(uint64_t inode_id, const Tag* tags, uint32_t tag_count
                 uint64_t* new_array = (uint64_t*)kmalloc(new_capacity * sizeof(uint64_t));
 
                 if (!new_array) {
-                    kprintf("[TAGFS] ERROR: Failed to resize inode_ids array (capacity %u -> %u)\n",
+                    klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to resize inode_ids array (capacity %u -> %u)\n",
                             entry->capacity, new_capacity);
                     continue;  // Skip adding this file to avoid corruption
                 }
@@ -1134,7 +1138,7 @@ void tagfs_index_remove_file(uint64_t inode_id) {
 }
 
 void tagfs_index_rebuild(void) {
-    kprintf("[TAGFS] Rebuilding tag index...\n");
+    klog_info(KLOG_TAGFS, "[TAGFS] Rebuilding tag index...\n");
 
     // Clear existing index
     for (uint32_t i = 0; i < global_tagfs.tag_index.entry_count; i++) {
@@ -1146,8 +1150,8 @@ void tagfs_index_rebuild(void) {
 
     // OPTIMIZATION: Skip scanning for freshly formatted filesystem
     if (global_tagfs.superblock->free_inodes == global_tagfs.superblock->total_inodes) {
-        kprintf("[TAGFS] Filesystem is empty, skipping inode scan\n");
-        kprintf("[TAGFS] Index rebuilt: 0 unique tags\n");
+        klog_info(KLOG_TAGFS, "[TAGFS] Filesystem is empty, skipping inode scan\n");
+        klog_info(KLOG_TAGFS, "[TAGFS] Index rebuilt: 0 unique tags\n");
         return;
     }
 
@@ -1160,7 +1164,7 @@ void tagfs_index_rebuild(void) {
     // Bounds check to prevent accessing memory outside tagfs_storage
     if (inode_end_block > TAGFS_MEM_BLOCKS) {
         inode_end_block = TAGFS_MEM_BLOCKS;
-        kprintf("[TAGFS] WARNING: Limiting inode scan to %lu blocks\n", inode_end_block);
+        klog_warn(KLOG_TAGFS, "[TAGFS] WARNING: Limiting inode scan to %lu blocks\n", inode_end_block);
     }
 
     uint64_t available_inode_blocks = inode_end_block - inode_start_block;
@@ -1169,12 +1173,12 @@ void tagfs_index_rebuild(void) {
     // Use the smaller of declared total_inodes or what fits in memory
     uint64_t inodes_to_scan = global_tagfs.superblock->total_inodes;
     if (inodes_to_scan > max_safe_inodes) {
-        kprintf("[TAGFS] WARNING: total_inodes=%lu exceeds safe limit %lu, capping scan\n",
+        klog_warn(KLOG_TAGFS, "[TAGFS] WARNING: total_inodes=%lu exceeds safe limit %lu, capping scan\n",
                 inodes_to_scan, max_safe_inodes);
         inodes_to_scan = max_safe_inodes;
     }
 
-    kprintf("[TAGFS] Scanning %lu inodes for index rebuild...\n", inodes_to_scan);
+    klog_info(KLOG_TAGFS, "[TAGFS] Scanning %lu inodes for index rebuild...\n", inodes_to_scan);
 
     // Scan all inodes and rebuild
     uint32_t scanned = 0;
@@ -1186,7 +1190,7 @@ void tagfs_index_rebuild(void) {
         scanned++;
     }
 
-    kprintf("[TAGFS] Index rebuilt: %u unique tags\n", global_tagfs.tag_index.entry_count);
+    klog_info(KLOG_TAGFS, "[TAGFS] Index rebuilt: %u unique tags\n", global_tagfs.tag_index.entry_count);
 }
 
 // ============================================================================
@@ -1195,11 +1199,12 @@ void tagfs_index_rebuild(void) {
 
 int tagfs_query_single(const Tag* tag, uint64_t* result_inodes, uint32_t* count_out, uint32_t max_results) {
     *count_out = 0;
+    uint32_t hash = tagfs_tag_hash(tag);
 
-    // Find tag in index
+    // Find tag in index: one integer compare per entry, strings only on a hash match
     for (uint32_t i = 0; i < global_tagfs.tag_index.entry_count; i++) {
         TagIndexEntry* entry = &global_tagfs.tag_index.entries[i];
-        if (tagfs_tag_equal(&entry->tag, tag)) {
+        if (entry->hash == hash && tagfs_tag_equal(&entry->tag, tag)) {
             uint32_t to_copy = entry->file_count;
             if (to_copy > max_results) {
                 to_copy = max_results;
@@ -1229,7 +1234,7 @@ int tagfs_query(TagQuery* query) {
 
         uint64_t* candidates = (uint64_t*)kmalloc(TAGFS_MAX_FILES * sizeof(uint64_t));
         if (!candidates) {
-            kprintf("[TAGFS] ERROR: Failed to allocate candidates array for AND query\n");
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to allocate candidates array for AND query\n");
             return 0;
         }
 
@@ -1264,7 +1269,7 @@ int tagfs_query(TagQuery* query) {
 
         uint8_t* seen = (uint8_t*)kmalloc(TAGFS_MAX_FILES);
         if (!seen) {
-            kprintf("[TAGFS] ERROR: Failed to allocate seen array for OR query\n");
+            klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to allocate seen array for OR query\n");
             return 0;
         }
 
@@ -1393,7 +1398,7 @@ void tagfs_print_tag_index(void) {
 // Установить контекст пользователя
 int tagfs_context_set(Tag* tags, uint32_t tag_count) {
     if (tag_count > TAGFS_MAX_CONTEXT_TAGS) {
-        kprintf("[TAGFS] ERROR: Too many context tags (%u > %u)\n",
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Too many context tags (%u > %u)\n",
                 tag_count, TAGFS_MAX_CONTEXT_TAGS);
         return -1;
     }
@@ -1409,9 +1414,9 @@ int tagfs_context_set(Tag* tags, uint32_t tag_count) {
 
     spin_unlock(&global_tagfs.lock);
 
-    kprintf("[TAGFS] Context set: %u tags\n", tag_count);
+    klog_debug(KLOG_TAGFS, "[TAGFS] Context set: %u tags\n", tag_count);
     for (uint32_t i = 0; i < tag_count; i++) {
-        kprintf("  - %s:%s\n", tags[i].key, tags[i].value);
+        klog_debug(KLOG_TAGFS, "  - %s:%s\n", tags[i].key, tags[i].value);
     }
 
     return 0;
@@ -1424,7 +1429,7 @@ void tagfs_context_clear(void) {
     global_tagfs.user_context.tag_count = 0;
     spin_unlock(&global_tagfs.lock);
 
-    kprintf("[TAGFS] Context cleared (showing all files)\n");
+    klog_debug(KLOG_TAGFS, "[TAGFS] Context cleared (showing all files)\n");
 }
 
 // Получить текущий контекст
@@ -1498,7 +1503,7 @@ uint64_t tagfs_create_file_with_data(Tag* tags, uint32_t tag_count,
 
     // Записываем данные
     if (tagfs_write_file_content(inode_id, data, size) != 0) {
-        kprintf("[TAGFS] ERROR: Failed to write file content\n");
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to write file content\n");
         // Можно удалить файл, но оставим для отладки
         return TAGFS_INVALID_INODE;
     }
@@ -1510,7 +1515,7 @@ uint64_t tagfs_create_file_with_data(Tag* tags, uint32_t tag_count,
 int tagfs_trash_file(uint64_t inode_id) {
     FileInode* inode = tagfs_get_inode(inode_id);
     if (!inode) {
-        kprintf("[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
         return -1;
     }
 
@@ -1519,7 +1524,7 @@ int tagfs_trash_file(uint64_t inode_id) {
     int result = tagfs_add_tag(inode_id, &trash_tag);
 
     if (result == 0) {
-        kprintf("[TAGFS] File moved to trash (inode=%lu)\n", inode_id);
+        klog_debug(KLOG_TAGFS, "[TAGFS] File moved to trash (inode=%lu)\n", inode_id);
     }
 
     return result;
@@ -1529,7 +1534,7 @@ int tagfs_trash_file(uint64_t inode_id) {
 int tagfs_restore_file(uint64_t inode_id) {
     FileInode* inode = tagfs_get_inode(inode_id);
     if (!inode) {
-        kprintf("[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
         return -1;
     }
 
@@ -1537,7 +1542,7 @@ int tagfs_restore_file(uint64_t inode_id) {
     int result = tagfs_remove_tag(inode_id, "trashed");
 
     if (result == 0) {
-        kprintf("[TAGFS] File restored from trash (inode=%lu)\n", inode_id);
+        klog_debug(KLOG_TAGFS, "[TAGFS] File restored from trash (inode=%lu)\n", inode_id);
     }
 
     return result;
@@ -1547,7 +1552,7 @@ int tagfs_restore_file(uint64_t inode_id) {
 int tagfs_erase_file(uint64_t inode_id) {
     FileInode* inode = tagfs_get_inode(inode_id);
     if (!inode) {
-        kprintf("[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
         return -1;
     }
 
@@ -1578,7 +1583,7 @@ int tagfs_erase_file(uint64_t inode_id) {
 
     spin_unlock(&global_tagfs.lock);
 
-    kprintf("[TAGFS] File erased completely (inode=%lu)\n", inode_id);
+    klog_debug(KLOG_TAGFS, "[TAGFS] File erased completely (inode=%lu)\n", inode_id);
     return 0;
 }
 
@@ -1586,7 +1591,7 @@ int tagfs_erase_file(uint64_t inode_id) {
 uint8_t* tagfs_read_file_content(uint64_t inode_id, uint64_t* size_out) {
     FileInode* inode = tagfs_get_inode(inode_id);
     if (!inode) {
-        kprintf("[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
         return NULL;
     }
 
@@ -1598,14 +1603,14 @@ uint8_t* tagfs_read_file_content(uint64_t inode_id, uint64_t* size_out) {
     // Выделяем память для данных
     uint8_t* buffer = (uint8_t*)kmalloc(inode->size + 1);  // +1 для null terminator
     if (!buffer) {
-        kprintf("[TAGFS] ERROR: Failed to allocate buffer (%lu bytes)\n", inode->size);
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to allocate buffer (%lu bytes)\n", inode->size);
         return NULL;
     }
 
     // Читаем данные
     int result = tagfs_read_file(inode_id, 0, buffer, inode->size);
     if (result != 0) {
-        kprintf("[TAGFS] ERROR: Failed to read file\n");
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to read file\n");
         kfree(buffer);
         return NULL;
     }
@@ -1619,14 +1624,14 @@ uint8_t* tagfs_read_file_content(uint64_t inode_id, uint64_t* size_out) {
 int tagfs_write_file_content(uint64_t inode_id, const uint8_t* data, uint64_t size) {
     FileInode* inode = tagfs_get_inode(inode_id);
     if (!inode) {
-        kprintf("[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: File not found (inode=%lu)\n", inode_id);
         return -1;
     }
 
     // Записываем данные с начала файла
     int result = tagfs_write_file(inode_id, 0, data, size);
     if (result < 0 || (uint64_t)result != size) {
-        kprintf("[TAGFS] ERROR: Failed to write file (wrote %d of %lu bytes)\n", result, size);
+        klog_error(KLOG_TAGFS, "[TAGFS] ERROR: Failed to write file (wrote %d of %lu bytes)\n", result, size);
         return -1;
     }
 
@@ -82,6 +82,7 @@ typedef struct {
 // Entry в индексе тегов - список файлов с определенным тегом
 typedef struct {
     Tag tag;                            // Тег (key:value)
+    uint32_t hash;                      // tagfs_tag_hash(&tag): строки сравниваются только при совпадении
     uint32_t file_count;                // Количество файлов с этим тегом
     uint32_t capacity;                  // Вместимость массива
     uint64_t* inode_ids;                // Массив ID файлов с этим тегом (динамический)
@@ -316,6 +317,9 @@ Tag tagfs_tag_from_string(const char* str);
 // Сравнить два тега
 int tagfs_tag_equal(const Tag* a, const Tag* b);
 
+// crc32c ключа и значения (SSE4.2, если есть): быстрый отсев при поиске в индексе
+uint32_t tagfs_tag_hash(const Tag* tag);
+
 // Проверить есть ли тег у файла
 int tagfs_file_has_tag(uint64_t inode_id, const Tag* tag);
 
@@ -3,176 +3,649 @@
 #include "pmm.h"
 #include "vmm.h"
 #include "cpu.h"
+#include "fpu.h"
 
 // ============================================================================
 // GLOBAL STATE
 // ============================================================================
 
-#define MAX_TASKS 1024
 #define MAX_TASK_GROUPS 64
 
-// Task table
+// Task table: a task_id is a handle, (generation << TASK_SLOT_BITS) | slot.
+// Lookups index the slot directly and compare generations; a slot's
+// generation is bumped when its task goes away, so stale IDs never match.
+// Free slots are kept on a stack, making insert and remove O(1) as well.
 static Task* task_table[MAX_TASKS];
+static uint32_t task_generation[MAX_TASKS];
+static uint16_t task_free_slots[MAX_TASKS];
+static uint32_t task_free_top;
 static spinlock_t task_table_lock;
 
 // Task groups
 static TaskGroup task_groups[MAX_TASK_GROUPS];
 static spinlock_t task_groups_lock;
 
-// Current task (per-CPU, for now we only support single CPU)
-static Task* current_task = NULL;
+// The boot context (kernel main loop, shell) is scheduled like any task so
+// that preemption can take the CPU from it and give it back
+static Task boot_task;
+
+// Exited tasks: freed later from another stack
+static Task* zombie_list = NULL;
+static spinlock_t zombie_lock;
 
 // ID counters
-static volatile uint64_t next_task_id = 1;
 static volatile uint64_t next_group_id = 1;
 
-// Scheduler queue (simple round-robin for now)
-static Task* scheduler_head = NULL;
-static Task* scheduler_tail = NULL;
-static spinlock_t scheduler_lock;
+// Per-CPU run queues. Each CPU picks from its own queue under its own
+// lock, so scheduling never serializes on one global lock. A task belongs
+// to runqueues[task->cpu] while it is queued or running; only migration
+// (task_migrate() or the load balancer) changes task->cpu, with the locks
+// of both queues held (lower index first).
+typedef struct {
+    spinlock_t lock;
+    rb_tree_t tree;                 // Runnable tasks by vruntime (not the running one)
+    Task* leftmost;                 // Cached minimum: pick-next is O(1)
+    Task* current;                  // Running on this CPU
+    Task* migrating;                // Switched out, to be queued on prev->migrate_cpu
+    uint64_t min_vruntime;          // Monotonic floor of all vruntimes here
+    uint32_t nr_queued;
+    bool resched_pending;
+    ktimer_t slice_timer;           // Armed on pick only if someone else is waiting
+    volatile bool slice_expired;
+    uint64_t context_switches;
+    uint64_t idle_cycles;           // Halted in task_idle()
+} cpu_runqueue_t;
+
+static cpu_runqueue_t runqueues[TASK_MAX_CPUS];
+static uint32_t cpus_online = 0;    // Bit per CPU that schedules
+
+// Single CPU until the APs are started; then the caller's LAPIC ID
+static inline uint32_t sched_this_cpu(void) {
+    return 0;
+}
+
+static inline cpu_runqueue_t* this_rq(void) {
+    return &runqueues[sched_this_cpu()];
+}
+
+static inline cpu_runqueue_t* task_rq(const Task* task) {
+    return &runqueues[task->cpu];
+}
+
+static inline uint32_t rq_cpu(const cpu_runqueue_t* rq) {
+    return (uint32_t)(rq - runqueues);
+}
+
+// The task running on this CPU
+#define current_task (this_rq()->current)
+
+// Periodic stall scan and load balancing, stopped while the kernel task is alone
+static ktimer_t health_timer;
+static uint32_t stall_scan_cursor = 0;
+
+// Tasks parked by their group's CPU cap, recounted at each refill
+static uint32_t group_parked_tasks = 0;
 
 // Statistics
 static uint64_t tasks_created = 0;
 static uint64_t tasks_destroyed = 0;
-static uint64_t context_switches = 0;
 
 // ============================================================================
 // INITIALIZATION
 // ============================================================================
 
+static void task_adopt_boot_context(void);
+static void task_slice_timer_fired(ktimer_t* timer);
+static void task_health_timer_fired(ktimer_t* timer);
+static void task_group_charge_cpu(cpu_runqueue_t* rq, Task* task, uint64_t delta);
+static void task_group_leave(Task* task);
+static bool task_group_over_quota(const Task* task);
+static void task_group_refill(void);
+
 void task_system_init(void) {
-    // Clear task table
+    // Clear task table; slots are handed out lowest first
     memset(task_table, 0, sizeof(task_table));
     memset(task_groups, 0, sizeof(task_groups));
+    for (int i = 0; i < MAX_TASKS; i++) {
+        task_generation[i] = 1;
+        task_free_slots[i] = (uint16_t)(MAX_TASKS - 1 - i);
+    }
+    task_free_top = MAX_TASKS;
 
     // Initialize locks
     spinlock_init(&task_table_lock);
     spinlock_init(&task_groups_lock);
-    spinlock_init(&scheduler_lock);
+    spinlock_init(&zombie_lock);
+    zombie_list = NULL;
+    ktimer_setup(&health_timer, task_health_timer_fired);
+    stall_scan_cursor = 0;
+
+    memset(runqueues, 0, sizeof(runqueues));
+    for (int cpu = 0; cpu < TASK_MAX_CPUS; cpu++) {
+        cpu_runqueue_t* rq = &runqueues[cpu];
+        spinlock_init(&rq->lock);
+        rb_tree_init(&rq->tree, NULL);
+        ktimer_setup(&rq->slice_timer, task_slice_timer_fired);
+    }
+    cpus_online = 0;
+    task_cpu_online(sched_this_cpu());
 
     // Reset counters
-    next_task_id = 1;
     next_group_id = 1;
+    group_parked_tasks = 0;
     tasks_created = 0;
     tasks_destroyed = 0;
-    context_switches = 0;
 
-    kprintf("[TASK] Task system initialized (max %d tasks)\n", MAX_TASKS);
+    task_adopt_boot_context();
+
+    kprintf("[TASK] Task system initialized (max %d tasks, %u of %d CPUs online)\n",
+            MAX_TASKS, task_cpu_count(), TASK_MAX_CPUS);
 }
 
 // ============================================================================
 // TASK TABLE MANAGEMENT
 // ============================================================================
 
+// Takes a free slot and assigns task->task_id from it
 static int task_table_insert(Task* task) {
-    spin_lock(&task_table_lock);
+    uint64_t flags = spin_lock_irqsave(&task_table_lock);
 
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (task_table[i] == NULL) {
-            task_table[i] = task;
-            spin_unlock(&task_table_lock);
-            return i;
-        }
+    if (task_free_top == 0) {
+        spin_unlock_irqrestore(&task_table_lock, flags);
+        return -1;  // Table full
     }
 
-    spin_unlock(&task_table_lock);
-    return -1;  // Table full
+    uint32_t slot = task_free_slots[--task_free_top];
+    task->task_id = TASK_MAKE_ID(task_generation[slot], slot);
+    __atomic_store_n(&task_table[slot], task, __ATOMIC_RELEASE);
+
+    spin_unlock_irqrestore(&task_table_lock, flags);
+    return (int)slot;
 }
 
 static void task_table_remove(uint64_t task_id) {
-    spin_lock(&task_table_lock);
+    uint32_t slot = TASK_ID_SLOT(task_id);
 
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (task_table[i] && task_table[i]->task_id == task_id) {
-            task_table[i] = NULL;
-            break;
-        }
+    uint64_t flags = spin_lock_irqsave(&task_table_lock);
+
+    if (task_table[slot] && task_generation[slot] == TASK_ID_GENERATION(task_id)) {
+        __atomic_store_n(&task_table[slot], NULL, __ATOMIC_RELEASE);
+
+        // Retire the handle; generation 0 is never used so IDs stay non-zero
+        uint32_t gen = task_generation[slot] + 1;
+        task_generation[slot] = gen ? gen : 1;
+
+        task_free_slots[task_free_top++] = (uint16_t)slot;
     }
 
-    spin_unlock(&task_table_lock);
+    spin_unlock_irqrestore(&task_table_lock, flags);
 }
 
+// Lock-free: the generation check rejects IDs of tasks that are gone
 Task* task_get(uint64_t task_id) {
-    spin_lock(&task_table_lock);
+    uint32_t slot = TASK_ID_SLOT(task_id);
 
-    Task* result = NULL;
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (task_table[i] && task_table[i]->task_id == task_id) {
-            result = task_table[i];
-            break;
-        }
+    Task* task = __atomic_load_n(&task_table[slot], __ATOMIC_ACQUIRE);
+    if (!task || __atomic_load_n(&task_generation[slot], __ATOMIC_ACQUIRE) != TASK_ID_GENERATION(task_id)) {
+        return NULL;
     }
-
-    spin_unlock(&task_table_lock);
-    return result;
+    return task;
 }
 
 // ============================================================================
 // SCHEDULER QUEUE MANAGEMENT
 // ============================================================================
 
-static void scheduler_enqueue(Task* task) {
-    spin_lock(&scheduler_lock);
+static inline Task* run_queue_entry(rb_node_t* node) {
+    return node ? container_of(node, Task, run_node) : NULL;
+}
+
+// Energy is the weight: vruntime advances by runtime * TASK_WEIGHT_REF / energy
+static inline uint64_t task_weight(const Task* task) {
+    return task->energy_allocated ? task->energy_allocated : 1;
+}
+
+// Equal vruntimes are ordered by ID so the tree order is total
+static inline bool task_runs_before(const Task* a, const Task* b) {
+    if (a->vruntime != b->vruntime) return a->vruntime < b->vruntime;
+    return a->task_id < b->task_id;
+}
 
-    task->next = NULL;
-    task->prev = scheduler_tail;
+static void run_queue_insert(cpu_runqueue_t* rq, Task* task) {
+    if (task->on_runqueue) return;
 
-    if (scheduler_tail) {
-        scheduler_tail->next = task;
-    } else {
-        scheduler_head = task;
+    rb_node_t** link = &rq->tree.root;
+    rb_node_t* parent = NULL;
+    bool leftmost = true;
+
+    while (*link) {
+        parent = *link;
+        if (task_runs_before(task, run_queue_entry(parent))) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+
+    rb_insert(&rq->tree, &task->run_node, parent, link);
+    if (leftmost) rq->leftmost = task;
+    task->on_runqueue = true;
+    rq->nr_queued++;
+}
+
+static void run_queue_remove(cpu_runqueue_t* rq, Task* task) {
+    if (!task->on_runqueue) return;
+
+    if (rq->leftmost == task) {
+        rq->leftmost = run_queue_entry(rb_next(&task->run_node));
+    }
+    rb_erase(&rq->tree, &task->run_node);
+    task->on_runqueue = false;
+    rq->nr_queued--;
+}
+
+// Charge the time since last_run_time to the task (caller holds rq->lock).
+// vruntime is the tree key, so a queued task is re-linked around the update.
+static void task_account(cpu_runqueue_t* rq, Task* task, uint64_t now) {
+    bool queued = task->on_runqueue;
+    if (queued) run_queue_remove(rq, task);
+
+    uint64_t delta = now - task->last_run_time;
+    task->total_runtime += delta;
+    task->vruntime += delta * TASK_WEIGHT_REF / task_weight(task);
+    task->last_run_time = now;
+    if (task->group_id) task_group_charge_cpu(rq, task, delta);
+
+    if (queued) run_queue_insert(rq, task);
+}
+
+// min_vruntime only moves forward: it follows the smaller of the running
+// task's and the leftmost queued task's vruntime
+static void update_min_vruntime(cpu_runqueue_t* rq) {
+    uint64_t vruntime = rq->min_vruntime;
+    bool found = false;
+
+    if (rq->current && rq->current->state != TASK_STATE_DEAD) {
+        vruntime = rq->current->vruntime;
+        found = true;
+    }
+    if (rq->leftmost && (!found || rq->leftmost->vruntime < vruntime)) {
+        vruntime = rq->leftmost->vruntime;
+        found = true;
+    }
+
+    if (found && vruntime > rq->min_vruntime) rq->min_vruntime = vruntime;
+}
+
+// States the scheduler may pick; the rest wait for an explicit wake/resume
+static inline bool task_state_runnable(TaskState state) {
+    return state == TASK_STATE_RUNNING || state == TASK_STATE_PROCESSING ||
+           state == TASK_STATE_DROWSY || state == TASK_STATE_STALLED;
+}
+
+// Time slice: TASK_SLICE_MIN_MS at energy 0 up to TASK_SLICE_MAX_MS at 100
+static uint64_t task_slice_ms(const Task* task) {
+    return TASK_SLICE_MIN_MS +
+           (uint64_t)(TASK_SLICE_MAX_MS - TASK_SLICE_MIN_MS) * task->energy_allocated / 100;
+}
+
+static void scheduler_enqueue_locked(cpu_runqueue_t* rq, Task* task) {
+    // A task coming back from sleep keeps its vruntime, but may not bank more
+    // than TASK_SLEEPER_CREDIT of lead: it runs soon without starving others
+    uint64_t floor = (rq->min_vruntime > TASK_SLEEPER_CREDIT) ? rq->min_vruntime - TASK_SLEEPER_CREDIT : 0;
+    if (task->vruntime < floor) task->vruntime = floor;
+
+    run_queue_insert(rq, task);
+
+    // Wakeup preemption: the newcomer is far enough behind the running task
+    Task* curr = rq->current;
+    if (curr && curr != task) {
+        task_account(rq, curr, rdtsc());
+        if (task->vruntime + TASK_WAKEUP_GRANULARITY < curr->vruntime) {
+            rq->resched_pending = true;
+        }
+
+        // The running task had the CPU to itself: from now on it has a slice
+        if (!rq->slice_timer.pending && !rq->slice_expired) {
+            ktimer_arm(&rq->slice_timer, task_slice_ms(curr), 0);
+        }
+    }
+}
+
+// ===== Queue locks and CPU choice =====
+
+// rq locks are also taken from the timer interrupt (sleep timers, health
+// sweep), so they are held with IRQs off. task->cpu may change until the
+// lock of its queue is held: re-check after locking.
+static cpu_runqueue_t* task_rq_lock(Task* task, uint64_t* flags) {
+    for (;;) {
+        cpu_runqueue_t* rq = task_rq(task);
+        *flags = spin_lock_irqsave(&rq->lock);
+        if (rq == task_rq(task)) return rq;
+        spin_unlock_irqrestore(&rq->lock, *flags);
+    }
+}
+
+static uint64_t rq_lock_pair(cpu_runqueue_t* a, cpu_runqueue_t* b) {
+    if (a == b) return spin_lock_irqsave(&a->lock);
+    if (a > b) {
+        cpu_runqueue_t* tmp = a;
+        a = b;
+        b = tmp;
+    }
+    uint64_t flags = spin_lock_irqsave(&a->lock);
+    spin_lock(&b->lock);
+    return flags;
+}
+
+static void rq_unlock_pair(cpu_runqueue_t* a, cpu_runqueue_t* b, uint64_t flags) {
+    if (a != b) spin_unlock(&b->lock);
+    spin_unlock_irqrestore(&a->lock, flags);
+}
+
+static inline bool task_cpu_allowed(const Task* task, uint32_t cpu) {
+    return cpu < TASK_MAX_CPUS && (cpus_online & task->cpu_affinity & (1U << cpu));
+}
+
+// Tasks on the CPU, the running one included
+static inline uint32_t rq_load(const cpu_runqueue_t* rq) {
+    return rq->nr_queued + (rq->current ? 1 : 0);
+}
+
+// Least loaded allowed CPU; the task's own CPU wins ties (warm caches)
+static uint32_t task_select_cpu(const Task* task) {
+    uint32_t best = task_cpu_allowed(task, task->cpu) ? task->cpu : TASK_MAX_CPUS;
+    uint32_t best_load = (best < TASK_MAX_CPUS) ? rq_load(&runqueues[best]) : ~0U;
+
+    for (uint32_t cpu = 0; cpu < TASK_MAX_CPUS; cpu++) {
+        if (!task_cpu_allowed(task, cpu)) continue;
+        uint32_t load = rq_load(&runqueues[cpu]);
+        if (load < best_load) {
+            best = cpu;
+            best_load = load;
+        }
+    }
+
+    return (best < TASK_MAX_CPUS) ? best : sched_this_cpu();
+}
+
+// Move a task that is not running between queues (both locks held). Its
+// lead or lag against min_vruntime carries over to the new queue.
+static void task_move_locked(Task* task, cpu_runqueue_t* src, cpu_runqueue_t* dst) {
+    bool queued = task->on_runqueue;
+    if (queued) run_queue_remove(src, task);
+
+    int64_t lag = (int64_t)(task->vruntime - src->min_vruntime);
+    task->vruntime = (lag < 0 && (uint64_t)-lag > dst->min_vruntime) ? 0 : dst->min_vruntime + lag;
+    task->cpu = (uint8_t)rq_cpu(dst);
+
+    if (queued) {
+        scheduler_enqueue_locked(dst, task);
+    }
+}
+
+static void task_health_on_wake(Task* task, uint64_t now);
+
+// The task becomes runnable (spawn, wake, resume)
+static void scheduler_enqueue(Task* task) {
+    task_health_on_wake(task, rdtsc());
+
+    uint64_t flags;
+    cpu_runqueue_t* rq = task_rq_lock(task, &flags);
+
+    // Its CPU went offline or left the affinity mask while it slept
+    if (!task->on_runqueue && !task_cpu_allowed(task, task->cpu)) {
+        cpu_runqueue_t* dst = &runqueues[task_select_cpu(task)];
+        spin_unlock_irqrestore(&rq->lock, flags);
+        flags = rq_lock_pair(rq, dst);
+        if (task_rq(task) == rq && !task->on_runqueue) {
+            task_move_locked(task, rq, dst);
+        }
+        rq_unlock_pair(rq, dst, flags);
+        rq = task_rq_lock(task, &flags);
     }
-    scheduler_tail = task;
 
-    spin_unlock(&scheduler_lock);
+    scheduler_enqueue_locked(rq, task);
+    spin_unlock_irqrestore(&rq->lock, flags);
 }
 
 static void scheduler_dequeue(Task* task) {
-    spin_lock(&scheduler_lock);
+    uint64_t flags;
+    cpu_runqueue_t* rq = task_rq_lock(task, &flags);
+    run_queue_remove(rq, task);
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
 
-    if (task->prev) {
-        task->prev->next = task->next;
-    } else {
-        scheduler_head = task->next;
+// ============================================================================
+// TASK AND STACK CACHES
+// ============================================================================
+//
+// Task structures come from a slab: chunks of TASK_SLAB_CHUNK are taken from
+// kmalloc when a CPU's free list runs dry and are never given back. Stacks
+// are recycled through a per-CPU cache of up to TASK_STACK_CACHE: a stack
+// keeps its guard pages and its mapped frames, so a recycled one needs no
+// new reservation or mapping. Each CPU only touches
+// its own cache, with interrupts off, so neither path takes a lock.
+
+typedef struct {
+    Task* free_tasks;               // Linked through zombie_next
+    void* stacks[TASK_STACK_CACHE];
+    uint32_t nr_stacks;
+} task_cpu_cache_t;
+
+static task_cpu_cache_t task_caches[TASK_MAX_CPUS];
+
+static Task* task_alloc(void) {
+    uint64_t flags = irq_save();
+    task_cpu_cache_t* cache = &task_caches[sched_this_cpu()];
+
+    if (!cache->free_tasks) {
+        Task* chunk = (Task*)kmalloc(sizeof(Task) * TASK_SLAB_CHUNK);
+        if (!chunk) {
+            irq_restore(flags);
+            return NULL;
+        }
+        for (int i = 0; i < TASK_SLAB_CHUNK; i++) {
+            chunk[i].zombie_next = cache->free_tasks;
+            cache->free_tasks = &chunk[i];
+        }
     }
 
-    if (task->next) {
-        task->next->prev = task->prev;
-    } else {
-        scheduler_tail = task->prev;
+    Task* task = cache->free_tasks;
+    cache->free_tasks = task->zombie_next;
+    irq_restore(flags);
+
+    memset(task, 0, sizeof(Task));
+    return task;
+}
+
+static void task_free(Task* task) {
+    uint64_t flags = irq_save();
+    task_cpu_cache_t* cache = &task_caches[sched_this_cpu()];
+    task->zombie_next = cache->free_tasks;
+    cache->free_tasks = task;
+    irq_restore(flags);
+}
+
+static void* task_stack_alloc(void) {
+    uint64_t flags = irq_save();
+    task_cpu_cache_t* cache = &task_caches[sched_this_cpu()];
+    void* stack = cache->nr_stacks ? cache->stacks[--cache->nr_stacks] : NULL;
+    irq_restore(flags);
+
+    // A new one, mapped in full: a stack must never fault, the fault handler
+    // would take the pmm/vmm locks its owner may be holding. Guard pages around.
+    return stack ? stack : vmalloc_stack(TASK_STACK_SIZE);
+}
+
+static void task_stack_free(void* stack) {
+    uint64_t flags = irq_save();
+    task_cpu_cache_t* cache = &task_caches[sched_this_cpu()];
+    if (cache->nr_stacks < TASK_STACK_CACHE) {
+        cache->stacks[cache->nr_stacks++] = stack;
+        stack = NULL;
+    }
+    irq_restore(flags);
+
+    if (stack) vfree(stack);
+}
+
+// ============================================================================
+// MAILBOX (lock-free MPSC ring, see TaskMessageQueue)
+// ============================================================================
+
+#define TASK_MAILBOX_MASK (TASK_MESSAGE_QUEUE_SIZE - 1)
+
+static void task_mailbox_init(TaskMessageQueue* queue) {
+    for (uint64_t i = 0; i < TASK_MESSAGE_QUEUE_SIZE; i++) {
+        queue->slots[i].seq = i;
+    }
+    queue->tail = 0;
+    queue->head = 0;
+    queue->waiting = 0;
+}
+
+// Any context. False if full.
+static bool task_mailbox_push(TaskMessageQueue* queue, const TaskMessage* message) {
+    uint64_t pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    TaskMessageSlot* slot;
+
+    for (;;) {
+        slot = &queue->slots[pos & TASK_MAILBOX_MASK];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+
+        if (diff == 0) {
+            // Free for this position: claim it (on failure pos is reloaded)
+            if (__atomic_compare_exchange_n(&queue->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // Still holds the message from a lap ago
+        } else {
+            pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
     }
 
-    task->next = NULL;
-    task->prev = NULL;
+    slot->message = *message;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static inline bool task_mailbox_pending(TaskMessageQueue* queue) {
+    TaskMessageSlot* slot = &queue->slots[queue->head & TASK_MAILBOX_MASK];
+    return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == queue->head + 1;
+}
+
+// Owner only. False if empty.
+static bool task_mailbox_pop(TaskMessageQueue* queue, TaskMessage* out) {
+    if (!task_mailbox_pending(queue)) return false;
+
+    TaskMessageSlot* slot = &queue->slots[queue->head & TASK_MAILBOX_MASK];
+    *out = slot->message;
 
-    spin_unlock(&scheduler_lock);
+    // Free for the position one lap ahead
+    __atomic_store_n(&slot->seq, queue->head + TASK_MESSAGE_QUEUE_SIZE, __ATOMIC_RELEASE);
+    queue->head++;
+    return true;
 }
 
 // ============================================================================
 // TASK CREATION
 // ============================================================================
 
+// Sleep timer expired (timer interrupt): back into the run queue, silently
+static void task_sleep_timer_fired(ktimer_t* timer) {
+    Task* task = container_of(timer, Task, sleep_timer);
+
+    if (task->state == TASK_STATE_SLEEPING) {
+        task->state = TASK_STATE_RUNNING;
+        task->sleep_until = 0;
+        scheduler_enqueue(task);
+    }
+}
+
+// Turn the code that is running now into boot_task. Its context is filled
+// in by the first switch away from it; it has no stack of its own to free.
+static void task_adopt_boot_context(void) {
+    memset(&boot_task, 0, sizeof(Task));
+    strncpy(boot_task.name, "kernel", TASK_NAME_MAX - 1);
+    boot_task.energy_requested = TASK_WEIGHT_REF;
+    boot_task.energy_allocated = TASK_WEIGHT_REF;
+    boot_task.energy_efficiency = 50;
+    boot_task.state = TASK_STATE_RUNNING;
+    boot_task.health.responsiveness = 100;
+    boot_task.health.efficiency = 50;
+    boot_task.health.stability = 100;
+    boot_task.health.progress = 100;
+    boot_task.health.overall_health = 87;
+    boot_task.creation_time = rdtsc();
+    boot_task.last_run_time = boot_task.creation_time;
+    boot_task.last_progress_time = boot_task.creation_time;
+    boot_task.wait_start = boot_task.creation_time;
+    boot_task.vmm_ctx = vmm_get_kernel_context();
+    boot_task.page_table = boot_task.vmm_ctx ? boot_task.vmm_ctx->pml4_phys : 0;
+    ktimer_setup(&boot_task.sleep_timer, task_sleep_timer_fired);
+    task_mailbox_init(&boot_task.message_queue);
+    boot_task.cpu = (uint8_t)sched_this_cpu();
+    boot_task.cpu_affinity = 1U << boot_task.cpu;   // It is this CPU's boot stack
+    boot_task.migrate_cpu = TASK_NO_MIGRATE;
+
+    task_table_insert(&boot_task);
+    current_task = &boot_task;
+
+    // From here on the boot code's FPU registers belong to boot_task
+    fpu_switch_to(&boot_task.context.fpu_state);
+}
+
+static void task_finish_switch(void);
+
+// Every task starts here, switched to with interrupts off; returning from
+// the entry point ends the task
+static void task_entry_trampoline(Task* task) {
+    task_finish_switch();
+    asm volatile("sti" ::: "memory");
+
+    void (*entry)(void*) = (void (*)(void*))task->entry_point;
+    entry(task->args);
+    task_exit();
+}
+
+// Drop a private (cloned) address space; kernel tasks share the kernel one
+static void task_release_address_space(Task* task) {
+    vmm_context_t* kernel_ctx = vmm_get_kernel_context();
+    if (!task->vmm_ctx || task->vmm_ctx == kernel_ctx) return;
+
+    if (vmm_get_current_context() == task->vmm_ctx) {
+        vmm_switch_context(kernel_ctx);
+    }
+    vmm_destroy_context(task->vmm_ctx);
+    task->vmm_ctx = NULL;
+}
+
 Task* task_spawn(const char* name, void* entry_point, uint8_t energy) {
     return task_spawn_with_args(name, entry_point, NULL, energy);
 }
 
 Task* task_spawn_with_args(const char* name, void* entry_point, void* args, uint8_t energy) {
-    // Allocate task structure
-    Task* task = (Task*)kmalloc(sizeof(Task));
+    task_reap_zombies();
+
+    // Allocate task structure (cleared)
+    Task* task = task_alloc();
     if (!task) {
         kprintf("[TASK] ERROR: Failed to allocate task structure\n");
         return NULL;
     }
 
-    // Clear structure
-    memset(task, 0, sizeof(Task));
-
     // === IDENTITY ===
-    task->task_id = atomic_increment_u64(&next_task_id);
+    // task_id is assigned when the task takes its table slot (below)
     strncpy(task->name, name, TASK_NAME_MAX - 1);
     task->name[TASK_NAME_MAX - 1] = '\0';
-    task->parent_id = current_task ? current_task->task_id : 0;
+    task->parent_id = task_get_current_id();
     task->group_id = 0;
+    task->group_parked = false;
 
     // === ENERGY ===
     task->energy_requested = energy;
@@ -192,64 +665,82 @@ Task* task_spawn_with_args(const char* name, void* entry_point, void* args, uint
     task->last_run_time = task->creation_time;
     task->total_runtime = 0;
     task->sleep_until = 0;
+    ktimer_setup(&task->sleep_timer, task_sleep_timer_fired);
+
+    // === PLACEMENT ===
+    task->cpu_affinity = TASK_AFFINITY_ALL;
+    task->migrate_cpu = TASK_NO_MIGRATE;
+    task->cpu = (uint8_t)task_select_cpu(task);
+    task->vruntime = runqueues[task->cpu].min_vruntime;   // Level with its queue, no banked credit
 
     // === MEMORY ===
-    // Allocate stack
-    task->stack_base = vmalloc(TASK_STACK_SIZE);
+    // Stack from the CPU's cache, or a fresh one
+    task->stack_base = task_stack_alloc();
     if (!task->stack_base) {
         kprintf("[TASK] ERROR: Failed to allocate stack for task '%s'\n", name);
-        kfree(task);
+        task_free(task);
         return NULL;
     }
     task->stack_size = TASK_STACK_SIZE;
     task->entry_point = entry_point;
     task->args = args;  // Save arguments
 
-    // Use kernel page table for all tasks (no isolation in v1)
-    // Future: Create separate page table per task for memory isolation
+    // Kernel tasks share the kernel page table. A task spawned by a task
+    // with its own address space gets a copy-on-write clone of it: only the
+    // page tables are copied, frames are shared until someone writes.
     vmm_context_t* kernel_ctx = vmm_get_kernel_context();
-    task->page_table = kernel_ctx->pml4_phys;
+    task->vmm_ctx = kernel_ctx;
+    if (current_task && current_task->vmm_ctx && current_task->vmm_ctx != kernel_ctx) {
+        task->vmm_ctx = vmm_clone_context(current_task->vmm_ctx);
+        if (!task->vmm_ctx) {
+            kprintf("[TASK] ERROR: Failed to clone address space for task '%s': %s\n",
+                    name, vmm_get_last_error());
+            task_stack_free(task->stack_base);
+            task_free(task);
+            return NULL;
+        }
+    }
+    task->page_table = task->vmm_ctx->pml4_phys;
 
     // === CPU CONTEXT ===
-    // Initialize context for first run using assembly helper
-    void* stack_top = (void*)((uint64_t)task->stack_base + TASK_STACK_SIZE - 16);
-    task_init_context(&task->context, entry_point, stack_top, args);
+    // First switch "returns" into a stub that calls task_entry_trampoline(task)
+    void* stack_top = (void*)((uint64_t)task->stack_base + TASK_STACK_SIZE);
+    task_init_context(&task->context, (void*)task_entry_trampoline, stack_top, task);
 
     // === STATISTICS ===
+    task->events_submitted = 0;
     task->events_processed = 0;
     task->errors_count = 0;
     task->io_operations = 0;
     task->last_progress_time = task->creation_time;
 
     // === COMMUNICATION ===
-    // Allocate message queue
-    task->message_queue = (TaskMessageQueue*)kmalloc(sizeof(TaskMessageQueue));
-    if (!task->message_queue) {
-        kprintf("[TASK] WARNING: Failed to allocate message queue for task '%s'\n", name);
-        vfree(task->stack_base);
-        kfree(task);
-        return NULL;
-    }
-    memset(task->message_queue, 0, sizeof(TaskMessageQueue));
+    // The message queue is embedded in the task
+    task_mailbox_init(&task->message_queue);
     task->pending_messages = 0;
 
-    // Add to task table
+    // Add to task table (assigns task_id)
     int slot = task_table_insert(task);
     if (slot < 0) {
         kprintf("[TASK] ERROR: Task table full, cannot spawn '%s'\n", name);
-        vfree(task->stack_base);
-        kfree(task);
+        task_release_address_space(task);
+        task_stack_free(task->stack_base);
+        task_free(task);
         return NULL;
     }
 
     // Add to scheduler queue
     scheduler_enqueue(task);
 
+    if (!health_timer.pending) {
+        ktimer_arm(&health_timer, TASK_STALL_SCAN_MS, TASK_STALL_SCAN_MS);
+    }
+
     // Update statistics
     atomic_increment_u64(&tasks_created);
 
-    kprintf("[TASK] Spawned task '%s' (ID=%lu, energy=%u, stack=%p)\n",
-            name, task->task_id, energy, task->stack_base);
+    klog_info(KLOG_TASK, "[TASK] Spawned task '%s' (ID=%lu, energy=%u, stack=%p)\n",
+              name, task->task_id, energy, task->stack_base);
 
     return task;
 }
@@ -258,6 +749,37 @@ Task* task_spawn_with_args(const char* name, void* entry_point, void* args, uint
 // TASK DESTRUCTION
 // ============================================================================
 
+// Free everything a task owns. It must not be running (nor be current).
+static void task_destroy(Task* task) {
+    uint64_t task_id = task->task_id;
+
+    // Free resources (the stack goes back to the cache, still mapped)
+    if (task->stack_base) {
+        task_stack_free(task->stack_base);
+    }
+
+    task_release_address_space(task);
+    task_group_leave(task);
+
+    if (task->context.fpu_state) {
+        fpu_release(&task->context.fpu_state);
+    }
+
+    // Undelivered broadcasts still hold a reference
+    TaskMessage message;
+    while (task_mailbox_pop(&task->message_queue, &message)) {
+        task_message_release(&message);
+    }
+
+    // Remove from task table (no-op if task_exit() already did)
+    task_table_remove(task_id);
+
+    // Back to the slab
+    task_free(task);
+
+    atomic_increment_u64(&tasks_destroyed);
+}
+
 int task_kill(uint64_t task_id) {
     Task* task = task_get(task_id);
     if (!task) {
@@ -265,35 +787,78 @@ int task_kill(uint64_t task_id) {
         return -1;
     }
 
+    if (task == &boot_task) {
+        kprintf("[TASK] ERROR: Cannot kill the kernel task\n");
+        return -1;
+    }
+
+    // Killing ourselves: our stack is in use, leave it to the reaper
+    if (task == current_task) {
+        klog_info(KLOG_TASK, "[TASK] Killed task %lu\n", task_id);
+        task_exit();
+    }
+
     // Remove from scheduler
+    ktimer_cancel(&task->sleep_timer);
     scheduler_dequeue(task);
 
     // Mark as dead
     task->state = TASK_STATE_DEAD;
 
-    // Free resources
-    if (task->stack_base) {
-        vfree(task->stack_base);
-    }
+    task_destroy(task);
 
-    if (task->context.fpu_state) {
-        kfree(task->context.fpu_state);
-    }
+    klog_info(KLOG_TASK, "[TASK] Killed task %lu\n", task_id);
+    return 0;
+}
 
-    if (task->message_queue) {
-        kfree(task->message_queue);
+void task_exit(void) {
+    Task* task = current_task;
+    if (!task || task == &boot_task) {
+        return;     // The kernel context has nowhere to go
     }
 
-    // Remove from task table
-    task_table_remove(task_id);
+    ktimer_cancel(&task->sleep_timer);
+    scheduler_dequeue(task);
+    task_table_remove(task->task_id);   // Invisible from now on
 
-    // Free task structure
-    kfree(task);
+    // Not runnable: the switch below never requeues us
+    uint64_t flags = spin_lock_irqsave(&zombie_lock);
+    task->state = TASK_STATE_DEAD;
+    task->zombie_next = zombie_list;
+    zombie_list = task;
+    spin_unlock_irqrestore(&zombie_lock, flags);
+
+    // Nothing else runnable yet: idle until the timer finds a task
+    for (;;) {
+        task_scheduler_yield();
+        asm volatile("sti; hlt");
+    }
+}
 
-    atomic_increment_u64(&tasks_destroyed);
+void task_reap_zombies(void) {
+    uint64_t flags = spin_lock_irqsave(&zombie_lock);
+    Task* list = zombie_list;
+    zombie_list = NULL;
+
+    // A zombie that is still on the CPU waits for the next round
+    Task** link = &list;
+    while (*link) {
+        if (*link == current_task) {
+            Task* self = *link;
+            *link = self->zombie_next;
+            self->zombie_next = zombie_list;
+            zombie_list = self;
+        } else {
+            link = &(*link)->zombie_next;
+        }
+    }
+    spin_unlock_irqrestore(&zombie_lock, flags);
 
-    kprintf("[TASK] Killed task %lu\n", task_id);
-    return 0;
+    while (list) {
+        Task* task = list;
+        list = task->zombie_next;
+        task_destroy(task);
+    }
 }
 
 // ============================================================================
@@ -306,16 +871,22 @@ int task_sleep(uint64_t task_id, uint64_t milliseconds) {
         return -1;
     }
 
-    // Calculate wake-up time (approximate: 2.4GHz CPU = 2.4M cycles/ms)
-    uint64_t cycles = milliseconds * 2400000;
-    task->sleep_until = rdtsc() + cycles;
+    task->sleep_until = rdtsc() + tsc_ms_to_cycles(milliseconds);
     task->state = TASK_STATE_SLEEPING;
 
     // Remove from scheduler (will be re-added when woken)
     scheduler_dequeue(task);
 
-    kprintf("[TASK] Task %lu '%s' sleeping for %lu ms\n",
+    // Armed last: the timer may fire as soon as it is in the wheel
+    ktimer_arm(&task->sleep_timer, milliseconds, 0);
+
+    klog_debug(KLOG_TASK, "[TASK] Task %lu '%s' sleeping for %lu ms\n",
             task_id, task->name, milliseconds);
+
+    // Sleeping ourselves: give the CPU away now, not at the end of the slice
+    if (task == current_task) {
+        task_scheduler_yield();
+    }
     return 0;
 }
 
@@ -328,13 +899,14 @@ int task_wake(uint64_t task_id) {
     if (task->state == TASK_STATE_SLEEPING ||
         task->state == TASK_STATE_HIBERNATING ||
         task->state == TASK_STATE_DROWSY) {
+        ktimer_cancel(&task->sleep_timer);
         task->state = TASK_STATE_RUNNING;
         task->sleep_until = 0;
 
         // Re-add to scheduler
         scheduler_enqueue(task);
 
-        kprintf("[TASK] Task %lu '%s' woken up\n", task_id, task->name);
+        klog_debug(KLOG_TASK, "[TASK] Task %lu '%s' woken up\n", task_id, task->name);
         return 0;
     }
 
@@ -348,9 +920,10 @@ int task_pause(uint64_t task_id) {
     }
 
     task->state = TASK_STATE_THROTTLED;
+    task->group_parked = false;     // Stays paused when its group is refilled
     scheduler_dequeue(task);
 
-    kprintf("[TASK] Task %lu '%s' paused\n", task_id, task->name);
+    klog_debug(KLOG_TASK, "[TASK] Task %lu '%s' paused\n", task_id, task->name);
     return 0;
 }
 
@@ -362,9 +935,10 @@ int task_resume(uint64_t task_id) {
 
     if (task->state == TASK_STATE_THROTTLED) {
         task->state = TASK_STATE_RUNNING;
+        task->group_parked = false;
         scheduler_enqueue(task);
 
-        kprintf("[TASK] Task %lu '%s' resumed\n", task_id, task->name);
+        klog_debug(KLOG_TASK, "[TASK] Task %lu '%s' resumed\n", task_id, task->name);
         return 0;
     }
 
@@ -384,7 +958,7 @@ int task_boost(uint64_t task_id, uint8_t extra_energy) {
     task->energy_allocated = (task->energy_allocated + extra_energy > 100) ?
                               100 : task->energy_allocated + extra_energy;
 
-    kprintf("[TASK] Task %lu boosted to energy=%u\n", task_id, task->energy_allocated);
+    klog_debug(KLOG_TASK, "[TASK] Task %lu boosted to energy=%u\n", task_id, task->energy_allocated);
     return 0;
 }
 
@@ -397,8 +971,10 @@ int task_throttle(uint64_t task_id, uint8_t reduction) {
     task->energy_allocated = (task->energy_allocated < reduction) ?
                               0 : task->energy_allocated - reduction;
     task->state = TASK_STATE_THROTTLED;
+    task->group_parked = false;
+    scheduler_dequeue(task);   // Back on task_resume()
 
-    kprintf("[TASK] Task %lu throttled to energy=%u\n", task_id, task->energy_allocated);
+    klog_debug(KLOG_TASK, "[TASK] Task %lu throttled to energy=%u\n", task_id, task->energy_allocated);
     return 0;
 }
 
@@ -423,8 +999,9 @@ Task* task_get_current(void) {
     return current_task;
 }
 
+// 0 = the kernel (boot) context, as for parent_id
 uint64_t task_get_current_id(void) {
-    return current_task ? current_task->task_id : 0;
+    return (current_task && current_task != &boot_task) ? current_task->task_id : 0;
 }
 
 TaskState task_get_state(uint64_t task_id) {
@@ -437,7 +1014,7 @@ int task_enumerate(Task** tasks_out, uint32_t max_tasks) {
         return 0;
     }
 
-    spin_lock(&task_table_lock);
+    uint64_t flags = spin_lock_irqsave(&task_table_lock);
 
     uint32_t count = 0;
     for (int i = 0; i < MAX_TASKS && count < max_tasks; i++) {
@@ -446,7 +1023,7 @@ int task_enumerate(Task** tasks_out, uint32_t max_tasks) {
         }
     }
 
-    spin_unlock(&task_table_lock);
+    spin_unlock_irqrestore(&task_table_lock, flags);
     return count;
 }
 
@@ -454,57 +1031,91 @@ int task_enumerate(Task** tasks_out, uint32_t max_tasks) {
 // HEALTH & MONITORING
 // ============================================================================
 
-void task_update_health(Task* task) {
+static inline void task_health_recompute(Task* task) {
+    task->health.overall_health = (
+        task->health.responsiveness +
+        task->health.efficiency +
+        task->health.stability +
+        task->health.progress
+    ) / 4;
+}
+
+// How long it waited for the CPU
+static uint8_t task_responsiveness(uint64_t waited) {
+    if (waited < tsc_ms_to_cycles(4)) return 100;
+    if (waited < tsc_ms_to_cycles(40)) return 70;
+    return 30;
+}
+
+// How long since it last made progress
+static uint8_t task_progress(uint64_t idle) {
+    if (idle < tsc_ms_to_cycles(20)) return 100;
+    if (idle < tsc_ms_to_cycles(TASK_STALL_MS)) return 50;
+    return 10;
+}
+
+// ===== Events =====
+
+// Picked to run (scheduler lock held)
+static void task_health_on_run(Task* task, uint64_t now) {
+    task->health.responsiveness = task_responsiveness(now - task->wait_start);
+    task_health_recompute(task);
+}
+
+// Back from a block: time spent blocked is neither waiting nor stalling
+static void task_health_on_wake(Task* task, uint64_t now) {
+    task->wait_start = now;
+    task->last_progress_time = now;
+    task->health.progress = 100;
+    task_health_recompute(task);
+}
+
+void task_record_progress(Task* task) {
     if (!task) return;
 
-    uint64_t now = rdtsc();
+    task->events_processed++;
+    task->last_progress_time = rdtsc();
+    task->health.progress = 100;
+    task->health.efficiency = (task->energy_efficiency + task->health.efficiency) / 2;
 
-    // Update responsiveness (based on how recently it ran)
-    uint64_t time_since_run = now - task->last_run_time;
-    if (time_since_run < 10000000) {  // Less than ~4ms
-        task->health.responsiveness = 100;
-    } else if (time_since_run < 100000000) {  // Less than ~40ms
-        task->health.responsiveness = 70;
-    } else {
-        task->health.responsiveness = 30;
-    }
+    uint64_t error_rate = (task->errors_count * 100) / task->events_processed;
+    task->health.stability = (error_rate < 100) ? 100 - error_rate : 0;
+    task_health_recompute(task);
+}
 
-    // Update efficiency (based on energy usage vs progress)
-    if (task->events_processed > 0) {
-        task->health.efficiency = (task->energy_efficiency + task->health.efficiency) / 2;
-    }
+void task_record_error(Task* task) {
+    if (!task) return;
+
+    task->errors_count++;
+    task->events_processed++;
+
+    uint64_t error_rate = (task->errors_count * 100) / task->events_processed;
+    task->health.stability = (error_rate < 100) ? 100 - error_rate : 0;
+    task_health_recompute(task);
+}
+
+// Event-driven metrics are current already; this refreshes the ones that
+// decay with time alone
+void task_update_health(Task* task) {
+    if (!task) return;
 
-    // Update stability (based on error rate)
-    if (task->events_processed > 0) {
-        uint64_t error_rate = (task->errors_count * 100) / task->events_processed;
-        task->health.stability = (error_rate < 100) ? 100 - error_rate : 0;
+    uint64_t now = rdtsc();
+
+    // Only a queued task is waiting: running and blocked ones are not
+    if (task->on_runqueue) {
+        task->health.responsiveness = task_responsiveness(now - task->wait_start);
     }
 
-    // Update progress (based on time since last progress)
-    uint64_t time_since_progress = now - task->last_progress_time;
-    if (time_since_progress < 50000000) {  // Less than ~20ms
-        task->health.progress = 100;
-    } else if (time_since_progress < 500000000) {  // Less than ~200ms
-        task->health.progress = 50;
-    } else {
-        task->health.progress = 10;
-        task->state = TASK_STATE_STALLED;
+    if (task_state_runnable(task->state)) {
+        task->health.progress = task_progress(now - task->last_progress_time);
     }
 
-    // Compute overall health
-    task->health.overall_health = (
-        task->health.responsiveness +
-        task->health.efficiency +
-        task->health.stability +
-        task->health.progress
-    ) / 4;
+    task_health_recompute(task);
 }
 
 int task_auto_recover(Task* task) {
     if (!task) return -1;
 
-    task_update_health(task);
-
     // If health is low, try to recover
     if (task->health.overall_health < 30) {
         kprintf("[TASK] WARNING: Task %lu '%s' health=%u, attempting recovery\n",
@@ -512,6 +1123,9 @@ int task_auto_recover(Task* task) {
 
         // Strategy 1: If stalled, boost energy
         if (task->state == TASK_STATE_STALLED) {
+            if (task != current_task) {
+                scheduler_enqueue(task);
+            }
             task_boost(task->task_id, 20);
             task->state = TASK_STATE_RUNNING;
             return 0;
@@ -548,132 +1162,622 @@ void task_print_stats(uint64_t task_id) {
             task->health.efficiency,
             task->health.stability,
             task->health.progress);
-    kprintf("Events:     %lu processed, %lu errors\n",
-            task->events_processed, task->errors_count);
-    kprintf("Runtime:    %lu cycles\n", task->total_runtime);
+    kprintf("Events:     %lu submitted, %lu processed, %lu errors, %lu I/O\n",
+            task->events_submitted, task->events_processed, task->errors_count,
+            task->io_operations);
+    kprintf("Runtime:    %lu cycles (vruntime %lu)\n", task->total_runtime, task->vruntime);
     kprintf("================================\n\n");
 }
 
 // ============================================================================
-// SCHEDULER
+// ACCOUNTING
 // ============================================================================
 
-Task* task_scheduler_next(void) {
-    spin_lock(&scheduler_lock);
-
-    // Simple round-robin: take head, move to tail
-    Task* task = scheduler_head;
+void task_count_event(uint64_t task_id) {
+    Task* task = task_get(task_id);
+    if (task) atomic_increment_u64(&task->events_submitted);
+}
 
-    if (task) {
-        // Check if task should wake up from sleep
-        if (task->state == TASK_STATE_SLEEPING) {
-            uint64_t now = rdtsc();
-            if (now >= task->sleep_until) {
-                task->state = TASK_STATE_RUNNING;
-                task->sleep_until = 0;
-            } else {
-                // Still sleeping, skip to next
-                task = task->next;
-            }
-        }
+void task_count_io(uint64_t task_id) {
+    Task* task = task_get(task_id);
+    if (task) atomic_increment_u64(&task->io_operations);
+}
 
-        // Move head to tail for round-robin
-        if (task && task->state == TASK_STATE_RUNNING) {
-            scheduler_head = task->next;
-            if (scheduler_head) {
-                scheduler_head->prev = NULL;
-            }
+void task_count_completion(uint64_t task_id, bool failed) {
+    Task* task = task_get(task_id);
+    if (!task) return;
+
+    if (failed) {
+        task_record_error(task);
+    } else {
+        task_record_progress(task);
+    }
+}
+
+// The table lock keeps every sampled task alive; runtime of a task that is
+// running right now is topped up with its current slice
+uint32_t task_snapshot(TaskStatSample* out, uint32_t max) {
+    if (!out || max == 0) return 0;
+
+    uint64_t flags = spin_lock_irqsave(&task_table_lock);
+    uint64_t now = rdtsc();
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < MAX_TASKS && count < max; i++) {
+        Task* task = task_table[i];
+        if (!task) continue;
+
+        TaskStatSample* sample = &out[count++];
+        sample->task_id = task->task_id;
+        memcpy(sample->name, task->name, TASK_NAME_MAX);
+        sample->state = task->state;
+        sample->cpu = task->cpu;
+        sample->energy = task->energy_allocated;
+        sample->runtime = task->total_runtime;
+        if (runqueues[task->cpu].current == task && now > task->last_run_time) {
+            sample->runtime += now - task->last_run_time;
+        }
+        sample->events_submitted = task->events_submitted;
+        sample->events_processed = task->events_processed;
+        sample->io_operations = task->io_operations;
+        sample->errors_count = task->errors_count;
+    }
+
+    spin_unlock_irqrestore(&task_table_lock, flags);
+    return count;
+}
+
+uint64_t task_idle_cycles(void) {
+    return this_rq()->idle_cycles;
+}
+
+const char* task_state_name(TaskState state) {
+    static const char* names[] = {
+        "RUN", "PROC", "IO", "EVENT", "DROWSY",
+        "SLEEP", "HIBER", "THROT", "STALL", "DEAD"
+    };
+    return (uint32_t)state < sizeof(names) / sizeof(names[0]) ? names[state] : "?";
+}
+
+// If the interrupt that ends the halt switched to another task, the pick
+// has restarted our clock already and nothing is moved
+void task_idle(void) {
+    // Background VMM upkeep (destroyed address spaces, page-table cache)
+    // before halting: every caller looks again after we return
+    if (vmm_idle_work()) return;
+
+    cpu_runqueue_t* rq = this_rq();
+    uint64_t flags = irq_save();
+
+    uint64_t switches = rq->context_switches;
+    uint64_t start = rdtsc();
+    asm volatile("sti; hlt; cli" : : : "memory");
+    uint64_t halted = rdtsc() - start;
+
+    rq->idle_cycles += halted;
+    if (rq->current && rq->context_switches == switches) {
+        rq->current->last_run_time += halted;
+    }
+
+    irq_restore(flags);
+}
+
+// ============================================================================
+// SCHEDULER
+// ============================================================================
+
+// Pull queued tasks from the busiest CPU until the two differ by at most
+// one. The least urgent (rightmost) tasks move first: they have had the
+// most CPU and their caches are the coldest. Returns the number moved.
+static uint32_t task_load_balance(uint32_t cpu) {
+    cpu_runqueue_t* rq = &runqueues[cpu];
+    cpu_runqueue_t* busiest = NULL;
+    uint32_t busiest_load = rq_load(rq) + 1;
+
+    // Unlocked reads: a stale load only makes this round less accurate
+    for (uint32_t other = 0; other < TASK_MAX_CPUS; other++) {
+        if (other == cpu || !(cpus_online & (1U << other))) continue;
+        uint32_t load = rq_load(&runqueues[other]);
+        if (load > busiest_load) {
+            busiest = &runqueues[other];
+            busiest_load = load;
+        }
+    }
+    if (!busiest) return 0;
+
+    uint64_t flags = rq_lock_pair(rq, busiest);
+
+    uint32_t moved = 0;
+    rb_node_t* node = rb_last(&busiest->tree);
+    while (node && rq_load(busiest) > rq_load(rq) + 1) {
+        Task* task = run_queue_entry(node);
+        node = rb_prev(node);
+
+        if (task->cpu_affinity & (1U << cpu)) {
+            task_move_locked(task, busiest, rq);
+            moved++;
+        }
+    }
 
-            task->next = NULL;
-            task->prev = scheduler_tail;
-            if (scheduler_tail) {
-                scheduler_tail->next = task;
+    rq_unlock_pair(rq, busiest, flags);
+    return moved;
+}
+
+Task* task_scheduler_next(void) {
+    cpu_runqueue_t* rq = this_rq();
+
+    // Idle balance: nothing queued here, try to take work from another CPU
+    if (rq->nr_queued == 0 && (cpus_online & ~(1U << rq_cpu(rq)))) {
+        task_load_balance(rq_cpu(rq));
+    }
+
+    uint64_t flags = spin_lock_irqsave(&rq->lock);
+
+    uint64_t now = rdtsc();
+    Task* prev = rq->current;
+
+    // The running task goes back into the queue keyed by its new vruntime,
+    // unless it is leaving this CPU: then it is queued on the target once
+    // it is off its stack (task_finish_switch)
+    if (prev) {
+        task_account(rq, prev, now);
+        if (task_state_runnable(prev->state)) {
+            prev->wait_start = now;
+            if (prev->migrate_cpu == TASK_NO_MIGRATE) {
+                run_queue_insert(rq, prev);
+            } else if (rq->leftmost && !rq->migrating) {
+                rq->migrating = prev;
+            } else {
+                prev->migrate_cpu = TASK_NO_MIGRATE;   // Nothing to switch to: stay
+                run_queue_insert(rq, prev);
             }
-            scheduler_tail = task;
+        }
+    }
+
+    // Members of a group over its CPU quota wait for the refill out of the
+    // queue. The last queued task is left: there is no idle task to run.
+    while (rq->leftmost && rq->nr_queued > 1 && task_group_over_quota(rq->leftmost)) {
+        Task* parked = rq->leftmost;
+        run_queue_remove(rq, parked);
+        parked->state = TASK_STATE_THROTTLED;
+        parked->group_parked = true;
+        __atomic_add_fetch(&group_parked_tasks, 1, __ATOMIC_RELAXED);
+    }
+
+    Task* task = rq->leftmost;
+    if (task) {
+        run_queue_remove(rq, task);
+        task_health_on_run(task, now);
+        task->last_run_time = now;
 
-            current_task = task;
-            context_switches++;
+        if (task != prev) {
+            rq->current = task;
+            rq->context_switches++;
         }
     }
 
-    spin_unlock(&scheduler_lock);
+    update_min_vruntime(rq);
+    rq->resched_pending = false;
+
+    // A fresh slice, but only if there is anyone to hand the CPU to after it
+    rq->slice_expired = false;
+    if (rq->leftmost) {
+        ktimer_arm(&rq->slice_timer, task_slice_ms(rq->current), 0);
+    } else {
+        ktimer_cancel(&rq->slice_timer);
+    }
+
+    spin_unlock_irqrestore(&rq->lock, flags);
     return task;
 }
 
-void task_scheduler_yield(void) {
-    // Current task voluntarily yields CPU
-    if (!current_task) {
-        return;  // No current task to yield from
-    }
+// Runs in the task switched to, once the previous one is off its stack:
+// only now may another CPU pick a task that is leaving this one
+static void task_finish_switch(void) {
+    cpu_runqueue_t* rq = this_rq();
+
+    // A new task gets here with interrupts on
+    uint64_t irq = irq_save();
+    Task* task = rq->migrating;
+    rq->migrating = NULL;
+    irq_restore(irq);
+    if (!task) return;
+
+    cpu_runqueue_t* dst = &runqueues[task->migrate_cpu];
+    uint64_t flags = rq_lock_pair(rq, dst);
+    task->migrate_cpu = TASK_NO_MIGRATE;
+    task_move_locked(task, rq, dst);
+    scheduler_enqueue_locked(dst, task);
+    rq_unlock_pair(rq, dst, flags);
+}
+
+bool task_need_resched(void) {
+    return this_rq()->resched_pending;
+}
 
-    // Save current task state
-    current_task->state = TASK_STATE_WAITING_EVENT;
+// Pick the next task and switch to it. Interrupts stay off from the pick
+// until the switch is done, otherwise a timer preemption in between would
+// save our registers into the task we just picked.
+static void task_switch_next(bool verbose) {
+    uint64_t flags = irq_save();
 
-    // Get next task to run
+    // Get next task to run (accounts the current one and requeues it)
+    Task* old_task = current_task;
     Task* next_task = task_scheduler_next();
-    if (!next_task || next_task == current_task) {
+    if (!next_task || next_task == old_task) {
+        irq_restore(flags);
         return;  // No other task available
     }
 
     // Perform context switch
-    Task* old_task = current_task;
-    current_task = next_task;
     next_task->state = TASK_STATE_RUNNING;
-    next_task->last_run_time = rdtsc();
 
-    kprintf("[SCHEDULER] Switching from task %lu to %lu\n",
-            old_task->task_id, next_task->task_id);
+    if (verbose) {
+        klog_debug(KLOG_TASK, "[SCHEDULER] Switching from task %lu to %lu\n",
+                   old_task->task_id, next_task->task_id);
+    }
+
+    // Different address space: load it (PCID keeps its TLB entries warm)
+    if (next_task->vmm_ctx && next_task->vmm_ctx != vmm_get_current_context()) {
+        vmm_switch_context(next_task->vmm_ctx);
+    }
+
+    // FPU registers stay as they are: CR0.TS defers the save/restore to
+    // the first FPU instruction of the new task (#NM)
+    fpu_switch_to(&next_task->context.fpu_state);
+
+    // The preemption count is per task: a lock we sleep holding must not
+    // keep next_task (which starts at its own depth, 0 if new) unpreemptible
+    old_task->preempt_count = preempt_count_get();
+    preempt_count_set(next_task->preempt_count);
 
-    // Switch contexts (this will save old and restore new)
+    // Callee-saved registers go on our stack, next_task's come off its own
     task_switch_to(&old_task->context, &next_task->context);
 
     // When we return here, we've been switched back
+    task_finish_switch();
+    irq_restore(flags);
 }
 
+void task_scheduler_yield(void) {
+    // Current task voluntarily yields CPU
+    if (!current_task) {
+        return;  // No current task to yield from
+    }
+
+    task_switch_next(true);
+}
+
+// Runs on the interrupted task's own stack, at the end of the timer IRQ.
+// Its registers are already in the isr_common frame; task_switch_to() only
+// parks this handler. When the task is picked again the handler returns and
+// isr_common's iretq resumes it where the interrupt hit. A task that has
+// never run starts in task_entry_trampoline(), which enables interrupts.
+void task_preempt_irq(void) {
+    cpu_runqueue_t* rq = this_rq();
+    Task* task = rq->current;
+    if (!task) {
+        return;
+    }
+
+    bool runnable = task_state_runnable(task->state);
+    if (runnable && !rq->slice_expired && !rq->resched_pending) {
+        return;
+    }
+
+    // Inside a critical section. The timer is one-shot, so no tick comes by
+    // on its own: look again shortly (slice_expired brings us back here)
+    if (!preemptible()) {
+        ktimer_arm_us(&rq->slice_timer, TASK_PREEMPT_RETRY_US, 0);
+        return;
+    }
+
+    task_switch_next(false);
+}
+
+// Timer interrupt: the slice is used up, task_preempt_irq() acts on it
+static void task_slice_timer_fired(ktimer_t* timer) {
+    cpu_runqueue_t* rq = container_of(timer, cpu_runqueue_t, slice_timer);
+    rq->slice_expired = true;
+}
+
+static void task_health_timer_fired(ktimer_t* timer) {
+    // Only the kernel task is left: stop until the next spawn
+    if (MAX_TASKS - task_free_top <= 1) {
+        ktimer_cancel(timer);
+        return;
+    }
+
+    task_group_refill();
+    task_scheduler_tick();
+
+    // Periodic balance: every online CPU pulls from the busiest one
+    for (uint32_t cpu = 0; cpu < TASK_MAX_CPUS; cpu++) {
+        if (cpus_online & (1U << cpu)) task_load_balance(cpu);
+    }
+}
+
+// Stall detection: TASK_STALL_SCAN_BUDGET slots per call, resuming where
+// the last call stopped. Blocked tasks are skipped (their timers and
+// wakers bring them back); everything else is kept current by events.
 void task_scheduler_tick(void) {
-    // Called by timer interrupt
-    // Update health of all tasks
-    spin_lock(&task_table_lock);
+    uint64_t now = rdtsc();
+    uint64_t stall_cycles = tsc_ms_to_cycles(TASK_STALL_MS);
 
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (task_table[i]) {
-            task_update_health(task_table[i]);
-            task_auto_recover(task_table[i]);
-        }
+    uint64_t flags = spin_lock_irqsave(&task_table_lock);
+
+    for (uint32_t n = 0; n < TASK_STALL_SCAN_BUDGET; n++) {
+        Task* task = task_table[stall_scan_cursor];
+        stall_scan_cursor = (stall_scan_cursor + 1) % MAX_TASKS;
+
+        if (!task || !task_state_runnable(task->state)) continue;
+        if (now - task->last_progress_time < stall_cycles) continue;
+
+        task_update_health(task);
+        task->state = TASK_STATE_STALLED;
+        task_auto_recover(task);
     }
 
-    spin_unlock(&task_table_lock);
+    spin_unlock_irqrestore(&task_table_lock, flags);
+}
 
-    // NOTE: For v1, we use COOPERATIVE multitasking
-    // Tasks explicitly call task_scheduler_yield() to switch contexts
-    // This provides real context switching without IRQ complexity
+// ============================================================================
+// MESSAGES
+// ============================================================================
 
-    // Future (v2): Implement PREEMPTIVE multitasking:
-    // 1. Save context in IRQ handler before calling this
-    // 2. Select next task here
-    // 3. Return next task's context to IRQ handler
-    // 4. IRQ handler restores new context and IRET
+// The receiver blocks with its waiting flag set; a sender that finds the
+// flag after publishing takes it and wakes the receiver. The receiver is
+// WAITING_EVENT before the flag is visible, and the flag is set before its
+// last look at the queue, so a message is never missed between the two.
+static void task_mailbox_notify(Task* task) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&task->message_queue.waiting, __ATOMIC_RELAXED)) return;
+    if (!__atomic_exchange_n(&task->message_queue.waiting, 0, __ATOMIC_ACQ_REL)) return;
+
+    // Under the rq lock the receiver is either still current (about to
+    // switch out, or idling with nothing else to run: the switch requeues
+    // it or it simply carries on) or off the CPU and out of the queue
+    uint64_t flags;
+    cpu_runqueue_t* rq = task_rq_lock(task, &flags);
+    bool wake = task->state == TASK_STATE_WAITING_EVENT;
+    if (wake) task->state = TASK_STATE_RUNNING;
+    bool enqueue = wake && rq->current != task;
+    spin_unlock_irqrestore(&rq->lock, flags);
+
+    if (enqueue) scheduler_enqueue(task);
+}
+
+int task_send(uint64_t task_id, const TaskMessage* message) {
+    Task* task = task_get(task_id);
+    if (!task || task->state == TASK_STATE_DEAD || !message) {
+        return -1;
+    }
+
+    TaskMessage copy = *message;
+    copy.sender_id = task_get_current_id();
+
+    if (!task_mailbox_push(&task->message_queue, &copy)) {
+        return -1;  // Full: the sender decides whether to retry
+    }
+    atomic_increment_u64(&task->pending_messages);
+
+    task_mailbox_notify(task);
+    return 0;
+}
+
+int task_receive(TaskMessage* out, bool wait) {
+    Task* task = current_task;
+    if (!task || !out) {
+        return -1;
+    }
+    TaskMessageQueue* queue = &task->message_queue;
+
+    for (;;) {
+        if (task_mailbox_pop(queue, out)) {
+            atomic_decrement_u64(&task->pending_messages);
+            if (task->state == TASK_STATE_WAITING_EVENT) {
+                task->state = TASK_STATE_RUNNING;   // Found it after an unrelated wakeup
+            }
+            return 0;
+        }
+        if (!wait) {
+            return -1;
+        }
+
+        // Blocked before the flag is published: a sender that sees the flag
+        // also sees the state it has to wake us from
+        uint64_t flags = irq_save();
+        task->state = TASK_STATE_WAITING_EVENT;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        __atomic_store_n(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+
+        if (task_mailbox_pending(queue)) {
+            // Arrived meanwhile: take the flag back (a sender may already have)
+            __atomic_store_n(&queue->waiting, 0, __ATOMIC_RELAXED);
+            task->state = TASK_STATE_RUNNING;
+        } else {
+            // Not runnable: the switch leaves us out of the run queue
+            task_switch_next(false);
+
+            // Nobody else to run: idle until an interrupt sends the message
+            if (task->state == TASK_STATE_WAITING_EVENT && (flags & (1ULL << 9))) {
+                task_idle();
+            }
+        }
+
+        irq_restore(flags);
+    }
+}
+
+void task_message_release(TaskMessage* message) {
+    TaskSharedMessage* shared = message->shared;
+    if (!shared) return;
+
+    message->shared = NULL;
+    if (__atomic_sub_fetch(&shared->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        kfree(shared);
+    }
 }
 
 // ============================================================================
-// TASK GROUPS (basic implementation)
+// TASK GROUPS
 // ============================================================================
+//
+// A group shares two budgets between its members:
+//   - memory: EVENT_MEMORY_ALLOC / EVENT_MEMORY_MAP pages are charged to it
+//     by the Storage deck, which refuses an event that would go over
+//     memory_limit; EVENT_MEMORY_FREE gives the pages back. Each task
+//     tracks what it charged (group_memory), and that is released when it
+//     leaves the group or is destroyed.
+//   - CPU: energy_limit percent of all online CPUs. Every run is charged to
+//     cpu_used in task_account(); once a period's quota is used the group
+//     is throttled and its members are parked at their next pick. The
+//     health timer grants a quota every TASK_GROUP_PERIOD_MS; time run over
+//     the quota is debt and is paid from the next periods first.
+//
+// The scheduler side takes no group lock (it runs under rq->lock, often in
+// the timer IRQ): groups are never freed, a slot is published by setting
+// its group_id last, and cpu_used / throttled are only touched atomically.
+
+// Slot of a group, without the lock
+static TaskGroup* task_group_find(uint64_t group_id) {
+    if (group_id == 0) return NULL;
+
+    for (int i = 0; i < MAX_TASK_GROUPS; i++) {
+        if (__atomic_load_n(&task_groups[i].group_id, __ATOMIC_ACQUIRE) == group_id) {
+            return &task_groups[i];
+        }
+    }
+    return NULL;
+}
+
+// Cycles the group may run per period, over all online CPUs
+static uint64_t task_group_quota(const TaskGroup* group) {
+    return tsc_ms_to_cycles(TASK_GROUP_PERIOD_MS) * task_cpu_count() / 100 * group->energy_limit;
+}
+
+// task_account(), rq->lock held
+static void task_group_charge_cpu(cpu_runqueue_t* rq, Task* task, uint64_t delta) {
+    TaskGroup* group = task_group_find(task->group_id);
+    if (!group || group->energy_limit >= 100) return;
+
+    uint64_t used = __atomic_add_fetch(&group->cpu_used, delta, __ATOMIC_RELAXED);
+    if (used >= task_group_quota(group) && !__atomic_load_n(&group->throttled, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&group->throttled, 1, __ATOMIC_RELAXED);
+        if (task == rq->current) rq->resched_pending = true;   // Parked at the switch
+    }
+}
+
+static bool task_group_over_quota(const Task* task) {
+    TaskGroup* group = task_group_find(task->group_id);
+    return group && __atomic_load_n(&group->throttled, __ATOMIC_RELAXED);
+}
+
+// Give back everything the task still has charged, task_groups_lock held
+static void task_group_release_memory(TaskGroup* group, Task* task) {
+    if (group) {
+        uint64_t bytes = MIN(task->group_memory, group->memory_used);
+        group->memory_used -= bytes;
+    }
+    task->group_memory = 0;
+}
+
+// Drop task_id from the member list, task_groups_lock held
+static bool task_group_drop_member(TaskGroup* group, uint64_t task_id) {
+    for (uint32_t j = 0; j < group->task_count; j++) {
+        if (group->task_ids[j] == task_id) {
+            for (uint32_t k = j; k < group->task_count - 1; k++) {
+                group->task_ids[k] = group->task_ids[k + 1];
+            }
+            group->task_count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+// task_destroy(): the task leaves its group and takes its charges along
+static void task_group_leave(Task* task) {
+    if (task->group_id == 0) return;
+
+    spin_lock(&task_groups_lock);
+    TaskGroup* group = task_group_find(task->group_id);
+    task_group_release_memory(group, task);
+    if (group) task_group_drop_member(group, task->task_id);
+    task->group_id = 0;
+    spin_unlock(&task_groups_lock);
+}
+
+// Health timer: bring the running tasks' time up to date, grant every group
+// its quota and queue the parked members of groups that are under it again
+static void task_group_refill(void) {
+    uint64_t flags;
+
+    for (uint32_t cpu = 0; cpu < TASK_MAX_CPUS; cpu++) {
+        if (!(cpus_online & (1U << cpu))) continue;
+
+        cpu_runqueue_t* rq = &runqueues[cpu];
+        flags = spin_lock_irqsave(&rq->lock);
+        if (rq->current && rq->current->group_id) task_account(rq, rq->current, rdtsc());
+        spin_unlock_irqrestore(&rq->lock, flags);
+    }
+
+    for (int i = 0; i < MAX_TASK_GROUPS; i++) {
+        TaskGroup* group = &task_groups[i];
+        if (__atomic_load_n(&group->group_id, __ATOMIC_ACQUIRE) == 0) continue;
+
+        uint64_t quota = task_group_quota(group);
+        uint64_t used = __atomic_load_n(&group->cpu_used, __ATOMIC_RELAXED);
+        uint64_t paid = (used < quota) ? used : quota;
+        uint64_t debt = __atomic_sub_fetch(&group->cpu_used, paid, __ATOMIC_RELAXED);
+
+        bool over = group->energy_limit < 100 && debt >= quota;
+        __atomic_store_n(&group->throttled, over ? 1 : 0, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_load_n(&group_parked_tasks, __ATOMIC_RELAXED) == 0) return;
+
+    // Killed tasks leave the table: the count is rebuilt from what is left
+    uint32_t still_parked = 0;
+    flags = spin_lock_irqsave(&task_table_lock);
+
+    for (uint32_t slot = 0; slot < MAX_TASKS; slot++) {
+        Task* task = task_table[slot];
+        if (!task || !task->group_parked) continue;
+
+        if (task->state == TASK_STATE_THROTTLED && task_group_over_quota(task)) {
+            still_parked++;
+            continue;
+        }
+
+        task->group_parked = false;
+        if (task->state == TASK_STATE_THROTTLED) {
+            task->state = TASK_STATE_RUNNING;
+            scheduler_enqueue(task);
+        }
+    }
+
+    __atomic_store_n(&group_parked_tasks, still_parked, __ATOMIC_RELAXED);
+    spin_unlock_irqrestore(&task_table_lock, flags);
+}
 
 uint64_t task_group_create(const char* name) {
     spin_lock(&task_groups_lock);
 
     for (int i = 0; i < MAX_TASK_GROUPS; i++) {
         if (task_groups[i].group_id == 0) {
-            task_groups[i].group_id = atomic_increment_u64(&next_group_id);
             strncpy(task_groups[i].name, name, TASK_GROUP_NAME_MAX - 1);
             task_groups[i].task_count = 0;
             task_groups[i].memory_limit = 0;
             task_groups[i].memory_used = 0;
             task_groups[i].energy_limit = 100;
+            task_groups[i].cpu_used = 0;
             task_groups[i].throttled = 0;
             task_groups[i].creation_time = rdtsc();
 
-            uint64_t group_id = task_groups[i].group_id;
+            // Published last: the scheduler finds the slot without the lock
+            uint64_t group_id = atomic_increment_u64(&next_group_id);
+            __atomic_store_n(&task_groups[i].group_id, group_id, __ATOMIC_RELEASE);
             spin_unlock(&task_groups_lock);
 
             kprintf("[TASK] Created task group '%s' (ID=%lu)\n", name, group_id);
@@ -696,6 +1800,11 @@ int task_group_add(uint64_t group_id, uint64_t task_id) {
             if (task_groups[i].task_count < TASK_GROUP_MAX_TASKS) {
                 task_groups[i].task_ids[task_groups[i].task_count] = task_id;
                 task_groups[i].task_count++;
+
+                // Charges stay with the group they were made against
+                if (task->group_id != group_id) {
+                    task_group_release_memory(task_group_find(task->group_id), task);
+                }
                 task->group_id = group_id;
 
                 spin_unlock(&task_groups_lock);
@@ -712,19 +1821,17 @@ int task_group_remove(uint64_t group_id, uint64_t task_id) {
     spin_lock(&task_groups_lock);
 
     for (int i = 0; i < MAX_TASK_GROUPS; i++) {
-        if (task_groups[i].group_id == group_id) {
-            // Find and remove task from array
-            for (uint32_t j = 0; j < task_groups[i].task_count; j++) {
-                if (task_groups[i].task_ids[j] == task_id) {
-                    // Shift remaining tasks
-                    for (uint32_t k = j; k < task_groups[i].task_count - 1; k++) {
-                        task_groups[i].task_ids[k] = task_groups[i].task_ids[k + 1];
-                    }
-                    task_groups[i].task_count--;
-                    spin_unlock(&task_groups_lock);
-                    return 0;
-                }
+        if (task_groups[i].group_id == group_id &&
+            task_group_drop_member(&task_groups[i], task_id)) {
+            // A parked task is queued again at the next refill
+            Task* task = task_get(task_id);
+            if (task && task->group_id == group_id) {
+                task_group_release_memory(&task_groups[i], task);
+                task->group_id = 0;
             }
+
+            spin_unlock(&task_groups_lock);
+            return 0;
         }
     }
 
@@ -747,32 +1854,310 @@ int task_group_set_memory_limit(uint64_t group_id, uint64_t bytes) {
     return -1;
 }
 
-int task_group_broadcast(uint64_t group_id, void* message) {
-    (void)message;  // Message API not yet implemented
+int task_group_set_energy_limit(uint64_t group_id, uint8_t percent) {
+    if (percent == 0 || percent > 100) return -1;
+
+    spin_lock(&task_groups_lock);
+
+    TaskGroup* group = task_group_find(group_id);
+    if (group) {
+        group->energy_limit = percent;
+        if (percent == 100) {
+            __atomic_store_n(&group->cpu_used, 0, __ATOMIC_RELAXED);   // No cap: debt forgiven
+        }
+    }
+
+    spin_unlock(&task_groups_lock);
+
+    if (!group) return -1;
+    kprintf("[TASK] Group %lu CPU share capped at %u%%\n", group_id, percent);
+    return 0;
+}
+
+int task_group_charge_memory(uint64_t task_id, uint64_t bytes) {
+    Task* task = task_get(task_id);
+    if (!task || task->group_id == 0) return 0;
+
+    int result = 0;
+    spin_lock(&task_groups_lock);
+
+    TaskGroup* group = task_group_find(task->group_id);
+    if (group) {
+        uint64_t limit = group->memory_limit;
+        if (limit && (group->memory_used > limit || bytes > limit - group->memory_used)) {
+            result = -1;
+        } else {
+            group->memory_used += bytes;
+            task->group_memory += bytes;
+        }
+    }
+
+    spin_unlock(&task_groups_lock);
+    return result;
+}
+
+void task_group_uncharge_memory(uint64_t task_id, uint64_t bytes) {
+    Task* task = task_get(task_id);
+    if (!task || task->group_id == 0) return;
+
+    spin_lock(&task_groups_lock);
+
+    // Only what the task charged to this group (leaving it released the rest)
+    TaskGroup* group = task_group_find(task->group_id);
+    if (group) {
+        bytes = MIN(bytes, MIN(task->group_memory, group->memory_used));
+        group->memory_used -= bytes;
+        task->group_memory -= bytes;
+    }
+
+    spin_unlock(&task_groups_lock);
+}
+
+// One payload for the whole group: each recipient's message points at it
+// and holds a reference
+int task_group_broadcast(uint64_t group_id, uint64_t message_type,
+                         const void* payload, uint32_t size) {
+    TaskSharedMessage* shared = (TaskSharedMessage*)kmalloc(sizeof(TaskSharedMessage) + size);
+    if (!shared) {
+        kprintf("[TASK] ERROR: Failed to allocate broadcast payload (%u bytes)\n", size);
+        return -1;
+    }
+    shared->refcount = 1;   // Ours, dropped below
+    shared->size = size;
+    if (size) memcpy(shared->payload, payload, size);
+
+    TaskMessage message;
+    memset(&message, 0, sizeof(message));
+    message.message_type = message_type;
+    message.shared = shared;
 
+    int delivered = -1;
     spin_lock(&task_groups_lock);
 
     for (int i = 0; i < MAX_TASK_GROUPS; i++) {
         if (task_groups[i].group_id == group_id) {
-            // NOTE: Message queue API for tasks not yet implemented
-            // When implemented, will send message to all tasks in group
-            kprintf("[TASK] Group broadcast to %u tasks (message API pending)\n",
-                    task_groups[i].task_count);
-            spin_unlock(&task_groups_lock);
-            return 0;
+            delivered = 0;
+            for (uint32_t j = 0; j < task_groups[i].task_count; j++) {
+                __atomic_add_fetch(&shared->refcount, 1, __ATOMIC_RELAXED);
+                if (task_send(task_groups[i].task_ids[j], &message) == 0) {
+                    delivered++;
+                } else {
+                    __atomic_sub_fetch(&shared->refcount, 1, __ATOMIC_RELAXED);
+                }
+            }
+            break;
         }
     }
 
     spin_unlock(&task_groups_lock);
-    return -1;  // Group not found
+
+    task_message_release(&message);
+    return delivered;
 }
 
 // ============================================================================
-// MIGRATION (stub for now)
+// CPUS AND MIGRATION
 // ============================================================================
 
+void task_cpu_online(uint32_t cpu) {
+    if (cpu >= TASK_MAX_CPUS) return;
+    __atomic_or_fetch(&cpus_online, 1U << cpu, __ATOMIC_RELEASE);
+}
+
+uint32_t task_cpu_count(void) {
+    uint32_t count = 0;
+    for (uint32_t mask = cpus_online; mask; mask &= mask - 1) {
+        count++;
+    }
+    return count;
+}
+
+int task_set_affinity(uint64_t task_id, uint32_t cpu_mask) {
+    Task* task = task_get(task_id);
+    if (!task || task == &boot_task) {
+        return -1;
+    }
+    if (!(cpu_mask & cpus_online)) {
+        return -1;  // Would never run
+    }
+
+    task->cpu_affinity = cpu_mask;
+
+    // Off the allowed set now: move to the least loaded allowed CPU
+    if (!(cpu_mask & (1U << task->cpu))) {
+        return task_migrate(task_id, (uint8_t)task_select_cpu(task));
+    }
+    return 0;
+}
+
 int task_migrate(uint64_t task_id, uint8_t target_core) {
-    // TODO: Implement task migration between CPU cores
-    kprintf("[TASK] Task migration not yet implemented\n");
-    return -1;
+    Task* task = task_get(task_id);
+    if (!task) {
+        return -1;
+    }
+    if (!task_cpu_allowed(task, target_core)) {
+        kprintf("[TASK] ERROR: Task %lu may not run on CPU %u\n", task_id, target_core);
+        return -1;
+    }
+
+    uint64_t flags;
+    cpu_runqueue_t* src = task_rq_lock(task, &flags);
+    cpu_runqueue_t* dst = &runqueues[target_core];
+    if (src == dst) {
+        task->migrate_cpu = TASK_NO_MIGRATE;
+        spin_unlock_irqrestore(&src->lock, flags);
+        return 0;
+    }
+
+    // Running: it leaves at its next switch, as soon as possible
+    if (src->current == task) {
+        task->migrate_cpu = target_core;
+        src->resched_pending = true;
+        spin_unlock_irqrestore(&src->lock, flags);
+        return 0;
+    }
+    spin_unlock_irqrestore(&src->lock, flags);
+
+    flags = rq_lock_pair(src, dst);
+    int result = -1;
+    if (task_rq(task) == src && src->current != task) {
+        task_move_locked(task, src, dst);
+        result = 0;
+    }
+    rq_unlock_pair(src, dst, flags);
+
+    // Lost a race with another migration or a switch onto the CPU: retry
+    return (result == 0) ? 0 : task_migrate(task_id, target_core);
+}
+
+// ============================================================================
+// BENCHMARKS
+// ============================================================================
+
+static void task_bench_entry(void* arg) {
+    (void)arg;
+}
+
+static inline uint64_t task_cycles_to_ns(uint64_t cycles) {
+    return cycles * 1000000 / tsc_khz();
+}
+
+// Spawn and kill `count` tasks, TASK_BENCH_BATCH at a time, and report the
+// average cost of each. Preemption is off per batch so none of them runs.
+// The first batch allocates stacks and fills the slab and the stack cache;
+// a batch is no larger than the cache, so every later spawn is served from it.
+int task_spawn_benchmark(uint32_t count) {
+    static uint64_t ids[TASK_BENCH_BATCH];
+
+    uint8_t log_level = klog_get_level(KLOG_TASK);
+    klog_set_level(KLOG_TASK, KLOG_LEVEL_WARN);
+
+    uint64_t spawn_cycles = 0;
+    uint64_t kill_cycles = 0;
+    uint32_t done = 0;
+    int result = 0;
+
+    while (done < count && result == 0) {
+        uint32_t batch = MIN(count - done, (uint32_t)TASK_BENCH_BATCH);
+        uint32_t spawned = 0;
+
+        preempt_disable();
+
+        uint64_t start = rdtsc();
+        for (; spawned < batch; spawned++) {
+            Task* task = task_spawn("bench", (void*)task_bench_entry, 50);
+            if (!task) {
+                result = -1;
+                break;
+            }
+            ids[spawned] = task->task_id;
+        }
+        uint64_t mid = rdtsc();
+        for (uint32_t i = 0; i < spawned; i++) {
+            task_kill(ids[i]);
+        }
+        uint64_t end = rdtsc();
+
+        preempt_enable();
+
+        spawn_cycles += mid - start;
+        kill_cycles += end - mid;
+        done += spawned;
+    }
+
+    klog_set_level(KLOG_TASK, log_level);
+
+    if (done == 0) {
+        kprintf("[TASK] Spawn benchmark: no task could be spawned\n");
+        return -1;
+    }
+
+    kprintf("[TASK] Spawn benchmark: %u tasks, spawn %lu cycles (%lu ns), kill %lu cycles (%lu ns)\n",
+            done, spawn_cycles / done, task_cycles_to_ns(spawn_cycles / done),
+            kill_cycles / done, task_cycles_to_ns(kill_cycles / done));
+    return result;
+}
+
+static volatile bool yield_bench_stop;
+
+static void task_bench_yield_partner(void* arg) {
+    (void)arg;
+    while (!yield_bench_stop) {
+        task_scheduler_yield();
+    }
+}
+
+// Ping-pong with a partner task pinned to this CPU and report the cost of
+// one round trip (two switches). The switch counter, not the yield count,
+// is the divisor: a yield that finds itself still leftmost does not switch.
+// Other runnable tasks on this CPU take part in the rotation too.
+int task_yield_benchmark(uint32_t count) {
+    Task* self = current_task;
+    if (!self || count == 0) return -1;
+
+    uint8_t log_level = klog_get_level(KLOG_TASK);
+    klog_set_level(KLOG_TASK, KLOG_LEVEL_WARN);
+
+    yield_bench_stop = false;
+    Task* partner = task_spawn("yield-bench", (void*)task_bench_yield_partner, self->energy_requested);
+    if (!partner) {
+        klog_set_level(KLOG_TASK, log_level);
+        kprintf("[TASK] Yield benchmark: cannot spawn the partner task\n");
+        return -1;
+    }
+    uint64_t partner_id = partner->task_id;
+    task_set_affinity(partner_id, 1U << self->cpu);
+
+    // Warm up: the partner's first run goes through the trampoline
+    for (uint32_t i = 0; i < TASK_BENCH_BATCH; i++) {
+        task_scheduler_yield();
+    }
+
+    cpu_runqueue_t* rq = this_rq();
+    uint64_t switches = rq->context_switches;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < count; i++) {
+        task_scheduler_yield();
+    }
+    uint64_t cycles = rdtsc() - start;
+    switches = rq->context_switches - switches;
+
+    // Let the partner see the flag and exit
+    yield_bench_stop = true;
+    for (uint32_t i = 0; i < TASK_BENCH_BATCH && task_get(partner_id); i++) {
+        task_scheduler_yield();
+    }
+    if (task_get(partner_id)) task_kill(partner_id);
+
+    klog_set_level(KLOG_TASK, log_level);
+
+    if (switches < 2) {
+        kprintf("[TASK] Yield benchmark: %u yields never switched\n", count);
+        return -1;
+    }
+
+    uint64_t round_trip = cycles * 2 / switches;
+    kprintf("[TASK] Yield benchmark: %u yields, %lu switches, round trip %lu cycles (%lu ns)\n",
+            count, switches, round_trip, task_cycles_to_ns(round_trip));
+    return 0;
 }
@@ -4,6 +4,9 @@
 #include "ktypes.h"
 #include "../core/atomics.h"
 #include "vmm.h"
+#include "rbtree.h"
+#include "tsc.h"
+#include "ktimer.h"
 
 // ============================================================================
 // TASK SYSTEM - Lightweight task management (replacement for heavy processes)
@@ -55,22 +58,13 @@ typedef struct {
 // TASK CONTEXT (CPU state)
 // ============================================================================
 
-// CPU context for task switching
+// CPU context for task switching. Switches happen only inside
+// task_switch_to() calls: the callee-saved registers and the resume address
+// are on the task's own stack, so the stack pointer is all that is kept here.
 typedef struct {
-    // General purpose registers
-    uint64_t rax, rbx, rcx, rdx;
-    uint64_t rsi, rdi, rbp, rsp;
-    uint64_t r8,  r9,  r10, r11;
-    uint64_t r12, r13, r14, r15;
+    uint64_t rsp;               // Must stay first (context_switch.asm)
 
-    // Instruction pointer and flags
-    uint64_t rip;
-    uint64_t rflags;
-
-    // Segment registers
-    uint16_t cs, ds, es, fs, gs, ss;
-
-    // FPU/SSE state pointer (allocated separately for efficiency)
+    // XSAVE area, allocated on the first FPU/SSE instruction (see fpu.h)
     void* fpu_state;
 } TaskContext;
 
@@ -79,22 +73,48 @@ typedef struct {
 // ============================================================================
 
 #define TASK_NAME_MAX 32
-#define TASK_STACK_SIZE (16 * 1024)  // 16KB stack per task
-#define TASK_MESSAGE_QUEUE_SIZE 16   // Max messages per task
+
+// Task IDs are handles: (generation << TASK_SLOT_BITS) | table slot
+#define TASK_SLOT_BITS 10
+#define MAX_TASKS (1 << TASK_SLOT_BITS)
+#define TASK_MAKE_ID(gen, slot) (((uint64_t)(gen) << TASK_SLOT_BITS) | (uint64_t)(slot))
+#define TASK_ID_SLOT(id) ((uint32_t)((id) & (MAX_TASKS - 1)))
+#define TASK_ID_GENERATION(id) ((uint32_t)((id) >> TASK_SLOT_BITS))
+#define TASK_STACK_SIZE (16 * 1024)  // 16KB per task, mapped up front with guard pages
+#define TASK_MESSAGE_QUEUE_SIZE 16   // Max messages per task (power of two)
+#define TASK_SLAB_CHUNK 16           // Task structures per slab refill
+#define TASK_STACK_CACHE 16          // Recycled stacks kept per CPU
 
 // === MESSAGE QUEUE ===
+// Broadcast payload: one copy shared by every recipient, freed when the
+// last one calls task_message_release()
 typedef struct {
-    uint64_t sender_id;            // ID of sender task
+    volatile uint32_t refcount;
+    uint32_t size;                 // Bytes in payload
+    uint8_t payload[];
+} TaskSharedMessage;
+
+typedef struct {
+    uint64_t sender_id;            // ID of sender task (0 = kernel)
     uint64_t message_type;         // Type of message
     uint64_t data[4];              // Message payload (32 bytes)
+    TaskSharedMessage* shared;     // Broadcast payload, or NULL
 } TaskMessage;
 
+// Lock-free MPSC mailbox: any task or interrupt handler may send, only the
+// owner receives. A sender claims a slot by advancing tail with CAS and
+// publishes it through the slot's sequence number (bounded queue after
+// Vyukov); the owner reads in order without atomics on head.
+typedef struct {
+    volatile uint64_t seq;         // == position: free; == position + 1: filled
+    TaskMessage message;
+} TaskMessageSlot;
+
 typedef struct {
-    TaskMessage messages[TASK_MESSAGE_QUEUE_SIZE];
-    uint32_t head;                 // Read position
-    uint32_t tail;                 // Write position
-    uint32_t count;                // Number of messages
-    uint32_t lock;                 // Spinlock
+    TaskMessageSlot slots[TASK_MESSAGE_QUEUE_SIZE];
+    volatile uint64_t tail;        // Next position to claim (senders)
+    uint64_t head;                 // Next position to read (owner only)
+    volatile uint32_t waiting;     // Owner is blocked in task_receive()
 } TaskMessageQueue;
 
 typedef struct Task {
@@ -103,6 +123,7 @@ typedef struct Task {
     char name[TASK_NAME_MAX];      // Task name (for debugging)
     uint64_t parent_id;            // Parent task ID (0 = kernel)
     uint64_t group_id;             // Task group ID (0 = none)
+    uint64_t group_memory;         // Bytes this task has charged to that group
 
     // === ENERGY & PRIORITY ===
     uint8_t energy_requested;      // Energy requested by task (0-100)
@@ -116,11 +137,14 @@ typedef struct Task {
     // === TIMING ===
     uint64_t creation_time;        // RDTSC at creation
     uint64_t last_run_time;        // RDTSC of last execution
+    uint64_t wait_start;           // RDTSC at which it last became runnable (responsiveness)
     uint64_t total_runtime;        // Total CPU time used
     uint64_t sleep_until;          // RDTSC to wake up (if sleeping)
+    ktimer_t sleep_timer;          // Wakes the task from task_sleep()
 
     // === MEMORY ===
     uint64_t page_table;           // CR3 value (virtual memory context)
+    vmm_context_t* vmm_ctx;        // Address space (loaded with its PCID on switch)
     void* stack_base;              // Stack base address
     uint64_t stack_size;           // Stack size
     void* entry_point;             // Task entry point function
@@ -130,18 +154,26 @@ typedef struct Task {
     TaskContext context;           // Saved CPU state
 
     // === STATISTICS ===
+    uint64_t events_submitted;     // Events the Receiver accepted from this task
     uint64_t events_processed;     // Total events processed
     uint64_t errors_count;         // Number of errors/crashes
     uint64_t io_operations;        // Number of I/O ops
     uint64_t last_progress_time;   // RDTSC of last progress
 
     // === COMMUNICATION ===
-    TaskMessageQueue* message_queue;  // Pointer to task's message queue
+    TaskMessageQueue message_queue;   // Task's message queue (embedded)
     uint64_t pending_messages;        // Number of pending messages
 
-    // === LINKED LIST ===
-    struct Task* next;             // Next task in scheduler queue
-    struct Task* prev;             // Previous task in scheduler queue
+    // === SCHEDULING ===
+    rb_node_t run_node;            // Node in the run queue (ordered by vruntime)
+    uint64_t vruntime;             // Runtime in cycles, scaled by TASK_WEIGHT_REF / energy
+    bool on_runqueue;              // Linked into the run queue (not while running)
+    uint8_t cpu;                   // Run queue the task belongs to
+    uint8_t migrate_cpu;           // Running, to be moved at the next switch (TASK_NO_MIGRATE)
+    uint32_t cpu_affinity;         // CPUs it may run on, bit per CPU
+    bool group_parked;             // THROTTLED by its group's CPU cap, not by task_pause()
+    uint32_t preempt_count;        // Its preempt_disable() depth while switched out
+    struct Task* zombie_next;      // Exited, waiting for task_reap_zombies()
 } Task;
 
 // ============================================================================
@@ -150,6 +182,7 @@ typedef struct Task {
 
 #define TASK_GROUP_NAME_MAX 32
 #define TASK_GROUP_MAX_TASKS 256
+#define TASK_GROUP_PERIOD_MS TASK_STALL_SCAN_MS    // CPU quota refill, on the health timer
 
 typedef struct {
     uint64_t group_id;                  // Unique group ID
@@ -159,12 +192,13 @@ typedef struct {
     uint64_t task_ids[TASK_GROUP_MAX_TASKS];  // Array of task IDs
 
     // Shared limits
-    uint64_t memory_limit;              // Total memory limit for group
-    uint64_t memory_used;               // Current memory usage
-    uint8_t  energy_limit;              // Total energy limit (0-100)
+    uint64_t memory_limit;              // Total memory limit for group (0 = none)
+    uint64_t memory_used;               // Bytes charged by EVENT_MEMORY_ALLOC / MAP
+    uint8_t  energy_limit;              // CPU share of all online CPUs, percent (100 = no cap)
+    uint64_t cpu_used;                  // Cycles run and not yet covered by a period's quota
 
     // Group state
-    uint8_t  throttled;                 // Is group throttled?
+    uint8_t  throttled;                 // Over its CPU quota: members are parked
     uint64_t creation_time;             // RDTSC at creation
 } TaskGroup;
 
@@ -179,6 +213,8 @@ void task_system_init(void);
 Task* task_spawn(const char* name, void* entry_point, uint8_t energy);
 Task* task_spawn_with_args(const char* name, void* entry_point, void* args, uint8_t energy);
 int task_kill(uint64_t task_id);
+void task_exit(void);             // Current task finishes (also on return from entry)
+void task_reap_zombies(void);     // Free exited tasks (their stacks cannot free themselves)
 
 // === TASK CONTROL ===
 int task_sleep(uint64_t task_id, uint64_t milliseconds);
@@ -203,25 +239,120 @@ uint64_t task_group_create(const char* name);
 int task_group_add(uint64_t group_id, uint64_t task_id);
 int task_group_remove(uint64_t group_id, uint64_t task_id);
 int task_group_set_memory_limit(uint64_t group_id, uint64_t bytes);
-int task_group_broadcast(uint64_t group_id, void* message);
+int task_group_set_energy_limit(uint64_t group_id, uint8_t percent);  // 1-100
+
+// Memory charged to the task's group: -1 if it would go over the limit.
+// Tasks outside a group are not limited. A task never gives back more than
+// it charged, and whatever it still holds is released when it leaves the
+// group or is destroyed.
+int task_group_charge_memory(uint64_t task_id, uint64_t bytes);
+void task_group_uncharge_memory(uint64_t task_id, uint64_t bytes);
+int task_group_broadcast(uint64_t group_id, uint64_t message_type,
+                         const void* payload, uint32_t size);   // Recipients reached, -1 if no group
 
 // === HEALTH & MONITORING ===
-void task_update_health(Task* task);
-int task_auto_recover(Task* task);
+// Health follows events instead of a per-tick sweep: responsiveness is set
+// when the task is picked (how long it waited), stability and efficiency
+// when it reports progress or an error, and waking from a block restarts
+// the progress clock. Only stall detection is periodic: every
+// TASK_STALL_SCAN_MS the health timer looks at TASK_STALL_SCAN_BUDGET table
+// slots, so its cost does not grow with the number of tasks.
+#define TASK_STALL_MS 200               // Runnable without progress this long: stalled
+#define TASK_STALL_SCAN_MS 100
+#define TASK_STALL_SCAN_BUDGET 64       // Slots per scan (full table every MAX_TASKS / 64 scans)
+
+void task_update_health(Task* task);    // Refresh the time-based metrics (stats, stall scan)
+int task_auto_recover(Task* task);      // Act on the current health values
+void task_record_progress(Task* task);  // Event handled / work done
+void task_record_error(Task* task);     // Event failed
 void task_print_stats(uint64_t task_id);
 
+// === ACCOUNTING ===
+// CPU time is charged in TSC cycles whenever a task is switched out;
+// pipeline work is charged by the stage that does it, to Event.user_id.
+// Unknown or stale task IDs are ignored.
+void task_count_event(uint64_t task_id);                    // Receiver accepted an event
+void task_count_io(uint64_t task_id);                       // Storage deck did file I/O
+void task_count_completion(uint64_t task_id, bool failed);  // Execution deck answered
+
+// Consistent copy of one task's counters (runtime includes the current slice)
+typedef struct {
+    uint64_t task_id;
+    char name[TASK_NAME_MAX];
+    TaskState state;
+    uint8_t cpu;
+    uint8_t energy;
+    uint64_t runtime;               // TSC cycles
+    uint64_t events_submitted;
+    uint64_t events_processed;
+    uint64_t io_operations;
+    uint64_t errors_count;
+} TaskStatSample;
+
+uint32_t task_snapshot(TaskStatSample* out, uint32_t max);  // Returns the number filled in
+uint64_t task_idle_cycles(void);       // Time this CPU spent halted in task_idle()
+const char* task_state_name(TaskState state);
+
+// Do one step of background VMM work (vmm_idle_work), or if there is none
+// halt until the next interrupt. The halted time counts as idle, not as
+// runtime of the task that halted.
+void task_idle(void);
+
 // === SCHEDULER INTERFACE ===
+// Proportional share: the runnable task with the smallest vruntime runs next,
+// and vruntime grows slower the more energy a task has, so CPU share is
+// proportional to energy_allocated (energy 100 gets twice the share of 50).
+#define TASK_WEIGHT_REF 50                                  // Energy at which vruntime == runtime
+#define TASK_SLEEPER_CREDIT tsc_ms_to_cycles(3)             // Max lead a waking task gets
+#define TASK_WAKEUP_GRANULARITY tsc_ms_to_cycles(1)         // Lead needed to preempt on wakeup
+
+// Preemption: the running task keeps the CPU for a time slice that grows
+// with its energy, then the timer interrupt switches to the next one.
+// Nothing is preempted while preempt_disable() is in effect (any spinlock).
+// The slice is a one-shot ktimer, armed only while another task is waiting:
+// a lone task (or an idle kernel) takes no scheduler interrupts at all.
+#define TASK_SLICE_MIN_MS 10                                // Energy 0
+#define TASK_SLICE_MAX_MS 50                                // Energy 100
+#define TASK_PREEMPT_RETRY_US 500                           // Switch due but a lock is held: retry after
+
 Task* task_scheduler_next(void);  // Get next task to run
 void task_scheduler_yield(void);  // Current task yields CPU
-void task_scheduler_tick(void);   // Called by timer interrupt
-
-// === MIGRATION ===
-int task_migrate(uint64_t task_id, uint8_t target_core);
+void task_scheduler_tick(void);   // Budgeted stall scan (health timer)
+bool task_need_resched(void);     // A woken task should preempt the current one
+void task_preempt_irq(void);      // End of the timer IRQ (after EOI): switch if the slice is used up
+
+// === CPUS AND MIGRATION ===
+// Every CPU has its own run queue and lock. New and woken tasks go to the
+// least loaded CPU they may run on (their last one if tied); a CPU with an
+// empty queue, and each CPU on the health timer, pulls tasks from the
+// busiest one until the two differ by at most one.
+#define TASK_MAX_CPUS 32
+#define TASK_AFFINITY_ALL 0xFFFFFFFFU
+#define TASK_NO_MIGRATE 0xFF
+
+void task_cpu_online(uint32_t cpu);                     // CPU starts scheduling (boot CPU: task_system_init)
+uint32_t task_cpu_count(void);
+int task_set_affinity(uint64_t task_id, uint32_t cpu_mask);
+int task_migrate(uint64_t task_id, uint8_t target_core);  // -1 if not allowed by the affinity mask
+
+// === MESSAGES ===
+// Sending never blocks (-1 if the mailbox is full or the task is gone) and
+// wakes the receiver if it waits. task_receive() with wait blocks the
+// current task in TASK_STATE_WAITING_EVENT until a message arrives.
+int task_send(uint64_t task_id, const TaskMessage* message);
+int task_receive(TaskMessage* out, bool wait);
+void task_message_release(TaskMessage* message);   // Drop the broadcast payload reference
+
+// === BENCHMARKS ===
+#define TASK_BENCH_BATCH TASK_STACK_CACHE      // Every spawn of a warm batch hits the stack cache
+#define TASK_BENCH_SPAWN_COUNT 10000
+#define TASK_BENCH_YIELD_COUNT 100000
+
+int task_spawn_benchmark(uint32_t count);   // Average spawn and kill cost, printed
+int task_yield_benchmark(uint32_t count);   // Cycles per yield round trip, printed
 
 // === CONTEXT SWITCHING (Assembly functions) ===
 // These are implemented in arch/x86-64/context/context_switch.asm
-void task_save_context(TaskContext* ctx);
-void task_restore_context(TaskContext* ctx);
 void task_switch_to(TaskContext* old_ctx, TaskContext* new_ctx);
 void task_init_context(TaskContext* ctx, void* entry, void* stack, void* arg);
 
@@ -1,5 +1,6 @@
 #include "eventapi.h"
 #include "klib.h"
+#include "../task/task.h"
 
 // ============================================================================
 // GLOBAL STATE (user space)
@@ -14,8 +15,13 @@ static ResponseRingBuffer* from_kernel_ring = 0;
 static Response response_cache[RESPONSE_CACHE_SIZE];
 static int response_cache_valid[RESPONSE_CACHE_SIZE];
 
-// PID текущего процесса (для заполнения событий)
-static uint64_t current_user_id = 1;  // TODO: получать реальный PID
+// Отправитель событий: текущая задача; до запуска планировщика - 1
+static uint64_t current_user_id = 1;
+
+static uint64_t eventapi_user_id(void) {
+    uint64_t task_id = task_get_current_id();
+    return task_id ? task_id : current_user_id;
+}
 
 // ============================================================================
 // INITIALIZATION
@@ -45,7 +51,7 @@ uint64_t eventapi_submit_event(Event* event) {
 
     // Заполняем метаданные
     event->id = 0;  // ВАЖНО! User НЕ устанавливает ID
-    event->user_id = current_user_id;
+    event->user_id = eventapi_user_id();
     event->timestamp = 0;  // Kernel установит timestamp
 
     // Отправляем в ring buffer
@@ -12,6 +12,9 @@
 #include "tagfs.h"
 #include "task.h"
 #include "pit.h"
+#include "tsc.h"
+#include "ktimer.h"
+#include "lapic.h"
 #include "keyboard.h"
 #include "eventdriven_system.h"
 #include "eventdriven_demo.h"
@@ -64,11 +67,19 @@ void kernel_main(e820_entry_t* e820_map, uint64_t e820_count, uint64_t mem_start
 
     kprintf("%[H]Initializing core systems...%[D]\n\n");
 
+    // CPU feature registry: hot paths (mem*, bitmaps, crc32c, FPU save)
+    // pick their implementation once here instead of testing flags on every call
+    cpu_features_init();
+    kmem_select(cpu_has(CPU_FEAT_ERMS), cpu_has(CPU_FEAT_FSRM));
+    kbits_select(cpu_has(CPU_FEAT_SSE42), cpu_has(CPU_FEAT_POPCNT));
+
     enable_fpu();
-    kprintf("%[S] FPU enabled%[D]\n");
+    kprintf("%[S] FPU enabled (lazy, %s, %lu-byte state)%[D]\n",
+            fpu_save_mode_name(), fpu_state_size());
 
     mem_init();
-    kprintf("%[S] Memory allocator initialized%[D]\n");
+    kprintf("%[S] Memory allocator initialized (mem*: %s, bits: %s)%[D]\n",
+            kmem_impl_name(), kbits_impl_name());
 
     // Use E820 map from bootloader (passed via RDI/RSI)
     e820_set_entries(e820_map, e820_count);
@@ -118,6 +129,15 @@ void kernel_main(e820_entry_t* e820_map, uint64_t e820_count, uint64_t mem_start
     kprintf("\n%[H]=== Step 5: PIT Timer Setup ===%[D]\n");
     pit_init(100);  // 100 Hz = 10ms per tick
     kprintf("%[S] PIT timer initialized (100 Hz)%[D]\n");
+    tsc_init();     // TSC rate measured on PIT channel 2
+    ktimer_init();
+
+    // One-shot LAPIC timer: interrupts only when a timer or slice is due.
+    // The periodic PIT tick is then no longer needed.
+    if (lapic_timer_init()) {
+        pic_disable_irq(0);
+    }
+    kprintf("%[S] Timer event device: %s%[D]\n", ktimer_event_device());
 
     kprintf("\n%[S] All core systems initialized!%[D]\n");
 
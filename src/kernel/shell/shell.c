@@ -59,6 +59,9 @@ int cmd_byebye(int argc, char** argv);
 int cmd_ls(int argc, char** argv);
 int cmd_whoami(int argc, char** argv);
 int cmd_login(int argc, char** argv);
+int cmd_loglevel(int argc, char** argv);
+int cmd_bench(int argc, char** argv);
+int cmd_top(int argc, char** argv);
 
 // ============================================================================
 // COMMAND TABLE
@@ -81,6 +84,9 @@ static shell_command_t commands[] = {
     {"info", "Show system information", cmd_info},
     {"whoami", "Show current user", cmd_whoami},
     {"login", "Login as user", cmd_login},
+    {"loglevel", "Show or set subsystem log levels", cmd_loglevel},
+    {"bench", "Run a kernel benchmark", cmd_bench},
+    {"top", "Show tasks by CPU and pipeline usage", cmd_top},
     {"reboot", "Reboot the system", cmd_reboot},
     {"byebye", "Shutdown system", cmd_byebye},
     {NULL, NULL, NULL}  // Sentinel
@@ -140,7 +146,9 @@ void shell_run(void) {
 
     while (1) {
         if (!keyboard_has_input()) {
-            asm("hlt");  // Wait for interrupt
+            // Idle: VMM upkeep first, otherwise wait for an interrupt
+            // (charged as idle time)
+            task_idle();
             continue;
         }
 
@@ -710,6 +718,238 @@ int cmd_edit(int argc, char** argv) {
     return 0;
 }
 
+// ============================================================================
+// COMMAND: loglevel
+// ============================================================================
+
+int cmd_loglevel(int argc, char** argv) {
+    static const char* level_names[] = {"none", "error", "warn", "info", "debug", "trace"};
+
+    if (argc < 3) {
+        kprintf("Usage: loglevel <subsystem|all> <0-5>\n");
+        kprintf("Levels: 0=none 1=error 2=warn 3=info 4=debug 5=trace (compiled up to %d)\n\n",
+                KLOG_COMPILE_LEVEL);
+        for (int i = 0; i < KLOG_SUBSYS_COUNT; i++) {
+            uint8_t level = klog_get_level((klog_subsys_t)i);
+            kprintf("  %[H]%-10s%[D] %s\n", klog_subsys_name((klog_subsys_t)i), level_names[level]);
+        }
+        return argc == 1 ? 0 : -1;
+    }
+
+    int level = atoi(argv[2]);
+    if (level < KLOG_LEVEL_NONE || level > KLOG_LEVEL_TRACE) {
+        kprintf("%[E]Invalid level: %s%[D]\n", argv[2]);
+        return -1;
+    }
+
+    if (strcmp(argv[1], "all") == 0) {
+        for (int i = 0; i < KLOG_SUBSYS_COUNT; i++) {
+            klog_set_level((klog_subsys_t)i, (uint8_t)level);
+        }
+    } else {
+        int subsys = klog_subsys_from_name(argv[1]);
+        if (subsys < 0) {
+            kprintf("%[E]Unknown subsystem: %s%[D]\n", argv[1]);
+            return -1;
+        }
+        klog_set_level((klog_subsys_t)subsys, (uint8_t)level);
+    }
+
+    kprintf("%[S]Log level for %s set to %s%[D]\n", argv[1], level_names[level]);
+    if (level > KLOG_COMPILE_LEVEL) {
+        kprintf("%[W]Note: messages above level %d are compiled out (make LOG_LEVEL=N)%[D]\n",
+                KLOG_COMPILE_LEVEL);
+    }
+    return 0;
+}
+
+// ============================================================================
+// COMMAND: bench
+// ============================================================================
+
+int cmd_bench(int argc, char** argv) {
+    if (argc < 2) {
+        kprintf("Usage: bench <spawn|yield> [count]\n");
+        kprintf("  spawn  Spawn and kill tasks (default %d)\n", TASK_BENCH_SPAWN_COUNT);
+        kprintf("  yield  Yield round trips with a partner task (default %d)\n", TASK_BENCH_YIELD_COUNT);
+        return -1;
+    }
+
+    if (strcmp(argv[1], "spawn") == 0) {
+        int count = (argc > 2) ? atoi(argv[2]) : TASK_BENCH_SPAWN_COUNT;
+        if (count <= 0) {
+            kprintf("%[E]Invalid count: %s%[D]\n", argv[2]);
+            return -1;
+        }
+        return task_spawn_benchmark((uint32_t)count);
+    }
+
+    if (strcmp(argv[1], "yield") == 0) {
+        int count = (argc > 2) ? atoi(argv[2]) : TASK_BENCH_YIELD_COUNT;
+        if (count <= 0) {
+            kprintf("%[E]Invalid count: %s%[D]\n", argv[2]);
+            return -1;
+        }
+        return task_yield_benchmark((uint32_t)count);
+    }
+
+    kprintf("%[E]Unknown benchmark: %s%[D]\n", argv[1]);
+    return -1;
+}
+
+// ============================================================================
+// COMMAND: top
+// ============================================================================
+
+#define TOP_DEFAULT_INTERVAL_MS 1000
+#define TOP_MAX_ROWS 16
+
+// Counters at the previous refresh, by task table slot
+typedef struct {
+    uint64_t task_id;
+    uint64_t runtime;
+    uint64_t events;
+    uint64_t io;
+} top_prev_t;
+
+typedef struct {
+    TaskStatSample* sample;
+    uint64_t cpu_permille;      // Share of one CPU over the interval
+    uint64_t events_per_sec;
+    uint64_t io_per_sec;
+} top_row_t;
+
+static volatile bool top_refresh;
+
+static void top_timer_fired(ktimer_t* timer) {
+    (void)timer;
+    top_refresh = true;
+}
+
+static uint64_t top_rate(uint64_t count, uint64_t elapsed) {
+    return elapsed ? count * tsc_khz() * 1000 / elapsed : 0;
+}
+
+// Deltas against the previous refresh (a new task in a slot counts from
+// zero), then rows sorted by CPU share, busiest first
+static uint32_t top_collect(TaskStatSample* samples, top_row_t* rows, top_prev_t* prev,
+                            uint64_t elapsed) {
+    uint32_t count = task_snapshot(samples, MAX_TASKS);
+
+    for (uint32_t i = 0; i < count; i++) {
+        TaskStatSample* sample = &samples[i];
+        top_prev_t* last = &prev[TASK_ID_SLOT(sample->task_id)];
+        if (last->task_id != sample->task_id) {
+            last->task_id = sample->task_id;
+            last->runtime = 0;
+            last->events = 0;
+            last->io = 0;
+        }
+
+        top_row_t row;
+        row.sample = sample;
+        row.cpu_permille = elapsed ? (sample->runtime - last->runtime) * 1000 / elapsed : 0;
+        row.events_per_sec = top_rate(sample->events_submitted - last->events, elapsed);
+        row.io_per_sec = top_rate(sample->io_operations - last->io, elapsed);
+
+        last->runtime = sample->runtime;
+        last->events = sample->events_submitted;
+        last->io = sample->io_operations;
+
+        uint32_t j = i;
+        while (j > 0 && rows[j - 1].cpu_permille < row.cpu_permille) {
+            rows[j] = rows[j - 1];
+            j--;
+        }
+        rows[j] = row;
+    }
+
+    return count;
+}
+
+static void top_draw(top_row_t* rows, uint32_t count, uint64_t elapsed, uint64_t idle,
+                     uint32_t interval_ms) {
+    uint64_t idle_permille = elapsed ? MIN(idle * 1000 / elapsed, 1000) : 0;
+
+    vga_clear_screen();
+    kprintf("%[H]top%[D] - %u tasks, %u CPU(s), idle %lu.%lu%%, every %u ms (any key quits)\n\n",
+            count, task_cpu_count(), idle_permille / 10, idle_permille % 10, interval_ms);
+    kprintf("%[H]%-6s %-12s %-5s %3s %6s %9s %7s %7s %8s %5s%[D]\n",
+            "ID", "NAME", "STATE", "CPU", "%CPU", "TIME(ms)", "EV/s", "IO/s", "EVENTS", "ERR");
+
+    for (uint32_t i = 0; i < count && i < TOP_MAX_ROWS; i++) {
+        TaskStatSample* sample = rows[i].sample;
+        kprintf("%-6lu %-12s %-5s %3u %4lu.%lu %9lu %7lu %7lu %8lu %5lu\n",
+                sample->task_id, sample->name, task_state_name(sample->state), sample->cpu,
+                rows[i].cpu_permille / 10, rows[i].cpu_permille % 10,
+                sample->runtime / tsc_khz(), rows[i].events_per_sec, rows[i].io_per_sec,
+                sample->events_submitted, sample->errors_count);
+    }
+
+    if (count > TOP_MAX_ROWS) {
+        kprintf("... %u more\n", count - TOP_MAX_ROWS);
+    }
+}
+
+int cmd_top(int argc, char** argv) {
+    int interval_ms = (argc > 1) ? atoi(argv[1]) : TOP_DEFAULT_INTERVAL_MS;
+    if (interval_ms <= 0) {
+        kprintf("Usage: top [interval_ms]\n");
+        return -1;
+    }
+
+    TaskStatSample* samples = kmalloc(MAX_TASKS * sizeof(TaskStatSample));
+    top_row_t* rows = kmalloc(MAX_TASKS * sizeof(top_row_t));
+    top_prev_t* prev = kmalloc(MAX_TASKS * sizeof(top_prev_t));
+    if (!samples || !rows || !prev) {
+        kprintf("%[E]top: out of memory%[D]\n");
+        if (samples) kfree(samples);
+        if (rows) kfree(rows);
+        if (prev) kfree(prev);
+        return -1;
+    }
+    memset(prev, 0, MAX_TASKS * sizeof(top_prev_t));
+
+    // The first round only records where the counters stand
+    uint64_t last = rdtsc();
+    uint64_t last_idle = task_idle_cycles();
+    top_collect(samples, rows, prev, 0);
+    kprintf("top: sampling every %d ms...\n", interval_ms);
+
+    // Refreshes come from a timer, so the shell can halt in between
+    ktimer_t timer;
+    ktimer_setup(&timer, top_timer_fired);
+    top_refresh = false;
+    keyboard_flush();
+    ktimer_arm(&timer, (uint64_t)interval_ms, (uint64_t)interval_ms);
+
+    while (!keyboard_has_input()) {
+        if (!top_refresh) {
+            task_idle();
+            continue;
+        }
+        top_refresh = false;
+
+        uint64_t now = rdtsc();
+        uint64_t idle = task_idle_cycles();
+        uint64_t elapsed = now - last;
+
+        uint32_t count = top_collect(samples, rows, prev, elapsed);
+        top_draw(rows, count, elapsed, idle - last_idle, (uint32_t)interval_ms);
+
+        last = now;
+        last_idle = idle;
+    }
+
+    ktimer_cancel(&timer);
+    keyboard_getchar();     // The key that stopped us is not a command
+
+    kfree(samples);
+    kfree(rows);
+    kfree(prev);
+    return 0;
+}
+
 // ============================================================================
 // COMMAND: reboot
 // ============================================================================
@@ -0,0 +1,179 @@
+#include "kbits.h"
+
+// Как и kmem.c, не зависит ни от чего, кроме ktypes.h
+
+typedef uint64_t __attribute__((may_alias, aligned(1))) kbits_u64_t;
+
+// ========== Выбор реализации ==========
+
+static uint32_t crc32c_soft(uint32_t crc, const void* data, size_t len);
+static uint32_t crc32c_sse42(uint32_t crc, const void* data, size_t len);
+static size_t kbits_weight_soft(const uint8_t* map, size_t nbits);
+static size_t kbits_weight_popcnt(const uint8_t* map, size_t nbits);
+
+static uint32_t (*kbits_crc32c)(uint32_t crc, const void* data, size_t len) = crc32c_soft;
+static size_t (*kbits_weight)(const uint8_t* map, size_t nbits) = kbits_weight_soft;
+
+static bool kbits_sse42 = false;
+static bool kbits_popcnt = false;
+
+void kbits_select(bool sse42, bool popcnt) {
+    kbits_sse42 = sse42;
+    kbits_popcnt = popcnt;
+    kbits_crc32c = sse42 ? crc32c_sse42 : crc32c_soft;
+    kbits_weight = popcnt ? kbits_weight_popcnt : kbits_weight_soft;
+}
+
+const char* kbits_impl_name(void) {
+    if (kbits_sse42 && kbits_popcnt) return "crc32 (SSE4.2) + popcnt";
+    if (kbits_sse42) return "crc32 (SSE4.2) + SWAR";
+    if (kbits_popcnt) return "table crc + popcnt";
+    return "table crc + SWAR";
+}
+
+// ========== Поиск в битмапе ==========
+
+// 64-битное слово номер w. Байты за концом битмапа (nbytes) читаются как 0,
+// за пределы массива обращений нет.
+static inline uint64_t kbits_word(const uint8_t* map, size_t w, size_t nbytes) {
+    size_t off = w << 3;
+    if (off + 8 <= nbytes) return *(const kbits_u64_t*)(map + off);
+
+    uint64_t word = 0;
+    for (size_t i = 0; off + i < nbytes; i++) {
+        word |= (uint64_t)map[off + i] << (i * 8);
+    }
+    return word;
+}
+
+// flip = ~0 - ищем нулевой бит, 0 - единичный
+static size_t kbits_find(const uint8_t* map, size_t start, size_t nbits, uint64_t flip) {
+    size_t nbytes = (nbits + 7) >> 3;
+
+    for (size_t bit = start; bit < nbits; bit = (bit | 63) + 1) {
+        uint64_t word = (kbits_word(map, bit >> 6, nbytes) ^ flip) & (~0ULL << (bit & 63));
+        if (word) {
+            size_t found = (bit & ~(size_t)63) + (size_t)__builtin_ctzll(word);
+            return found < nbits ? found : KBITS_NONE;
+        }
+    }
+
+    return KBITS_NONE;
+}
+
+size_t bitmap_find_zero(const uint8_t* map, size_t start, size_t nbits) {
+    return kbits_find(map, start, nbits, ~0ULL);
+}
+
+size_t bitmap_find_set(const uint8_t* map, size_t start, size_t nbits) {
+    return kbits_find(map, start, nbits, 0);
+}
+
+size_t bitmap_find_zero_run(const uint8_t* map, size_t start, size_t nbits, size_t count) {
+    if (count == 0) return start < nbits ? start : KBITS_NONE;
+
+    size_t bit = start;
+    while (bit < nbits) {
+        bit = bitmap_find_zero(map, bit, nbits);
+        if (bit == KBITS_NONE || nbits - bit < count) return KBITS_NONE;
+
+        // Первый занятый бит внутри окна - с него и продолжаем
+        size_t used = bitmap_find_set(map, bit, bit + count);
+        if (used == KBITS_NONE) return bit;
+        bit = used;
+    }
+
+    return KBITS_NONE;
+}
+
+// ========== Подсчёт битов ==========
+
+static inline size_t kbits_popcount_swar(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (size_t)((x * 0x0101010101010101ULL) >> 56);
+}
+
+static inline size_t kbits_popcount_hw(uint64_t x) {
+    uint64_t r;
+    asm("popcnt %1, %0" : "=r"(r) : "rm"(x));
+    return (size_t)r;
+}
+
+// Хвост за последним полным словом, без битов за nbits
+static inline uint64_t kbits_tail(const uint8_t* map, size_t nbits) {
+    if (!(nbits & 63)) return 0;
+    return kbits_word(map, nbits >> 6, (nbits + 7) >> 3) & ((1ULL << (nbits & 63)) - 1);
+}
+
+static size_t kbits_weight_soft(const uint8_t* map, size_t nbits) {
+    const kbits_u64_t* words = (const kbits_u64_t*)map;
+    size_t count = 0;
+
+    for (size_t i = 0; i < (nbits >> 6); i++) count += kbits_popcount_swar(words[i]);
+    return count + kbits_popcount_swar(kbits_tail(map, nbits));
+}
+
+static size_t kbits_weight_popcnt(const uint8_t* map, size_t nbits) {
+    const kbits_u64_t* words = (const kbits_u64_t*)map;
+    size_t count = 0;
+
+    for (size_t i = 0; i < (nbits >> 6); i++) count += kbits_popcount_hw(words[i]);
+    return count + kbits_popcount_hw(kbits_tail(map, nbits));
+}
+
+size_t bitmap_weight(const uint8_t* map, size_t nbits) {
+    return kbits_weight(map, nbits);
+}
+
+// ========== CRC32C ==========
+
+#define CRC32C_POLY 0x82F63B78U   // 0x1EDC6F41, отражённый
+
+static uint32_t crc32c_table[256];
+
+static void crc32c_build_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c >> 1) ^ ((c & 1) ? CRC32C_POLY : 0);
+        }
+        crc32c_table[i] = c;
+    }
+}
+
+static uint32_t crc32c_soft(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+
+    // Таблица строится при первом обращении (crc32c_table[1] != 0 после сборки)
+    if (!crc32c_table[1]) crc32c_build_table();
+
+    crc = ~crc;
+    while (len--) {
+        crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t crc32c_sse42(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+    uint64_t c = (uint32_t)~crc;
+
+    while (len >= 8) {
+        asm("crc32q %1, %0" : "+r"(c) : "rm"(*(const kbits_u64_t*)p));
+        p += 8;
+        len -= 8;
+    }
+
+    uint32_t c32 = (uint32_t)c;
+    while (len--) {
+        asm("crc32b %1, %0" : "+r"(c32) : "rm"(*p));
+        p++;
+    }
+    return ~c32;
+}
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t len) {
+    return kbits_crc32c(crc, data, len);
+}
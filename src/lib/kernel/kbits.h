@@ -0,0 +1,40 @@
+#ifndef KBITS_H
+#define KBITS_H
+
+#include "ktypes.h"
+
+// ============================================================================
+// BIT SCANS / CHECKSUMS (bitmap_*, crc32c)
+// ============================================================================
+//
+// Как и kmem, реализация выбирается один раз при загрузке (kbits_select()
+// по реестру возможностей CPU), дальше вызовы идут через указатель без
+// проверок флагов:
+//   SSE4.2  - инструкция crc32 по 8 байт за раз, иначе таблица на 256 записей
+//   POPCNT  - инструкция popcnt, иначе SWAR-подсчёт
+// Поиск в битмапе идёт по 64-битным словам (bsf), целиком занятые слова
+// пропускаются за одну проверку.
+//
+// Битмапы - массивы байт, бит N лежит в байте N / 8, разряд N % 8
+// (так их хранят PMM и TagFS).
+
+#define KBITS_NONE ((size_t)-1)
+
+void kbits_select(bool sse42, bool popcnt);
+const char* kbits_impl_name(void);
+
+// Первый нулевой / единичный бит в [start, nbits), либо KBITS_NONE
+size_t bitmap_find_zero(const uint8_t* map, size_t start, size_t nbits);
+size_t bitmap_find_set(const uint8_t* map, size_t start, size_t nbits);
+
+// Начало первой серии из count нулевых битов в [start, nbits), либо KBITS_NONE
+size_t bitmap_find_zero_run(const uint8_t* map, size_t start, size_t nbits, size_t count);
+
+// Количество единичных битов среди первых nbits
+size_t bitmap_weight(const uint8_t* map, size_t nbits);
+
+// CRC32C (Castagnoli, как у SSE4.2). Начальное значение - 0; для продолжения
+// передавайте результат предыдущего вызова.
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+#endif // KBITS_H
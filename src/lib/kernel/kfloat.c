@@ -0,0 +1,42 @@
+#include "kfloat.h"
+#include "klib.h"
+#include "fpu.h"
+
+// Собирается с SSE (FPU_SOURCES в Makefile), см. kfloat.h
+
+// Преобразование числа с плавающей точкой в строку
+void ftoa(double num, char* buf, int precision) {
+    // Вызывающий уже в kernel_fpu_begin(); вложенность допускается
+    kernel_fpu_begin();
+
+    int i = 0;
+
+    if (num < 0) {
+        buf[i++] = '-';
+        num = -num;
+    }
+
+    int int_part = (int)num;
+    double fractional_part = num - (double)int_part;
+
+    char intbuf[32];
+    itoa(int_part, intbuf, 10);
+    for (char* p = intbuf; *p; ++p) {
+        buf[i++] = *p;
+    }
+
+    if (precision > 0) {
+        buf[i++] = '.';
+
+        for (int j = 0; j < precision; j++) {
+            fractional_part *= 10.0;
+            int digit = (int)fractional_part;
+            buf[i++] = '0' + digit;
+            fractional_part -= digit;
+        }
+    }
+
+    buf[i] = '\0';
+
+    kernel_fpu_end();
+}
@@ -0,0 +1,21 @@
+#ifndef KFLOAT_H
+#define KFLOAT_H
+
+#include "ktypes.h"
+
+// ============================================================================
+// ПЛАВАЮЩАЯ ТОЧКА В ЯДРЕ
+// ============================================================================
+//
+// Ядро собирается с -mgeneral-regs-only: FPU/SSE-состояние задач
+// переключается лениво (#NM), и компилятор не должен сам использовать
+// SIMD-регистры. Код с double/float живёт только в файлах из FPU_SOURCES
+// (Makefile), собранных с SSE, и выполняется между kernel_fpu_begin() и
+// kernel_fpu_end() - начиная с вычисления аргументов, которые уже идут
+// через xmm-регистры.
+
+// Число в строку с precision знаками после точки. Вызывать только из
+// FPU_SOURCES внутри kernel_fpu_begin()/kernel_fpu_end().
+void ftoa(double num, char* buf, int precision);
+
+#endif // KFLOAT_H
@@ -521,18 +521,6 @@ int kprintf(const char* format, ...) {
                     }
                     break;
                 }
-                case 'f': {
-                    double num = va_arg(args, double);
-                    char buf[64];
-                    ftoa(num, buf, 6);
-                    int len = strlen(buf);
-                    for (int i = len; i < pad_width; ++i) {
-                        kputchar(' ');
-                        ++count;
-                    }
-                    for (char* p = buf; *p; ++p) { kputchar(*p); ++count; }
-                    break;
-                }
                 case 'c': {
                     char c = (char)va_arg(args, int);
                     kputchar(c);
@@ -619,12 +607,58 @@ int ksnprintf(char* buf, size_t size, const char* fmt, ...) {
     return (int)pos;
 }
 
+// ========== Журналирование ==========
+uint8_t klog_levels[KLOG_SUBSYS_COUNT] = {
+    [KLOG_VMM]      = KLOG_DEFAULT_LEVEL,
+    [KLOG_TAGFS]    = KLOG_DEFAULT_LEVEL,
+    [KLOG_STORAGE]  = KLOG_DEFAULT_LEVEL,
+    [KLOG_PIPELINE] = KLOG_DEFAULT_LEVEL,
+    [KLOG_TASK]     = KLOG_DEFAULT_LEVEL,
+    [KLOG_IPC]      = KLOG_DEFAULT_LEVEL,
+    [KLOG_HARDWARE] = KLOG_DEFAULT_LEVEL,
+};
+
+static const char* klog_names[KLOG_SUBSYS_COUNT] = {
+    [KLOG_VMM]      = "vmm",
+    [KLOG_TAGFS]    = "tagfs",
+    [KLOG_STORAGE]  = "storage",
+    [KLOG_PIPELINE] = "pipeline",
+    [KLOG_TASK]     = "task",
+    [KLOG_IPC]      = "ipc",
+    [KLOG_HARDWARE] = "hardware",
+};
+
+void klog_set_level(klog_subsys_t subsys, uint8_t level) {
+    if (subsys >= KLOG_SUBSYS_COUNT) return;
+    if (level > KLOG_LEVEL_TRACE) level = KLOG_LEVEL_TRACE;
+    klog_levels[subsys] = level;
+}
+
+uint8_t klog_get_level(klog_subsys_t subsys) {
+    return subsys < KLOG_SUBSYS_COUNT ? klog_levels[subsys] : KLOG_LEVEL_NONE;
+}
+
+const char* klog_subsys_name(klog_subsys_t subsys) {
+    return subsys < KLOG_SUBSYS_COUNT ? klog_names[subsys] : "?";
+}
+
+int klog_subsys_from_name(const char* name) {
+    if (!name) return -1;
+    for (int i = 0; i < KLOG_SUBSYS_COUNT; i++) {
+        if (strcmp(name, klog_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
 // ========== Блокировки ==========
 void spinlock_init(spinlock_t* lock) {
     lock->locked = 0;
 }
 
+// Держатель обычного спинлока не должен быть вытеснен: на одном CPU
+// следующая задача крутилась бы на этом замке вечно
 void spin_lock(spinlock_t* lock) {
+    preempt_disable();
     while (__sync_lock_test_and_set(&lock->locked, 1)) {
         asm volatile ("pause");
     }
@@ -632,10 +666,72 @@ void spin_lock(spinlock_t* lock) {
 
 void spin_unlock(spinlock_t* lock) {
     __sync_lock_release(&lock->locked);
+    preempt_enable();
 }
 
 bool spin_trylock(spinlock_t* lock) {
-    return !__sync_lock_test_and_set(&lock->locked, 1);
+    preempt_disable();
+    if (__sync_lock_test_and_set(&lock->locked, 1)) {
+        preempt_enable();
+        return false;
+    }
+    return true;
+}
+
+uint64_t spin_lock_irqsave(spinlock_t* lock) {
+    uint64_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t* lock, uint64_t flags) {
+    spin_unlock(lock);
+    irq_restore(flags);
+}
+
+// ========== Прерывания и вытеснение ==========
+// Счётчик работающей задачи. task_switch_next() сохраняет его в уходящей
+// задаче и загружает счётчик следующей, так что спинлок или preempt_disable(),
+// с которыми задача уснула, не запрещают вытеснение всем остальным.
+// Ячейка одна: задачи планирует только BSP (sched_this_cpu() в task.c
+// всегда 0). С запуском AP она станет полем per-CPU данных.
+static volatile uint32_t preempt_count = 0;
+
+uint64_t irq_save(void) {
+    uint64_t flags;
+    asm volatile("pushfq; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+void irq_restore(uint64_t flags) {
+    if (flags & (1ULL << 9)) {   // IF был установлен
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+void preempt_disable(void) {
+    __atomic_add_fetch(&preempt_count, 1, __ATOMIC_ACQUIRE);
+}
+
+void preempt_enable(void) {
+    // Несбалансированный unlock/preempt_enable - ошибка вызывающего, её не прячем
+    uint32_t count = __atomic_sub_fetch(&preempt_count, 1, __ATOMIC_RELEASE);
+    if (count == (uint32_t)-1) {
+        __atomic_store_n(&preempt_count, 0, __ATOMIC_RELAXED);   // panic() сам берёт блокировки
+        panic("preempt_enable: unbalanced (count underflow)");
+    }
+}
+
+bool preemptible(void) {
+    return __atomic_load_n(&preempt_count, __ATOMIC_RELAXED) == 0;
+}
+
+uint32_t preempt_count_get(void) {
+    return __atomic_load_n(&preempt_count, __ATOMIC_RELAXED);
+}
+
+void preempt_count_set(uint32_t count) {
+    __atomic_store_n(&preempt_count, count, __ATOMIC_RELAXED);
 }
 
 // ========== Реализация списка ==========
@@ -976,67 +1072,6 @@ char* strpbrk(const char* s, const char* accept) {
     return NULL;
 }
 
-// ========== Работа с памятью ==========
-void* memset(void* s, int c, size_t n) {
-    unsigned char* p = s;
-    while (n--) *p++ = (unsigned char)c;
-    return s;
-}
-
-void* memcpy(void* dest, const void* src, size_t n) {
-    unsigned char* d = dest;
-    const unsigned char* s = src;
-    while (n--) *d++ = *s++;
-    return dest;
-}
-
-void* memmem(const void* haystack, size_t haystacklen, const void* needle, size_t needlelen) {
-    if (!haystack || !needle || needlelen == 0 || haystacklen < needlelen)
-        return NULL;
-
-    const uint8_t* h = (const uint8_t*)haystack;
-    const uint8_t* n = (const uint8_t*)needle;
-
-    for (size_t i = 0; i <= haystacklen - needlelen; i++) {
-        if (memcmp(h + i, n, needlelen) == 0)
-            return (void*)(h + i);
-    }
-
-    return NULL;
-}
-
-void* memmove(void* dest, const void* src, size_t n) {
-    unsigned char* d = dest;
-    const unsigned char* s = src;
-    
-    if (d < s) {
-        while (n--) *d++ = *s++;
-    } else {
-        d += n;
-        s += n;
-        while (n--) *--d = *--s;
-    }
-    return dest;
-}
-
-int memcmp(const void* s1, const void* s2, size_t n) {
-    const unsigned char* p1 = s1, *p2 = s2;
-    while (n--) {
-        if (*p1 != *p2) return *p1 - *p2;
-        p1++, p2++;
-    }
-    return 0;
-}
-
-void* memchr(const void* s, int c, size_t n) {
-    const unsigned char* p = s;
-    while (n--) {
-        if (*p == (unsigned char)c) return (void*)p;
-        p++;
-    }
-    return NULL;
-}
-
 // ========== Преобразования чисел ==========
 char* reverse_str(char* str) {
     if (!str) return NULL;
@@ -1241,38 +1276,6 @@ char* ulltoa(unsigned long long value, char* str, int base) {
     return utoa64((uint64_t)value, str, base);
 }
 
-// Преобразование числа с плавающей точкой в строку
-void ftoa(double num, char* buf, int precision) {
-    int i = 0;
-
-    if (num < 0) {
-        buf[i++] = '-';
-        num = -num;
-    }
-
-    int int_part = (int)num;
-    double fractional_part = num - (double)int_part;
-
-    char intbuf[32];
-    itoa(int_part, intbuf, 10);
-    for (char* p = intbuf; *p; ++p) {
-        buf[i++] = *p;
-    }
-
-    if (precision > 0) {
-        buf[i++] = '.';
-
-        for (int j = 0; j < precision; j++) {
-            fractional_part *= 10.0;
-            int digit = (int)fractional_part;
-            buf[i++] = '0' + digit;
-            fractional_part -= digit;
-        }
-    }
-
-    buf[i] = '\0';
-}
-
 // ========== Утилиты ==========
 int atoi(const char* str) {
     int result = 0;
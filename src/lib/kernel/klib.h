@@ -7,6 +7,8 @@
 
 #include "ktypes.h"   // Replaces stdint.h, stddef.h, stdbool.h
 #include "kstdarg.h"  // Replaces stdarg.h
+#include "kmem.h"     // memcpy, memset, memmove, memcmp...
+#include "kbits.h"    // bitmap_find_*, bitmap_weight, crc32c
 
 // Объявления для линкера
 extern uintptr_t _kernel_end;
@@ -76,11 +78,76 @@ int ksnprintf(char* buf, size_t size, const char* fmt, ...);
 void kputchar(char c);
 int kputnl(void);
 
+// ========== Журналирование ==========
+// Уровни логов. Всё выше KLOG_COMPILE_LEVEL вырезается компилятором целиком
+// (строки формата не попадают в образ), остальное фильтруется во время
+// выполнения по уровню подсистемы.
+#define KLOG_LEVEL_NONE   0
+#define KLOG_LEVEL_ERROR  1
+#define KLOG_LEVEL_WARN   2
+#define KLOG_LEVEL_INFO   3
+#define KLOG_LEVEL_DEBUG  4
+#define KLOG_LEVEL_TRACE  5
+
+// Переопределяется через make LOG_LEVEL=N
+#ifndef KLOG_COMPILE_LEVEL
+#define KLOG_COMPILE_LEVEL KLOG_LEVEL_INFO
+#endif
+
+#define KLOG_DEFAULT_LEVEL KLOG_LEVEL_INFO
+
+// Подсистемы с отдельным уровнем логов
+typedef enum {
+    KLOG_VMM = 0,
+    KLOG_TAGFS,
+    KLOG_STORAGE,
+    KLOG_PIPELINE,
+    KLOG_TASK,
+    KLOG_IPC,
+    KLOG_HARDWARE,
+    KLOG_SUBSYS_COUNT
+} klog_subsys_t;
+
+extern uint8_t klog_levels[KLOG_SUBSYS_COUNT];
+
+void klog_set_level(klog_subsys_t subsys, uint8_t level);
+uint8_t klog_get_level(klog_subsys_t subsys);
+const char* klog_subsys_name(klog_subsys_t subsys);
+int klog_subsys_from_name(const char* name);   // -1 если не найдена
+
+#define KLOG_ENABLED(subsys, level) \
+    ((level) <= KLOG_COMPILE_LEVEL && (level) <= klog_levels[(subsys)])
+
+#define KLOG(subsys, level, ...) \
+    do { if (KLOG_ENABLED(subsys, level)) kprintf(__VA_ARGS__); } while (0)
+
+#define klog_error(subsys, ...) KLOG(subsys, KLOG_LEVEL_ERROR, __VA_ARGS__)
+#define klog_warn(subsys, ...)  KLOG(subsys, KLOG_LEVEL_WARN, __VA_ARGS__)
+#define klog_info(subsys, ...)  KLOG(subsys, KLOG_LEVEL_INFO, __VA_ARGS__)
+#define klog_debug(subsys, ...) KLOG(subsys, KLOG_LEVEL_DEBUG, __VA_ARGS__)
+#define klog_trace(subsys, ...) KLOG(subsys, KLOG_LEVEL_TRACE, __VA_ARGS__)
+
 // ========== Блокировки ==========
 void spinlock_init(spinlock_t* lock);
 void spin_lock(spinlock_t* lock);
 void spin_unlock(spinlock_t* lock);
 bool spin_trylock(spinlock_t* lock);
+// Для данных, которые трогает и обработчик прерывания: запрещает прерывания
+// на время захвата и возвращает прежний RFLAGS
+uint64_t spin_lock_irqsave(spinlock_t* lock);
+void spin_unlock_irqrestore(spinlock_t* lock, uint64_t flags);
+
+// ========== Прерывания и вытеснение ==========
+uint64_t irq_save(void);                // cli, возвращает прежний RFLAGS
+void irq_restore(uint64_t flags);       // sti, если IF был установлен
+// Вытеснение по таймеру запрещено, пока счётчик не 0 (спинлоки берут его сами)
+void preempt_disable(void);
+void preempt_enable(void);
+bool preemptible(void);
+// Счётчик принадлежит задаче: планировщик сохраняет его у уходящей задачи
+// и ставит счётчик следующей
+uint32_t preempt_count_get(void);
+void preempt_count_set(uint32_t count);
 
 // ========== Строковые функции ==========
 size_t strlen(const char* s);
@@ -95,14 +162,6 @@ char* strstr(const char* haystack, const char* needle);
 char* strcat(char* dest, const char* src);
 char* strncat(char* dest, const char* src, size_t n);
 
-// ========== Работа с памятью ==========
-void* memset(void* s, int c, size_t n);
-void* memcpy(void* dest, const void* src, size_t n);
-void* memmem(const void* haystack, size_t haystacklen, const void* needle, size_t needlelen);
-void* memmove(void* dest, const void* src, size_t n);
-int memcmp(const void* s1, const void* s2, size_t n);
-void* memchr(const void* s, int c, size_t n);
-
 // ========== Преобразования чисел ==========
 char* itoa(int value, char* str, int base);
 char* utoa(unsigned int value, char* str, int base);
@@ -127,7 +186,6 @@ long long atoll(const char* str);
 void delay(uint32_t milliseconds);
 
 // ========== Вспомогательные функции для форматирования ==========
-void ftoa(double num, char* buf, int precision);
 int toupper(int c);
 int tolower(int c);
 bool isdigit(int c);
@@ -0,0 +1,335 @@
+#include "kmem.h"
+
+// Не зависит ни от чего, кроме ktypes.h: собирается и в ядро, и в
+// tools/membench (на хосте, с переименованными символами).
+
+// ========== Выбор реализации ==========
+// У rep movsb/stosb есть цена запуска (даже с FSRM): до KMEM_MEDIUM_MAX байт
+// быстрее обычные 8-байтные пересылки
+#define KMEM_MEDIUM_MAX 256
+
+static bool kmem_erms = false;   // Enhanced REP MOVSB/STOSB
+static bool kmem_fsrm = false;   // Fast Short REP MOVSB
+
+// Путь для блоков KMEM_MEDIUM_MAX..KMEM_NT_THRESHOLD выбирается один раз в
+// kmem_select(), а не проверкой флага на каждом вызове
+static void kmem_copy_qwords(uint8_t* d, const uint8_t* s, size_t n);
+static void kmem_copy_erms(uint8_t* d, const uint8_t* s, size_t n);
+static void kmem_set_qwords(uint8_t* d, uint64_t v, size_t n);
+static void kmem_set_erms(uint8_t* d, uint64_t v, size_t n);
+
+static void (*kmem_copy_large)(uint8_t* d, const uint8_t* s, size_t n) = kmem_copy_qwords;
+static void (*kmem_set_large)(uint8_t* d, uint64_t v, size_t n) = kmem_set_qwords;
+
+void kmem_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0), "c"(0));
+    if (eax < 7) return;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+    kmem_select((ebx & (1U << 9)) != 0, (edx & (1U << 4)) != 0);
+}
+
+void kmem_select(bool erms, bool fsrm) {
+    kmem_erms = erms;
+    kmem_fsrm = erms && fsrm;
+    kmem_copy_large = erms ? kmem_copy_erms : kmem_copy_qwords;
+    kmem_set_large = erms ? kmem_set_erms : kmem_set_qwords;
+}
+
+const char* kmem_impl_name(void) {
+    if (kmem_fsrm) return "rep movsb/stosb (ERMS+FSRM)";
+    if (kmem_erms) return "rep movsb/stosb (ERMS)";
+    return "rep movsq/stosq";
+}
+
+// ========== Внутренние функции ==========
+
+// Невыровненный 8/4/2-байтный доступ (на x86 это допустимо)
+typedef uint64_t __attribute__((may_alias, aligned(1))) kmem_u64_t;
+typedef uint32_t __attribute__((may_alias, aligned(1))) kmem_u32_t;
+typedef uint16_t __attribute__((may_alias, aligned(1))) kmem_u16_t;
+
+static inline void kmem_movsb(void* d, const void* s, size_t n) {
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+static inline void kmem_movsq(void* d, const void* s, size_t n) {
+    asm volatile("rep movsq" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+static inline void kmem_stosb(void* d, uint8_t c, size_t n) {
+    asm volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+}
+
+static inline void kmem_stosq(void* d, uint64_t v, size_t n) {
+    asm volatile("rep stosq" : "+D"(d), "+c"(n) : "a"(v) : "memory");
+}
+
+// До 16 байт: две перекрывающиеся загрузки, затем две записи. Все чтения
+// идут до записей, поэтому годится и для перекрывающихся областей.
+static inline void kmem_copy_small(uint8_t* d, const uint8_t* s, size_t n) {
+    if (n >= 8) {
+        uint64_t a = *(const kmem_u64_t*)s;
+        uint64_t b = *(const kmem_u64_t*)(s + n - 8);
+        *(kmem_u64_t*)d = a;
+        *(kmem_u64_t*)(d + n - 8) = b;
+    } else if (n >= 4) {
+        uint32_t a = *(const kmem_u32_t*)s;
+        uint32_t b = *(const kmem_u32_t*)(s + n - 4);
+        *(kmem_u32_t*)d = a;
+        *(kmem_u32_t*)(d + n - 4) = b;
+    } else if (n >= 2) {
+        uint16_t a = *(const kmem_u16_t*)s;
+        uint16_t b = *(const kmem_u16_t*)(s + n - 2);
+        *(kmem_u16_t*)d = a;
+        *(kmem_u16_t*)(d + n - 2) = b;
+    } else if (n) {
+        *d = *s;
+    }
+}
+
+static inline void kmem_set_small(uint8_t* d, uint64_t v, size_t n) {
+    if (n >= 8) {
+        *(kmem_u64_t*)d = v;
+        *(kmem_u64_t*)(d + n - 8) = v;
+    } else if (n >= 4) {
+        *(kmem_u32_t*)d = (uint32_t)v;
+        *(kmem_u32_t*)(d + n - 4) = (uint32_t)v;
+    } else if (n >= 2) {
+        *(kmem_u16_t*)d = (uint16_t)v;
+        *(kmem_u16_t*)(d + n - 2) = (uint16_t)v;
+    } else if (n) {
+        *d = (uint8_t)v;
+    }
+}
+
+// 17..KMEM_MEDIUM_MAX байт без rep: по 16 байт, последние 16 - с перекрытием.
+// Только для неперекрывающихся областей.
+static inline void kmem_copy_medium(uint8_t* d, const uint8_t* s, size_t n) {
+    kmem_copy_small(d + n - 16, s + n - 16, 16);
+    while (n > 16) {
+        uint64_t a = ((const kmem_u64_t*)s)[0];
+        uint64_t b = ((const kmem_u64_t*)s)[1];
+        ((kmem_u64_t*)d)[0] = a;
+        ((kmem_u64_t*)d)[1] = b;
+        d += 16;
+        s += 16;
+        n -= 16;
+        // Не даём компилятору свернуть цикл обратно в вызов memcpy
+        asm volatile("" : "+r"(d), "+r"(s));
+    }
+}
+
+static inline void kmem_set_medium(uint8_t* d, uint64_t v, size_t n) {
+    kmem_set_small(d + n - 16, v, 16);
+    while (n > 16) {
+        ((kmem_u64_t*)d)[0] = v;
+        ((kmem_u64_t*)d)[1] = v;
+        d += 16;
+        n -= 16;
+        asm volatile("" : "+r"(d));
+    }
+}
+
+// Байты до следующей 8-байтной границы
+static inline size_t kmem_head(const void* p) {
+    return (-(uintptr_t)p) & 7;
+}
+
+// Большие блоки (n > 16): non-temporal запись мимо кэша, края обычными записями
+static void kmem_copy_nt(uint8_t* d, const uint8_t* s, size_t n) {
+    size_t head = kmem_head(d);
+    kmem_copy_small(d, s, 8);
+    kmem_copy_small(d + n - 8, s + n - 8, 8);
+
+    uint64_t* q = (uint64_t*)(d + head);
+    const kmem_u64_t* src = (const kmem_u64_t*)(s + head);
+    size_t count = (n - head) >> 3;
+
+    for (size_t i = 0; i < count; i++) {
+        asm volatile("movnti %1, %0" : "=m"(q[i]) : "r"(src[i]));
+    }
+    asm volatile("sfence" : : : "memory");
+}
+
+static void kmem_set_nt(uint8_t* d, uint64_t v, size_t n) {
+    size_t head = kmem_head(d);
+    kmem_set_small(d, v, 8);
+    kmem_set_small(d + n - 8, v, 8);
+
+    uint64_t* q = (uint64_t*)(d + head);
+    size_t count = (n - head) >> 3;
+
+    for (size_t i = 0; i < count; i++) {
+        asm volatile("movnti %1, %0" : "=m"(q[i]) : "r"(v));
+    }
+    asm volatile("sfence" : : : "memory");
+}
+
+// Средние и крупные блоки (n > KMEM_MEDIUM_MAX)
+static void kmem_copy_erms(uint8_t* d, const uint8_t* s, size_t n) {
+    kmem_movsb(d, s, n);
+}
+
+// Невыровненная голова одной записью, дальше выровненные qword-ы
+static void kmem_copy_qwords(uint8_t* d, const uint8_t* s, size_t n) {
+    size_t head = kmem_head(d);
+    kmem_copy_small(d, s, 8);
+    kmem_copy_small(d + n - 8, s + n - 8, 8);
+    kmem_movsq(d + head, s + head, (n - head) >> 3);
+}
+
+static void kmem_set_erms(uint8_t* d, uint64_t v, size_t n) {
+    kmem_stosb(d, (uint8_t)v, n);
+}
+
+static void kmem_set_qwords(uint8_t* d, uint64_t v, size_t n) {
+    size_t head = kmem_head(d);
+    kmem_set_small(d, v, 8);
+    kmem_set_small(d + n - 8, v, 8);
+    kmem_stosq(d + head, v, (n - head) >> 3);
+}
+
+// Копирование с конца (n > 16, dest выше src): qword-ами сверху вниз,
+// остаток в начале - последним. Прочитанное ни разу не перезаписывается раньше времени.
+static void kmem_copy_backward(uint8_t* d, const uint8_t* s, size_t n) {
+    size_t q = n >> 3;
+    uint8_t* dq = d + n - 8;
+    const uint8_t* sq = s + n - 8;
+
+    asm volatile("std\n\trep movsq\n\tcld" : "+D"(dq), "+S"(sq), "+c"(q) : : "memory");
+    kmem_copy_small(d, s, n & 7);
+}
+
+// ========== Работа с памятью ==========
+void* memset(void* s, int c, size_t n) {
+    uint8_t* d = s;
+    uint64_t v = 0x0101010101010101ULL * (uint8_t)c;
+
+    if (n <= 16) {
+        kmem_set_small(d, v, n);
+        return s;
+    }
+    if (n <= KMEM_MEDIUM_MAX) {
+        kmem_set_medium(d, v, n);
+        return s;
+    }
+    if (n >= KMEM_NT_THRESHOLD) {
+        kmem_set_nt(d, v, n);
+        return s;
+    }
+
+    kmem_set_large(d, v, n);
+    return s;
+}
+
+void* memcpy(void* dest, const void* src, size_t n) {
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+
+    if (n <= 16) {
+        kmem_copy_small(d, s, n);
+        return dest;
+    }
+    if (n <= KMEM_MEDIUM_MAX) {
+        kmem_copy_medium(d, s, n);
+        return dest;
+    }
+    if (n >= KMEM_NT_THRESHOLD) {
+        kmem_copy_nt(d, s, n);
+        return dest;
+    }
+
+    kmem_copy_large(d, s, n);
+    return dest;
+}
+
+void* memmove(void* dest, const void* src, size_t n) {
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+    uintptr_t da = (uintptr_t)d;
+    uintptr_t sa = (uintptr_t)s;
+
+    if (d == s) return dest;
+    if (n <= 16) {
+        kmem_copy_small(d, s, n);
+        return dest;
+    }
+
+    // Не перекрываются - обычное копирование
+    if (da + n <= sa || sa + n <= da) return memcpy(dest, src, n);
+
+    // rep movsb архитектурно копирует по байту вперёд - при dest < src это
+    // безопасно даже при перекрытии
+    if (da < sa) {
+        kmem_movsb(d, s, n);
+        return dest;
+    }
+
+    kmem_copy_backward(d, s, n);
+    return dest;
+}
+
+// Порядок двух различающихся qword-ов как строк байт (младший адрес - старший байт)
+static inline int kmem_cmp_u64(uint64_t a, uint64_t b) {
+    a = __builtin_bswap64(a);
+    b = __builtin_bswap64(b);
+    return a < b ? -1 : 1;
+}
+
+int memcmp(const void* s1, const void* s2, size_t n) {
+    const uint8_t* p1 = s1;
+    const uint8_t* p2 = s2;
+
+    // По 32 байта, пока всё совпадает
+    while (n >= 32) {
+        const kmem_u64_t* a = (const kmem_u64_t*)p1;
+        const kmem_u64_t* b = (const kmem_u64_t*)p2;
+        if ((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a[2] ^ b[2]) | (a[3] ^ b[3])) break;
+        p1 += 32;
+        p2 += 32;
+        n -= 32;
+    }
+
+    // Различие (если есть) ищем по 8 байт
+    while (n >= 8) {
+        uint64_t a = *(const kmem_u64_t*)p1;
+        uint64_t b = *(const kmem_u64_t*)p2;
+        if (a != b) return kmem_cmp_u64(a, b);
+        p1 += 8;
+        p2 += 8;
+        n -= 8;
+    }
+
+    while (n--) {
+        if (*p1 != *p2) return *p1 - *p2;
+        p1++, p2++;
+    }
+    return 0;
+}
+
+void* memchr(const void* s, int c, size_t n) {
+    const unsigned char* p = s;
+    while (n--) {
+        if (*p == (unsigned char)c) return (void*)p;
+        p++;
+    }
+    return NULL;
+}
+
+void* memmem(const void* haystack, size_t haystacklen, const void* needle, size_t needlelen) {
+    if (!haystack || !needle || needlelen == 0 || haystacklen < needlelen)
+        return NULL;
+
+    const uint8_t* h = (const uint8_t*)haystack;
+    const uint8_t* n = (const uint8_t*)needle;
+
+    for (size_t i = 0; i <= haystacklen - needlelen; i++) {
+        if (memcmp(h + i, n, needlelen) == 0)
+            return (void*)(h + i);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef KMEM_H
+#define KMEM_H
+
+#include "ktypes.h"
+
+// ============================================================================
+// MEMORY PRIMITIVES (memcpy / memset / memmove / memcmp)
+// ============================================================================
+//
+// Реализация выбирается один раз при загрузке - kmem_select() по реестру
+// возможностей CPU (cpu_has()) или kmem_init() по CPUID:
+//   ERMS/FSRM  - rep movsb / rep stosb (микрокод сам копирует строками кэша)
+//   иначе      - выровненный по 8 байт приёмник + rep movsq / rep stosq
+// Блоки от KMEM_NT_THRESHOLD пишутся non-temporal (movnti), чтобы большая
+// очистка или копия не вытесняла из кэша рабочие данные.
+// Векторные регистры не используются: FPU/SSE-состояние сохраняется лениво
+// (#NM) и только для задач, а mem* вызываются и из обработчиков прерываний.
+// XMM здесь потребовал бы kernel_fpu_begin()/end() на каждый вызов, что
+// дороже выигрыша - поэтому kmem собран с -mgeneral-regs-only (см. fpu.h).
+//
+// До kmem_init() работает путь через rep movsq/stosq - он корректен на
+// любом x86-64.
+
+#ifndef KMEM_NT_THRESHOLD
+#define KMEM_NT_THRESHOLD   (4 * 1024 * 1024)   // Заведомо больше L2 и доли L3 на ядро
+#endif
+
+void kmem_init(void);
+void kmem_select(bool erms, bool fsrm);   // Ручной выбор (бенчмарки, тесты)
+const char* kmem_impl_name(void);
+
+void* memset(void* s, int c, size_t n);
+void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
+int memcmp(const void* s1, const void* s2, size_t n);
+void* memchr(const void* s, int c, size_t n);
+void* memmem(const void* haystack, size_t haystacklen, const void* needle, size_t needlelen);
+
+#endif // KMEM_H
@@ -0,0 +1,270 @@
+#include "rbtree.h"
+
+// ========== INTERNAL HELPERS ==========
+
+static inline void rb_augment(rb_tree_t* tree, rb_node_t* node) {
+    if (tree->augment && node) tree->augment(node);
+}
+
+static inline bool rb_is_black(const rb_node_t* node) {
+    return !node || node->color == RB_BLACK;
+}
+
+// Put `v` where `u` was (u's parent now points to v)
+static void rb_transplant(rb_tree_t* tree, rb_node_t* u, rb_node_t* v) {
+    if (!u->parent) {
+        tree->root = v;
+    } else if (u == u->parent->left) {
+        u->parent->left = v;
+    } else {
+        u->parent->right = v;
+    }
+    if (v) v->parent = u->parent;
+}
+
+static void rb_rotate_left(rb_tree_t* tree, rb_node_t* x) {
+    rb_node_t* y = x->right;
+
+    x->right = y->left;
+    if (y->left) y->left->parent = x;
+
+    rb_transplant(tree, x, y);
+    y->left = x;
+    x->parent = y;
+
+    // x is now below y: recompute bottom-up
+    rb_augment(tree, x);
+    rb_augment(tree, y);
+}
+
+static void rb_rotate_right(rb_tree_t* tree, rb_node_t* x) {
+    rb_node_t* y = x->left;
+
+    x->left = y->right;
+    if (y->right) y->right->parent = x;
+
+    rb_transplant(tree, x, y);
+    y->right = x;
+    x->parent = y;
+
+    rb_augment(tree, x);
+    rb_augment(tree, y);
+}
+
+// ========== INSERT ==========
+
+void rb_insert(rb_tree_t* tree, rb_node_t* node, rb_node_t* parent, rb_node_t** link) {
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+
+    rb_propagate(tree, node);
+
+    rb_node_t* p;
+    while ((p = node->parent) && p->color == RB_RED) {
+        rb_node_t* g = p->parent;   // exists: a red node is never the root
+
+        if (p == g->left) {
+            rb_node_t* uncle = g->right;
+            if (uncle && uncle->color == RB_RED) {
+                p->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                g->color = RB_RED;
+                node = g;
+                continue;
+            }
+            if (node == p->right) {
+                rb_rotate_left(tree, p);
+                node = p;
+                p = node->parent;
+            }
+            p->color = RB_BLACK;
+            g->color = RB_RED;
+            rb_rotate_right(tree, g);
+        } else {
+            rb_node_t* uncle = g->left;
+            if (uncle && uncle->color == RB_RED) {
+                p->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                g->color = RB_RED;
+                node = g;
+                continue;
+            }
+            if (node == p->left) {
+                rb_rotate_right(tree, p);
+                node = p;
+                p = node->parent;
+            }
+            p->color = RB_BLACK;
+            g->color = RB_RED;
+            rb_rotate_left(tree, g);
+        }
+    }
+
+    tree->root->color = RB_BLACK;
+}
+
+// ========== ERASE ==========
+
+static void rb_erase_fixup(rb_tree_t* tree, rb_node_t* x, rb_node_t* parent) {
+    while (x != tree->root && rb_is_black(x)) {
+        if (x == parent->left) {
+            rb_node_t* w = parent->right;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(tree, parent);
+                w = parent->right;
+            }
+            if (rb_is_black(w->left) && rb_is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (rb_is_black(w->right)) {
+                    w->left->color = RB_BLACK;
+                    w->color = RB_RED;
+                    rb_rotate_right(tree, w);
+                    w = parent->right;
+                }
+                w->color = parent->color;
+                parent->color = RB_BLACK;
+                if (w->right) w->right->color = RB_BLACK;
+                rb_rotate_left(tree, parent);
+                x = tree->root;
+                break;
+            }
+        } else {
+            rb_node_t* w = parent->left;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(tree, parent);
+                w = parent->left;
+            }
+            if (rb_is_black(w->left) && rb_is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (rb_is_black(w->left)) {
+                    w->right->color = RB_BLACK;
+                    w->color = RB_RED;
+                    rb_rotate_left(tree, w);
+                    w = parent->left;
+                }
+                w->color = parent->color;
+                parent->color = RB_BLACK;
+                if (w->left) w->left->color = RB_BLACK;
+                rb_rotate_right(tree, parent);
+                x = tree->root;
+                break;
+            }
+        }
+    }
+
+    if (x) x->color = RB_BLACK;
+}
+
+void rb_erase(rb_tree_t* tree, rb_node_t* node) {
+    rb_node_t* child;
+    rb_node_t* parent;
+    int removed_color;
+
+    if (!node->left) {
+        child = node->right;
+        parent = node->parent;
+        removed_color = node->color;
+        rb_transplant(tree, node, child);
+    } else if (!node->right) {
+        child = node->left;
+        parent = node->parent;
+        removed_color = node->color;
+        rb_transplant(tree, node, child);
+    } else {
+        // Two children: the in-order successor takes node's place
+        rb_node_t* succ = node->right;
+        while (succ->left) succ = succ->left;
+
+        removed_color = succ->color;
+        child = succ->right;
+
+        if (succ->parent == node) {
+            parent = succ;
+        } else {
+            parent = succ->parent;
+            rb_transplant(tree, succ, succ->right);
+            succ->right = node->right;
+            succ->right->parent = succ;
+        }
+
+        rb_transplant(tree, node, succ);
+        succ->left = node->left;
+        succ->left->parent = succ;
+        succ->color = node->color;
+    }
+
+    // The successor (if moved) is an ancestor of `parent`, so this covers it
+    rb_propagate(tree, parent);
+
+    if (removed_color == RB_BLACK) {
+        rb_erase_fixup(tree, child, parent);
+    }
+
+    node->parent = node->left = node->right = NULL;
+}
+
+void rb_propagate(rb_tree_t* tree, rb_node_t* node) {
+    if (!tree->augment) return;
+    for (; node; node = node->parent) {
+        tree->augment(node);
+    }
+}
+
+// ========== TRAVERSAL ==========
+
+rb_node_t* rb_first(const rb_tree_t* tree) {
+    rb_node_t* node = tree->root;
+    if (!node) return NULL;
+    while (node->left) node = node->left;
+    return node;
+}
+
+rb_node_t* rb_last(const rb_tree_t* tree) {
+    rb_node_t* node = tree->root;
+    if (!node) return NULL;
+    while (node->right) node = node->right;
+    return node;
+}
+
+rb_node_t* rb_next(const rb_node_t* node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) node = node->left;
+        return (rb_node_t*)node;
+    }
+
+    rb_node_t* parent = node->parent;
+    while (parent && node == parent->right) {
+        node = parent;
+        parent = parent->parent;
+    }
+    return parent;
+}
+
+rb_node_t* rb_prev(const rb_node_t* node) {
+    if (node->left) {
+        node = node->left;
+        while (node->right) node = node->right;
+        return (rb_node_t*)node;
+    }
+
+    rb_node_t* parent = node->parent;
+    while (parent && node == parent->left) {
+        node = parent;
+        parent = parent->parent;
+    }
+    return parent;
+}
@@ -0,0 +1,56 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include "ktypes.h"
+
+// ============================================================================
+// INTRUSIVE RED-BLACK TREE
+// ============================================================================
+//
+// Nodes are embedded in the owning structure (use container_of to get back).
+// The tree does not compare keys itself: callers walk down to find the
+// insertion point and then call rb_insert() with the parent and link.
+//
+// Optional augmentation: if tree->augment is set it is called to recompute
+// a node's cached subtree value from its children whenever the subtree below
+// that node changes (rotations, insert, erase). rb_propagate() lets callers
+// refresh ancestors after changing a node's own value in place.
+
+#define RB_RED   0
+#define RB_BLACK 1
+
+typedef struct rb_node {
+    struct rb_node* parent;
+    struct rb_node* left;
+    struct rb_node* right;
+    int color;
+} rb_node_t;
+
+typedef struct {
+    rb_node_t* root;
+    void (*augment)(rb_node_t* node);   // NULL for plain trees
+} rb_tree_t;
+
+static inline void rb_tree_init(rb_tree_t* tree, void (*augment)(rb_node_t*)) {
+    tree->root = NULL;
+    tree->augment = augment;
+}
+
+static inline bool rb_empty(const rb_tree_t* tree) {
+    return tree->root == NULL;
+}
+
+// Insert `node` as child `*link` of `parent` (parent NULL => root) and rebalance
+void rb_insert(rb_tree_t* tree, rb_node_t* node, rb_node_t* parent, rb_node_t** link);
+void rb_erase(rb_tree_t* tree, rb_node_t* node);
+
+// Recompute augmented values from `node` up to the root
+void rb_propagate(rb_tree_t* tree, rb_node_t* node);
+
+// In-order traversal
+rb_node_t* rb_first(const rb_tree_t* tree);
+rb_node_t* rb_last(const rb_tree_t* tree);
+rb_node_t* rb_next(const rb_node_t* node);
+rb_node_t* rb_prev(const rb_node_t* node);
+
+#endif // RBTREE_H